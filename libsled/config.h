@@ -3,5 +3,9 @@
 
 //#define DIRTY_SINUSOID
 
+// Start motion tasks and acknowledge set-points with a single RPDO1
+//  carrying motion task and control word, instead of SDO writes.
+#define RPDO_MOTION_TRIGGER
+
 #endif
 
@@ -1,6 +1,7 @@
 
 #include "interface.h"
 #include "interface_internal.h"
+#include "sled_time.h"
 
 #include <syslog.h>
 #include <assert.h>
@@ -16,40 +17,13 @@
 #include <sys/stat.h>
 
 
-/**
- * Writes PEAK CAN interface status to system log.
- *
- * @param function  Function where the status message was received.
- * @param status  Status message received.
- */
-static void intf_log_status(const char *function, int status)
-{
-  assert(function);
-
-	if(status & 0x01)
-		syslog(LOG_ALERT, "%s() chip-send-buffer full.", function);
-
-	if(status & 0x02)
-		syslog(LOG_ALERT, "%s() chip-receive-buffer overrun.", function);
+// Event and message handlers (registered in intf_create and intf_open)
+static void intf_on_read(evutil_socket_t fd, short events, void *intf_v);
 
-	if(status & 0x04)
-		syslog(LOG_WARNING, "%s() bus warning.", function);
-
-	if(status & 0x08)
-		syslog(LOG_WARNING, "%s() bus passive.", function);
-
-	if(status & 0x10)
-		syslog(LOG_ERR, "%s() bus off.", function);
-
-	if(status & 0x20)
-		syslog(LOG_INFO, "%s() receive buffer is empty.", function);
-
-	if(status & 0x40)
-		syslog(LOG_ALERT, "%s() receive buffer overrun.", function);
-
-	if(status & 0x80)
-		syslog(LOG_ALERT, "%s() send-buffer is full.", function);
-}
+static void intf_on_emergency(intf_t *intf, void *payload, const can_message_t *msg);
+static void intf_on_tpdo(intf_t *intf, void *payload, const can_message_t *msg);
+static void intf_on_node_guard(intf_t *intf, void *payload, const can_message_t *msg);
+static void intf_on_sdo_response(intf_t *intf, void *payload, const can_message_t *msg);
 
 
 static void intf_log_emergency(int emergency)
@@ -97,14 +71,22 @@ static void intf_log_emergency(int emergency)
 }
 
 
-static void intf_clear_sdo_callbacks(intf_t *intf)
+/**
+ * Selects backend based on the device name.
+ *
+ * Device nodes (/dev/pcanpci0) are handled by the PEAK driver,
+ * anything else is treated as a SocketCAN interface (can0, vcan0).
+ */
+static const intf_backend_t *intf_select_backend(const char *device)
 {
-  assert(intf);
+	assert(device);
 
-	intf->sdo_callback_data = NULL;
-	intf->read_callback = NULL;
-	intf->write_callback = NULL;
-	intf->abort_callback = NULL;
+	#ifdef HAVE_PCAN
+	if(strncmp(device, "/dev/", 5) == 0)
+		return &intf_backend_pcan;
+	#endif
+
+	return &intf_backend_socketcan;
 }
 
 
@@ -112,20 +94,31 @@ static void intf_clear_sdo_callbacks(intf_t *intf)
  * Setup CAN Interface
  *
  * @param ev_base  LibEvent event_base.
+ * @param device  CAN device (e.g. /dev/pcanpci0 or can0).
  * @return CAN Interface instance.
  */
-intf_t *intf_create(event_base *ev_base)
+intf_t *intf_create(event_base *ev_base, const char *device)
 {
 	assert(ev_base);
 
+	if(!device)
+		device = INTF_DEFAULT_DEVICE;
+
 	intf_t *intf = new intf_t();
 
 	intf->ev_base = ev_base;
-	intf->handle = 0;
-	intf->fd = 0;
+	intf->fd = -1;
+
+	intf->device = strdup(device);
+	intf->backend = intf_select_backend(device);
+	intf->backend_data = NULL;
 
 	intf->read_event = NULL;
 
+	intf->read_budget = INTF_DEFAULT_READ_BUDGET;
+	intf_reset_rx_stats(intf);
+	intf_clock_reset(&(intf->clock));
+
 	intf->payload = NULL;
 
 	// Initialize callback functions
@@ -133,7 +126,22 @@ intf_t *intf_create(event_base *ev_base)
 	intf->tpdo_handler = NULL;
 	intf->close_handler = NULL;
 
-	intf_clear_sdo_callbacks(intf);
+	// Setup dispatch table
+	for(int i = 0; i < INTF_NUM_COB_IDS; i++)
+		intf->dispatch[i] = NULL;
+
+	intf->free_subscriptions = NULL;
+	for(int i = INTF_MAX_SUBSCRIPTIONS - 1; i >= 0; i--) {
+		intf->subscriptions[i].next = intf->free_subscriptions;
+		intf->free_subscriptions = &(intf->subscriptions[i]);
+	}
+
+	intf_subscribe(intf, COB_ID(FC_EMERGENCY, INTF_NODE_ID), intf_on_emergency, NULL);
+	intf_subscribe(intf, COB_ID(FC_TPDO1, INTF_NODE_ID), intf_on_tpdo, NULL);
+	intf_subscribe(intf, COB_ID(FC_TPDO2, INTF_NODE_ID), intf_on_tpdo, NULL);
+	intf_subscribe(intf, COB_ID(FC_TPDO3, INTF_NODE_ID), intf_on_tpdo, NULL);
+	intf_subscribe(intf, COB_ID(FC_TPDO4, INTF_NODE_ID), intf_on_tpdo, NULL);
+	intf_subscribe(intf, COB_ID(FC_NODE_GUARD, INTF_NODE_ID), intf_on_node_guard, NULL);
 
   return intf;
 }
@@ -147,6 +155,7 @@ intf_t *intf_create(event_base *ev_base)
 void intf_destroy(intf_t **intf)
 {
 	intf_close(*intf);
+	free((*intf)->device);
 	free(*intf);
 	*intf = NULL;
 }
@@ -162,58 +171,27 @@ int intf_open(intf_t *intf)
 {
 	assert(intf);
 
-	#ifdef WIN32
-	return -1;
-	#else
-	const char *device = "/dev/pcanpci0";
-
 	// Device is already open
-	if(intf->handle) {
+	if(intf->fd >= 0) {
 		return 0;
 	}
 
-	// Check whether the device exists
-	struct stat buf;
-	if(stat(device, &buf) == -1)
-	{
-		fprintf(stderr, "Error locating device node (%s)\n", device);
-		return -1;
-	}
-
-	// Device should be a character device
-	if(!S_ISCHR(buf.st_mode))
-	{
-		fprintf(stderr, "Device node is not a character device (%s)\n", device);
-		return -1;
-	}
-
-	// Try to open interface
-	intf->handle = LINUX_CAN_Open(device, O_RDWR);
-
-	if(!intf->handle) {
-		fprintf(stderr, "Opening of CAN device failed\n");
+	if(intf->backend->open(intf, intf->device) == -1)
 		return -1;
-	}
 
-	// Initialize interface
-	DWORD result = CAN_Init(intf->handle, CAN_BAUD_1M, CAN_INIT_TYPE_ST);
+	// Driver clock may have been reset
+	intf_clock_reset(&(intf->clock));
 
-	if(result != CAN_ERR_OK && result != CAN_ERR_QRCVEMPTY)
-	{
-		fprintf(stderr, "Initializing of CAN device failed\n");
-		intf_close(intf);
-		return -1;
-	}
+	syslog(LOG_INFO, "%s() opened %s using %s backend",
+		__FUNCTION__, intf->device, intf->backend->name);
 
 	// Register handle with libevent and set priority to important
-	intf->fd = LINUX_CAN_FileHandle(intf->handle);
 	intf->read_event = event_new(intf->ev_base, intf->fd, 
 		EV_READ | EV_PERSIST, intf_on_read, (void *) intf);
 	event_priority_set(intf->read_event, 0);
 	event_add(intf->read_event, NULL);
 
 	return 0;
-#endif
 }
 
 
@@ -229,20 +207,14 @@ int intf_close(intf_t *intf)
 		intf->read_event = NULL;
 	}
 
-	#ifdef WIN32
-	#else
 	// Close connection
-	if(intf->handle) {
-		DWORD result = CAN_Close(intf->handle);
-		if(result != CAN_ERR_OK) {
-			fprintf(stderr, "Closing of CAN device failed\n");
-			return -1;
-		}
+	if(intf->fd >= 0) {
+		int result = intf->backend->close(intf);
+		intf->fd = -1;
 
-		intf->handle = 0;
-		intf->fd = 0;
+		if(result != 0)
+			return -1;
 	}
-	#endif
 
 	if(intf->close_handler) {
 		intf->close_handler(intf, intf->payload);
@@ -259,31 +231,17 @@ int intf_write(intf_t *intf, can_message_t msg)
 {
 	assert(intf);
 
-	TPCANMsg cmsg;
-	cmsg.ID = msg.id;
-	cmsg.MSGTYPE = msg.type;
-	cmsg.LEN = msg.len;
-
-	for(int i = 0; i < 8; i++)
-		cmsg.DATA[i] = msg.data[i];
-
 	syslog(LOG_DEBUG, "%s() %04x %02x %02x (%02x %02x %02x %02x %02x %02x %02x %02x)\n",
-		__FUNCTION__, cmsg.ID, cmsg.MSGTYPE, cmsg.LEN,
-		cmsg.DATA[0], cmsg.DATA[1], cmsg.DATA[2], cmsg.DATA[3],
-		cmsg.DATA[4], cmsg.DATA[5], cmsg.DATA[6], cmsg.DATA[7]);
-
-	#ifdef WIN32
-	DWORD result = -1;
-	#else
-	DWORD result = CAN_Write(intf->handle, &cmsg);
-	#endif
+		__FUNCTION__, msg.id, msg.type, msg.len,
+		msg.data[0], msg.data[1], msg.data[2], msg.data[3],
+		msg.data[4], msg.data[5], msg.data[6], msg.data[7]);
 
-	if(result == -1) {
-		syslog(LOG_ALERT, "%s() could not send message: %s", __FUNCTION__, strerror(errno));
+	if(intf->fd < 0) {
+		syslog(LOG_ALERT, "%s() could not send message: interface closed", __FUNCTION__);
 		return -1;
 	}
 
-	return 0;
+	return intf->backend->write(intf, &msg);
 }
 
 
@@ -299,7 +257,7 @@ int intf_send_nmt_command(intf_t *intf, uint8_t command)
 	msg.type = mt_standard;
 	msg.len = 2;
 	msg.data[0] = command;
-	msg.data[1] = 1;
+	msg.data[1] = INTF_NODE_ID;
 
 	for(int i = 2; i < 8; i++)
 		msg.data[i] = 0;
@@ -309,15 +267,15 @@ int intf_send_nmt_command(intf_t *intf, uint8_t command)
 
 
 /**
- * Send read request.
+ * Send read request, the response goes to the SDO clients
+ * (intf_subscribe_sdo).
  */
-int intf_send_read_req(intf_t *intf, uint16_t index, uint8_t subindex,
-	intf_read_callback_t read_callback, intf_abort_callback_t abort_callback, void *data)
+int intf_send_read_req(intf_t *intf, uint16_t index, uint8_t subindex)
 {
 	assert(intf);
 
 	can_message_t msg;
-	msg.id = (0x0C << 7) + 1;
+	msg.id = COB_ID(FC_SDO_RX, INTF_NODE_ID);
 	msg.type = mt_standard;
 
 	msg.len = 8;
@@ -330,24 +288,19 @@ int intf_send_read_req(intf_t *intf, uint16_t index, uint8_t subindex,
 	msg.data[6] = 0;
 	msg.data[7] = 0;
 
-	intf->read_callback = read_callback;
-	intf->write_callback = NULL;
-	intf->abort_callback = abort_callback;
-	intf->sdo_callback_data = data;
-
 	return intf_write(intf, msg);
 }
 
 /**
- * Send write request.
+ * Send write request, the response goes to the SDO clients
+ * (intf_subscribe_sdo).
  */
-int intf_send_write_req(intf_t *intf, uint16_t index, uint8_t subindex, uint32_t value, uint8_t size,
-	intf_write_callback_t write_callback, intf_abort_callback_t abort_callback, void *data)
+int intf_send_write_req(intf_t *intf, uint16_t index, uint8_t subindex, uint32_t value, uint8_t size)
 {
 	assert(intf);
 
 	can_message_t msg;
-	msg.id = (0x0C << 7) + 1;
+	msg.id = COB_ID(FC_SDO_RX, INTF_NODE_ID);
 	msg.type = mt_standard;
 
 	msg.len = 8;
@@ -360,156 +313,353 @@ int intf_send_write_req(intf_t *intf, uint16_t index, uint8_t subindex, uint32_t
 	msg.data[6] = (value & 0x00FF0000) >> 16;
 	msg.data[7] = (value & 0xFF000000) >> 24;
 
-	intf->read_callback = NULL;
-	intf->write_callback = write_callback;
-	intf->abort_callback = abort_callback;
-	intf->sdo_callback_data = data;
-
   return intf_write(intf, msg);
 }
 
 
 /**
- * Parses CAN message and invokes callbacks.
+ * Send RPDO with up to four bytes of data (little endian).
+ *
+ * @param function  Function code (FC_RPDO1 .. FC_RPDO4).
  */
-static void intf_dispatch_msg(intf_t *intf, can_message_t msg)
+int intf_send_rpdo(intf_t *intf, uint8_t function, uint32_t value, uint8_t size)
 {
 	assert(intf);
-	int function = msg.id >> 7;
+	assert(size <= 4);
 
-  // Emergency messages are only logged (not handled)
-	if(function == 0x01) {
-		int emergency = msg.data[0] + (msg.data[1] << 8);
-		syslog(LOG_ALERT, "%s() received an emergency message (%04x:%02x:%02x).", __FUNCTION__, emergency, msg.data[2], msg.data[3]);
-		intf_log_emergency(emergency);
-	}
+	can_message_t msg;
+	msg.id = COB_ID(function, INTF_NODE_ID);
+	msg.type = mt_standard;
+	msg.len = size;
+
+	for(int i = 0; i < 8; i++)
+		msg.data[i] = (i < size) ? (value >> (8 * i)) & 0xFF : 0;
+
+	return intf_write(intf, msg);
+}
+
+
+/**
+ * Send SYNC message.
+ */
+int intf_send_sync(intf_t *intf)
+{
+	assert(intf);
+
+	can_message_t msg;
+	msg.id = COB_ID_SYNC;
+	msg.type = mt_standard;
+	msg.len = 0;
+
+	for(int i = 0; i < 8; i++)
+		msg.data[i] = 0;
+
+	return intf_write(intf, msg);
+}
 
-	// TPDOs
-	if(function == 0x03 || function == 0x05 || function == 0x07 || function == 0x09) {
-		if(intf->tpdo_handler)
-			intf->tpdo_handler(intf, intf->payload, (function-1)/2, msg.data);
-	}
 
-	// Node guard message
-	if(function == 0x0E && intf->nmt_state_handler) {
-		uint8_t state = msg.data[0] & 0x7F;
+/**
+ * Emergency messages are only logged (not handled).
+ */
+static void intf_on_emergency(intf_t *intf, void *payload, const can_message_t *msg)
+{
+	int emergency = msg->data[0] + (msg->data[1] << 8);
+	syslog(LOG_ALERT, "%s() received an emergency message (%04x:%02x:%02x).", __FUNCTION__, emergency, msg->data[2], msg->data[3]);
+	intf_log_emergency(emergency);
+}
+
+
+/**
+ * Forwards TPDOs to the TPDO handler.
+ */
+static void intf_on_tpdo(intf_t *intf, void *payload, const can_message_t *msg)
+{
+	int function = msg->id >> 7;
+
+	if(intf->tpdo_handler)
+		intf->tpdo_handler(intf, intf->payload, (function-1)/2, (uint8_t *) msg->data, msg->time);
+}
+
+
+/**
+ * Forwards node guard state to the NMT state handler.
+ */
+static void intf_on_node_guard(intf_t *intf, void *payload, const can_message_t *msg)
+{
+	if(intf->nmt_state_handler) {
+		uint8_t state = msg->data[0] & 0x7F;
 		intf->nmt_state_handler(intf, intf->payload, state);
 	}
+}
+
 
-	// SDO response
-	if(function == 0x0B) {
-		uint16_t index = msg.data[1] + (msg.data[2] << 8);
-		uint8_t subindex = msg.data[3];
-		uint32_t value;
-
-		switch(msg.data[0]) {
-			case 0x80:
-			case 0x43:
-				value = msg.data[4] + (msg.data[5] << 8) + (msg.data[6] << 16) + (msg.data[7] << 24);
-				break;
-			case 0x47: value = msg.data[4] + (msg.data[5] << 8) + (msg.data[6] << 16); break;
-			case 0x4B: value = msg.data[4] + (msg.data[5] << 8); break;
-			case 0x4F: value = msg.data[4]; break;
+/**
+ * Parses SDO response and invokes the callbacks of the client.
+ */
+static void intf_on_sdo_response(intf_t *intf, void *payload, const can_message_t *msg)
+{
+	intf_sdo_client_t *client = (intf_sdo_client_t *) payload;
+
+	uint16_t index = msg->data[1] + (msg->data[2] << 8);
+	uint8_t subindex = msg->data[3];
+	uint32_t value = 0;
+
+	switch(msg->data[0]) {
+		case 0x80:
+		case 0x43:
+			value = msg->data[4] + (msg->data[5] << 8) + (msg->data[6] << 16) + (msg->data[7] << 24);
+			break;
+		case 0x47: value = msg->data[4] + (msg->data[5] << 8) + (msg->data[6] << 16); break;
+		case 0x4B: value = msg->data[4] + (msg->data[5] << 8); break;
+		case 0x4F: value = msg->data[4]; break;
+	}
+
+	// Write response
+	if(msg->data[0] == 0x60) {
+		if(client->write_callback) {
+			client->write_callback(client->data, index, subindex);
+		} else {
+			syslog(LOG_NOTICE, "%s() received a write response, but the client has no callback for it.", __FUNCTION__);
 		}
+	}
 
-		// Write response
-		if(msg.data[0] == 0x60) {
-			if(intf->write_callback) {
-				intf->write_callback(intf->sdo_callback_data, index, subindex);
-			} else {
-				syslog(LOG_NOTICE, "%s() received a write response, but no callback function has been set.", __FUNCTION__);
-			}
+	// Read response
+	if(msg->data[0] == 0x43 || msg->data[0] == 0x47 || msg->data[0] == 0x4B || msg->data[0] == 0x4F) {
+		if(client->read_callback) {
+			client->read_callback(client->data, index, subindex, value);
+		} else {
+			syslog(LOG_NOTICE, "%s() received a read response, but the client has no callback for it.", __FUNCTION__);
 		}
+	}
 
-		// Read response
-		if(msg.data[0] == 0x43 || msg.data[0] == 0x47 || msg.data[0] == 0x4B || msg.data[0] == 0x4F) {
-			if(intf->read_callback) {
-				intf->read_callback(intf->sdo_callback_data, index, subindex, value);
-			} else {
-				syslog(LOG_NOTICE, "%s() received a read response, but no callback function has been set.", __FUNCTION__);
-			}
+	// Abort response
+	if(msg->data[0] == 0x80) {
+		if(client->abort_callback) {
+			client->abort_callback(client->data, index, subindex, value);
+		} else {
+			syslog(LOG_NOTICE, "%s() received an abort response, but the client has no callback for it.", __FUNCTION__);
 		}
+	}
+}
+
+
+/**
+ * Invokes all handlers registered for the COB-ID of the message.
+ */
+static void intf_dispatch_msg(intf_t *intf, const can_message_t *msg)
+{
+	assert(intf && msg);
+
+	intf_subscription_t *subscription = intf->dispatch[msg->id & (INTF_NUM_COB_IDS - 1)];
+
+	while(subscription) {
+		// Handler is allowed to unsubscribe itself
+		intf_subscription_t *next = subscription->next;
+		subscription->handler(intf, subscription->payload, msg);
+		subscription = next;
+	}
+}
 
-		// Abort response
-		if(msg.data[0] == 0x80) {
-			if(intf->abort_callback) {
-				intf->abort_callback(intf->sdo_callback_data, index, subindex, value);
-			} else {
-				syslog(LOG_NOTICE, "%s() received an abort response, but no callback function has been set.", __FUNCTION__);
-			}
+
+/**
+ * Registers a handler for all messages with the given COB-ID.
+ *
+ * Handlers are invoked in order of registration.
+ *
+ * @return 0 on success, -1 when no more registrations are available.
+ */
+int intf_subscribe(intf_t *intf, uint16_t cob_id, intf_msg_handler_t handler, void *payload)
+{
+	assert(intf && handler);
+
+	if(cob_id >= INTF_NUM_COB_IDS)
+		return -1;
+
+	intf_subscription_t *subscription = intf->free_subscriptions;
+
+	if(!subscription) {
+		syslog(LOG_ERR, "%s() unable to register handler for %03x, no registrations left",
+			__FUNCTION__, cob_id);
+		return -1;
+	}
+
+	intf->free_subscriptions = subscription->next;
+
+	subscription->handler = handler;
+	subscription->payload = payload;
+	subscription->next = NULL;
+
+	// Append to the end of the list
+	intf_subscription_t **tail = &(intf->dispatch[cob_id]);
+	while(*tail)
+		tail = &((*tail)->next);
+	*tail = subscription;
+
+	return 0;
+}
+
+
+/**
+ * Removes a handler registered using intf_subscribe.
+ *
+ * @return 0 on success, -1 if the handler was not registered.
+ */
+int intf_unsubscribe(intf_t *intf, uint16_t cob_id, intf_msg_handler_t handler, void *payload)
+{
+	assert(intf);
+
+	if(cob_id >= INTF_NUM_COB_IDS)
+		return -1;
+
+	for(intf_subscription_t **it = &(intf->dispatch[cob_id]); *it; it = &((*it)->next)) {
+		intf_subscription_t *subscription = *it;
+
+		if(subscription->handler == handler && subscription->payload == payload) {
+			*it = subscription->next;
+
+			subscription->next = intf->free_subscriptions;
+			intf->free_subscriptions = subscription;
+			return 0;
 		}
 	}
+
+	return -1;
+}
+
+
+/**
+ * Registers an SDO client for the responses of the node, the client
+ * must remain valid until it is unsubscribed.
+ *
+ * @return 0 on success, -1 when no more registrations are available.
+ */
+int intf_subscribe_sdo(intf_t *intf, intf_sdo_client_t *client)
+{
+	assert(intf && client);
+
+	return intf_subscribe(intf, COB_ID(FC_SDO_TX, INTF_NODE_ID), intf_on_sdo_response, (void *) client);
+}
+
+
+/**
+ * Removes an SDO client registered using intf_subscribe_sdo.
+ *
+ * @return 0 on success, -1 if the client was not registered.
+ */
+int intf_unsubscribe_sdo(intf_t *intf, intf_sdo_client_t *client)
+{
+	assert(intf && client);
+
+	return intf_unsubscribe(intf, COB_ID(FC_SDO_TX, INTF_NODE_ID), intf_on_sdo_response, (void *) client);
 }
 
 
 /**
- * Called when data is pending
+ * Called when data is pending.
+ *
+ * Keeps reading until the receive queue is empty or the frame
+ * budget has been used up. In the latter case the (level-triggered)
+ * read event fires again on the next event loop iteration.
  */
 static void intf_on_read(evutil_socket_t fd, short events, void *intf_v)
 {
-	#ifndef WIN32
 	intf_t *intf = (intf_t *) intf_v;
 
 	// We've been closed down, stop.
-	if(!intf || !intf->fd)
+	if(!intf || intf->fd < 0)
 		return;
 
-	TPCANRdMsg message;
-	DWORD result;
-
-	result = LINUX_CAN_Read(intf->handle, &message);
+	intf_rx_stats_t *stats = &(intf->rx_stats);
+	stats->wakeups++;
 
-	/*count++;
-	if(count % 1000 == 0) {
-		double delta = get_time() - start;
-		printf("%d messages in %f seconds: %.0f Hz (%.4f sec/msg)\n", count, delta, double(count)/delta, delta/double(count));
-	}*/
-
-	// Receive queue was empty, no message read
-	if(result == CAN_ERR_QRCVEMPTY) {
-		syslog(LOG_NOTICE, "%s() expected message in queue, but found none.", __FUNCTION__);
-		return;
-	}
+	int depth = intf->backend->pending ? intf->backend->pending(intf) : -1;
+	int handled = 0;
 
-	// There was an error
-	if(result != CAN_ERR_OK) {
-		syslog(LOG_ALERT, "%s() reading from the CAN bus failed interface will be closed.", __FUNCTION__);
-		intf_close(intf);
-		return;
-	}
+	while(handled < intf->read_budget) {
+		int max = intf->read_budget - handled;
+		if(max > INTF_READ_BATCH)
+			max = INTF_READ_BATCH;
 
-	// A status message was received
-	if(message.Msg.MSGTYPE & MSGTYPE_STATUS == MSGTYPE_STATUS)
-	{
-		int32_t status = int32_t(CAN_Status(intf->handle));
+		can_message_t msgs[INTF_READ_BATCH];
+		int count = intf->backend->read(intf, msgs, max);
 
-		if(status < 0) {
-			syslog(LOG_ALERT, "%s() received invalid status (%x) interface will be closed.", __FUNCTION__, status);
+		// There was an error
+		if(count < 0) {
+			syslog(LOG_ALERT, "%s() reading from the CAN bus failed interface will be closed.", __FUNCTION__);
 			intf_close(intf);
 			return;
 		}
 
-		if(status != 0x20 && status != 0x00)
-			intf_log_status(__FUNCTION__, status);
+		// Receive queue is empty
+		if(count == 0)
+			break;
 
-		return;
+		// Express receive times on the monotonic clock
+		double now = get_time();
+
+		for(int i = 0; i < count; i++) {
+			if(msgs[i].timestamp)
+				msgs[i].time = intf_clock_map(&(intf->clock), msgs[i].timestamp, now);
+			else
+				msgs[i].time = now;
+		}
+
+		// Tell the world we've received messages, a handler
+		//  might close the interface halfway through the batch.
+		for(int i = 0; i < count; i++) {
+			if(intf->fd < 0)
+				return;
+			intf_dispatch_msg(intf, &msgs[i]);
+		}
+
+		handled += count;
 	}
 
-	uint64_t timestamp = message.dwTime * 1000 + message.wUsec;
+	// Update statistics
+	if(handled == 0)
+		stats->empty_wakeups++;
+	if(handled >= intf->read_budget)
+		stats->budget_exhausted++;
 
-	// Tell the world we've received a message
-	can_message_t msg;
-	msg.id = message.Msg.ID;
-	msg.type = message.Msg.MSGTYPE;
-	msg.len = message.Msg.LEN;
+	stats->frames += handled;
 
-	for(int i = 0; i < 8; i++)
-		msg.data[i] = message.Msg.DATA[i];
+	if(uint32_t(handled) > stats->max_frames_per_wakeup)
+		stats->max_frames_per_wakeup = handled;
+
+	if(depth < handled)
+		depth = handled;
+	if(uint32_t(depth) > stats->max_queue_depth)
+		stats->max_queue_depth = depth;
+}
 
-	intf_dispatch_msg(intf, msg);
 
-	return;
-  #endif
+/**
+ * Sets the maximum number of frames handled per read event.
+ */
+void intf_set_read_budget(intf_t *intf, int budget)
+{
+	assert(intf);
+	intf->read_budget = (budget > 0) ? budget : INTF_DEFAULT_READ_BUDGET;
+}
+
+
+/**
+ * Returns a copy of the receive path statistics.
+ */
+void intf_get_rx_stats(intf_t *intf, intf_rx_stats_t *stats)
+{
+	assert(intf && stats);
+	*stats = intf->rx_stats;
+}
+
+
+/**
+ * Resets receive path statistics (e.g. at the start of a reporting period).
+ */
+void intf_reset_rx_stats(intf_t *intf)
+{
+	assert(intf);
+	memset(&(intf->rx_stats), 0, sizeof(intf->rx_stats));
 }
 
 
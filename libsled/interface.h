@@ -6,6 +6,45 @@
 struct event_base;
 struct intf_t;
 
+/**
+ * Device opened when none is specified.
+ */
+#define INTF_DEFAULT_DEVICE "/dev/pcanpci0"
+
+/**
+ * Devices named "fd:<n>" use an already connected socket carrying
+ * SocketCAN frames, e.g. a socketpair to a simulated drive.
+ */
+#define INTF_FD_DEVICE_PREFIX "fd:"
+
+/**
+ * Node id of the drive.
+ */
+#define INTF_NODE_ID 1
+
+/**
+ * CANopen function codes, the COB-ID of a message consists of
+ * the function code (upper four bits) followed by the node id.
+ */
+#define FC_NMT        0x00
+#define FC_EMERGENCY  0x01
+#define FC_TPDO1      0x03
+#define FC_RPDO1      0x04
+#define FC_TPDO2      0x05
+#define FC_RPDO2      0x06
+#define FC_TPDO3      0x07
+#define FC_RPDO3      0x08
+#define FC_TPDO4      0x09
+#define FC_RPDO4      0x0A
+#define FC_SDO_TX     0x0B  // Response from drive
+#define FC_SDO_RX     0x0C  // Request to drive
+#define FC_NODE_GUARD 0x0E
+
+#define COB_ID(function, node) ((((function) & 0x0F) << 7) | ((node) & 0x7F))
+
+// SYNC shares the function code of emergency messages (node 0)
+#define COB_ID_SYNC 0x080
+
 /**
  * Network management commands.
  */
@@ -26,6 +65,10 @@ struct intf_t;
 #define OB_O_FT   0x35BD  // Delay before next
 #define OB_O_MOVE 0x3642  // Execute motion task
 
+// Subindex 0x01 of the OB_O_* objects addresses motion task 0, drives
+//  that support it address volatile tasks 201..300 at 0x02..0x65.
+#define OB_O_SUBINDEX(task) ((task) == 0 ? 0x01 : (task) - 199)
+
 #define OB_O_O1		0x35AE	// State of digital output 1
 #define OB_O_O2		0x35B1	// State of digital output 2
 
@@ -40,9 +83,53 @@ struct intf_t;
 #define OB_CONTROL_WORD 		 0x6040	 // Control word
 
 
+/**
+ * Default number of frames handled per read event before
+ * control is returned to the event loop.
+ */
+#define INTF_DEFAULT_READ_BUDGET 64
+
+
+enum message_type_t
+{
+	mt_status = 0x80,
+	mt_extended = 0x02,
+	mt_rtr = 0x01,
+	mt_standard = 0x00
+};
+
+struct can_message_t
+{
+	uint16_t id;
+	uint8_t type;
+	uint8_t len;
+	uint8_t data[8];
+
+	// Driver receive timestamp in microseconds (0 if not available)
+	//  and the receive time mapped onto CLOCK_MONOTONIC in seconds.
+	uint64_t timestamp;
+	double time;
+};
+
+
+/**
+ * Receive path statistics.
+ */
+struct intf_rx_stats_t {
+	uint64_t wakeups;				// Read events handled
+	uint64_t empty_wakeups;			// Read events without any frame pending
+	uint64_t frames;				// Frames dispatched
+	uint64_t budget_exhausted;		// Read events that hit the frame budget
+	uint64_t overruns;				// Receive overruns reported by driver
+	uint32_t max_frames_per_wakeup;
+	uint32_t max_queue_depth;		// Largest number of frames pending on wakeup
+};
+
+
 // Callbacks
+typedef void(*intf_msg_handler_t)(intf_t *intf, void *payload, const can_message_t *msg);
 typedef void(*intf_nmt_state_handler_t)(intf_t *intf, void *payload, uint8_t state);
-typedef void(*intf_tpdo_handler_t)(intf_t *intf, void *payload, int pdo, uint8_t *data);
+typedef void(*intf_tpdo_handler_t)(intf_t *intf, void *payload, int pdo, uint8_t *data, double time);
 typedef void(*intf_close_handler_t)(intf_t *intf, void *payload);
 
 /**
@@ -52,16 +139,41 @@ typedef void(*intf_abort_callback_t)(void *data, uint16_t index, uint8_t subinde
 typedef void(*intf_write_callback_t)(void *data, uint16_t index, uint8_t subindex);
 typedef void(*intf_read_callback_t)(void *data, uint16_t index, uint8_t subindex, uint32_t value);
 
+/**
+ * SDO client, subscribed to the SDO responses of the node.
+ */
+struct intf_sdo_client_t
+{
+	intf_write_callback_t write_callback;
+	intf_read_callback_t read_callback;
+	intf_abort_callback_t abort_callback;
+
+	// Passed to the callbacks
+	void *data;
+};
+
 // Functions
-intf_t *intf_create(event_base *ev_base);
+intf_t *intf_create(event_base *ev_base, const char *device);
 void intf_destroy(intf_t **intf);
 
 int intf_open(intf_t *intf);
 int intf_close(intf_t *intf);
 
+void intf_set_read_budget(intf_t *intf, int budget);
+void intf_get_rx_stats(intf_t *intf, intf_rx_stats_t *stats);
+void intf_reset_rx_stats(intf_t *intf);
+
 int intf_send_nmt_command(intf_t *intf, uint8_t command);
-int intf_send_read_req(intf_t *intf, uint16_t index, uint8_t subindex, intf_read_callback_t read_callback, intf_abort_callback_t abort_callback, void *data);
-int intf_send_write_req(intf_t *intf, uint16_t index, uint8_t subindex, uint32_t value, uint8_t size, intf_write_callback_t write_callback, intf_abort_callback_t abort_callback, void *data);
+int intf_send_read_req(intf_t *intf, uint16_t index, uint8_t subindex);
+int intf_send_write_req(intf_t *intf, uint16_t index, uint8_t subindex, uint32_t value, uint8_t size);
+int intf_send_rpdo(intf_t *intf, uint8_t function, uint32_t value, uint8_t size);
+int intf_send_sync(intf_t *intf);
+
+// Per COB-ID handler registration
+int intf_subscribe(intf_t *intf, uint16_t cob_id, intf_msg_handler_t handler, void *payload);
+int intf_unsubscribe(intf_t *intf, uint16_t cob_id, intf_msg_handler_t handler, void *payload);
+int intf_subscribe_sdo(intf_t *intf, intf_sdo_client_t *client);
+int intf_unsubscribe_sdo(intf_t *intf, intf_sdo_client_t *client);
 
 // Callback setters
 void intf_set_callback_payload(intf_t *intf, void *payload);
@@ -0,0 +1,115 @@
+
+#include "interface.h"
+#include "interface_internal.h"
+
+#include <syslog.h>
+#include <assert.h>
+#include <math.h>
+
+
+// Length of the window over which the minimum offset is determined
+#define CLOCK_WINDOW 1.0
+
+// Offset errors larger than this reset the estimator (driver restart, clock step)
+#define CLOCK_MAX_RESIDUAL 0.1
+
+// Rate at which the offset follows samples above the envelope
+#define CLOCK_OFFSET_GAIN 0.0002
+
+// Rate at which the drift follows new window estimates
+#define CLOCK_DRIFT_GAIN 0.1
+
+// Largest drift accepted from a window estimate (1000 ppm)
+#define CLOCK_MAX_DRIFT 1e-3
+
+
+/**
+ * Forget all previous samples.
+ */
+void intf_clock_reset(intf_clock_t *clock)
+{
+	assert(clock);
+
+	clock->valid = false;
+	clock->prev_valid = false;
+	clock->drift = 0.0;
+}
+
+
+/**
+ * Start a new estimation window.
+ */
+static void intf_clock_start_window(intf_clock_t *clock, double time, double offset)
+{
+	clock->window_start = time;
+	clock->window_min_time = time;
+	clock->window_min_offset = offset;
+}
+
+
+/**
+ * Updates the clock model with a new sample and returns the
+ * driver timestamp expressed in CLOCK_MONOTONIC seconds.
+ *
+ * @param clock  Clock model.
+ * @param timestamp  Driver timestamp in microseconds.
+ * @param now  Time (CLOCK_MONOTONIC) at which the frame was read.
+ * @return Receive time in CLOCK_MONOTONIC seconds.
+ */
+double intf_clock_map(intf_clock_t *clock, uint64_t timestamp, double now)
+{
+	assert(clock);
+
+	double time = double(timestamp) / 1e6;
+	double offset = now - time;
+
+	if(clock->valid) {
+		double predicted = clock->ref_offset + clock->drift * (time - clock->ref_time);
+		double residual = offset - predicted;
+
+		if(fabs(residual) > CLOCK_MAX_RESIDUAL) {
+			syslog(LOG_NOTICE, "%s() driver clock jumped by %.3f s, resetting estimate",
+				__FUNCTION__, residual);
+			intf_clock_reset(clock);
+		} else {
+			// Samples below the envelope had less latency, follow
+			//  them immediately. Others only slowly pull the offset up.
+			clock->ref_time = time;
+			clock->ref_offset = (residual < 0) ? offset : predicted + residual * CLOCK_OFFSET_GAIN;
+		}
+	}
+
+	if(!clock->valid) {
+		clock->valid = true;
+		clock->ref_time = time;
+		clock->ref_offset = offset;
+		intf_clock_start_window(clock, time, offset);
+	}
+
+	// Track lower envelope within the window
+	if(offset < clock->window_min_offset) {
+		clock->window_min_offset = offset;
+		clock->window_min_time = time;
+	}
+
+	// Estimate drift from successive window minima
+	if(time - clock->window_start >= CLOCK_WINDOW) {
+		if(clock->prev_valid && clock->window_min_time > clock->prev_min_time) {
+			double drift = (clock->window_min_offset - clock->prev_min_offset) /
+				(clock->window_min_time - clock->prev_min_time);
+
+			if(fabs(drift) < CLOCK_MAX_DRIFT)
+				clock->drift += (drift - clock->drift) * CLOCK_DRIFT_GAIN;
+		}
+
+		clock->prev_valid = true;
+		clock->prev_min_time = clock->window_min_time;
+		clock->prev_min_offset = clock->window_min_offset;
+
+		intf_clock_start_window(clock, time, offset);
+	}
+
+	// A frame cannot have been received after it was read
+	double mapped = time + clock->ref_offset;
+	return (mapped < now) ? mapped : now;
+}
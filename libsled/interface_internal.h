@@ -4,37 +4,105 @@
 #include <stdint.h>
 #include <event2/event.h>
 
-#ifdef WIN32
-#include <PCANBasic.h>
-#else
-#include <libpcan.h>
-#endif
-
 #include "interface.h"
 
-enum message_type_t
+// Maximum number of frames fetched from the backend per read
+#define INTF_READ_BATCH 16
+
+// Size of the COB-ID dispatch table (11-bit identifiers)
+#define INTF_NUM_COB_IDS 0x800
+
+// Number of handler registrations available (shared by all COB-IDs)
+#define INTF_MAX_SUBSCRIPTIONS 32
+
+/**
+ * Maps driver timestamps onto CLOCK_MONOTONIC.
+ *
+ * The offset between both clocks follows the lower envelope of
+ * (receive time - driver timestamp), which excludes event loop
+ * latency, the drift is estimated from successive envelope minima.
+ */
+struct intf_clock_t
 {
-	mt_status = 0x80,
-	mt_extended = 0x02,
-	mt_rtr = 0x01,
-	mt_standard = 0x00
+	bool valid;
+
+	// Offset (monotonic - driver) at reference driver time, drift in s/s
+	double ref_time, ref_offset;
+	double drift;
+
+	// Minimum offset within current and previous estimation window
+	double window_start;
+	double window_min_time, window_min_offset;
+	double prev_min_time, prev_min_offset;
+	bool prev_valid;
 };
 
-struct can_message_t
+void intf_clock_reset(intf_clock_t *clock);
+double intf_clock_map(intf_clock_t *clock, uint64_t timestamp, double now);
+
+
+/**
+ * CAN backend (PEAK character device, SocketCAN, ...).
+ *
+ * The open function stores a pollable file descriptor in intf->fd,
+ * read returns the number of frames stored in msgs (0 when the
+ * receive queue is empty) or -1 when the interface should be closed.
+ * Read must never block. Pending returns the number of frames waiting
+ * in the receive queue, or -1 when the backend cannot tell (optional).
+ * Backends add receive overruns to intf->rx_stats.overruns.
+ */
+struct intf_backend_t
 {
-	uint16_t id;
-	uint8_t type;
-	uint8_t len;
-	uint8_t data[8];
+	const char *name;
+
+	int (*open)(intf_t *intf, const char *device);
+	int (*close)(intf_t *intf);
+	int (*write)(intf_t *intf, const can_message_t *msg);
+	int (*read)(intf_t *intf, can_message_t *msgs, int max);
+	int (*pending)(intf_t *intf);
 };
 
+#ifdef HAVE_PCAN
+extern const intf_backend_t intf_backend_pcan;
+#endif
+extern const intf_backend_t intf_backend_socketcan;
+
+
+/**
+ * Handler registered for a single COB-ID.
+ */
+struct intf_subscription_t
+{
+	intf_msg_handler_t handler;
+	void *payload;
+
+	intf_subscription_t *next;
+};
+
+
 struct intf_t
 {
   event_base *ev_base;
-  HANDLE handle;
   int fd;
+
+  // Device name and the backend that drives it
+  char *device;
+  const intf_backend_t *backend;
+  void *backend_data;
   
   event *read_event;
+
+  // Maximum number of frames handled per read event
+  int read_budget;
+  intf_rx_stats_t rx_stats;
+
+  // Driver to monotonic clock mapping
+  intf_clock_t clock;
+
+  // Handlers indexed by COB-ID, registrations come from a fixed pool
+  intf_subscription_t *dispatch[INTF_NUM_COB_IDS];
+  intf_subscription_t subscriptions[INTF_MAX_SUBSCRIPTIONS];
+  intf_subscription_t *free_subscriptions;
   
   // Callbacks
   void *payload;
@@ -42,20 +110,6 @@ struct intf_t
   intf_nmt_state_handler_t nmt_state_handler;  
 	intf_tpdo_handler_t tpdo_handler;
   intf_close_handler_t close_handler;
-
-	// Data passed to read/write/abort callbacks
-	void *sdo_callback_data;
-
-	// Write SDO callback
-	intf_write_callback_t write_callback;
-
-	// Read SDO callback
-	intf_read_callback_t read_callback;
-
-	// Abort SDO callback
-	intf_abort_callback_t abort_callback;
 };
 
-static void intf_on_read(evutil_socket_t fd, short events, void *intf_v);
-
 #endif
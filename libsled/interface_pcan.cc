@@ -0,0 +1,244 @@
+
+#include "interface.h"
+#include "interface_internal.h"
+
+#include <syslog.h>
+#include <assert.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+
+#include <sys/stat.h>
+
+#include <libpcan.h>
+
+
+/**
+ * Writes PEAK CAN interface status to system log.
+ *
+ * @param function  Function where the status message was received.
+ * @param status  Status message received.
+ */
+static void intf_pcan_log_status(const char *function, int status)
+{
+  assert(function);
+
+	if(status & 0x01)
+		syslog(LOG_ALERT, "%s() chip-send-buffer full.", function);
+
+	if(status & 0x02)
+		syslog(LOG_ALERT, "%s() chip-receive-buffer overrun.", function);
+
+	if(status & 0x04)
+		syslog(LOG_WARNING, "%s() bus warning.", function);
+
+	if(status & 0x08)
+		syslog(LOG_WARNING, "%s() bus passive.", function);
+
+	if(status & 0x10)
+		syslog(LOG_ERR, "%s() bus off.", function);
+
+	if(status & 0x20)
+		syslog(LOG_INFO, "%s() receive buffer is empty.", function);
+
+	if(status & 0x40)
+		syslog(LOG_ALERT, "%s() receive buffer overrun.", function);
+
+	if(status & 0x80)
+		syslog(LOG_ALERT, "%s() send-buffer is full.", function);
+}
+
+
+/**
+ * Open PEAK character device (e.g. /dev/pcanpci0).
+ *
+ * @return 0 on success, -1 on failure.
+ */
+static int intf_pcan_open(intf_t *intf, const char *device)
+{
+	assert(intf && device);
+
+	// Check whether the device exists
+	struct stat buf;
+	if(stat(device, &buf) == -1)
+	{
+		fprintf(stderr, "Error locating device node (%s)\n", device);
+		return -1;
+	}
+
+	// Device should be a character device
+	if(!S_ISCHR(buf.st_mode))
+	{
+		fprintf(stderr, "Device node is not a character device (%s)\n", device);
+		return -1;
+	}
+
+	// Try to open interface
+	HANDLE handle = LINUX_CAN_Open(device, O_RDWR);
+
+	if(!handle) {
+		fprintf(stderr, "Opening of CAN device failed\n");
+		return -1;
+	}
+
+	// Initialize interface
+	DWORD result = CAN_Init(handle, CAN_BAUD_1M, CAN_INIT_TYPE_ST);
+
+	if(result != CAN_ERR_OK && result != CAN_ERR_QRCVEMPTY)
+	{
+		fprintf(stderr, "Initializing of CAN device failed\n");
+		CAN_Close(handle);
+		return -1;
+	}
+
+	intf->backend_data = handle;
+	intf->fd = LINUX_CAN_FileHandle(handle);
+
+	return 0;
+}
+
+
+/**
+ * Close PEAK character device.
+ */
+static int intf_pcan_close(intf_t *intf)
+{
+	assert(intf && intf->backend_data);
+
+	DWORD result = CAN_Close((HANDLE) intf->backend_data);
+	intf->backend_data = NULL;
+
+	if(result != CAN_ERR_OK) {
+		fprintf(stderr, "Closing of CAN device failed\n");
+		return -1;
+	}
+
+	return 0;
+}
+
+
+/**
+ * Writes a single message.
+ */
+static int intf_pcan_write(intf_t *intf, const can_message_t *msg)
+{
+	assert(intf && msg);
+
+	TPCANMsg cmsg;
+	cmsg.ID = msg->id;
+	cmsg.MSGTYPE = msg->type;
+	cmsg.LEN = msg->len;
+
+	for(int i = 0; i < 8; i++)
+		cmsg.DATA[i] = msg->data[i];
+
+	DWORD result = CAN_Write((HANDLE) intf->backend_data, &cmsg);
+
+	if(result != CAN_ERR_OK) {
+		syslog(LOG_ALERT, "%s() could not send message: %s", __FUNCTION__, strerror(errno));
+		return -1;
+	}
+
+	return 0;
+}
+
+
+/**
+ * Reads up to max messages from the driver queue without blocking.
+ *
+ * Status messages are logged and not returned, receive overruns
+ * reported in them are added to the interface statistics. Extended
+ * and remote frames are skipped as in the socketcan backend.
+ */
+static int intf_pcan_read(intf_t *intf, can_message_t *msgs, int max)
+{
+	assert(intf && msgs && max > 0);
+
+	HANDLE handle = (HANDLE) intf->backend_data;
+	int count = 0;
+
+	while(count < max) {
+		TPCANRdMsg message;
+
+		// A timeout of zero polls the queue
+		DWORD result = LINUX_CAN_Read_Timeout(handle, &message, 0);
+
+		// Receive queue is empty
+		if(result == CAN_ERR_QRCVEMPTY)
+			break;
+
+		// There was an error
+		if(result != CAN_ERR_OK) {
+			syslog(LOG_ALERT, "%s() reading from the CAN bus failed.", __FUNCTION__);
+			return -1;
+		}
+
+		// A status message was received
+		if((message.Msg.MSGTYPE & MSGTYPE_STATUS) == MSGTYPE_STATUS)
+		{
+			int32_t status = int32_t(CAN_Status(handle));
+
+			if(status < 0) {
+				syslog(LOG_ALERT, "%s() received invalid status (%x).", __FUNCTION__, status);
+				return -1;
+			}
+
+			if(status & (CAN_ERR_OVERRUN | CAN_ERR_QOVERRUN))
+				intf->rx_stats.overruns++;
+
+			if(status != 0x20 && status != 0x00)
+				intf_pcan_log_status(__FUNCTION__, status);
+
+			continue;
+		}
+
+		// The identifier would alias a standard one once masked
+		if(message.Msg.MSGTYPE & (MSGTYPE_EXTENDED | MSGTYPE_RTR))
+			continue;
+
+		can_message_t *msg = &msgs[count++];
+
+		msg->id = message.Msg.ID;
+		msg->type = mt_standard;
+		msg->len = message.Msg.LEN;
+
+		for(int i = 0; i < 8; i++)
+			msg->data[i] = message.Msg.DATA[i];
+
+		// Driver time since it was loaded
+		msg->timestamp = uint64_t(message.dwTime) * 1000 + message.wUsec;
+	}
+
+	return count;
+}
+
+
+/**
+ * Returns the number of messages waiting in the driver queue.
+ */
+static int intf_pcan_pending(intf_t *intf)
+{
+	assert(intf);
+
+	int pending_reads = 0, pending_writes = 0;
+
+	// Returns the (non-negative) bus status on success
+	DWORD result = LINUX_CAN_Extended_Status((HANDLE) intf->backend_data, &pending_reads, &pending_writes);
+
+	if(int32_t(result) < 0)
+		return -1;
+
+	return pending_reads;
+}
+
+
+const intf_backend_t intf_backend_pcan = {
+	"pcan",
+	intf_pcan_open,
+	intf_pcan_close,
+	intf_pcan_write,
+	intf_pcan_read,
+	intf_pcan_pending
+};
@@ -0,0 +1,330 @@
+
+#include "interface.h"
+#include "interface_internal.h"
+
+#include <syslog.h>
+#include <assert.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <net/if.h>
+
+#include <linux/can.h>
+#include <linux/can/raw.h>
+#include <linux/can/error.h>
+
+
+/**
+ * Backend specific state.
+ */
+struct intf_socketcan_t {
+	// Cumulative number of frames dropped by the kernel (SO_RXQ_OVFL)
+	uint32_t dropped;
+};
+
+
+// Control messages attached to every frame
+#define SOCKETCAN_CONTROL_SIZE \
+	(CMSG_SPACE(sizeof(uint32_t)) + CMSG_SPACE(sizeof(timespec)))
+
+
+/**
+ * Writes SocketCAN error frame to system log.
+ *
+ * @param intf  Interface on which the frame was received.
+ * @param function  Function where the error frame was received.
+ * @param frame  Error frame received.
+ */
+static void intf_socketcan_log_error(intf_t *intf, const char *function, const can_frame *frame)
+{
+	assert(intf && function && frame);
+
+	if(frame->can_id & CAN_ERR_BUSOFF)
+		syslog(LOG_ERR, "%s() bus off.", function);
+
+	if(frame->can_id & CAN_ERR_CRTL) {
+		if(frame->data[1] & CAN_ERR_CRTL_RX_OVERFLOW)
+			intf->rx_stats.overruns++;
+		if(frame->data[1] & (CAN_ERR_CRTL_RX_OVERFLOW | CAN_ERR_CRTL_TX_OVERFLOW))
+			syslog(LOG_ALERT, "%s() controller buffer overrun.", function);
+		if(frame->data[1] & (CAN_ERR_CRTL_RX_WARNING | CAN_ERR_CRTL_TX_WARNING))
+			syslog(LOG_WARNING, "%s() bus warning.", function);
+		if(frame->data[1] & (CAN_ERR_CRTL_RX_PASSIVE | CAN_ERR_CRTL_TX_PASSIVE))
+			syslog(LOG_WARNING, "%s() bus passive.", function);
+	}
+
+	if(frame->can_id & CAN_ERR_ACK)
+		syslog(LOG_WARNING, "%s() no acknowledge on transmission.", function);
+
+	if(frame->can_id & CAN_ERR_RESTARTED)
+		syslog(LOG_NOTICE, "%s() controller restarted.", function);
+}
+
+
+/**
+ * Adopt an already connected datagram socket (e.g. one end of a
+ * SOCK_SEQPACKET socketpair) that carries one can_frame per message.
+ * Used to connect to a simulated drive without a CAN interface.
+ *
+ * @return 0 on success, -1 on failure.
+ */
+static int intf_socketcan_adopt(intf_t *intf, const char *device)
+{
+	assert(intf && device);
+
+	char *end;
+	long fd = strtol(device + strlen(INTF_FD_DEVICE_PREFIX), &end, 10);
+
+	if(*end != '\0' || fd < 0 || fcntl(int(fd), F_GETFD) == -1) {
+		fprintf(stderr, "Invalid file descriptor (%s)\n", device);
+		return -1;
+	}
+
+	int enable = 1;
+	setsockopt(int(fd), SOL_SOCKET, SO_TIMESTAMPNS, &enable, sizeof(enable));
+
+	fcntl(int(fd), F_SETFL, fcntl(int(fd), F_GETFL) | O_NONBLOCK);
+
+	intf_socketcan_t *socketcan = new intf_socketcan_t();
+	socketcan->dropped = 0;
+
+	intf->backend_data = socketcan;
+	intf->fd = int(fd);
+
+	return 0;
+}
+
+
+/**
+ * Open SocketCAN network interface (e.g. can0 or vcan0).
+ *
+ * @return 0 on success, -1 on failure.
+ */
+static int intf_socketcan_open(intf_t *intf, const char *device)
+{
+	assert(intf && device);
+
+	if(strncmp(device, INTF_FD_DEVICE_PREFIX, strlen(INTF_FD_DEVICE_PREFIX)) == 0)
+		return intf_socketcan_adopt(intf, device);
+
+	int fd = socket(PF_CAN, SOCK_RAW, CAN_RAW);
+
+	if(fd == -1) {
+		fprintf(stderr, "Could not create CAN socket: %s\n", strerror(errno));
+		return -1;
+	}
+
+	// Lookup interface index
+	ifreq ifr;
+	memset(&ifr, 0, sizeof(ifr));
+	strncpy(ifr.ifr_name, device, IFNAMSIZ - 1);
+
+	if(ioctl(fd, SIOCGIFINDEX, &ifr) == -1) {
+		fprintf(stderr, "Error locating CAN interface (%s)\n", device);
+		close(fd);
+		return -1;
+	}
+
+	// Receive bus-off and controller errors as error frames
+	can_err_mask_t err_mask = CAN_ERR_BUSOFF | CAN_ERR_CRTL | CAN_ERR_ACK | CAN_ERR_RESTARTED;
+	setsockopt(fd, SOL_CAN_RAW, CAN_RAW_ERR_FILTER, &err_mask, sizeof(err_mask));
+
+	// Report frames dropped because the socket queue was full
+	int enable = 1;
+	setsockopt(fd, SOL_SOCKET, SO_RXQ_OVFL, &enable, sizeof(enable));
+
+	// Have the kernel timestamp frames on reception
+	setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPNS, &enable, sizeof(enable));
+
+	sockaddr_can addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.can_family = AF_CAN;
+	addr.can_ifindex = ifr.ifr_ifindex;
+
+	if(bind(fd, (sockaddr *) &addr, sizeof(addr)) == -1) {
+		fprintf(stderr, "Binding of CAN socket failed (%s): %s\n", device, strerror(errno));
+		close(fd);
+		return -1;
+	}
+
+	// Reads should never block the event loop
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+	intf_socketcan_t *socketcan = new intf_socketcan_t();
+	socketcan->dropped = 0;
+
+	intf->backend_data = socketcan;
+	intf->fd = fd;
+
+	return 0;
+}
+
+
+/**
+ * Close SocketCAN socket.
+ */
+static int intf_socketcan_close(intf_t *intf)
+{
+	assert(intf);
+
+	delete (intf_socketcan_t *) intf->backend_data;
+	intf->backend_data = NULL;
+
+	if(close(intf->fd) == -1) {
+		fprintf(stderr, "Closing of CAN socket failed\n");
+		return -1;
+	}
+
+	return 0;
+}
+
+
+/**
+ * Writes a single message.
+ */
+static int intf_socketcan_write(intf_t *intf, const can_message_t *msg)
+{
+	assert(intf && msg);
+
+	can_frame frame;
+	memset(&frame, 0, sizeof(frame));
+
+	frame.can_id = msg->id;
+	if(msg->type & mt_extended) frame.can_id |= CAN_EFF_FLAG;
+	if(msg->type & mt_rtr) frame.can_id |= CAN_RTR_FLAG;
+
+	frame.can_dlc = msg->len;
+
+	for(int i = 0; i < 8; i++)
+		frame.data[i] = msg->data[i];
+
+	if(write(intf->fd, &frame, sizeof(frame)) != sizeof(frame)) {
+		syslog(LOG_ALERT, "%s() could not send message: %s", __FUNCTION__, strerror(errno));
+		return -1;
+	}
+
+	return 0;
+}
+
+
+/**
+ * Reads all frames currently queued on the socket, up to max,
+ * using a single recvmmsg() call.
+ *
+ * Error frames are logged and not returned, extended and remote frames
+ * are not used by CANopen and dropped. Returns 0 only if the socket is
+ * empty, a batch made up of such frames is followed by another read.
+ */
+static int intf_socketcan_read(intf_t *intf, can_message_t *msgs, int max)
+{
+	assert(intf && msgs && max > 0);
+
+	intf_socketcan_t *socketcan = (intf_socketcan_t *) intf->backend_data;
+
+	can_frame frames[INTF_READ_BATCH];
+	iovec iov[INTF_READ_BATCH];
+	mmsghdr hdrs[INTF_READ_BATCH];
+	uint8_t control[INTF_READ_BATCH][SOCKETCAN_CONTROL_SIZE];
+
+	if(max > INTF_READ_BATCH)
+		max = INTF_READ_BATCH;
+
+	int received, count;
+
+	// After a batch with nothing usable the socket may hold more,
+	//  the kernel shortens the control buffers so set them up again
+	do {
+		memset(hdrs, 0, sizeof(hdrs[0]) * max);
+
+		for(int i = 0; i < max; i++) {
+			iov[i].iov_base = &frames[i];
+			iov[i].iov_len = sizeof(frames[i]);
+			hdrs[i].msg_hdr.msg_iov = &iov[i];
+			hdrs[i].msg_hdr.msg_iovlen = 1;
+			hdrs[i].msg_hdr.msg_control = control[i];
+			hdrs[i].msg_hdr.msg_controllen = sizeof(control[i]);
+		}
+
+		received = recvmmsg(intf->fd, hdrs, max, MSG_DONTWAIT, NULL);
+
+		if(received == -1) {
+			if(errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+				return 0;
+
+			syslog(LOG_ALERT, "%s() reading from the CAN bus failed: %s", __FUNCTION__, strerror(errno));
+			return -1;
+		}
+
+		count = 0;
+
+		for(int i = 0; i < received; i++) {
+			const can_frame *frame = &frames[i];
+			uint64_t timestamp = 0;
+
+			// Drop counter and receive time are attached to every frame
+			msghdr *hdr = &(hdrs[i].msg_hdr);
+			for(cmsghdr *cmsg = CMSG_FIRSTHDR(hdr); cmsg; cmsg = CMSG_NXTHDR(hdr, cmsg)) {
+				if(cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPNS) {
+					timespec ts;
+					memcpy(&ts, CMSG_DATA(cmsg), sizeof(ts));
+					timestamp = uint64_t(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+				}
+
+				if(cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SO_RXQ_OVFL) {
+					uint32_t dropped;
+					memcpy(&dropped, CMSG_DATA(cmsg), sizeof(dropped));
+
+					if(dropped != socketcan->dropped) {
+						syslog(LOG_ALERT, "%s() receive buffer overrun, %u frames dropped.",
+							__FUNCTION__, dropped - socketcan->dropped);
+						intf->rx_stats.overruns++;
+						socketcan->dropped = dropped;
+					}
+				}
+			}
+
+			if(hdrs[i].msg_len < sizeof(can_frame))
+				continue;
+
+			if(frame->can_id & CAN_ERR_FLAG) {
+				intf_socketcan_log_error(intf, __FUNCTION__, frame);
+				continue;
+			}
+
+			// The identifier would alias a standard one once masked
+			if(frame->can_id & (CAN_EFF_FLAG | CAN_RTR_FLAG))
+				continue;
+
+			can_message_t *msg = &msgs[count++];
+
+			msg->type = mt_standard;
+			msg->id = frame->can_id & CAN_SFF_MASK;
+			msg->len = frame->can_dlc;
+
+			for(int j = 0; j < 8; j++)
+				msg->data[j] = frame->data[j];
+
+			// Kernel receive time (CLOCK_REALTIME)
+			msg->timestamp = timestamp;
+		}
+	} while(received > 0 && count == 0);
+
+	return count;
+}
+
+
+const intf_backend_t intf_backend_socketcan = {
+	"socketcan",
+	intf_socketcan_open,
+	intf_socketcan_close,
+	intf_socketcan_write,
+	intf_socketcan_read,
+	NULL
+};
@@ -1,6 +1,14 @@
 #include <syslog.h>
 #include <assert.h>
 
+#include "machine_table.h"
+#include "machine_queue.h"
+#include "machine_trace.h"
+#include "machine_timer.h"
+
+#define MACHINE_STR_(a) #a
+#define MACHINE_STR(a) MACHINE_STR_(a)
+
 // First generate structure type
 #include "machine_undef.h"
 #define FIELD(type, name) type name;
@@ -12,9 +20,75 @@ struct MACHINE_TYPE {
 	STATE_TYPE state;
 	void *payload;
 
+	// Events are posted here if set, else handled immediately
+	machine_queue_t *queue;
+
+	// Transitions are recorded here if set, else logged
+	machine_trace_t *trace;
+
+	// Dwell timeouts, only armed if set
+	machine_timer_t *timer;
+	int timer_slot;
+
+	// Number of times the state was entered again without leaving it
+	int reentries;
+
 #include MACHINE_FILE()
 };
 
+// Count states and events
+#include "machine_undef.h"
+#define BEGIN_STATES static const int CONCAT(PREFIX, _num_states) = 0
+#define STATE(name) + 1
+#define END_STATES ;
+#define BEGIN_EVENTS static const int CONCAT(PREFIX, _num_events) = 0
+#define EVENT(name) + 1
+#define END_EVENTS ;
+
+#include MACHINE_FILE()
+
+// Build and check transition table
+#include "machine_undef.h"
+#define TRANSITION_TABLE_TYPE machine_table_t<CONCAT(PREFIX, _num_states), CONCAT(PREFIX, _num_events)>
+
+#define BEGIN_TRANSITIONS \
+	static constexpr machine_transition_t CONCAT(PREFIX, _transitions)[] = {
+#define TRANSITION(state, event, to) {MT_TRANSITION, state, event, to},
+#define TRANSITION_ANY(event, to) {MT_ANY, -1, event, to},
+#define TRANSITION_ANY_BUT(state, event, to) {MT_ANY_BUT, state, event, to},
+#define TRANSITION_IGNORE(event) {MT_IGNORE, -1, event, -1},
+#define END_TRANSITIONS \
+	}; \
+	static_assert(CONCAT(PREFIX, _num_states) <= 256, MACHINE_STR(PREFIX) ": too many states"); \
+	static_assert(CONCAT(PREFIX, _num_events) <= 256, MACHINE_STR(PREFIX) ": too many events"); \
+	static_assert(machine_find_invalid<CONCAT(PREFIX, _num_states), CONCAT(PREFIX, _num_events)>( \
+		CONCAT(PREFIX, _transitions)) == -1, MACHINE_STR(PREFIX) ": transition with invalid state or event"); \
+	static_assert(machine_find_conflict<CONCAT(PREFIX, _num_states)>( \
+		CONCAT(PREFIX, _transitions)) == -1, MACHINE_STR(PREFIX) ": conflicting transitions"); \
+	static_assert(machine_find_unhandled_event<CONCAT(PREFIX, _num_events)>( \
+		CONCAT(PREFIX, _transitions)) == -1, MACHINE_STR(PREFIX) ": event without transition"); \
+	static constexpr TRANSITION_TABLE_TYPE CONCAT(PREFIX, _table) = \
+		machine_build_table<CONCAT(PREFIX, _num_states), CONCAT(PREFIX, _num_events)>(CONCAT(PREFIX, _transitions)); \
+	static_assert(machine_find_unreachable_state(CONCAT(PREFIX, _table), INITIAL_STATE) == -1, \
+		MACHINE_STR(PREFIX) ": unreachable state");
+
+#include MACHINE_FILE()
+
+// Build and check dwell timeouts
+#include "machine_undef.h"
+#define BEGIN_TIMEOUTS \
+	static constexpr machine_timeout_t CONCAT(PREFIX, _timeout_list)[] = {
+#define STATE_TIMEOUT(state, seconds, event) {state, seconds, event},
+#define END_TIMEOUTS \
+		{-1, 0.0, -1} \
+	}; \
+	static_assert(machine_find_invalid_timeout(CONCAT(PREFIX, _timeout_list), CONCAT(PREFIX, _table)) == -1, \
+		MACHINE_STR(PREFIX) ": invalid state timeout"); \
+	static constexpr machine_timeouts_t<CONCAT(PREFIX, _num_states)> CONCAT(PREFIX, _timeouts) = \
+		machine_build_timeouts<CONCAT(PREFIX, _num_states)>(CONCAT(PREFIX, _timeout_list));
+
+#include MACHINE_FILE()
+
 // Then generate simple functions (all except constructor)
 #include "machine_undef.h"
 
@@ -43,17 +117,73 @@ struct MACHINE_TYPE {
 #define END_EVENTS } return "Invalid event"; }
 
 #define GENERATE_DEFAULT_FUNCTIONS \
-	void CONCAT(PREFIX, _handle_event)(MACHINE_TYPE *machine, EVENT_TYPE event) \
+	static const char *CONCAT(PREFIX, _trace_statename)(int state) \
 	{ \
-		assert(machine); \
-		STATE_TYPE next_state = CONCAT(PREFIX, _next_state_given_event)(machine, event); \
-		if(!(machine->state == next_state)) { \
+		return CONCAT(PREFIX, _statename)(STATE_TYPE(state)); \
+	} \
+	static const char *CONCAT(PREFIX, _trace_eventname)(int event) \
+	{ \
+		return CONCAT(PREFIX, _eventname)(EVENT_TYPE(event)); \
+	} \
+	static const machine_trace_info_t CONCAT(PREFIX, _trace_info) = { \
+		MACHINE_STR(PREFIX), CONCAT(PREFIX, _trace_statename), CONCAT(PREFIX, _trace_eventname) \
+	}; \
+	static void CONCAT(PREFIX, _post_event)(void *payload, int event) \
+	{ \
+		CONCAT(PREFIX, _handle_event)((MACHINE_TYPE *) payload, EVENT_TYPE(event)); \
+	} \
+	static void CONCAT(PREFIX, _dispatch_event)(void *payload, int event) \
+	{ \
+		MACHINE_TYPE *machine = (MACHINE_TYPE *) payload; \
+		STATE_TYPE next_state = CONCAT(PREFIX, _next_state_given_event)(machine, EVENT_TYPE(event)); \
+		if(!(machine->state == next_state) || CONCAT(PREFIX, _table).reenter[machine->state][event]) { \
+			STATE_TYPE previous_state = machine->state; \
 		    CONCAT(PREFIX, _on_exit)(machine); \
 			machine->state = next_state; \
-			syslog(LOG_DEBUG, "%s() state changed to %s",  __FUNCTION__, CONCAT(PREFIX, _statename)(machine->state)); \
+			machine->reentries = previous_state == next_state ? machine->reentries + 1 : 0; \
+			if(machine->trace) \
+				machine_trace_record(machine->trace, &CONCAT(PREFIX, _trace_info), previous_state, next_state, event); \
+			else \
+				syslog(LOG_DEBUG, "%s() state changed to %s",  __FUNCTION__, CONCAT(PREFIX, _statename)(machine->state)); \
+			if(machine->timer) { \
+				if(CONCAT(PREFIX, _timeouts).dwell[next_state] > 0.0) \
+					machine_timer_arm(machine->timer, machine->timer_slot, CONCAT(PREFIX, _timeouts).dwell[next_state], \
+						CONCAT(PREFIX, _post_event), machine, CONCAT(PREFIX, _timeouts).event[next_state]); \
+				else \
+					machine_timer_disarm(machine->timer, machine->timer_slot); \
+			} \
 			CONCAT(PREFIX, _on_enter)(machine); \
 		} \
 	} \
+	void CONCAT(PREFIX, _handle_event)(MACHINE_TYPE *machine, EVENT_TYPE event) \
+	{ \
+		assert(machine); \
+		if(machine->queue) \
+			machine_queue_post(machine->queue, CONCAT(PREFIX, _dispatch_event), machine, event); \
+		else \
+			CONCAT(PREFIX, _dispatch_event)(machine, event); \
+	} \
+	void CONCAT(PREFIX, _set_queue)(MACHINE_TYPE *machine, machine_queue_t *queue) \
+	{ \
+		assert(machine); \
+		machine->queue = queue; \
+	} \
+	void CONCAT(PREFIX, _set_trace)(MACHINE_TYPE *machine, machine_trace_t *trace) \
+	{ \
+		assert(machine); \
+		machine->trace = trace; \
+	} \
+	int CONCAT(PREFIX, _set_timer)(MACHINE_TYPE *machine, machine_timer_t *timer) \
+	{ \
+		assert(machine && timer); \
+		machine->timer_slot = machine_timer_register(timer); \
+		machine->timer = machine->timer_slot == -1 ? NULL : timer; \
+		return machine->timer ? 0 : -1; \
+	} \
+	STATE_TYPE CONCAT(PREFIX, _next_state_given_event)(MACHINE_TYPE *machine, EVENT_TYPE event) \
+	{ \
+		return STATE_TYPE(CONCAT(PREFIX, _table).next[machine->state][event]); \
+	} \
 	void CONCAT(PREFIX, _destroy)(MACHINE_TYPE **machine) \
 	{ \
 		free(*machine); \
@@ -81,6 +211,11 @@ MACHINE_TYPE *CONCAT(PREFIX, _create)(
 
 	machine->state = INITIAL_STATE;
 	machine->payload = NULL;
+	machine->queue = NULL;
+	machine->trace = NULL;
+	machine->timer = NULL;
+	machine->timer_slot = -1;
+	machine->reentries = 0;
 
 	#undef FIELD
 	#undef FIELD_INIT
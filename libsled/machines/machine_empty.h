@@ -56,6 +56,42 @@
 #define END_FIELDS
 #endif
 
+#ifndef BEGIN_TRANSITIONS
+#define BEGIN_TRANSITIONS
+#endif
+
+#ifndef TRANSITION
+#define TRANSITION(state, event, to)
+#endif
+
+#ifndef TRANSITION_ANY
+#define TRANSITION_ANY(event, to)
+#endif
+
+#ifndef TRANSITION_ANY_BUT
+#define TRANSITION_ANY_BUT(state, event, to)
+#endif
+
+#ifndef TRANSITION_IGNORE
+#define TRANSITION_IGNORE(event)
+#endif
+
+#ifndef END_TRANSITIONS
+#define END_TRANSITIONS
+#endif
+
+#ifndef BEGIN_TIMEOUTS
+#define BEGIN_TIMEOUTS
+#endif
+
+#ifndef STATE_TIMEOUT
+#define STATE_TIMEOUT(state, seconds, event)
+#endif
+
+#ifndef END_TIMEOUTS
+#define END_TIMEOUTS
+#endif
+
 #ifndef GENERATE_DEFAULT_FUNCTIONS
 #define GENERATE_DEFAULT_FUNCTIONS
 #endif
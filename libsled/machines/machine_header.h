@@ -34,11 +34,17 @@
 
 // Forward declaration
 struct MACHINE_TYPE;
+struct machine_queue_t;
+struct machine_trace_t;
+struct machine_timer_t;
 
 #define GENERATE_DEFAULT_FUNCTIONS \
 	void CONCAT(PREFIX, _destroy)(MACHINE_TYPE **machine); \
 	STATE_TYPE CONCAT(PREFIX, _active_state)(MACHINE_TYPE *machine); \
 	void CONCAT(PREFIX, _handle_event)(MACHINE_TYPE *machine, EVENT_TYPE event); \
+	void CONCAT(PREFIX, _set_queue)(MACHINE_TYPE *machine, machine_queue_t *queue); \
+	void CONCAT(PREFIX, _set_trace)(MACHINE_TYPE *machine, machine_trace_t *trace); \
+	int CONCAT(PREFIX, _set_timer)(MACHINE_TYPE *machine, machine_timer_t *timer); \
 	void CONCAT(PREFIX, _set_callback_payload)(MACHINE_TYPE *machine, void *payload); \
 	STATE_TYPE CONCAT(PREFIX, _next_state_given_event)(MACHINE_TYPE *machine, EVENT_TYPE event); \
 	void CONCAT(PREFIX, _on_enter)(MACHINE_TYPE *machine); \
@@ -0,0 +1,125 @@
+#include "machine_queue.h"
+#include "../sled_time.h"
+
+#include <assert.h>
+#include <string.h>
+#include <syslog.h>
+#include <time.h>
+
+
+/**
+ * Handles pending events until the queue is empty, including those
+ * posted by the handlers.
+ */
+static void machine_queue_drain(machine_queue_t *queue)
+{
+	machine_queue_stats_t *stats = &(queue->stats);
+	double start = get_time();
+	int events = 0;
+
+	queue->depth++;
+
+	while(queue->count > 0) {
+		machine_queue_entry_t entry = queue->entries[queue->head];
+
+		queue->head = (queue->head + 1) % MACHINE_QUEUE_CAPACITY;
+		queue->count--;
+
+		entry.dispatch(entry.machine, entry.event);
+		events++;
+	}
+
+	queue->depth--;
+
+	double time = get_time() - start;
+
+	stats->events += events;
+	stats->drains++;
+	stats->total_drain_time += time;
+
+	if(time > stats->max_drain_time)
+		stats->max_drain_time = time;
+	if(events > stats->max_events_per_drain)
+		stats->max_events_per_drain = events;
+}
+
+
+void machine_queue_init(machine_queue_t *queue)
+{
+	assert(queue);
+
+	queue->head = 0;
+	queue->count = 0;
+	queue->depth = 0;
+
+	memset(&(queue->stats), 0, sizeof(machine_queue_stats_t));
+}
+
+
+/**
+ * Posts an event to a machine. The event is handled before returning,
+ * unless the queue is being drained or a batch is open.
+ *
+ * @param dispatch  Handles event, generated by machine_body.h
+ */
+void machine_queue_post(machine_queue_t *queue, machine_dispatch_t dispatch, void *machine, int event)
+{
+	assert(queue);
+
+	if(queue->count == MACHINE_QUEUE_CAPACITY) {
+		syslog(LOG_ERR, "%s() queue full, handling event %d immediately", __FUNCTION__, event);
+		queue->stats.overflows++;
+		dispatch(machine, event);
+		return;
+	}
+
+	machine_queue_entry_t *entry =
+		&(queue->entries[(queue->head + queue->count) % MACHINE_QUEUE_CAPACITY]);
+
+	entry->dispatch = dispatch;
+	entry->machine = machine;
+	entry->event = event;
+
+	queue->count++;
+
+	if(queue->count > queue->stats.high_water_mark)
+		queue->stats.high_water_mark = queue->count;
+
+	if(queue->depth == 0)
+		machine_queue_drain(queue);
+}
+
+
+/**
+ * Opens a batch, events posted until machine_queue_end() are queued
+ * and handled in a single drain.
+ */
+void machine_queue_begin(machine_queue_t *queue)
+{
+	assert(queue);
+	queue->depth++;
+}
+
+
+/**
+ * Closes a batch and handles its events.
+ */
+void machine_queue_end(machine_queue_t *queue)
+{
+	assert(queue && queue->depth > 0);
+	queue->depth--;
+
+	if(queue->depth == 0 && queue->count > 0)
+		machine_queue_drain(queue);
+}
+
+
+void machine_queue_get_stats(machine_queue_t *queue, machine_queue_stats_t *stats, bool reset)
+{
+	assert(queue && stats);
+
+	*stats = queue->stats;
+
+	if(reset)
+		memset(&(queue->stats), 0, sizeof(machine_queue_stats_t));
+}
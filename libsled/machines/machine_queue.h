@@ -0,0 +1,57 @@
+#ifndef __MACHINE_QUEUE_H__
+#define __MACHINE_QUEUE_H__
+
+#include <stdint.h>
+
+// Number of events that may be pending. An event posted to a full
+//  queue is handled immediately and counted as an overflow.
+#define MACHINE_QUEUE_CAPACITY 64
+
+typedef void (*machine_dispatch_t)(void *machine, int event);
+
+struct machine_queue_entry_t {
+	machine_dispatch_t dispatch;
+	void *machine;
+	int event;
+};
+
+/**
+ * Event processing statistics. A drain handles all events posted
+ * from a single callback, including those posted while handling them.
+ */
+struct machine_queue_stats_t {
+	uint64_t events;			// Events handled
+	uint64_t drains;
+	uint64_t overflows;			// Events handled immediately, queue full
+	int high_water_mark;		// Largest number of pending events
+	int max_events_per_drain;
+	double total_drain_time;	// Time spent handling events (s)
+	double max_drain_time;
+};
+
+/**
+ * Events of a group of state machines, handled run-to-completion in
+ * order of posting. Events posted while another event is handled are
+ * queued, such that the stack depth does not depend on the number of
+ * machines reacting to each other.
+ */
+struct machine_queue_t {
+	machine_queue_entry_t entries[MACHINE_QUEUE_CAPACITY];
+	int head;
+	int count;
+
+	// Drains in progress or batches open, events are only queued
+	int depth;
+
+	machine_queue_stats_t stats;
+};
+
+void machine_queue_init(machine_queue_t *queue);
+void machine_queue_post(machine_queue_t *queue, machine_dispatch_t dispatch, void *machine, int event);
+
+void machine_queue_begin(machine_queue_t *queue);
+void machine_queue_end(machine_queue_t *queue);
+
+void machine_queue_get_stats(machine_queue_t *queue, machine_queue_stats_t *stats, bool reset);
+
+#endif
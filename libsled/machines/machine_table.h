@@ -0,0 +1,231 @@
+#ifndef __MACHINE_TABLE_H__
+#define __MACHINE_TABLE_H__
+
+/**
+ * Compile-time transition tables.
+ *
+ * Transitions are declared in the *_def.h files:
+ *
+ *   TRANSITION(from, event, to)        from a single state
+ *   TRANSITION_ANY(event, to)          from every state
+ *   TRANSITION_ANY_BUT(state, event, to)  from every state but one
+ *   TRANSITION_IGNORE(event)           event never changes state
+ *
+ * machine_body.h collects them in a constexpr array, from which the
+ * [state][event] table used by *_next_state_given_event() is built.
+ * Events without a transition leave the state unchanged, a TRANSITION
+ * from a state to itself leaves and enters it again. The checks below
+ * run in static_assert, such that a machine with conflicting
+ * transitions, unreachable states or unhandled events does not build.
+ *
+ * States may declare a maximum dwell time:
+ *
+ *   STATE_TIMEOUT(state, seconds, event)
+ *
+ * event is posted when the state was not left within the given time,
+ * it must have a transition from the state (possibly to itself).
+ */
+
+enum machine_transition_kind_t {
+	MT_TRANSITION,
+	MT_ANY,
+	MT_ANY_BUT,
+	MT_IGNORE
+};
+
+struct machine_transition_t {
+	machine_transition_kind_t kind;
+	int state;		// Source state, or excluded state for MT_ANY_BUT
+	int event;
+	int to;
+};
+
+template<int S, int E>
+struct machine_table_t {
+	unsigned char next[S][E];
+	bool reenter[S][E];		// Transition to the same state
+};
+
+struct machine_timeout_t {
+	int state;				// -1 terminates the list
+	double dwell;			// Seconds
+	int event;
+};
+
+template<int S>
+struct machine_timeouts_t {
+	double dwell[S];		// 0 if state has no timeout
+	int event[S];
+};
+
+
+/**
+ * Returns whether transition applies to state and event.
+ */
+constexpr bool machine_transition_applies(const machine_transition_t &t, int state, int event)
+{
+	if(t.event != event)
+		return false;
+
+	switch(t.kind) {
+		case MT_TRANSITION: return t.state == state;
+		case MT_ANY: return true;
+		case MT_ANY_BUT: return t.state != state;
+		case MT_IGNORE: return false;
+	}
+
+	return false;
+}
+
+
+template<int S, int E, int T>
+constexpr machine_table_t<S, E> machine_build_table(const machine_transition_t (&transitions)[T])
+{
+	machine_table_t<S, E> table = {};
+
+	for(int state = 0; state < S; state++)
+		for(int event = 0; event < E; event++) {
+			table.next[state][event] = state;
+			table.reenter[state][event] = false;
+
+			for(int i = 0; i < T; i++)
+				if(machine_transition_applies(transitions[i], state, event)) {
+					table.next[state][event] = transitions[i].to;
+					table.reenter[state][event] =
+						transitions[i].kind == MT_TRANSITION && transitions[i].to == state;
+				}
+		}
+
+	return table;
+}
+
+
+template<int S, int T>
+constexpr machine_timeouts_t<S> machine_build_timeouts(const machine_timeout_t (&timeouts)[T])
+{
+	machine_timeouts_t<S> result = {};
+
+	for(int i = 0; i < T; i++)
+		if(timeouts[i].state >= 0) {
+			result.dwell[timeouts[i].state] = timeouts[i].dwell;
+			result.event[timeouts[i].state] = timeouts[i].event;
+		}
+
+	return result;
+}
+
+
+/**
+ * Returns index of first timeout with a state or event out of range,
+ * a state that already has a timeout, or an event that does not leave
+ * or enter the state again, or -1.
+ */
+template<int S, int E, int T>
+constexpr int machine_find_invalid_timeout(const machine_timeout_t (&timeouts)[T], const machine_table_t<S, E> &table)
+{
+	for(int i = 0; i < T; i++) {
+		const machine_timeout_t &t = timeouts[i];
+
+		if(t.state < 0)
+			continue;
+
+		if(t.state >= S || t.event < 0 || t.event >= E || !(t.dwell > 0.0))
+			return i;
+
+		if(table.next[t.state][t.event] == t.state && !table.reenter[t.state][t.event])
+			return i;
+
+		for(int j = 0; j < i; j++)
+			if(timeouts[j].state == t.state)
+				return i;
+	}
+
+	return -1;
+}
+
+
+/**
+ * Returns index of first transition with a state or event out of range,
+ * or -1.
+ */
+template<int S, int E, int T>
+constexpr int machine_find_invalid(const machine_transition_t (&transitions)[T])
+{
+	for(int i = 0; i < T; i++) {
+		const machine_transition_t &t = transitions[i];
+
+		if(t.event < 0 || t.event >= E)
+			return i;
+		if(t.kind != MT_IGNORE && (t.to < 0 || t.to >= S))
+			return i;
+		if((t.kind == MT_TRANSITION || t.kind == MT_ANY_BUT) && (t.state < 0 || t.state >= S))
+			return i;
+	}
+
+	return -1;
+}
+
+
+/**
+ * Returns index of first transition that applies to the same state and
+ * event as an earlier one, or -1.
+ */
+template<int S, int T>
+constexpr int machine_find_conflict(const machine_transition_t (&transitions)[T])
+{
+	for(int j = 0; j < T; j++)
+		for(int i = 0; i < j; i++)
+			for(int state = 0; state < S; state++)
+				if(machine_transition_applies(transitions[i], state, transitions[j].event) &&
+				   machine_transition_applies(transitions[j], state, transitions[j].event))
+					return j;
+
+	return -1;
+}
+
+
+/**
+ * Returns first event without transition that is not ignored, or -1.
+ */
+template<int E, int T>
+constexpr int machine_find_unhandled_event(const machine_transition_t (&transitions)[T])
+{
+	for(int event = 0; event < E; event++) {
+		bool handled = false;
+
+		for(int i = 0; i < T; i++)
+			if(transitions[i].event == event)
+				handled = true;
+
+		if(!handled)
+			return event;
+	}
+
+	return -1;
+}
+
+
+/**
+ * Returns first state that cannot be reached from the initial state,
+ * or -1.
+ */
+template<int S, int E>
+constexpr int machine_find_unreachable_state(const machine_table_t<S, E> &table, int initial)
+{
+	bool reachable[S] = {};
+	reachable[initial] = true;
+
+	for(int pass = 0; pass < S; pass++)
+		for(int state = 0; state < S; state++)
+			if(reachable[state])
+				for(int event = 0; event < E; event++)
+					reachable[table.next[state][event]] = true;
+
+	for(int state = 0; state < S; state++)
+		if(!reachable[state])
+			return state;
+
+	return -1;
+}
+
+#endif
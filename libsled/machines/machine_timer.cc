@@ -0,0 +1,150 @@
+#include "machine_timer.h"
+#include "../sled_time.h"
+
+#include <event2/event.h>
+
+#include <assert.h>
+#include <math.h>
+#include <time.h>
+
+
+/**
+ * Adds the event for the earliest deadline, if it is not already
+ * added for that deadline.
+ */
+static void machine_timer_schedule(machine_timer_t *timer)
+{
+	double deadline = 0.0;
+
+	for(int i = 0; i < timer->num_slots; i++)
+		if(timer->slots[i].armed && (deadline == 0.0 || timer->slots[i].deadline < deadline))
+			deadline = timer->slots[i].deadline;
+
+	if(deadline == timer->scheduled)
+		return;
+
+	timer->scheduled = deadline;
+
+	if(deadline == 0.0) {
+		event_del(timer->ev);
+		return;
+	}
+
+	double delay = deadline - get_time();
+	if(delay < 0.0)
+		delay = 0.0;
+
+	timeval timeout;
+	timeout.tv_sec = (time_t) floor(delay);
+	timeout.tv_usec = (suseconds_t) ((delay - floor(delay)) * 1e6);
+
+	event_add(timer->ev, &timeout);
+}
+
+
+/**
+ * Posts the timeout event of every machine whose deadline passed.
+ */
+static void machine_timer_on_timeout(evutil_socket_t fd, short flags, void *param)
+{
+	machine_timer_t *timer = (machine_timer_t *) param;
+	double now = get_time();
+
+	timer->scheduled = 0.0;
+
+	for(int i = 0; i < timer->num_slots; i++) {
+		machine_timer_slot_t *slot = &(timer->slots[i]);
+
+		if(!slot->armed || slot->deadline > now)
+			continue;
+
+		// The handler may arm the slot again
+		slot->armed = false;
+		timer->expired++;
+		slot->post(slot->machine, slot->event);
+	}
+
+	machine_timer_schedule(timer);
+}
+
+
+/**
+ * Initialises timer, the event has the highest priority.
+ *
+ * @return 0 on success, -1 on failure.
+ */
+int machine_timer_init(machine_timer_t *timer, event_base *ev_base)
+{
+	assert(timer);
+
+	timer->ev = event_new(ev_base, -1, 0, machine_timer_on_timeout, (void *) timer);
+	if(timer->ev == NULL)
+		return -1;
+
+	event_priority_set(timer->ev, 0);
+
+	timer->scheduled = 0.0;
+	timer->num_slots = 0;
+	timer->expired = 0;
+
+	return 0;
+}
+
+
+void machine_timer_destroy(machine_timer_t *timer)
+{
+	assert(timer);
+
+	if(timer->ev)
+		event_free(timer->ev);
+
+	timer->ev = NULL;
+}
+
+
+/**
+ * Returns slot for a machine, or -1 if all are taken.
+ */
+int machine_timer_register(machine_timer_t *timer)
+{
+	assert(timer);
+
+	if(timer->num_slots == MACHINE_TIMER_SLOTS)
+		return -1;
+
+	timer->slots[timer->num_slots].armed = false;
+
+	return timer->num_slots++;
+}
+
+
+/**
+ * Posts event to machine after dwell seconds, unless disarmed or
+ * armed again before.
+ */
+void machine_timer_arm(machine_timer_t *timer, int slot, double dwell, machine_dispatch_t post, void *machine, int event)
+{
+	assert(timer && slot >= 0 && slot < timer->num_slots);
+
+	machine_timer_slot_t *s = &(timer->slots[slot]);
+
+	s->armed = true;
+	s->deadline = get_time() + dwell;
+	s->post = post;
+	s->machine = machine;
+	s->event = event;
+
+	machine_timer_schedule(timer);
+}
+
+
+void machine_timer_disarm(machine_timer_t *timer, int slot)
+{
+	assert(timer && slot >= 0 && slot < timer->num_slots);
+
+	if(!timer->slots[slot].armed)
+		return;
+
+	timer->slots[slot].armed = false;
+	machine_timer_schedule(timer);
+}
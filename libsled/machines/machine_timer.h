@@ -0,0 +1,49 @@
+#ifndef __MACHINE_TIMER_H__
+#define __MACHINE_TIMER_H__
+
+#include <stdint.h>
+
+#include "machine_queue.h"
+
+// Number of machines that may share a timer
+#define MACHINE_TIMER_SLOTS 8
+
+struct event;
+struct event_base;
+
+/**
+ * Timeout of a single machine, armed while it dwells in a state
+ * that declares a STATE_TIMEOUT.
+ */
+struct machine_timer_slot_t {
+	bool armed;
+	double deadline;
+
+	// Posts event to machine, generated by machine_body.h
+	machine_dispatch_t post;
+	void *machine;
+	int event;
+};
+
+/**
+ * Dwell timeouts of a group of machines, backed by a single libevent
+ * timer that expires at the earliest deadline.
+ */
+struct machine_timer_t {
+	event *ev;
+	double scheduled;		// Deadline the event was added for, 0 if none
+
+	machine_timer_slot_t slots[MACHINE_TIMER_SLOTS];
+	int num_slots;
+
+	uint64_t expired;		// Timeout events posted
+};
+
+int machine_timer_init(machine_timer_t *timer, event_base *ev_base);
+void machine_timer_destroy(machine_timer_t *timer);
+
+int machine_timer_register(machine_timer_t *timer);
+void machine_timer_arm(machine_timer_t *timer, int slot, double dwell, machine_dispatch_t post, void *machine, int event);
+void machine_timer_disarm(machine_timer_t *timer, int slot);
+
+#endif
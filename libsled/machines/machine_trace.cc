@@ -0,0 +1,62 @@
+#include "machine_trace.h"
+#include "../sled_time.h"
+
+#include <assert.h>
+#include <syslog.h>
+#include <time.h>
+
+
+void machine_trace_init(machine_trace_t *trace)
+{
+	assert(trace);
+	trace->head = 0;
+}
+
+
+void machine_trace_record(machine_trace_t *trace, const machine_trace_info_t *machine, int from, int to, int event)
+{
+	machine_trace_entry_t *entry = &(trace->entries[trace->head % MACHINE_TRACE_SIZE]);
+
+	entry->time = get_time();
+	entry->machine = machine;
+	entry->from = from;
+	entry->to = to;
+	entry->event = event;
+
+	trace->head++;
+}
+
+
+/**
+ * Writes transitions recorded since the given one to the system log.
+ *
+ * @param since  Number of transitions recorded at the previous dump,
+ *               updated to the current number.
+ *
+ * @return Number of transitions written.
+ */
+int machine_trace_dump(machine_trace_t *trace, uint64_t *since)
+{
+	assert(trace && since);
+
+	uint64_t first = *since;
+
+	if(trace->head > MACHINE_TRACE_SIZE && first < trace->head - MACHINE_TRACE_SIZE) {
+		syslog(LOG_DEBUG, "%s() %llu transitions lost", __FUNCTION__,
+			(unsigned long long) (trace->head - MACHINE_TRACE_SIZE - first));
+		first = trace->head - MACHINE_TRACE_SIZE;
+	}
+
+	for(uint64_t i = first; i < trace->head; i++) {
+		machine_trace_entry_t *entry = &(trace->entries[i % MACHINE_TRACE_SIZE]);
+
+		syslog(LOG_DEBUG, "%s() %.6f %s: %s -> %s on %s", __FUNCTION__, entry->time,
+			entry->machine->name, entry->machine->statename(entry->from),
+			entry->machine->statename(entry->to), entry->machine->eventname(entry->event));
+	}
+
+	int count = first < trace->head ? int(trace->head - first) : 0;
+	*since = trace->head;
+
+	return count;
+}
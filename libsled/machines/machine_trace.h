@@ -0,0 +1,41 @@
+#ifndef __MACHINE_TRACE_H__
+#define __MACHINE_TRACE_H__
+
+#include <stdint.h>
+
+// Number of transitions kept, power of two
+#define MACHINE_TRACE_SIZE 1024
+
+/**
+ * Names of a machine, its states and events, generated by machine_body.h
+ */
+struct machine_trace_info_t {
+	const char *name;
+	const char *(*statename)(int state);
+	const char *(*eventname)(int event);
+};
+
+struct machine_trace_entry_t {
+	double time;
+	const machine_trace_info_t *machine;
+	uint8_t from, to;
+	uint8_t event;			// Event that caused the transition
+};
+
+/**
+ * Ring of the most recent state transitions of a group of machines.
+ * Recording a transition only copies it into the ring, names are
+ * looked up when the trace is written to the system log.
+ */
+struct machine_trace_t {
+	machine_trace_entry_t entries[MACHINE_TRACE_SIZE];
+
+	// Number of transitions recorded
+	uint64_t head;
+};
+
+void machine_trace_init(machine_trace_t *trace);
+void machine_trace_record(machine_trace_t *trace, const machine_trace_info_t *machine, int from, int to, int event);
+int machine_trace_dump(machine_trace_t *trace, uint64_t *since);
+
+#endif
@@ -16,4 +16,15 @@
 #undef FIELD_INIT
 #undef END_FIELDS
 
+#undef BEGIN_TRANSITIONS
+#undef TRANSITION
+#undef TRANSITION_ANY
+#undef TRANSITION_ANY_BUT
+#undef TRANSITION_IGNORE
+#undef END_TRANSITIONS
+
+#undef BEGIN_TIMEOUTS
+#undef STATE_TIMEOUT
+#undef END_TIMEOUTS
+
 #undef GENERATE_DEFAULT_FUNCTIONS
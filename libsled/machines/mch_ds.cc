@@ -9,104 +9,25 @@
 #include "machine_body.h"
 
 
+/**
+ * Writes the control word in the safety class. Set-point triggers of
+ * the mp machine are held back until operation is enabled again, see
+ * mch_sdo_set_control_hold().
+ */
 void mch_ds_send_control_word(mch_ds_t *machine, uint16_t control_word)
 {
+	mch_sdo_set_control_hold(machine->mch_sdo, true);
 	mch_sdo_queue_write(machine->mch_sdo, OB_CONTROL_WORD, 0x00, control_word, 0x02);
 }
 
 
-mch_ds_state_t mch_ds_next_state_given_event(mch_ds_t *machine, mch_ds_event_t event)
+/**
+ * Whether the drive was adopted by a warm attach and not disabled
+ * or faulted since, as opposed to enabled by this machine.
+ */
+bool mch_ds_is_attached(mch_ds_t *machine)
 {
-	if(!machine->state == ST_DS_DISABLED && event == EV_DS_NET_INOPERATIONAL)
-		return ST_DS_DISABLED;
-
-	if(!machine->state == ST_DS_DISABLED) {
-		if(event == EV_DS_FAULT)
-			return ST_DS_CLEARING_FAULT;
-		if(event == EV_DS_FAULT_REACTION_ACTIVE)
-			return ST_DS_FAULT;
-	}
-
-	switch(machine->state) {
-		case ST_DS_DISABLED:
-			if(event == EV_DS_NET_OPERATIONAL)
-				return ST_DS_UNKNOWN;
-			break;
-
-		case ST_DS_FAULT:
-			if(event == EV_DS_FAULT)
-				return ST_DS_CLEARING_FAULT;
-			break;
-
-		case ST_DS_CLEARING_FAULT:
-      if(event == EV_DS_NOT_READY_TO_SWITCH_ON)
-        return ST_DS_SWITCH_ON_DISABLED;
-      if(event == EV_DS_READY_TO_SWITCH_ON)
-        return ST_DS_READY_TO_SWITCH_ON;
-      if(event == EV_DS_SWITCHED_ON)
-        return ST_DS_SWITCHED_ON;
-			break;
-
-		case ST_DS_UNKNOWN:
-			if(event == EV_DS_NOT_READY_TO_SWITCH_ON)
-				return ST_DS_SWITCH_ON_DISABLED;
-			if(event == EV_DS_READY_TO_SWITCH_ON)
-				return ST_DS_READY_TO_SWITCH_ON;
-			break;
-
-		case ST_DS_SWITCH_ON_DISABLED:
-			if(event == EV_DS_VOLTAGE_ENABLED)
-				return ST_DS_PREPARE_SWITCH_ON;
-			break;
-
-		case ST_DS_PREPARE_SWITCH_ON:
-			if(event == EV_DS_READY_TO_SWITCH_ON)
-				return ST_DS_READY_TO_SWITCH_ON;
-			break;
-
-		case ST_DS_READY_TO_SWITCH_ON:
-			if(event == EV_DS_VOLTAGE_ENABLED)
-				return ST_DS_SWITCH_ON;
-			break;
-
-		case ST_DS_SWITCH_ON:
-			if(event == EV_DS_SWITCHED_ON)
-				return ST_DS_SWITCHED_ON;
-			if(event == EV_DS_VOLTAGE_DISABLED)
-				return ST_DS_SHUTDOWN;
-			break;
-
-		case ST_DS_SHUTDOWN:
-			if(event == EV_DS_NOT_READY_TO_SWITCH_ON)
-				return ST_DS_SWITCH_ON_DISABLED;
-			if(event == EV_DS_READY_TO_SWITCH_ON)
-				return ST_DS_READY_TO_SWITCH_ON;
-			break;
-
-		case ST_DS_SWITCHED_ON:
-			if(event == EV_DS_VOLTAGE_ENABLED)
-				return ST_DS_ENABLE_OPERATION;
-			if(event == EV_DS_VOLTAGE_DISABLED)
-				return ST_DS_SHUTDOWN;
-			break;
-
-		case ST_DS_DISABLE_OPERATION:
-			if(event == EV_DS_SWITCHED_ON)
-				return ST_DS_SWITCHED_ON;
-			break;
-
-		case ST_DS_ENABLE_OPERATION:
-			if(event == EV_DS_OPERATION_ENABLED)
-				return ST_DS_OPERATION_ENABLED;
-			break;
-
-		case ST_DS_OPERATION_ENABLED:
-			if(event == EV_DS_VOLTAGE_DISABLED)
-				return ST_DS_DISABLE_OPERATION;
-			break;
-	}
-
-	return machine->state;
+	return machine->attached;
 }
 
 
@@ -114,12 +35,19 @@ void mch_ds_on_enter(mch_ds_t *machine)
 {
 	switch(machine->state) {
 		case ST_DS_DISABLED:
+			machine->attached = false;
 			break;
 
 		case ST_DS_UNKNOWN:
+			machine->attached = false;
 			mch_ds_send_control_word(machine, 0x06); // Shutdown
 			break;
 
+		case ST_DS_ATTACH:
+			// Wait for the status word, nothing is sent
+			machine->attached = true;
+			break;
+
 		case ST_DS_PREPARE_SWITCH_ON:
 			mch_ds_send_control_word(machine, 0x06); // Shutdown
 			break;
@@ -141,13 +69,21 @@ void mch_ds_on_enter(mch_ds_t *machine)
 			break;
 
 		case ST_DS_OPERATION_ENABLED:
+			mch_sdo_set_control_hold(machine->mch_sdo, false);
 			if(machine->operation_enabled_handler)
 				machine->operation_enabled_handler(machine, machine->payload);
 			break;
 
 		case ST_DS_CLEARING_FAULT:
+			machine->attached = false;
 			mch_sdo_queue_read(machine->mch_sdo, 0x3518, 0x01);
 			break;
+
+		case ST_DS_FAULT:
+			machine->attached = false;
+			if(machine->fault_handler)
+				machine->fault_handler(machine, machine->payload);
+			break;
 	}
 }
 
@@ -156,6 +92,8 @@ void mch_ds_on_exit(mch_ds_t *machine)
 {
 	switch(machine->state) {
 		case ST_DS_OPERATION_ENABLED:
+			// Before the mp machine reacts, even if no control word follows
+			mch_sdo_set_control_hold(machine->mch_sdo, true);
 			if(machine->operation_disabled_handler)
 				machine->operation_disabled_handler(machine, machine->payload);
 			break;
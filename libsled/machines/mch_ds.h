@@ -11,4 +11,6 @@
 #include "machine_header.h"
 #include "mch_ds_def.h"
 
+bool mch_ds_is_attached(mch_ds_t *machine);
+
 #endif
@@ -5,6 +5,7 @@
 BEGIN_EVENTS
 	EVENT(EV_DS_NET_OPERATIONAL)	// From NMT machine (mch_net.cc)
 	EVENT(EV_DS_NET_INOPERATIONAL)	// From NMT machine (mch_net.cc)
+	EVENT(EV_DS_NET_ATTACHED)		// From NMT machine, drive adopted as is
 
 	EVENT(EV_DS_NOT_READY_TO_SWITCH_ON)
 	EVENT(EV_DS_READY_TO_SWITCH_ON)
@@ -16,11 +17,14 @@ BEGIN_EVENTS
 
 	EVENT(EV_DS_VOLTAGE_ENABLED)
 	EVENT(EV_DS_VOLTAGE_DISABLED)
+
+	EVENT(EV_DS_TIMEOUT)			// Internal, state not left in time
 END_EVENTS
 
 BEGIN_STATES
 	STATE(ST_DS_DISABLED)
 	STATE(ST_DS_UNKNOWN)
+	STATE(ST_DS_ATTACH)
 
 	STATE(ST_DS_FAULT)
 	STATE(ST_DS_CLEARING_FAULT)
@@ -36,14 +40,85 @@ BEGIN_STATES
 	STATE(ST_DS_OPERATION_ENABLED)
 END_STATES
 
+BEGIN_TRANSITIONS
+	TRANSITION(ST_DS_DISABLED, EV_DS_NET_OPERATIONAL, ST_DS_UNKNOWN)
+	TRANSITION(ST_DS_DISABLED, EV_DS_NET_ATTACHED, ST_DS_ATTACH)
+
+	// Loss of network or fault, from any state
+	TRANSITION_ANY_BUT(ST_DS_DISABLED, EV_DS_NET_INOPERATIONAL, ST_DS_DISABLED)
+	TRANSITION_ANY_BUT(ST_DS_DISABLED, EV_DS_FAULT, ST_DS_CLEARING_FAULT)
+	TRANSITION_ANY_BUT(ST_DS_DISABLED, EV_DS_FAULT_REACTION_ACTIVE, ST_DS_FAULT)
+
+	TRANSITION(ST_DS_CLEARING_FAULT, EV_DS_NOT_READY_TO_SWITCH_ON, ST_DS_SWITCH_ON_DISABLED)
+	TRANSITION(ST_DS_CLEARING_FAULT, EV_DS_READY_TO_SWITCH_ON, ST_DS_READY_TO_SWITCH_ON)
+	TRANSITION(ST_DS_CLEARING_FAULT, EV_DS_SWITCHED_ON, ST_DS_SWITCHED_ON)
+
+	TRANSITION(ST_DS_UNKNOWN, EV_DS_NOT_READY_TO_SWITCH_ON, ST_DS_SWITCH_ON_DISABLED)
+	TRANSITION(ST_DS_UNKNOWN, EV_DS_READY_TO_SWITCH_ON, ST_DS_READY_TO_SWITCH_ON)
+
+	// Warm attach: the state reported is taken over without a command,
+	//  the drive is shut down as above if no status word is seen.
+	TRANSITION(ST_DS_ATTACH, EV_DS_NOT_READY_TO_SWITCH_ON, ST_DS_SWITCH_ON_DISABLED)
+	TRANSITION(ST_DS_ATTACH, EV_DS_READY_TO_SWITCH_ON, ST_DS_READY_TO_SWITCH_ON)
+	TRANSITION(ST_DS_ATTACH, EV_DS_SWITCHED_ON, ST_DS_SWITCHED_ON)
+	TRANSITION(ST_DS_ATTACH, EV_DS_OPERATION_ENABLED, ST_DS_OPERATION_ENABLED)
+	TRANSITION(ST_DS_ATTACH, EV_DS_TIMEOUT, ST_DS_UNKNOWN)
+
+	TRANSITION(ST_DS_SWITCH_ON_DISABLED, EV_DS_VOLTAGE_ENABLED, ST_DS_PREPARE_SWITCH_ON)
+	TRANSITION(ST_DS_PREPARE_SWITCH_ON, EV_DS_READY_TO_SWITCH_ON, ST_DS_READY_TO_SWITCH_ON)
+	TRANSITION(ST_DS_READY_TO_SWITCH_ON, EV_DS_VOLTAGE_ENABLED, ST_DS_SWITCH_ON)
+
+	TRANSITION(ST_DS_SWITCH_ON, EV_DS_SWITCHED_ON, ST_DS_SWITCHED_ON)
+	TRANSITION(ST_DS_SWITCH_ON, EV_DS_VOLTAGE_DISABLED, ST_DS_SHUTDOWN)
+
+	TRANSITION(ST_DS_SHUTDOWN, EV_DS_NOT_READY_TO_SWITCH_ON, ST_DS_SWITCH_ON_DISABLED)
+	TRANSITION(ST_DS_SHUTDOWN, EV_DS_READY_TO_SWITCH_ON, ST_DS_READY_TO_SWITCH_ON)
+
+	TRANSITION(ST_DS_SWITCHED_ON, EV_DS_VOLTAGE_ENABLED, ST_DS_ENABLE_OPERATION)
+	TRANSITION(ST_DS_SWITCHED_ON, EV_DS_VOLTAGE_DISABLED, ST_DS_SHUTDOWN)
+
+	TRANSITION(ST_DS_DISABLE_OPERATION, EV_DS_SWITCHED_ON, ST_DS_SWITCHED_ON)
+	TRANSITION(ST_DS_ENABLE_OPERATION, EV_DS_OPERATION_ENABLED, ST_DS_OPERATION_ENABLED)
+	TRANSITION(ST_DS_OPERATION_ENABLED, EV_DS_VOLTAGE_DISABLED, ST_DS_DISABLE_OPERATION)
+
+	// Quick stop is not used
+	TRANSITION_IGNORE(EV_DS_QUICK_STOP_ACTIVE)
+
+	// Control words of which no effect was seen are sent again
+	TRANSITION(ST_DS_UNKNOWN, EV_DS_TIMEOUT, ST_DS_UNKNOWN)
+	TRANSITION(ST_DS_CLEARING_FAULT, EV_DS_TIMEOUT, ST_DS_CLEARING_FAULT)
+	TRANSITION(ST_DS_PREPARE_SWITCH_ON, EV_DS_TIMEOUT, ST_DS_PREPARE_SWITCH_ON)
+	TRANSITION(ST_DS_SWITCH_ON, EV_DS_TIMEOUT, ST_DS_SWITCH_ON)
+	TRANSITION(ST_DS_SHUTDOWN, EV_DS_TIMEOUT, ST_DS_SHUTDOWN)
+	TRANSITION(ST_DS_ENABLE_OPERATION, EV_DS_TIMEOUT, ST_DS_ENABLE_OPERATION)
+	TRANSITION(ST_DS_DISABLE_OPERATION, EV_DS_TIMEOUT, ST_DS_DISABLE_OPERATION)
+END_TRANSITIONS
+
+// Status words are sent at least every 10 ms (TPDO1)
+BEGIN_TIMEOUTS
+	STATE_TIMEOUT(ST_DS_UNKNOWN, 0.1, EV_DS_TIMEOUT)
+	STATE_TIMEOUT(ST_DS_ATTACH, 0.1, EV_DS_TIMEOUT)
+	STATE_TIMEOUT(ST_DS_CLEARING_FAULT, 0.1, EV_DS_TIMEOUT)
+	STATE_TIMEOUT(ST_DS_PREPARE_SWITCH_ON, 0.1, EV_DS_TIMEOUT)
+	STATE_TIMEOUT(ST_DS_SWITCH_ON, 0.1, EV_DS_TIMEOUT)
+	STATE_TIMEOUT(ST_DS_SHUTDOWN, 0.1, EV_DS_TIMEOUT)
+	STATE_TIMEOUT(ST_DS_ENABLE_OPERATION, 0.1, EV_DS_TIMEOUT)
+	STATE_TIMEOUT(ST_DS_DISABLE_OPERATION, 0.1, EV_DS_TIMEOUT)
+END_TIMEOUTS
+
 BEGIN_FIELDS
 	FIELD(intf_t *, interface)
 	FIELD(mch_sdo_t *, mch_sdo)
+
+	// Current state follows from a warm attach, not from enabling
+	FIELD_DECL(bool, attached)
+	FIELD_INIT(attached, false)
 END_FIELDS
 
 BEGIN_CALLBACKS
 	CALLBACK(operation_enabled)
 	CALLBACK(operation_disabled)
+	CALLBACK(fault)
 END_CALLBACKS
 
 GENERATE_DEFAULT_FUNCTIONS
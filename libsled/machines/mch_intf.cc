@@ -10,34 +10,6 @@
 #include "machine_body.h"
 
 
-mch_intf_state_t mch_intf_next_state_given_event(mch_intf_t *machine, mch_intf_event_t event)
-{
-  switch(machine->state) {
-    case ST_INTF_CLOSED:      
-      if(event == EV_INTF_OPEN)
-				return ST_INTF_OPENING;      
-      break;
-      
-    case ST_INTF_OPENING:
-      if(event == EV_INTF_OPENED)
-				return ST_INTF_OPENED;
-      break;
-    
-    case ST_INTF_CLOSING:
-      if(event == EV_INTF_CLOSED)
-				return ST_INTF_CLOSED;
-      break;
-
-    case ST_INTF_OPENED:
-      if(event == EV_INTF_CLOSE)
-				return ST_INTF_CLOSING;
-      break;      
-  }
-  
-  return machine->state;
-}
-
-
 void mch_intf_on_enter(mch_intf_t *machine)
 {
   switch(machine->state) {
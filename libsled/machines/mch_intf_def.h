@@ -16,6 +16,16 @@ BEGIN_EVENTS
 	EVENT(EV_INTF_CLOSED)
 END_EVENTS
 
+BEGIN_TRANSITIONS
+	TRANSITION(ST_INTF_CLOSED, EV_INTF_OPEN, ST_INTF_OPENING)
+	TRANSITION(ST_INTF_OPENING, EV_INTF_OPENED, ST_INTF_OPENED)
+	TRANSITION(ST_INTF_OPENED, EV_INTF_CLOSE, ST_INTF_CLOSING)
+	TRANSITION(ST_INTF_CLOSING, EV_INTF_CLOSED, ST_INTF_CLOSED)
+END_TRANSITIONS
+
+BEGIN_TIMEOUTS
+END_TIMEOUTS
+
 BEGIN_CALLBACKS
 	CALLBACK(opened)
 	CALLBACK(closed)
@@ -17,92 +17,62 @@ void mch_mp_send_mode_switch(mch_mp_t *machine, uint8_t mode)
 
 void mch_mp_send_control_word(mch_mp_t *machine, uint16_t control_word)
 {
-	mch_sdo_queue_write(machine->mch_sdo, OB_CONTROL_WORD, 0x00, control_word, 0x02);
+	// Set-point handshake, ordered with the motion tasks
+	mch_sdo_queue_write_with_class(machine->mch_sdo, OB_CONTROL_WORD, 0x00, control_word, 0x02, SDO_CLASS_MOTION);
 }
 
 
-mch_mp_state_t mch_mp_next_state_given_event(mch_mp_t *machine, mch_mp_event_t event)
+/**
+ * Selects a motion task and writes the control word, e.g. to start the
+ * task on the rising edge of the new set-point bit.
+ *
+ * With RPDO_MOTION_TRIGGER both are sent in a single RPDO1 frame,
+ * otherwise as two SDOs. Either way they follow queued SDOs of the
+ * motion class, such as the upload of the motion task.
+ *
+ * Returns 0 on success, -1 if the SDO queue is full or set-point
+ * triggers are held back (mch_sdo_set_control_hold()).
+ */
+int mch_mp_send_motion_task(mch_mp_t *machine, uint16_t motion_task, uint16_t control_word)
 {
-	if(!machine->state == ST_MP_DISABLED && event == EV_MP_DS_INOPERATIONAL)
-		return ST_MP_DISABLED;
+	machine->motion_task = motion_task;
 
-	switch(machine->state) {
-		case ST_MP_DISABLED:
-			if(event == EV_MP_DS_OPERATIONAL)
-				return ST_MP_SWITCH_MODE_HOMING;
-			break;
+	#ifdef RPDO_MOTION_TRIGGER
+	return mch_sdo_queue_pdo(machine->mch_sdo, FC_RPDO1,
+		motion_task | (uint32_t(control_word) << 16), 0x04, SDO_CLASS_MOTION);
+	#else
+	if(mch_sdo_queue_write(machine->mch_sdo, OB_MOTION_TASK, 0x00, motion_task, 0x02) == -1)
+		return -1;
 
-		case ST_MP_SWITCH_MODE_HOMING:
-			if(event == EV_MP_MODE_HOMING)
-				return ST_MP_HH_UNKNOWN;
-			break;
-
-		case ST_MP_HH_UNKNOWN:
-			if(event == EV_MP_NOTHOMED)
-				return ST_MP_HH_HOMING;
-			if(event == EV_MP_HOMED)
-				return ST_MP_SWITCH_MODE_PP;
-			break;
-
-		case ST_MP_SWITCH_MODE_PP:
-			if(event == EV_MP_MODE_PP)
-				return ST_MP_PP_IDLE;
-			break;
-
-		case ST_MP_HH_HOMING:
-			if(event == EV_MP_HOMED)
-				return ST_MP_SWITCH_MODE_PP;
-			break;
-
-		case ST_MP_PP_IDLE:
-			if(event == EV_MP_SETPOINT_SET)
-				return ST_MP_PP_SP_NACK;
-			#ifdef DIRTY_SINUSOID
-			if(event == EV_MP_SINUSOID_START)
-				return ST_MP_SWITCH_MODE_IP;
-			#endif
-			break;
-
-		case ST_MP_PP_SP_NACK:
-			if(event == EV_MP_SETPOINT_ACK)
-				return ST_MP_PP_SP_ACK;
-			break;
-
-		case ST_MP_PP_SP_ACK:
-			if(event == EV_MP_SETPOINT_NACK)
-				return ST_MP_PP_IDLE;
-			break;
-
-		#ifdef DIRTY_SINUSOID
-		case ST_MP_SWITCH_MODE_IP:
-			if(event == EV_MP_MODE_IP)
-				return ST_MP_IP_SINUSOID;
-			break;
-
-		case ST_MP_IP_SINUSOID:
-			if(event == EV_MP_SINUSOID_STOP)
-				return ST_MP_IP_SINUSOID_STOP;
-			break;
-
-		case ST_MP_IP_SINUSOID_STOP:
-			if(event == EV_MP_TARGET_REACHED)
-				return ST_MP_SWITCH_MODE_PP;
-			break;
-		#endif
-	}
-
-	return machine->state;
+	return mch_sdo_queue_write_with_class(machine->mch_sdo, OB_CONTROL_WORD, 0x00, control_word, 0x02, SDO_CLASS_MOTION);
+	#endif
 }
 
 
 void mch_mp_on_enter(mch_mp_t *machine)
 {
 	switch(machine->state) {
+		case ST_MP_HH_UNKNOWN:
+		case ST_MP_PP_IDLE:
+			// Adopted by a warm attach, the control word left by the
+			//  previous client is not known. Enable operation with the
+			//  set-point bit (4, interpolation in IP mode) cleared and
+			//  change set immediately (5), as after a handshake.
+			//  PP_SP_ACK writes the same on entry.
+			if(machine->attaching)
+				mch_mp_send_control_word(machine, 0x0F | 0x20);
+			break;
+
 		case ST_MP_SWITCH_MODE_HOMING:
 			mch_mp_send_mode_switch(machine, 0x06);
 			break;
 
 		case ST_MP_SWITCH_MODE_PP:
+			// Stream stopped, disable interpolation and hold position.
+			//  Not on the way to DISABLED, that would follow the control
+			//  word of the ds machine.
+			if(machine->streaming)
+				mch_mp_send_control_word(machine, 0x0F);
 			mch_mp_send_mode_switch(machine, 0x01);
 			break;
 
@@ -111,9 +81,29 @@ void mch_mp_on_enter(mch_mp_t *machine)
 			mch_mp_send_control_word(machine, 0x1F | 0x20);
 			break;
 
+		case ST_MP_PP_SP_NACK:
+			// Set-point not acknowledged in time, trigger again. The
+			//  first trigger was sent by sled_profile_execute().
+			if(machine->reentries > 0)
+				mch_mp_send_motion_task(machine, machine->motion_task, 0x1F | 0x20);
+			break;
+
 		case ST_MP_PP_SP_ACK:
 			// Setpoint has been acknowledged, reset new_setpoint.
+			#ifdef RPDO_MOTION_TRIGGER
+			mch_mp_send_motion_task(machine, machine->motion_task, 0x0F | 0x20);
+			#else
 			mch_mp_send_control_word(machine, 0x0F | 0x20);
+			#endif
+			break;
+
+		case ST_MP_SWITCH_MODE_IP_STREAM:
+			mch_mp_send_mode_switch(machine, 0x07);
+			break;
+
+		case ST_MP_IP_STREAM:
+			// Enable interpolation, drive follows set-points on SYNC.
+			mch_mp_send_control_word(machine, 0x1F);
 			break;
 
 		#ifdef DIRTY_SINUSOID
@@ -122,10 +112,16 @@ void mch_mp_on_enter(mch_mp_t *machine)
 			break;
 
 		case ST_MP_IP_SINUSOID:
-			mch_sdo_queue_write(machine->mch_sdo, OB_DPRVAR_WO, DPRVAR(10), 0x01, 0x04);
+			mch_sdo_queue_ordered_write(machine->mch_sdo, OB_DPRVAR_WO, DPRVAR(10), 0x01, 0x04);
 			break;
 		#endif
 	}
+
+	// Adopted states follow ATTACH, or the switch out of a stream
+	//  left by the previous client
+	machine->attaching = machine->state == ST_MP_ATTACH ||
+		(machine->attaching && machine->state == ST_MP_SWITCH_MODE_PP);
+	machine->streaming = machine->state == ST_MP_IP_STREAM;
 }
 
 
@@ -139,7 +135,7 @@ void mch_mp_on_exit(mch_mp_t *machine)
 
 		#ifdef DIRTY_SINUSOID
 		case ST_MP_IP_SINUSOID:
-			mch_sdo_queue_write(machine->mch_sdo, OB_DPRVAR_WO, DPRVAR(10), 0x00, 0x04);
+			mch_sdo_queue_ordered_write(machine->mch_sdo, OB_DPRVAR_WO, DPRVAR(10), 0x00, 0x04);
 			break;
 		#endif
 	}
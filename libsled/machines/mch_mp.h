@@ -12,4 +12,6 @@
 #include "machine_header.h"
 #include "mch_mp_def.h"
 
+int mch_mp_send_motion_task(mch_mp_t *machine, uint16_t motion_task, uint16_t control_word);
+
 #endif
@@ -4,6 +4,7 @@
 
 BEGIN_STATES
 	STATE(ST_MP_DISABLED)
+	STATE(ST_MP_ATTACH)
 
 	STATE(ST_MP_SWITCH_MODE_HOMING)
 	STATE(ST_MP_HH_UNKNOWN)
@@ -14,15 +15,22 @@ BEGIN_STATES
 	STATE(ST_MP_PP_SP_NACK)
 	STATE(ST_MP_PP_SP_ACK)
 
+	// Set-point streaming (sled_stream.cc)
+	STATE(ST_MP_SWITCH_MODE_IP_STREAM)
+	STATE(ST_MP_IP_STREAM)
+
 	// Only for dirty sinusoid
+	#ifdef DIRTY_SINUSOID
 	STATE(ST_MP_SWITCH_MODE_IP)
 	STATE(ST_MP_IP_SINUSOID)
 	STATE(ST_MP_IP_SINUSOID_STOP)
+	#endif
 END_STATES
 
 BEGIN_EVENTS
 	EVENT(EV_MP_DS_OPERATIONAL)		// From DS machine (mch_ds.cc)
 	EVENT(EV_MP_DS_INOPERATIONAL)	// From DS machine (mch_ds.cc)
+	EVENT(EV_MP_DS_ATTACHED)		// From DS machine, drive adopted as is
 
 	EVENT(EV_MP_MODE_HOMING)
 	EVENT(EV_MP_MODE_PP)
@@ -36,14 +44,97 @@ BEGIN_EVENTS
 	EVENT(EV_MP_SETPOINT_NACK)
 	EVENT(EV_MP_TARGET_REACHED)
 
+	EVENT(EV_MP_STREAM_START)		// From sled_rt_stream_start()
+	EVENT(EV_MP_STREAM_STOP)		// From sled_rt_stream_stop()
+
+	EVENT(EV_MP_TIMEOUT)			// Internal, state not left in time
+
 	// Only for dirty sinusoid
+	#ifdef DIRTY_SINUSOID
 	EVENT(EV_MP_SINUSOID_START)
 	EVENT(EV_MP_SINUSOID_STOP)
+	#endif
 END_EVENTS
 
+BEGIN_TRANSITIONS
+	TRANSITION_ANY_BUT(ST_MP_DISABLED, EV_MP_DS_INOPERATIONAL, ST_MP_DISABLED)
+
+	TRANSITION(ST_MP_DISABLED, EV_MP_DS_OPERATIONAL, ST_MP_SWITCH_MODE_HOMING)
+	TRANSITION(ST_MP_DISABLED, EV_MP_DS_ATTACHED, ST_MP_ATTACH)
+
+	// Warm attach: profile position mode is only entered once homed,
+	//  and a stream left by the previous client is stopped. Without a
+	//  known mode, homing is checked as above.
+	TRANSITION(ST_MP_ATTACH, EV_MP_SETPOINT_NACK, ST_MP_PP_IDLE)
+	TRANSITION(ST_MP_ATTACH, EV_MP_SETPOINT_ACK, ST_MP_PP_SP_ACK)
+	TRANSITION(ST_MP_ATTACH, EV_MP_MODE_HOMING, ST_MP_HH_UNKNOWN)
+	TRANSITION(ST_MP_ATTACH, EV_MP_MODE_IP, ST_MP_SWITCH_MODE_PP)
+	TRANSITION(ST_MP_ATTACH, EV_MP_TIMEOUT, ST_MP_SWITCH_MODE_HOMING)
+
+	TRANSITION(ST_MP_SWITCH_MODE_HOMING, EV_MP_MODE_HOMING, ST_MP_HH_UNKNOWN)
+	TRANSITION(ST_MP_HH_UNKNOWN, EV_MP_NOTHOMED, ST_MP_HH_HOMING)
+	TRANSITION(ST_MP_HH_UNKNOWN, EV_MP_HOMED, ST_MP_SWITCH_MODE_PP)
+	TRANSITION(ST_MP_HH_HOMING, EV_MP_HOMED, ST_MP_SWITCH_MODE_PP)
+
+	TRANSITION(ST_MP_SWITCH_MODE_PP, EV_MP_MODE_PP, ST_MP_PP_IDLE)
+	TRANSITION(ST_MP_PP_IDLE, EV_MP_SETPOINT_SET, ST_MP_PP_SP_NACK)
+	TRANSITION(ST_MP_PP_SP_NACK, EV_MP_SETPOINT_ACK, ST_MP_PP_SP_ACK)
+	TRANSITION(ST_MP_PP_SP_ACK, EV_MP_SETPOINT_NACK, ST_MP_PP_IDLE)
+
+	TRANSITION(ST_MP_PP_IDLE, EV_MP_STREAM_START, ST_MP_SWITCH_MODE_IP_STREAM)
+	TRANSITION(ST_MP_SWITCH_MODE_IP_STREAM, EV_MP_MODE_IP, ST_MP_IP_STREAM)
+	TRANSITION(ST_MP_SWITCH_MODE_IP_STREAM, EV_MP_STREAM_STOP, ST_MP_SWITCH_MODE_PP)
+	TRANSITION(ST_MP_IP_STREAM, EV_MP_STREAM_STOP, ST_MP_SWITCH_MODE_PP)
+
+	#ifdef DIRTY_SINUSOID
+	TRANSITION(ST_MP_PP_IDLE, EV_MP_SINUSOID_START, ST_MP_SWITCH_MODE_IP)
+	TRANSITION(ST_MP_SWITCH_MODE_IP, EV_MP_MODE_IP, ST_MP_IP_SINUSOID)
+	TRANSITION(ST_MP_IP_SINUSOID, EV_MP_SINUSOID_STOP, ST_MP_IP_SINUSOID_STOP)
+	TRANSITION(ST_MP_IP_SINUSOID_STOP, EV_MP_TARGET_REACHED, ST_MP_SWITCH_MODE_PP)
+	#else
+	TRANSITION_IGNORE(EV_MP_TARGET_REACHED)
+	#endif
+
+	// Mode switches and set-point handshakes of which no effect
+	//  was seen are sent again
+	TRANSITION(ST_MP_SWITCH_MODE_HOMING, EV_MP_TIMEOUT, ST_MP_SWITCH_MODE_HOMING)
+	TRANSITION(ST_MP_SWITCH_MODE_PP, EV_MP_TIMEOUT, ST_MP_SWITCH_MODE_PP)
+	TRANSITION(ST_MP_SWITCH_MODE_IP_STREAM, EV_MP_TIMEOUT, ST_MP_SWITCH_MODE_IP_STREAM)
+	TRANSITION(ST_MP_PP_SP_NACK, EV_MP_TIMEOUT, ST_MP_PP_SP_NACK)
+	TRANSITION(ST_MP_PP_SP_ACK, EV_MP_TIMEOUT, ST_MP_PP_SP_ACK)
+	#ifdef DIRTY_SINUSOID
+	TRANSITION(ST_MP_SWITCH_MODE_IP, EV_MP_TIMEOUT, ST_MP_SWITCH_MODE_IP)
+	#endif
+END_TRANSITIONS
+
+// Status words are sent at least every 10 ms (TPDO1)
+BEGIN_TIMEOUTS
+	STATE_TIMEOUT(ST_MP_ATTACH, 0.1, EV_MP_TIMEOUT)
+	STATE_TIMEOUT(ST_MP_SWITCH_MODE_HOMING, 0.1, EV_MP_TIMEOUT)
+	STATE_TIMEOUT(ST_MP_SWITCH_MODE_PP, 0.1, EV_MP_TIMEOUT)
+	STATE_TIMEOUT(ST_MP_SWITCH_MODE_IP_STREAM, 0.1, EV_MP_TIMEOUT)
+	STATE_TIMEOUT(ST_MP_PP_SP_NACK, 0.1, EV_MP_TIMEOUT)
+	STATE_TIMEOUT(ST_MP_PP_SP_ACK, 0.1, EV_MP_TIMEOUT)
+	#ifdef DIRTY_SINUSOID
+	STATE_TIMEOUT(ST_MP_SWITCH_MODE_IP, 0.1, EV_MP_TIMEOUT)
+	#endif
+END_TIMEOUTS
+
 BEGIN_FIELDS
 	FIELD(intf_t *, interface)
 	FIELD(mch_sdo_t *, mch_sdo)
+
+	// Motion task last started
+	FIELD_DECL(uint16_t, motion_task)
+	FIELD_INIT(motion_task, 0)
+
+	// Warm attach in progress, the control word is not yet known
+	FIELD_DECL(bool, attaching)
+	FIELD_INIT(attaching, false)
+
+	// In IP_STREAM or just left it, interpolation is still enabled
+	FIELD_DECL(bool, streaming)
+	FIELD_INIT(streaming, false)
 END_FIELDS
 
 BEGIN_CALLBACKS
@@ -3,13 +3,159 @@
 #include "mch_net.h"
 #include "mch_sdo.h"
 
+#include <assert.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <syslog.h>
 
 #define MACHINE_FILE() "mch_net_def.h"
 #include "machine_body.h"
 
 
+#define MISMATCH_MAPPING 0x01
+
+// Communication parameters: COB-ID, transmission type, inhibit time
+//  and event timer. Only the transmission type applies to RPDOs.
+static const uint8_t mch_net_comm_subindices[] = {0x01, 0x02, 0x03, 0x05};
+
+
+static uint16_t mch_net_comm_index(const mch_net_pdo_t *pdo)
+{
+	return (pdo->transmit ? 0x1800 : 0x1400) + pdo->number - 1;
+}
+
+
+static uint16_t mch_net_mapping_index(const mch_net_pdo_t *pdo)
+{
+	return (pdo->transmit ? 0x1A00 : 0x1600) + pdo->number - 1;
+}
+
+
+/**
+ * Desired value and size of a communication parameter, returns false
+ * if the parameter is not configured for this PDO.
+ */
+static bool mch_net_comm_value(mch_net_t *mch_net, const mch_net_pdo_t *pdo, uint8_t subindex,
+	uint32_t *value, uint8_t *size)
+{
+	if(!pdo->transmit && subindex != 0x02)
+		return false;
+
+	switch(subindex) {
+		case 0x01:
+			*value = 0x40000000 | COB_ID(FC_TPDO1 + 2 * (pdo->number - 1), INTF_NODE_ID);
+			*size = 0x04;
+			return true;
+
+		case 0x02:
+			*value = pdo->type;
+			if(pdo->transmit && pdo->number == 2 && mch_net->tpdo2_sync)
+				*value = 0x01;
+			*size = 0x01;
+			return true;
+
+		case 0x03:
+			*value = pdo->inhibit;
+			*size = 0x02;
+			return true;
+
+		case 0x05:
+			*value = pdo->event_timer;
+			*size = 0x02;
+			return true;
+	}
+
+	return false;
+}
+
+
+/**
+ * Compares a value read back with the configuration and marks the
+ * PDO it belongs to when it differs.
+ */
+static void mch_net_verify_value(mch_net_t *mch_net, uint16_t index, uint8_t subindex, uint32_t value, bool valid)
+{
+	for(int i = 0; i < mch_net->num_pdos; i++) {
+		const mch_net_pdo_t *pdo = &(mch_net->pdos[i]);
+
+		if(index == mch_net_mapping_index(pdo)) {
+			uint32_t expected = subindex ? pdo->entries[subindex - 1].object : pdo->count;
+			uint32_t mask = subindex ? 0xFFFFFFFF : 0xFF;
+
+			if(!valid || (value & mask) != expected)
+				mch_net->mismatch[i] |= MISMATCH_MAPPING;
+			return;
+		}
+
+		if(index == mch_net_comm_index(pdo)) {
+			uint32_t expected;
+			uint8_t size;
+
+			if(!mch_net_comm_value(mch_net, pdo, subindex, &expected, &size))
+				return;
+
+			uint32_t mask = size == 0x04 ? 0xFFFFFFFF : (1u << (8 * size)) - 1;
+
+			// The RTR bit of the COB-ID is not supported by every drive
+			if(subindex == 0x01)
+				mask &= ~0x40000000;
+
+			if(!valid || (value & mask) != (expected & mask))
+				mch_net->mismatch[i] |= 1 << subindex;
+			return;
+		}
+	}
+}
+
+
+static void mch_net_verify_done(mch_net_t *mch_net)
+{
+	if(--mch_net->config_pending > 0)
+		return;
+
+	for(int i = 0; i < mch_net->num_pdos; i++) {
+		if(mch_net->mismatch[i]) {
+			mch_net_handle_event(mch_net, EV_NET_CONFIG_DIFFERS);
+			return;
+		}
+	}
+
+	mch_net_handle_event(mch_net, EV_NET_CONFIG_MATCH);
+}
+
+
+static bool mch_net_verifying(mch_net_t *mch_net)
+{
+	return mch_net->state == ST_NET_VERIFYCONFIG || mch_net->state == ST_NET_VERIFYOPERATIONAL;
+}
+
+
+void mch_net_sdo_read_callback(void *data, uint16_t index, uint8_t subindex, uint32_t value)
+{
+	mch_net_t *machine = (mch_net_t *) data;
+
+	// Reads dropped on leaving pre-operational are of no interest
+	if(!mch_net_verifying(machine))
+		return;
+
+	mch_net_verify_value(machine, index, subindex, value, true);
+	mch_net_verify_done(machine);
+}
+
+
+void mch_net_sdo_read_abort_callback(void *data, uint16_t index, uint8_t subindex, uint32_t abort)
+{
+	mch_net_t *machine = (mch_net_t *) data;
+
+	if(!mch_net_verifying(machine))
+		return;
+
+	// Objects that could not be read are written
+	mch_net_verify_value(machine, index, subindex, 0, false);
+	mch_net_verify_done(machine);
+}
+
+
 void mch_net_sdo_abort_callback(void *data, uint16_t index, uint8_t subindex, uint32_t abort)
 {
 	fprintf(stderr, "Error while uploading configuration (SDO index %04x:%02x abort code %04x).\n", index, subindex, abort);
@@ -17,144 +163,247 @@ void mch_net_sdo_abort_callback(void *data, uint16_t index, uint8_t subindex, ui
 }
 
 
+static void mch_net_upload_done(mch_net_t *mch_net)
+{
+	if(--mch_net->config_pending == 0)
+		mch_net_handle_event(mch_net, EV_NET_UPLOAD_COMPLETE);
+}
+
+
 void mch_net_sdo_write_callback(void *data, uint16_t index, uint8_t subindex)
 {
 	mch_net_t *machine = (mch_net_t *) data;
-	mch_net_handle_event(machine, EV_NET_UPLOAD_COMPLETE);
+
+	if(machine->state != ST_NET_UPLOADCONFIG)
+		return;
+
+	mch_net_upload_done(machine);
 }
 
 
-#define ENQUEUE(final, index, subindex, value, size) \
-	mch_sdo_queue_write_with_cb( \
-		mch_sdo, index, subindex, value, size, \
-		final?mch_net_sdo_write_callback:NULL, mch_net_sdo_abort_callback, (void *) mch_net);
+static void mch_net_enqueue_read(mch_net_t *mch_net, mch_sdo_t *mch_sdo, uint16_t index, uint8_t subindex)
+{
+	mch_net->config_pending++;
+	mch_net->config_reads++;
+
+	mch_sdo_queue_read_with_cb(mch_sdo, index, subindex,
+		mch_net_sdo_read_callback, mch_net_sdo_read_abort_callback, (void *) mch_net);
+}
+
+
+static void mch_net_enqueue_write(mch_net_t *mch_net, mch_sdo_t *mch_sdo,
+	uint16_t index, uint8_t subindex, uint32_t value, uint8_t size)
+{
+	mch_net->config_pending++;
+	mch_net->config_writes++;
+
+	mch_sdo_queue_write_with_cb(mch_sdo, index, subindex, value, size,
+		mch_net_sdo_write_callback, mch_net_sdo_abort_callback, (void *) mch_net);
+}
+
 
 /**
- * Enqueue controller configuration for transmission.
+ * Enqueue reads of all objects of the PDO map set with
+ * mch_net_set_pdo_map() in a single batch, such that they are
+ * pipelined up to the SDO window. Once all are answered either
+ * EV_NET_CONFIG_MATCH or EV_NET_CONFIG_DIFFERS is raised.
+ *
+ * @param mch_sdo  SDO state machine that owns the queue.
+ */
+void mch_net_queue_verify(mch_net_t *mch_net, mch_sdo_t *mch_sdo)
+{
+	assert(mch_net->num_pdos > 0);
+
+	// Held while queueing, rejected reads complete at once
+	mch_net->config_pending = 1;
+	mch_net->config_reads = 0;
+
+	// Nothing to read back from a drive that just booted
+	if(mch_net->booted) {
+		for(int i = 0; i < mch_net->num_pdos; i++)
+			mch_net->mismatch[i] = 0xFF;
+
+		mch_net->booted = false;
+		mch_net_verify_done(mch_net);
+		return;
+	}
+
+	for(int i = 0; i < mch_net->num_pdos; i++) {
+		const mch_net_pdo_t *pdo = &(mch_net->pdos[i]);
+		uint16_t mapping = mch_net_mapping_index(pdo);
+
+		mch_net->mismatch[i] = 0;
+
+		mch_net_enqueue_read(mch_net, mch_sdo, mapping, 0x00);
+
+		for(int j = 0; j < pdo->count; j++)
+			mch_net_enqueue_read(mch_net, mch_sdo, mapping, j + 1);
+
+		for(size_t j = 0; j < sizeof(mch_net_comm_subindices); j++) {
+			uint32_t value;
+			uint8_t size;
+
+			if(mch_net_comm_value(mch_net, pdo, mch_net_comm_subindices[j], &value, &size))
+				mch_net_enqueue_read(mch_net, mch_sdo, mch_net_comm_index(pdo), mch_net_comm_subindices[j]);
+		}
+	}
+
+	mch_net_verify_done(mch_net);
+}
+
+
+/**
+ * Enqueue the controller configuration that differs from what was
+ * read back by mch_net_queue_verify(). EV_NET_UPLOAD_COMPLETE is
+ * raised once all writes are acknowledged, or at once when the
+ * configuration matches.
  *
  * @param mch_sdo  SDO state machine that owns the queue.
  */
 void mch_net_queue_setup(mch_net_t *mch_net, mch_sdo_t *mch_sdo)
 {
-	// Setup TPDO1
-	ENQUEUE(0, 0x1A00, 0x00, 0x00, 0x01);
-	ENQUEUE(0, 0x1A00, 0x01, 0x60410010, 0x04);	// Status word
-	ENQUEUE(0, 0x1A00, 0x02, 0x60610008, 0x04);	// Mode of operation
-	ENQUEUE(0, 0x1A00, 0x00, 0x02, 0x01);
+	assert(mch_net->num_pdos > 0);
+
+	// Held while queueing, like mch_net_queue_verify()
+	mch_net->config_pending = 1;
+	mch_net->config_writes = 0;
+
+	for(int i = 0; i < mch_net->num_pdos; i++) {
+		const mch_net_pdo_t *pdo = &(mch_net->pdos[i]);
+
+		if(mch_net->mismatch[i] & MISMATCH_MAPPING) {
+			uint16_t mapping = mch_net_mapping_index(pdo);
+
+			// Mapping can only be changed while disabled (no entries)
+			mch_net_enqueue_write(mch_net, mch_sdo, mapping, 0x00, 0x00, 0x01);
+
+			for(int j = 0; j < pdo->count; j++)
+				mch_net_enqueue_write(mch_net, mch_sdo, mapping, j + 1, pdo->entries[j].object, 0x04);
 
-	ENQUEUE(0, 0x1800, 0x01, 0x40000181, 0x04);
-	ENQUEUE(0, 0x1800, 0x02, 0xFF, 0x01);			// Event triggered
-	ENQUEUE(0, 0x1800, 0x03, 0x0A, 0x02);			// Inhibit timer
-	ENQUEUE(0, 0x1800, 0x05, 0x0A, 0x02);			// Event timer
+			if(pdo->count)
+				mch_net_enqueue_write(mch_net, mch_sdo, mapping, 0x00, pdo->count, 0x01);
+		}
 
-	// Setup TPDO2
-	ENQUEUE(0, 0x1A01, 0x00, 0x00, 0x01);
-	ENQUEUE(0, 0x1A01, 0x01, 0x60640020, 0x04);	// Position
-	ENQUEUE(0, 0x1A01, 0x02, 0x606C0020, 0x04);	// Velocity
-	ENQUEUE(0, 0x1A01, 0x00, 0x02, 0x01);
+		for(size_t j = 0; j < sizeof(mch_net_comm_subindices); j++) {
+			uint8_t subindex = mch_net_comm_subindices[j];
+			uint32_t value;
+			uint8_t size;
 
-	ENQUEUE(0, 0x1801, 0x01, 0x40000281, 0x04);
-	ENQUEUE(0, 0x1801, 0x02, 0xFF, 0x01);			// On change (should be sync or timer?)
-	ENQUEUE(0, 0x1801, 0x03, 0x0A, 0x02);
-	ENQUEUE(0, 0x1801, 0x05, 0x0A, 0x02);
+			if(!(mch_net->mismatch[i] & (1 << subindex)))
+				continue;
 
-	// Setup RPDO2 for IP mode
-	ENQUEUE(0, 0x1601, 0x00, 0x00, 0x01);
-	ENQUEUE(0, 0x1601, 0x01, 0x60C10120, 0x04);
-	ENQUEUE(0, 0x1601, 0x00, 0x01, 0x01);
+			if(mch_net_comm_value(mch_net, pdo, subindex, &value, &size))
+				mch_net_enqueue_write(mch_net, mch_sdo, mch_net_comm_index(pdo), subindex, value, size);
+		}
+	}
 
-	ENQUEUE(0, 0x1401, 0x02, 0x01, 0x01);			// Every sync
+	syslog(LOG_INFO, "%s() %d of %d PDO configuration objects written",
+		__FUNCTION__, mch_net->config_writes, mch_net->config_reads);
 
-	// Disable TPDO 3 and 4
-	ENQUEUE(0, 0x1A02, 0x00, 0x00, 0x01);
-	ENQUEUE(0, 0x1802, 0x01, 0x40000381, 0x04);
-	
-	ENQUEUE(0, 0x1A03, 0x00, 0x00, 0x01);
-	ENQUEUE(1, 0x1803, 0x01, 0x40000481, 0x04);
+	mch_net_upload_done(mch_net);
 }
 
 
-mch_net_state_t mch_net_next_state_given_event(mch_net_t *machine, mch_net_event_t event)
+/**
+ * Set PDO map uploaded on configuration, the map is not copied.
+ */
+void mch_net_set_pdo_map(mch_net_t *mch_net, const mch_net_pdo_t *pdos, int count)
 {
-	//fprintf(stderr, "Received event: %s\n", mch_net_eventname(event));
+	assert(count <= MCH_NET_MAX_PDOS);
 
-	switch(machine->state) {
-		case ST_NET_DISABLED:
-			if(event == EV_NET_INTF_OPENED)
-				return ST_NET_UNKNOWN;
-			break;
+	mch_net->pdos = pdos;
+	mch_net->num_pdos = count;
+}
 
-		case ST_NET_UNKNOWN:
-			if(event == EV_NET_STOPPED)
-				return ST_NET_STOPPED;
-			if(event == EV_NET_PREOPERATIONAL)
-				return ST_NET_PREOPERATIONAL;
-
-			// This might seem counter-intuitive, but
-			// is to make sure the correct configuration 
-			// is uploaded before we accept the
-			// operational state.
-			if(event == EV_NET_OPERATIONAL)
-				return ST_NET_ENTERPREOPERATIONAL;
-			if(event == EV_NET_INTF_CLOSED)
-				return ST_NET_DISABLED;
-			break;	
 
-		case ST_NET_STOPPED:
-			if(event == EV_NET_INTF_CLOSED)
-				return ST_NET_DISABLED;
-			break;
+/**
+ * Select transmission of TPDO2 (position and velocity), either on
+ * every SYNC or on change. Takes effect immediately when operational,
+ * else when the configuration is uploaded.
+ */
+int mch_net_set_tpdo2_sync(mch_net_t *mch_net, bool sync)
+{
+	if(mch_net->tpdo2_sync == sync)
+		return 0;
 
-		case ST_NET_PREOPERATIONAL:
-			if(event == EV_NET_INTF_CLOSED)
-				return ST_NET_DISABLED;
-			if(event == EV_NET_UPLOAD_COMPLETE)
-				return ST_NET_STARTREMOTENODE;
-			if(event == EV_NET_STOPPED)
-				return ST_NET_UNKNOWN;
-			if(event == EV_NET_WATCHDOG_FAILED)
-				return ST_NET_UNKNOWN;
-			break;
+	mch_net->tpdo2_sync = sync;
 
-		case ST_NET_OPERATIONAL:
-			if(event == EV_NET_INTF_CLOSED)
-				return ST_NET_DISABLED;
-			if(event == EV_NET_STOPPED)
-				return ST_NET_UNKNOWN;
-			if(event == EV_NET_PREOPERATIONAL)
-				return ST_NET_UNKNOWN;
-			if(event == EV_NET_WATCHDOG_FAILED)
-				return ST_NET_UNKNOWN;
-			break;
+	if(mch_net->state != ST_NET_OPERATIONAL)
+		return 0;
 
-		case ST_NET_UPLOADCONFIG:
-			if(event == EV_NET_INTF_CLOSED)
-				return ST_NET_DISABLED;
-			if(event == EV_NET_UPLOAD_COMPLETE)
-				return ST_NET_STARTREMOTENODE;
-			break;
+	// Transmission type as the configuration upload would write it
+	for(int i = 0; i < mch_net->num_pdos; i++) {
+		const mch_net_pdo_t *pdo = &(mch_net->pdos[i]);
+		uint32_t value;
+		uint8_t size;
 
-		case ST_NET_STARTREMOTENODE:
-			if(event == EV_NET_INTF_CLOSED)
-				return ST_NET_DISABLED;
-			if(event == EV_NET_OPERATIONAL)
-				return ST_NET_OPERATIONAL;
-			break;
-      
-		case ST_NET_ENTERPREOPERATIONAL:
-			if(event == EV_NET_INTF_CLOSED)
-				return ST_NET_DISABLED;
-			if(event == EV_NET_PREOPERATIONAL)
-				return ST_NET_PREOPERATIONAL;
-			break;
+		if(!pdo->transmit || pdo->number != 2)
+			continue;
+
+		if(!mch_net_comm_value(mch_net, pdo, 0x02, &value, &size))
+			return -1;
+
+		return mch_sdo_queue_write(mch_net->mch_sdo, mch_net_comm_index(pdo), 0x02, value, size);
 	}
-  
-	return machine->state;
+
+	return 0;
+}
+
+
+bool mch_net_get_tpdo2_sync(mch_net_t *mch_net)
+{
+	return mch_net->tpdo2_sync;
+}
+
+
+/**
+ * Boot-up message of the drive received, its PDO configuration is
+ * reset to defaults and is written without reading it back first.
+ */
+void mch_net_on_boot_up(mch_net_t *mch_net)
+{
+	mch_net->booted = true;
+}
+
+
+/**
+ * Adopt a drive that is found operational when the interface opens,
+ * provided its PDO configuration matches. The drive is not reset and
+ * the DS402 and motion states it reports are taken over (sled.cc).
+ * Takes effect the next time the interface opens, or on the first
+ * NMT state seen if called directly after creation.
+ */
+void mch_net_set_warm_attach(mch_net_t *mch_net, bool warm_attach)
+{
+	mch_net->warm_attach = warm_attach;
+}
+
+
+/**
+ * Whether operational was entered by adopting the drive as it was.
+ */
+bool mch_net_is_attached(mch_net_t *mch_net)
+{
+	return mch_net->attached;
+}
+
+
+/**
+ * Number of PDO configuration objects read back and written by the
+ * last verification.
+ */
+void mch_net_get_config_counts(mch_net_t *mch_net, int *reads, int *writes)
+{
+	*reads = mch_net->config_reads;
+	*writes = mch_net->config_writes;
 }
 
 
 void mch_net_on_enter(mch_net_t *machine)
 {
+	if(machine->state != ST_NET_OPERATIONAL)
+		machine->attached = machine->state == ST_NET_VERIFYOPERATIONAL;
+
 	switch(machine->state) {
 		case ST_NET_DISABLED:
 			if(machine->sdos_disabled_handler)
@@ -179,10 +428,6 @@ void mch_net_on_enter(mch_net_t *machine)
 			intf_send_nmt_command(machine->interface, NMT_ENTERPREOPERATIONAL);
 			break;
 
-		case ST_NET_UPLOADCONFIG:
-			mch_net_queue_setup(machine, machine->mch_sdo);
-			break;
-
 		case ST_NET_OPERATIONAL:
 			if(machine->sdos_enabled_handler)
 				machine->sdos_enabled_handler(machine, machine->payload);
@@ -194,8 +439,37 @@ void mch_net_on_enter(mch_net_t *machine)
 			if(machine->sdos_enabled_handler)
 				machine->sdos_enabled_handler(machine, machine->payload);
 
-			mch_net_queue_setup(machine, machine->mch_sdo);
+			mch_net_handle_event(machine, EV_NET_SDOS_READY);
+			break;
+
+		case ST_NET_ATTACH:
+			if(!machine->warm_attach) {
+				mch_net_handle_event(machine, EV_NET_COLD_START);
+				break;
+			}
 
+			if(machine->sdos_enabled_handler)
+				machine->sdos_enabled_handler(machine, machine->payload);
+
+			mch_net_handle_event(machine, EV_NET_SDOS_READY);
+			break;
+
+		case ST_NET_VERIFYOPERATIONAL:
+			mch_net_queue_verify(machine, machine->mch_sdo);
+			break;
+
+		case ST_NET_VERIFYCONFIG:
+			mch_net_queue_verify(machine, machine->mch_sdo);
+			break;
+
+		case ST_NET_UPLOADCONFIG:
+			// Verification timed out, write everything
+			if(machine->config_pending > 0) {
+				for(int i = 0; i < machine->num_pdos; i++)
+					machine->mismatch[i] = 0xFF;
+			}
+
+			mch_net_queue_setup(machine, machine->mch_sdo);
 			break;
 	}
 }
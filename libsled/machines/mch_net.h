@@ -3,6 +3,33 @@
 
 #include "mch_sdo.h"
 
+/**
+ * PDO mapping entry, object is index << 16 | subindex << 8 | bits.
+ * Channel is the sled channel the value is decoded into, or -1 when
+ * the PDO is decoded by sled.cc itself.
+ */
+struct mch_net_pdo_entry_t {
+	uint32_t object;
+	int8_t channel;
+};
+
+#define MCH_NET_PDO_MAX_ENTRIES 4
+#define MCH_NET_MAX_PDOS 8			// Four receive and four transmit
+
+/**
+ * Configuration of a single PDO, uploaded when entering operational.
+ * Timers are in units of 100 us (inhibit) and 1 ms (event timer).
+ */
+struct mch_net_pdo_t {
+	bool transmit;
+	uint8_t number;				// 1 to 4
+	uint8_t type;				// Transmission type
+	uint16_t inhibit, event_timer;
+
+	int count;
+	mch_net_pdo_entry_t entries[MCH_NET_PDO_MAX_ENTRIES];
+};
+
 #undef PREFIX
 
 // Define machine prefix
@@ -11,4 +38,12 @@
 #include "machine_header.h"
 #include "mch_net_def.h"
 
+void mch_net_set_pdo_map(mch_net_t *mch_net, const mch_net_pdo_t *pdos, int count);
+int mch_net_set_tpdo2_sync(mch_net_t *mch_net, bool sync);
+bool mch_net_get_tpdo2_sync(mch_net_t *mch_net);
+void mch_net_on_boot_up(mch_net_t *mch_net);
+void mch_net_set_warm_attach(mch_net_t *mch_net, bool warm_attach);
+bool mch_net_is_attached(mch_net_t *mch_net);
+void mch_net_get_config_counts(mch_net_t *mch_net, int *reads, int *writes);
+
 #endif
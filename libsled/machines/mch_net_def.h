@@ -6,6 +6,10 @@ BEGIN_EVENTS
 	EVENT(EV_NET_INTF_OPENED)		// From interface machine (mch_intf.cc)
 	EVENT(EV_NET_INTF_CLOSED)		// From interface machine (mch_intf.cc)
 
+	EVENT(EV_NET_SDOS_READY)		// Internal, SDO machine enabled
+	EVENT(EV_NET_CONFIG_MATCH)		// Internal, configuration read back
+	EVENT(EV_NET_CONFIG_DIFFERS)	// Internal, configuration read back
+	EVENT(EV_NET_COLD_START)		// Internal, warm attach disabled
 	EVENT(EV_NET_UPLOAD_COMPLETE)	// Internal
 	EVENT(EV_NET_UPLOAD_FAILED)		// Internal
 
@@ -14,24 +18,133 @@ BEGIN_EVENTS
 	EVENT(EV_NET_PREOPERATIONAL)	// From CANOpen (interface.cc)
 
 	EVENT(EV_NET_WATCHDOG_FAILED)	// From sled.cc
+	EVENT(EV_NET_TIMEOUT)			// Internal, state not left in time
 END_EVENTS
 
 BEGIN_STATES
 	STATE(ST_NET_DISABLED)
 
+	STATE(ST_NET_OBSERVE)
 	STATE(ST_NET_UNKNOWN)
 	STATE(ST_NET_STOPPED)
 	STATE(ST_NET_PREOPERATIONAL)
 	STATE(ST_NET_OPERATIONAL)
 
 	STATE(ST_NET_ENTERPREOPERATIONAL)
+	STATE(ST_NET_VERIFYCONFIG)
 	STATE(ST_NET_UPLOADCONFIG)
 	STATE(ST_NET_STARTREMOTENODE)
+
+	// Warm attach to a drive that is already operational
+	STATE(ST_NET_ATTACH)
+	STATE(ST_NET_VERIFYOPERATIONAL)
 END_STATES
 
+BEGIN_TRANSITIONS
+	// The NMT state of the drive is observed before it is commanded
+	TRANSITION(ST_NET_DISABLED, EV_NET_INTF_OPENED, ST_NET_OBSERVE)
+	TRANSITION(ST_NET_OBSERVE, EV_NET_STOPPED, ST_NET_STOPPED)
+	TRANSITION(ST_NET_OBSERVE, EV_NET_PREOPERATIONAL, ST_NET_PREOPERATIONAL)
+	TRANSITION(ST_NET_OBSERVE, EV_NET_OPERATIONAL, ST_NET_ATTACH)
+	TRANSITION(ST_NET_OBSERVE, EV_NET_TIMEOUT, ST_NET_UNKNOWN)
+
+	// An operational drive of which the configuration matches is
+	//  adopted as is, otherwise it is reset as below.
+	TRANSITION(ST_NET_ATTACH, EV_NET_COLD_START, ST_NET_ENTERPREOPERATIONAL)
+	TRANSITION(ST_NET_ATTACH, EV_NET_SDOS_READY, ST_NET_VERIFYOPERATIONAL)
+	TRANSITION(ST_NET_VERIFYOPERATIONAL, EV_NET_CONFIG_MATCH, ST_NET_OPERATIONAL)
+	TRANSITION(ST_NET_VERIFYOPERATIONAL, EV_NET_CONFIG_DIFFERS, ST_NET_ENTERPREOPERATIONAL)
+	TRANSITION(ST_NET_VERIFYOPERATIONAL, EV_NET_STOPPED, ST_NET_UNKNOWN)
+	TRANSITION(ST_NET_VERIFYOPERATIONAL, EV_NET_PREOPERATIONAL, ST_NET_PREOPERATIONAL)
+	TRANSITION(ST_NET_VERIFYOPERATIONAL, EV_NET_WATCHDOG_FAILED, ST_NET_UNKNOWN)
+	TRANSITION(ST_NET_VERIFYOPERATIONAL, EV_NET_TIMEOUT, ST_NET_ENTERPREOPERATIONAL)
+
+	TRANSITION(ST_NET_UNKNOWN, EV_NET_STOPPED, ST_NET_STOPPED)
+	TRANSITION(ST_NET_UNKNOWN, EV_NET_PREOPERATIONAL, ST_NET_PREOPERATIONAL)
+
+	// This might seem counter-intuitive, but is to make sure the correct
+	// configuration is uploaded before we accept the operational state.
+	TRANSITION(ST_NET_UNKNOWN, EV_NET_OPERATIONAL, ST_NET_ENTERPREOPERATIONAL)
+	TRANSITION(ST_NET_ENTERPREOPERATIONAL, EV_NET_PREOPERATIONAL, ST_NET_PREOPERATIONAL)
+
+	TRANSITION(ST_NET_PREOPERATIONAL, EV_NET_STOPPED, ST_NET_UNKNOWN)
+	TRANSITION(ST_NET_PREOPERATIONAL, EV_NET_WATCHDOG_FAILED, ST_NET_UNKNOWN)
+
+	// The configuration is queued only after the SDO machine handled
+	//  the enable posted before, which clears its queue. It is read
+	//  back first, such that only objects that differ are written.
+	TRANSITION(ST_NET_PREOPERATIONAL, EV_NET_SDOS_READY, ST_NET_VERIFYCONFIG)
+	TRANSITION(ST_NET_VERIFYCONFIG, EV_NET_CONFIG_MATCH, ST_NET_UPLOADCONFIG)
+	TRANSITION(ST_NET_VERIFYCONFIG, EV_NET_CONFIG_DIFFERS, ST_NET_UPLOADCONFIG)
+	TRANSITION(ST_NET_VERIFYCONFIG, EV_NET_STOPPED, ST_NET_UNKNOWN)
+	TRANSITION(ST_NET_VERIFYCONFIG, EV_NET_WATCHDOG_FAILED, ST_NET_UNKNOWN)
+
+	// Read-backs that do not complete in time fall back to a full upload
+	TRANSITION(ST_NET_VERIFYCONFIG, EV_NET_TIMEOUT, ST_NET_UPLOADCONFIG)
+	TRANSITION(ST_NET_UPLOADCONFIG, EV_NET_UPLOAD_COMPLETE, ST_NET_STARTREMOTENODE)
+	TRANSITION(ST_NET_UPLOADCONFIG, EV_NET_STOPPED, ST_NET_UNKNOWN)
+	TRANSITION(ST_NET_UPLOADCONFIG, EV_NET_WATCHDOG_FAILED, ST_NET_UNKNOWN)
+
+	TRANSITION(ST_NET_STARTREMOTENODE, EV_NET_OPERATIONAL, ST_NET_OPERATIONAL)
+
+	TRANSITION(ST_NET_OPERATIONAL, EV_NET_STOPPED, ST_NET_UNKNOWN)
+	TRANSITION(ST_NET_OPERATIONAL, EV_NET_PREOPERATIONAL, ST_NET_UNKNOWN)
+	TRANSITION(ST_NET_OPERATIONAL, EV_NET_WATCHDOG_FAILED, ST_NET_UNKNOWN)
+
+	TRANSITION_ANY_BUT(ST_NET_DISABLED, EV_NET_INTF_CLOSED, ST_NET_DISABLED)
+
+	// Not raised at present
+	TRANSITION_IGNORE(EV_NET_UPLOAD_FAILED)
+
+	// NMT commands of which no effect was seen are sent again
+	TRANSITION(ST_NET_UNKNOWN, EV_NET_TIMEOUT, ST_NET_UNKNOWN)
+	TRANSITION(ST_NET_ENTERPREOPERATIONAL, EV_NET_TIMEOUT, ST_NET_ENTERPREOPERATIONAL)
+	TRANSITION(ST_NET_STARTREMOTENODE, EV_NET_TIMEOUT, ST_NET_STARTREMOTENODE)
+END_TRANSITIONS
+
+// The NMT state is only seen in the drive's heartbeat (100 ms)
+BEGIN_TIMEOUTS
+	STATE_TIMEOUT(ST_NET_OBSERVE, 0.25, EV_NET_TIMEOUT)
+	STATE_TIMEOUT(ST_NET_UNKNOWN, 0.25, EV_NET_TIMEOUT)
+	STATE_TIMEOUT(ST_NET_ENTERPREOPERATIONAL, 0.25, EV_NET_TIMEOUT)
+	STATE_TIMEOUT(ST_NET_STARTREMOTENODE, 0.25, EV_NET_TIMEOUT)
+
+	// Reading back the configuration, well over the SDO retries (mch_sdo.h)
+	STATE_TIMEOUT(ST_NET_VERIFYCONFIG, 2.0, EV_NET_TIMEOUT)
+	STATE_TIMEOUT(ST_NET_VERIFYOPERATIONAL, 2.0, EV_NET_TIMEOUT)
+END_TIMEOUTS
+
 BEGIN_FIELDS
 	FIELD(intf_t *, interface)
 	FIELD(mch_sdo_t *, mch_sdo)
+
+	// PDO configuration (sled_pdo.cc)
+	FIELD_DECL(const mch_net_pdo_t *, pdos)
+	FIELD_INIT(pdos, NULL)
+	FIELD_DECL(int, num_pdos)
+	FIELD_INIT(num_pdos, 0)
+
+	// Transmit TPDO2 on SYNC instead of on change
+	FIELD_DECL(bool, tpdo2_sync)
+	FIELD_INIT(tpdo2_sync, false)
+
+	// Adopt a drive found operational rather than resetting it, and
+	//  whether operational was entered that way.
+	FIELD_DECL(bool, warm_attach)
+	FIELD_INIT(warm_attach, false)
+	FIELD_DECL(bool, attached)
+	FIELD_INIT(attached, false)
+
+	// Verification: per PDO, bit 0 is set when the mapping differs
+	//  and bit n when communication parameter n differs.
+	FIELD_DECL(uint8_t, mismatch[MCH_NET_MAX_PDOS])
+	FIELD_DECL(bool, booted)		// Drive holds its defaults
+	FIELD_INIT(booted, false)
+	FIELD_DECL(int, config_pending)
+	FIELD_DECL(int, config_reads)
+	FIELD_INIT(config_reads, 0)
+	FIELD_DECL(int, config_writes)
+	FIELD_INIT(config_writes, 0)
 END_FIELDS
 
 BEGIN_CALLBACKS
@@ -1,15 +1,36 @@
 
 #include "../interface.h"
 #include "mch_sdo.h"
+#include "../sled_time.h"
+
+#include <event2/event.h>
 
 #include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
-
-#include <queue>
+#include <string.h>
+#include <time.h>
 
 
 struct sdo_t {
+	// Order of submission
+	uint32_t sequence;
+
+	// Priority class, SDOs of one class are sent and retired in order
+	uint8_t sdo_class;
+	double queued_time;
+
+	// Request sent, awaiting a response or retirement
+	bool sent;
+	bool retired;
+
+	// Never replaced by a later write to the same object
+	bool ordered;
+
+	// RPDO sent in order with the SDOs, value holds the data
+	bool is_pdo;
+	uint8_t function;
+
 	bool is_write;
 	uint16_t index;
 	uint8_t subindex;
@@ -20,6 +41,28 @@ struct sdo_t {
 	sdo_abort_callback_t abort_callback;
 	sdo_write_callback_t write_callback;
 	sdo_read_callback_t read_callback;
+
+	// Response received, value holds the result of a read
+	bool answered;
+	bool aborted;
+	uint32_t abort_code;
+
+	// Time of first transmission and response deadline
+	double sent_time;
+	double deadline;
+	int retries;
+};
+
+
+/**
+ * Responses expected for SDOs that were retransmitted, but
+ * answered in the meantime. These are discarded on arrival.
+ */
+struct sdo_duplicate_t {
+	uint16_t index;
+	uint8_t subindex;
+	int count;
+	double expires;
 };
 
 
@@ -27,6 +70,135 @@ struct sdo_t {
 #include "machine_body.h"
 
 
+void mch_sdo_read_callback(void *data, uint16_t index, uint8_t subindex, uint32_t value);
+void mch_sdo_write_callback(void *data, uint16_t index, uint8_t subindex);
+void mch_sdo_abort_callback(void *data, uint16_t index, uint8_t subindex, uint32_t code);
+static void mch_sdo_on_timeout(evutil_socket_t fd, short flags, void *param);
+static void mch_sdo_on_response(mch_sdo_t *machine, mch_sdo_event_t event);
+static void mch_sdo_send_available(mch_sdo_t *machine);
+
+
+/**
+ * Handles an event the machine raises itself at once, also while the
+ * queue is drained. Whether SDOs are sent follows from the state, so it
+ * has to change before the next SDO is queued or answered, e.g. an
+ * abort must be seen in SENDING to stop the queue.
+ */
+static void mch_sdo_handle_internal_event(mch_sdo_t *machine, mch_sdo_event_t event)
+{
+	mch_sdo_dispatch_event(machine, event);
+}
+
+
+/**
+ * Returns statistics of SDOs to the given index, or NULL
+ * if statistics are already kept for SDO_MAX_INDICES others.
+ */
+static mch_sdo_index_stats_t *mch_sdo_index_stats(mch_sdo_t *machine, uint16_t index)
+{
+	int i = 0;
+	while(i < machine->num_stats && machine->stats[i].index < index)
+		i++;
+
+	if(i < machine->num_stats && machine->stats[i].index == index)
+		return &(machine->stats[i]);
+
+	if(machine->num_stats == SDO_MAX_INDICES)
+		return NULL;
+
+	// Keep table ordered by index
+	memmove(&(machine->stats[i + 1]), &(machine->stats[i]),
+		(machine->num_stats - i) * sizeof(mch_sdo_index_stats_t));
+	machine->num_stats++;
+
+	memset(&(machine->stats[i]), 0, sizeof(mch_sdo_index_stats_t));
+	machine->stats[i].index = index;
+
+	return &(machine->stats[i]);
+}
+
+
+/**
+ * Returns the i-th SDO in use, in order of submission.
+ */
+static sdo_t *mch_sdo_slot(mch_sdo_t *machine, int i)
+{
+	return &(machine->sdo_slots[(machine->sdo_head + i) % SDO_QUEUE_CAPACITY]);
+}
+
+
+static void mch_sdo_record_latency(mch_sdo_t *machine, uint16_t index, double latency)
+{
+	mch_sdo_index_stats_t *stats = mch_sdo_index_stats(machine, index);
+
+	if(!stats)
+		return;
+
+	int bucket = 0;
+	while(bucket < SDO_HISTOGRAM_BUCKETS - 1 && latency >= (1 << bucket) * SDO_HISTOGRAM_BASE)
+		bucket++;
+
+	stats->histogram[bucket]++;
+	stats->responses++;
+
+	if(latency > stats->max_latency)
+		stats->max_latency = latency;
+}
+
+
+/**
+ * Arms the timer for the earliest deadline of the SDOs
+ * awaiting a response, or disarms it if there are none.
+ */
+static void mch_sdo_schedule_timeout(mch_sdo_t *machine)
+{
+	if(!machine->ev_base)
+		return;
+
+	bool pending = false;
+	double deadline = 0.0;
+
+	for(int i = 0; i < machine->sdo_count; i++) {
+		sdo_t *sdo = mch_sdo_slot(machine, i);
+
+		if(sdo->retired || !sdo->sent || sdo->answered)
+			continue;
+
+		if(!pending || sdo->deadline < deadline)
+			deadline = sdo->deadline;
+		pending = true;
+	}
+
+	// SDOs to the object of a duplicate are held back until it expires
+	for(int i = 0; i < machine->num_duplicates; i++) {
+		if(!pending || machine->sdo_duplicates[i].expires < deadline)
+			deadline = machine->sdo_duplicates[i].expires;
+		pending = true;
+	}
+
+	if(!pending) {
+		if(machine->timeout_event)
+			event_del(machine->timeout_event);
+		return;
+	}
+
+	if(!machine->timeout_event) {
+		machine->timeout_event = event_new(machine->ev_base, -1, 0, mch_sdo_on_timeout, (void *) machine);
+		event_priority_set(machine->timeout_event, 0);
+	}
+
+	double delay = deadline - get_time();
+	if(delay < 0.0)
+		delay = 0.0;
+
+	timeval timeout;
+	timeout.tv_sec = time_t(delay);
+	timeout.tv_usec = suseconds_t((delay - timeout.tv_sec) * 1000000.0);
+
+	event_add(machine->timeout_event, &timeout);
+}
+
+
 const char *mch_sdo_abort_to_message(uint32_t code)
 {
 	switch(code) {
@@ -50,130 +222,603 @@ const char *mch_sdo_abort_to_message(uint32_t code)
 }
 
 
-void mch_sdo_read_callback(void *data, uint16_t index, uint8_t subindex, uint32_t value)
+/**
+ * Subscribes to the SDO responses of the node, before the first
+ * request is sent.
+ */
+static void mch_sdo_subscribe(mch_sdo_t *machine)
 {
-	assert(data);
+	if(machine->subscribed)
+		return;
 
-	// Unpack SDO
-	mch_sdo_t *machine = (mch_sdo_t *) data;
-	sdo_t *sdo = machine->sdo_active;
+	machine->sdo_client.write_callback = mch_sdo_write_callback;
+	machine->sdo_client.read_callback = mch_sdo_read_callback;
+	machine->sdo_client.abort_callback = mch_sdo_abort_callback;
+	machine->sdo_client.data = (void *) machine;
+
+	if(intf_subscribe_sdo(machine->interface, &(machine->sdo_client)) == 0)
+		machine->subscribed = true;
+}
 
-	assert(sdo);
-	assert(!sdo->is_write);
-	assert(machine->sdo_active->index == index);
-	assert(machine->sdo_active->subindex == subindex);
 
-	// Invoke callback
-	if(sdo->read_callback)
-		sdo->read_callback(sdo->data, index, subindex, value);
+void mch_sdo_send(mch_sdo_t *machine, sdo_t *sdo)
+{
+	if(sdo->is_pdo) {
+		intf_send_rpdo(machine->interface, sdo->function, sdo->value, sdo->size);
+		return;
+	}
 
-	// Free memory
-	delete sdo;
-	machine->sdo_active = NULL;
+	mch_sdo_subscribe(machine);
 
-	// Notify state machine
-	mch_sdo_handle_event(machine, EV_SDO_READ_RESPONSE);
+	if(sdo->is_write)
+		intf_send_write_req(machine->interface, sdo->index, sdo->subindex, sdo->value, sdo->size);
+	else
+		intf_send_read_req(machine->interface, sdo->index, sdo->subindex);
 }
 
 
-void mch_sdo_write_callback(void *data, uint16_t index, uint8_t subindex)
+/**
+ * Barriers depend on all preceding SDOs having completed, and all
+ * following SDOs depend on them (e.g. the motion task fields have to
+ * be written before a copy, the copy before execution). These are only
+ * sent when no other SDO is in flight.
+ *
+ * Writes to ordered objects act on every value written, rather than
+ * just the last one, and are never coalesced.
+ */
+#define SDO_POLICY_BARRIER	0x01
+#define SDO_POLICY_ORDERED	0x02
+
+/**
+ * Class and policy of an object. Motion tasks are staged in task 0
+ * and copied, so profile uploads share the class of the trigger that
+ * depends on them (profiles uploaded ahead of time are written in a
+ * lower class and promoted). Objects not listed are configuration.
+ */
+struct sdo_policy_t {
+	uint16_t index;
+	uint8_t sdo_class;
+	uint8_t flags;
+};
+
+static const sdo_policy_t mch_sdo_policies[] = {
+	{OB_CONTROL_WORD,		SDO_CLASS_SAFETY,	SDO_POLICY_BARRIER | SDO_POLICY_ORDERED},	// Transitions and new set-point are edge triggered
+	{0x3518,				SDO_CLASS_SAFETY,	0},		// Reading clears a fault
+	{0x6060,				SDO_CLASS_MOTION,	SDO_POLICY_BARRIER | SDO_POLICY_ORDERED},	// Mode of operation
+	{OB_COPY_MOTION_TASK,	SDO_CLASS_MOTION,	SDO_POLICY_BARRIER | SDO_POLICY_ORDERED},
+	{OB_MOTION_TASK,		SDO_CLASS_MOTION,	SDO_POLICY_BARRIER | SDO_POLICY_ORDERED},
+	{OB_O_MOVE,				SDO_CLASS_MOTION,	SDO_POLICY_ORDERED},
+	{OB_O_P,				SDO_CLASS_MOTION,	0},
+	{OB_O_V,				SDO_CLASS_MOTION,	0},
+	{OB_O_C,				SDO_CLASS_MOTION,	0},
+	{OB_O_ACC,				SDO_CLASS_MOTION,	0},
+	{OB_O_DEC,				SDO_CLASS_MOTION,	0},
+	{OB_O_TAB,				SDO_CLASS_MOTION,	0},
+	{OB_O_FN,				SDO_CLASS_MOTION,	0},
+	{OB_O_FT,				SDO_CLASS_MOTION,	0},
+	{OB_DPRVAR_WO,			SDO_CLASS_MOTION,	0},		// Sinusoid parameters
+	{OB_O_O1,				SDO_CLASS_BULK,		0},		// Lights
+	{OB_O_O2,				SDO_CLASS_BULK,		0},
+};
+
+
+static const sdo_policy_t *mch_sdo_find_policy(uint16_t index)
 {
-  assert(data);
+	for(size_t i = 0; i < sizeof(mch_sdo_policies) / sizeof(mch_sdo_policies[0]); i++)
+		if(mch_sdo_policies[i].index == index)
+			return &(mch_sdo_policies[i]);
 
-  // Unpack SDO
-  mch_sdo_t *machine = (mch_sdo_t *) data;
-  sdo_t *sdo = machine->sdo_active;
+	return NULL;
+}
 
-  assert(sdo);
-	assert(sdo->is_write);
-  assert(machine->sdo_active->index == index);
-  assert(machine->sdo_active->subindex == subindex);
 
-  // Invoke callback
-  if(sdo->write_callback)
-    sdo->write_callback(sdo->data, index, subindex);
+static uint8_t mch_sdo_policy(uint16_t index)
+{
+	const sdo_policy_t *policy = mch_sdo_find_policy(index);
+	return policy ? policy->flags : 0;
+}
 
-  // Free memory
-  delete sdo;
-  machine->sdo_active = NULL;
 
-  // Notify state machine
-	mch_sdo_handle_event(machine, EV_SDO_WRITE_RESPONSE);
+static uint8_t mch_sdo_default_class(uint16_t index)
+{
+	const sdo_policy_t *policy = mch_sdo_find_policy(index);
+	return policy ? policy->sdo_class : SDO_CLASS_CONFIGURATION;
 }
 
 
-void mch_sdo_abort_callback(void *data, uint16_t index, uint8_t subindex, uint32_t code)
+static bool mch_sdo_is_barrier(const sdo_t *sdo)
 {
-  assert(data);
+	return sdo->is_pdo || (mch_sdo_policy(sdo->index) & SDO_POLICY_BARRIER);
+}
 
-  // Unpack SDO
-  mch_sdo_t *machine = (mch_sdo_t *) data;
-  sdo_t *sdo = machine->sdo_active;
 
-  assert(sdo);
-  assert(machine->sdo_active->index == index);
-  assert(machine->sdo_active->subindex == subindex);
+/**
+ * Whether the SDO is a set-point trigger of the motion machine, which
+ * is held back while the DS402 machine commands the drive.
+ */
+static bool mch_sdo_is_trigger(const sdo_t *sdo)
+{
+	if(sdo->sdo_class != SDO_CLASS_MOTION)
+		return false;
 
-	fprintf(stderr, "%s SDO to %04x:%02x was aborted because: %s\n",
-		machine->sdo_active->is_write?"Write":"Read", index, subindex,
-		mch_sdo_abort_to_message(code));
+	return sdo->is_pdo ? sdo->function == FC_RPDO1 : (sdo->is_write && sdo->index == OB_CONTROL_WORD);
+}
+
+
+/**
+ * Invokes the callback of an SDO that is no longer in flight.
+ * An abort code of 0 indicates that the SDO was dropped.
+ */
+static void mch_sdo_retire(mch_sdo_t *machine, sdo_t *sdo)
+{
+	if(sdo->aborted || !sdo->answered) {
+		if(sdo->abort_callback)
+			sdo->abort_callback(sdo->data, sdo->index, sdo->subindex, sdo->abort_code);
+	} else if(sdo->is_write) {
+		if(sdo->write_callback)
+			sdo->write_callback(sdo->data, sdo->index, sdo->subindex);
+	} else {
+		if(sdo->read_callback)
+			sdo->read_callback(sdo->data, sdo->index, sdo->subindex, sdo->value);
+	}
+}
+
+
+/**
+ * Releases slots at the head of the ring that were retired.
+ */
+static void mch_sdo_release_retired(mch_sdo_t *machine)
+{
+	while(machine->sdo_count > 0 && mch_sdo_slot(machine, 0)->retired) {
+		machine->sdo_head = (machine->sdo_head + 1) % SDO_QUEUE_CAPACITY;
+		machine->sdo_count--;
+	}
+}
 
-  // Invoke callback
-  if(sdo->abort_callback)
-    sdo->abort_callback(sdo->data, index, subindex, code);
 
-  // Free memory
-  delete sdo;
-  machine->sdo_active = NULL;
+/**
+ * Retires an SDO and invokes its callback.
+ *
+ * The slot is released first, as the callback may queue new SDOs.
+ */
+static void mch_sdo_retire_slot(mch_sdo_t *machine, sdo_t *slot)
+{
+	sdo_t sdo = *slot;
+	slot->retired = true;
 
-  // Notify state machine
-	mch_sdo_handle_event(machine, EV_SDO_ABORT_RESPONSE);
+	if(!sdo.sent) {
+		machine->sdo_queued--;
+		machine->sdo_class_queued[sdo.sdo_class]--;
+	} else {
+		machine->sdo_sent--;
+		if(!sdo.answered)
+			machine->sdo_outstanding--;
+	}
+
+	mch_sdo_release_retired(machine);
+	mch_sdo_retire(machine, &sdo);
 }
 
 
-mch_sdo_state_t mch_sdo_next_state_given_event(mch_sdo_t *machine, mch_sdo_event_t event)
+/**
+ * Retires answered SDOs in the order they were submitted within their
+ * class, such that callbacks of a class observe the same order as
+ * without pipelining.
+ */
+static void mch_sdo_retire_answered(mch_sdo_t *machine)
 {
-	switch(machine->state) {
-		case ST_SDO_DISABLED:
-		case ST_SDO_ERROR:
-			if(event == EV_NET_SDO_ENABLED)
-				return ST_SDO_WAITING;
-			break;
+	bool retired = true;
 
-		case ST_SDO_WAITING:
-			if(event == EV_NET_SDO_DISABLED)
-				return ST_SDO_DISABLED;
-			if(event == EV_SDO_ITEM_AVAILABLE)
-				return ST_SDO_SENDING;
+	// Callbacks may change the queue, start over after each
+	while(retired) {
+		bool blocked[SDO_NUM_CLASSES] = {false};
+		retired = false;
+
+		for(int i = 0; i < machine->sdo_count; i++) {
+			sdo_t *sdo = mch_sdo_slot(machine, i);
+
+			if(sdo->retired || blocked[sdo->sdo_class])
+				continue;
+
+			// Not answered, or still has to be sent
+			if(!sdo->sent || !sdo->answered) {
+				blocked[sdo->sdo_class] = true;
+				continue;
+			}
+
+			mch_sdo_retire_slot(machine, sdo);
+			retired = true;
 			break;
+		}
+	}
+}
 
-		case ST_SDO_SENDING:
-			if(event == EV_NET_SDO_DISABLED)
-				return ST_SDO_DISABLED;
-			if(event == EV_SDO_READ_RESPONSE)
-				return ST_SDO_WAITING;
-			if(event == EV_SDO_WRITE_RESPONSE)
-				return ST_SDO_WAITING;
-			if(event == EV_SDO_ABORT_RESPONSE)
-				return ST_SDO_ERROR;
+
+/**
+ * Remembers that count more responses to an SDO may arrive.
+ * If the list is full, the entry that expires first is replaced.
+ */
+static void mch_sdo_add_duplicate(mch_sdo_t *machine, uint16_t index, uint8_t subindex, int count, double expires)
+{
+	sdo_duplicate_t *duplicate = &(machine->sdo_duplicates[0]);
+
+	if(machine->num_duplicates < SDO_MAX_DUPLICATES) {
+		duplicate = &(machine->sdo_duplicates[machine->num_duplicates++]);
+	} else {
+		for(int i = 1; i < SDO_MAX_DUPLICATES; i++)
+			if(machine->sdo_duplicates[i].expires < duplicate->expires)
+				duplicate = &(machine->sdo_duplicates[i]);
+	}
+
+	duplicate->index = index;
+	duplicate->subindex = subindex;
+	duplicate->count = count;
+	duplicate->expires = expires;
+}
+
+
+static void mch_sdo_remove_duplicate(mch_sdo_t *machine, int i)
+{
+	machine->sdo_duplicates[i] = machine->sdo_duplicates[--(machine->num_duplicates)];
+}
+
+
+/**
+ * Removes duplicates that expired.
+ *
+ * @return Whether any were removed.
+ */
+static bool mch_sdo_expire_duplicates(mch_sdo_t *machine, double now)
+{
+	bool removed = false;
+	int i = 0;
+
+	while(i < machine->num_duplicates) {
+		if(machine->sdo_duplicates[i].expires < now) {
+			mch_sdo_remove_duplicate(machine, i);
+			removed = true;
+		} else {
+			i++;
+		}
+	}
+
+	return removed;
+}
+
+
+/**
+ * Whether a response to an earlier, retransmitted SDO to the object may
+ * still arrive. It cannot be told apart from the response to a new SDO,
+ * because it is not known whether the request or the response was lost.
+ */
+static bool mch_sdo_duplicate_pending(mch_sdo_t *machine, uint16_t index, uint8_t subindex)
+{
+	for(int i = 0; i < machine->num_duplicates; i++)
+		if(machine->sdo_duplicates[i].index == index && machine->sdo_duplicates[i].subindex == subindex)
+			return true;
+
+	return false;
+}
+
+
+/**
+ * Records the response to an SDO in flight.
+ *
+ * @return SDO the response belongs to or NULL if it was unexpected.
+ */
+static sdo_t *mch_sdo_match_response(mch_sdo_t *machine, uint16_t index, uint8_t subindex)
+{
+	double now = get_time();
+
+	mch_sdo_expire_duplicates(machine, now);
+
+	// Discard second response to a retransmitted SDO, no new SDO to the
+	//  object was sent while one may still arrive
+	int i = 0;
+	while(i < machine->num_duplicates) {
+		sdo_duplicate_t *duplicate = &(machine->sdo_duplicates[i]);
+
+		if(duplicate->index == index && duplicate->subindex == subindex) {
+			syslog(LOG_DEBUG, "%s() discarding duplicate response for %04x:%02x", __FUNCTION__, index, subindex);
+
+			// Last one arrived, SDOs held back for the object may be sent
+			if(--(duplicate->count) == 0) {
+				mch_sdo_remove_duplicate(machine, i);
+
+				if(mch_sdo_active_state(machine) == ST_SDO_SENDING)
+					mch_sdo_send_available(machine);
+			}
+			return NULL;
+		}
+
+		i++;
+	}
+
+	for(int i = 0; i < machine->sdo_count; i++) {
+		sdo_t *sdo = mch_sdo_slot(machine, i);
+
+		if(!sdo->retired && sdo->sent && !sdo->answered && sdo->index == index && sdo->subindex == subindex) {
+			sdo->answered = true;
+			machine->sdo_outstanding--;
+
+			mch_sdo_record_latency(machine, index, now - sdo->sent_time);
+
+			if(sdo->retries > 0)
+				mch_sdo_add_duplicate(machine, index, subindex, sdo->retries, now + machine->timeout);
+
+			return sdo;
+		}
+	}
+
+	syslog(LOG_WARNING, "%s() unexpected response for %04x:%02x", __FUNCTION__, index, subindex);
+	return NULL;
+}
+
+
+/**
+ * Returns the oldest queued SDO of a class that may be sent, or
+ * NULL if there is none.
+ *
+ * An SDO may overtake older queued SDOs of its class, but never one
+ * for the same object index (e.g. the sub-indices of a PDO mapping) or
+ * a barrier. A barrier is sent once all older SDOs of its class have
+ * been answered and no other SDO is awaiting a response. No SDO is sent
+ * while a duplicate response to its object may arrive.
+ */
+static sdo_t *mch_sdo_next_in_class(mch_sdo_t *machine, uint8_t sdo_class)
+{
+	bool first = true;
+
+	for(int i = 0; i < machine->sdo_count; i++) {
+		sdo_t *sdo = mch_sdo_slot(machine, i);
+
+		if(sdo->retired || sdo->sent || sdo->sdo_class != sdo_class)
+			continue;
+
+		bool duplicate = !sdo->is_pdo && mch_sdo_duplicate_pending(machine, sdo->index, sdo->subindex);
+
+		if(mch_sdo_is_barrier(sdo))
+			return (first && machine->sdo_outstanding == 0 && !duplicate) ? sdo : NULL;
+
+		first = false;
+
+		// Older queued SDO of the class, or any unanswered SDO, to the same object
+		bool conflict = duplicate;
+
+		for(int j = 0; j < machine->sdo_count && !conflict; j++) {
+			sdo_t *other = mch_sdo_slot(machine, j);
+
+			if(other->retired || other->index != sdo->index)
+				continue;
+
+			if(!other->sent && j < i && other->sdo_class == sdo_class)
+				conflict = true;
+			if(other->sent && !other->answered)
+				conflict = true;
+		}
+
+		if(!conflict)
+			return sdo;
+	}
+
+	return NULL;
+}
+
+
+/**
+ * Sends queued SDOs until the window is full.
+ *
+ * Classes are served in strict priority: no SDO is sent while a class
+ * of higher priority has queued SDOs that have to wait.
+ */
+static void mch_sdo_send_available(mch_sdo_t *machine)
+{
+	bool pdo_sent = false;
+
+	while(machine->sdo_outstanding < machine->window && machine->sdo_queued > 0) {
+		// Nothing may be sent alongside a barrier
+		if(machine->sdo_outstanding > 0) {
+			bool barrier_in_flight = false;
+
+			for(int i = 0; i < machine->sdo_count; i++) {
+				sdo_t *sdo = mch_sdo_slot(machine, i);
+
+				if(!sdo->retired && sdo->sent && !sdo->answered && mch_sdo_is_barrier(sdo))
+					barrier_in_flight = true;
+			}
+
+			if(barrier_in_flight)
+				break;
+		}
+
+		sdo_t *next = NULL;
+
+		for(int c = 0; c < SDO_NUM_CLASSES && !next; c++) {
+			if(machine->sdo_class_queued[c] == 0)
+				continue;
+
+			next = mch_sdo_next_in_class(machine, c);
+
+			if(!next)
+				break;
+		}
+
+		if(!next)
 			break;
+
+		next->sent = true;
+		machine->sdo_queued--;
+		machine->sdo_class_queued[next->sdo_class]--;
+		machine->sdo_sent++;
+
+		// PDOs are not answered, they complete when sent
+		if(next->is_pdo) {
+			next->answered = true;
+			pdo_sent = true;
+		} else {
+			machine->sdo_outstanding++;
+		}
+
+		next->sent_time = get_time();
+		next->deadline = next->sent_time + machine->timeout;
+
+		// Time spent waiting in the queue
+		mch_sdo_class_stats_t *stats = &(machine->class_stats[next->sdo_class]);
+		double wait = next->sent_time - next->queued_time;
+
+		stats->sent++;
+		stats->total_wait += wait;
+		if(wait > stats->max_wait)
+			stats->max_wait = wait;
+
+		mch_sdo_send(machine, next);
 	}
 
-	return machine->state;
+	if(pdo_sent)
+		mch_sdo_on_response(machine, EV_SDO_WRITE_RESPONSE);
+	else
+		mch_sdo_schedule_timeout(machine);
 }
 
 
-void mch_sdo_send(mch_sdo_t *machine, sdo_t *sdo)
+/**
+ * Continues after a response: retires answered SDOs and either
+ * sends more or informs the state machine that all were answered.
+ */
+static void mch_sdo_on_response(mch_sdo_t *machine, mch_sdo_event_t event)
 {
-	if(sdo->is_write) {
-		intf_send_write_req(machine->interface,
-			sdo->index, sdo->subindex, sdo->value, sdo->size,
-			mch_sdo_write_callback, mch_sdo_abort_callback, (void *) machine);
-	} else {
-		intf_send_read_req(machine->interface,
-			sdo->index, sdo->subindex,
-			mch_sdo_read_callback, mch_sdo_abort_callback, (void *) machine);
+	mch_sdo_retire_answered(machine);
+
+	// No SDO sent that was not yet retired
+	if(machine->sdo_sent == 0)
+		mch_sdo_handle_internal_event(machine, event);
+	else if(mch_sdo_active_state(machine) == ST_SDO_SENDING)
+		mch_sdo_send_available(machine);
+
+	mch_sdo_schedule_timeout(machine);
+}
+
+
+/**
+ * Retransmits SDOs that passed their deadline, or aborts
+ * them if they have been retransmitted too often.
+ */
+static void mch_sdo_on_timeout(evutil_socket_t fd, short flags, void *param)
+{
+	mch_sdo_t *machine = (mch_sdo_t *) param;
+	double now = get_time();
+	bool expired = false;
+
+	for(int i = 0; i < machine->sdo_count; i++) {
+		sdo_t *sdo = mch_sdo_slot(machine, i);
+
+		if(sdo->retired || !sdo->sent || sdo->answered || sdo->deadline > now)
+			continue;
+
+		mch_sdo_index_stats_t *stats = mch_sdo_index_stats(machine, sdo->index);
+
+		if(sdo->retries < machine->max_retries) {
+			syslog(LOG_WARNING, "%s() no response for %04x:%02x, retransmitting (%d of %d)",
+				__FUNCTION__, sdo->index, sdo->subindex, sdo->retries + 1, machine->max_retries);
+
+			sdo->retries++;
+			sdo->deadline = now + machine->timeout;
+			if(stats)
+				stats->retransmits++;
+
+			mch_sdo_send(machine, sdo);
+		} else {
+			syslog(LOG_ERR, "%s() no response for %04x:%02x after %d retransmissions",
+				__FUNCTION__, sdo->index, sdo->subindex, sdo->retries);
+
+			sdo->answered = true;
+			sdo->aborted = true;
+			sdo->abort_code = SDO_ABORT_TIMEOUT;
+			machine->sdo_outstanding--;
+			if(stats)
+				stats->timeouts++;
+
+			expired = true;
+		}
+	}
+
+	// SDOs held back by a duplicate may be sent
+	bool released = mch_sdo_expire_duplicates(machine, now);
+
+	// Continue with the rest of the queue
+	if(expired)
+		mch_sdo_on_response(machine, EV_SDO_TIMEOUT);
+	else if(released && mch_sdo_active_state(machine) == ST_SDO_SENDING)
+		mch_sdo_send_available(machine);
+	else
+		mch_sdo_schedule_timeout(machine);
+}
+
+
+void mch_sdo_read_callback(void *data, uint16_t index, uint8_t subindex, uint32_t value)
+{
+	assert(data);
+
+	mch_sdo_t *machine = (mch_sdo_t *) data;
+	sdo_t *sdo = mch_sdo_match_response(machine, index, subindex);
+
+	if(!sdo)
+		return;
+
+	assert(!sdo->is_write);
+	sdo->value = value;
+
+	mch_sdo_on_response(machine, EV_SDO_READ_RESPONSE);
+}
+
+
+void mch_sdo_write_callback(void *data, uint16_t index, uint8_t subindex)
+{
+	assert(data);
+
+	mch_sdo_t *machine = (mch_sdo_t *) data;
+	sdo_t *sdo = mch_sdo_match_response(machine, index, subindex);
+
+	if(!sdo)
+		return;
+
+	assert(sdo->is_write);
+
+	mch_sdo_on_response(machine, EV_SDO_WRITE_RESPONSE);
+}
+
+
+void mch_sdo_abort_callback(void *data, uint16_t index, uint8_t subindex, uint32_t code)
+{
+	assert(data);
+
+	mch_sdo_t *machine = (mch_sdo_t *) data;
+	sdo_t *sdo = mch_sdo_match_response(machine, index, subindex);
+
+	if(!sdo)
+		return;
+
+	fprintf(stderr, "%s SDO to %04x:%02x was aborted because: %s\n",
+		sdo->is_write?"Write":"Read", index, subindex,
+		mch_sdo_abort_to_message(code));
+
+	sdo->aborted = true;
+	sdo->abort_code = code;
+
+	mch_sdo_index_stats_t *stats = mch_sdo_index_stats(machine, index);
+	if(stats)
+		stats->aborts++;
+
+	// A read has no effect on the drive, so no later SDO depends on it
+	//  (e.g. reading back a configuration object the drive lacks).
+	if(!sdo->is_write) {
+		mch_sdo_on_response(machine, EV_SDO_READ_RESPONSE);
+		return;
 	}
+
+	// Stop sending before the abort is reported
+	mch_sdo_handle_internal_event(machine, EV_SDO_ABORT_RESPONSE);
+	mch_sdo_retire_answered(machine);
 }
 
 
@@ -181,15 +826,12 @@ void mch_sdo_on_enter(mch_sdo_t *machine)
 {
 	switch(machine->state) {
 		case ST_SDO_SENDING:
-			machine->sdo_active = machine->sdo_queue.front();
-			machine->sdo_queue.pop();
-
-			mch_sdo_send(machine, machine->sdo_active);
+			mch_sdo_send_available(machine);
 			break;
 
 		case ST_SDO_WAITING:
-			if(!machine->sdo_queue.empty()) {
-				mch_sdo_handle_event(machine, EV_SDO_ITEM_AVAILABLE);
+			if(machine->sdo_queued > 0) {
+				mch_sdo_handle_internal_event(machine, EV_SDO_ITEM_AVAILABLE);
 			}
 			break;
 	}
@@ -197,19 +839,19 @@ void mch_sdo_on_enter(mch_sdo_t *machine)
 
 
 /**
- * Drop all SDOs in the queue.
+ * Drop all SDOs in the queue and those still awaiting a response.
+ *
+ * Callbacks are invoked in order of submission, SDOs that were
+ * not answered receive an abort with code 0.
  */
 void mch_sdo_clear_queue(mch_sdo_t *machine)
 {
-	while(!machine->sdo_queue.empty()) {
-		sdo_t *sdo = machine->sdo_queue.front();
-		machine->sdo_queue.pop();
+	while(machine->sdo_count > 0)
+		mch_sdo_retire_slot(machine, mch_sdo_slot(machine, 0));
 
-		if(sdo->abort_callback)
-			sdo->abort_callback(sdo->data, sdo->index, sdo->subindex, 0);
+	machine->num_duplicates = 0;
 
-		delete sdo;
-	}
+	mch_sdo_schedule_timeout(machine);
 }
 
 
@@ -227,72 +869,501 @@ void mch_sdo_on_exit(mch_sdo_t *machine)
 }
 
 
+/**
+ * Frees the response timeout and unsubscribes from the SDO responses,
+ * call before mch_sdo_destroy().
+ */
+void mch_sdo_release(mch_sdo_t *machine)
+{
+	assert(machine);
+
+	if(machine->subscribed) {
+		intf_unsubscribe_sdo(machine->interface, &(machine->sdo_client));
+		machine->subscribed = false;
+	}
+
+	if(machine->timeout_event) {
+		event_del(machine->timeout_event);
+		event_free(machine->timeout_event);
+		machine->timeout_event = NULL;
+	}
+}
+
+
+/**
+ * Sets the number of SDOs that may await a response at the same time.
+ *
+ * Returns 0 on success, -1 if the window size is not supported.
+ */
+int mch_sdo_set_window(mch_sdo_t *machine, int window)
+{
+	assert(machine);
+
+	if(window < 1 || window > SDO_MAX_WINDOW)
+		return -1;
+
+	machine->window = window;
+
+	if(mch_sdo_active_state(machine) == ST_SDO_SENDING)
+		mch_sdo_send_available(machine);
+
+	return 0;
+}
+
+
+/**
+ * Sets time to wait for a response and number of retransmissions
+ * before an SDO is aborted with code SDO_ABORT_TIMEOUT.
+ *
+ * Returns 0 on success, -1 on invalid arguments.
+ */
+int mch_sdo_set_timeout(mch_sdo_t *machine, double timeout, int retries)
+{
+	assert(machine);
+
+	if(timeout <= 0.0 || retries < 0)
+		return -1;
+
+	machine->timeout = timeout;
+	machine->max_retries = retries;
+
+	return 0;
+}
+
+
+/**
+ * Copies statistics of up to max object indices, ordered by index.
+ *
+ * Returns the number of entries written.
+ */
+int mch_sdo_get_stats(mch_sdo_t *machine, mch_sdo_index_stats_t *stats, int max)
+{
+	assert(machine && stats);
+
+	int count = 0;
+
+	for(int i = 0; i < machine->num_stats && count < max; i++)
+		stats[count++] = machine->stats[i];
+
+	return count;
+}
+
+
+void mch_sdo_reset_stats(mch_sdo_t *machine)
+{
+	assert(machine);
+	machine->num_stats = 0;
+}
+
+
+void mch_sdo_get_queue_stats(mch_sdo_t *machine, mch_sdo_queue_stats_t *stats)
+{
+	assert(machine && stats);
+
+	stats->capacity = SDO_QUEUE_CAPACITY;
+	stats->depth = machine->sdo_count;
+	stats->high_water_mark = machine->sdo_high_water_mark;
+	stats->overflows = machine->sdo_overflows;
+	stats->coalesced = machine->sdo_coalesced;
+}
+
+
+/**
+ * Resets overflow counter, and the high-water mark to the current depth.
+ */
+void mch_sdo_reset_queue_stats(mch_sdo_t *machine)
+{
+	assert(machine);
+
+	machine->sdo_high_water_mark = machine->sdo_count;
+	machine->sdo_overflows = 0;
+	machine->sdo_coalesced = 0;
+}
+
+
+/**
+ * Copies queue wait statistics of all SDO_NUM_CLASSES classes.
+ */
+void mch_sdo_get_class_stats(mch_sdo_t *machine, mch_sdo_class_stats_t *stats)
+{
+	assert(machine && stats);
+
+	for(int i = 0; i < SDO_NUM_CLASSES; i++)
+		stats[i] = machine->class_stats[i];
+}
+
+
+void mch_sdo_reset_class_stats(mch_sdo_t *machine)
+{
+	assert(machine);
+	memset(machine->class_stats, 0, sizeof(machine->class_stats));
+}
+
+
+/**
+ * Enables replacing writes that were not yet sent by a
+ * later write of the same size to the same object.
+ */
+void mch_sdo_set_coalescing(mch_sdo_t *machine, bool coalescing)
+{
+	assert(machine);
+	machine->coalescing = coalescing;
+}
+
+
+/**
+ * Writes the value of a new write request into a queued write to the
+ * same object, if coalescing is enabled and neither write is ordered or
+ * has callbacks. The search stops at a barrier or any other SDO to the
+ * object in the same class, as the value may not move across these.
+ *
+ * Returns true if the request was merged.
+ */
+static bool mch_sdo_coalesce(mch_sdo_t *machine, const sdo_t *request)
+{
+	if(!machine->coalescing || !request->is_write || request->ordered)
+		return false;
+
+	if(request->write_callback || request->abort_callback)
+		return false;
+
+	if(mch_sdo_policy(request->index) & SDO_POLICY_ORDERED)
+		return false;
+
+	for(int i = machine->sdo_count - 1; i >= 0; i--) {
+		sdo_t *sdo = mch_sdo_slot(machine, i);
+
+		if(sdo->retired || sdo->sent || sdo->sdo_class != request->sdo_class)
+			continue;
+
+		if(mch_sdo_is_barrier(sdo))
+			return false;
+
+		if(sdo->index != request->index || sdo->subindex != request->subindex)
+			continue;
+
+		if(!sdo->is_write || sdo->ordered || sdo->size != request->size)
+			return false;
+
+		if(sdo->write_callback || sdo->abort_callback)
+			return false;
+
+		sdo->value = request->value;
+		machine->sdo_coalesced++;
+
+		return true;
+	}
+
+	return false;
+}
+
+
+/**
+ * Copies SDO into a free slot at the end of the queue.
+ *
+ * If the queue is full the SDO is rejected, and its abort
+ * callback invoked with code SDO_ABORT_QUEUE_FULL. Set-point
+ * triggers are rejected with code 0 during a control hold.
+ *
+ * Returns 0 on success, -1 if the SDO was rejected.
+ */
+static int mch_sdo_enqueue(mch_sdo_t *machine, sdo_t *request)
+{
+	assert(machine);
+
+	if(request->sdo_class >= SDO_NUM_CLASSES)
+		request->sdo_class = mch_sdo_default_class(request->index);
+
+	if(machine->control_hold && mch_sdo_is_trigger(request)) {
+		syslog(LOG_WARNING, "%s() drive state changing, rejecting set-point trigger", __FUNCTION__);
+
+		if(request->abort_callback)
+			request->abort_callback(request->data, request->index, request->subindex, 0);
+
+		return -1;
+	}
+
+	if(mch_sdo_coalesce(machine, request))
+		return 0;
+
+	if(machine->sdo_count == SDO_QUEUE_CAPACITY) {
+		machine->sdo_overflows++;
+
+		syslog(LOG_ERR, "%s() queue full, rejecting %s of %04x:%02x", __FUNCTION__,
+			request->is_write?"write":"read", request->index, request->subindex);
+
+		if(request->abort_callback)
+			request->abort_callback(request->data, request->index, request->subindex, SDO_ABORT_QUEUE_FULL);
+
+		return -1;
+	}
+
+	sdo_t *sdo = mch_sdo_slot(machine, machine->sdo_count);
+	*sdo = *request;
+
+	sdo->sequence = machine->next_sequence++;
+	sdo->queued_time = get_time();
+	sdo->sent = false;
+	sdo->retired = false;
+	sdo->answered = false;
+	sdo->aborted = false;
+	sdo->abort_code = 0;
+	sdo->retries = 0;
+
+	machine->sdo_count++;
+	machine->sdo_queued++;
+	machine->sdo_class_queued[sdo->sdo_class]++;
+
+	if(machine->sdo_count > machine->sdo_high_water_mark)
+		machine->sdo_high_water_mark = machine->sdo_count;
+
+	if(mch_sdo_active_state(machine) == ST_SDO_SENDING)
+		mch_sdo_send_available(machine);
+	else
+		mch_sdo_handle_internal_event(machine, EV_SDO_ITEM_AVAILABLE);
+
+	return 0;
+}
+
+
 /**
  * Enqueue a write request SDO and register callback.
  *
- * If the SDO is dropped or aborted, the abort_callback is invoked.
- * In case the write succeeds the write_callback is invoked.
+ * If the SDO is dropped, aborted or rejected, the abort_callback is
+ * invoked. In case the write succeeds the write_callback is invoked.
+ *
+ * Returns 0 on success, -1 if the queue is full.
  */
-void mch_sdo_queue_write_with_cb(mch_sdo_t *machine, uint16_t index, uint8_t subindex, uint32_t value, uint8_t size,
+int mch_sdo_queue_write_with_cb(mch_sdo_t *machine, uint16_t index, uint8_t subindex, uint32_t value, uint8_t size,
   sdo_write_callback_t write_callback, sdo_abort_callback_t abort_callback, void *data)
 {
-	sdo_t *sdo = new sdo_t();
-	sdo->is_write = true;
-	sdo->index = index;
-	sdo->subindex = subindex;
-	sdo->value = value;
-	sdo->size = size;
+	return mch_sdo_queue_write_with_class_cb(machine, index, subindex, value, size, SDO_CLASS_DEFAULT,
+		write_callback, abort_callback, data);
+}
 
-	sdo->write_callback = write_callback;
-	sdo->read_callback = NULL;
-	sdo->abort_callback = abort_callback;
-	sdo->data = data;
 
-	machine->sdo_queue.push(sdo);
-	mch_sdo_handle_event(machine, EV_SDO_ITEM_AVAILABLE);
+/**
+ * Enqueue a write request SDO in the given priority class and register
+ * callback, SDO_CLASS_DEFAULT selects the class of the object.
+ */
+int mch_sdo_queue_write_with_class_cb(mch_sdo_t *machine, uint16_t index, uint8_t subindex, uint32_t value, uint8_t size,
+	uint8_t sdo_class, sdo_write_callback_t write_callback, sdo_abort_callback_t abort_callback, void *data)
+{
+	assert(sdo_class < SDO_NUM_CLASSES || sdo_class == SDO_CLASS_DEFAULT);
+
+	sdo_t sdo = sdo_t();
+	sdo.sdo_class = sdo_class;
+	sdo.is_write = true;
+	sdo.ordered = false;
+	sdo.index = index;
+	sdo.subindex = subindex;
+	sdo.value = value;
+	sdo.size = size;
+
+	sdo.write_callback = write_callback;
+	sdo.read_callback = NULL;
+	sdo.abort_callback = abort_callback;
+	sdo.data = data;
+
+	return mch_sdo_enqueue(machine, &sdo);
 }
 
 
 /**
  * Enqueue a write request SDO.
  */
-void mch_sdo_queue_write(mch_sdo_t *machine, uint16_t index, uint8_t subindex, uint32_t value, uint8_t size)
+int mch_sdo_queue_write(mch_sdo_t *machine, uint16_t index, uint8_t subindex, uint32_t value, uint8_t size)
+{
+	return mch_sdo_queue_write_with_cb(machine, index, subindex, value, size, NULL, NULL, NULL);
+}
+
+
+/**
+ * Enqueue a write request SDO in the given priority class, rather than
+ * the default class of the object (e.g. a control word that triggers
+ * motion, and so has to follow the motion task).
+ */
+int mch_sdo_queue_write_with_class(mch_sdo_t *machine, uint16_t index, uint8_t subindex, uint32_t value, uint8_t size,
+	uint8_t sdo_class)
+{
+	assert(sdo_class < SDO_NUM_CLASSES);
+	return mch_sdo_queue_write_with_class_cb(machine, index, subindex, value, size, sdo_class, NULL, NULL, NULL);
+}
+
+
+/**
+ * Enqueue an RPDO, which is sent as a barrier: once all older SDOs of
+ * its class were answered and no other SDO is awaiting a response.
+ * The PDO has been handled once sent, as it is not answered.
+ *
+ * @param function  Function code of the RPDO (FC_RPDO1 .. FC_RPDO4).
+ * @param value  Data of the PDO, least significant byte first.
+ * @param size  Number of bytes (at most four).
+ */
+int mch_sdo_queue_pdo(mch_sdo_t *machine, uint8_t function, uint32_t value, uint8_t size, uint8_t sdo_class)
 {
-	mch_sdo_queue_write_with_cb(machine, index, subindex, value, size, NULL, NULL, NULL);
+	assert(sdo_class < SDO_NUM_CLASSES && size <= 4);
+
+	sdo_t sdo = sdo_t();
+	sdo.sdo_class = sdo_class;
+	sdo.is_pdo = true;
+	sdo.function = function;
+	sdo.is_write = false;
+	sdo.ordered = true;
+	sdo.index = 0;
+	sdo.subindex = 0;
+	sdo.value = value;
+	sdo.size = size;
+
+	sdo.write_callback = NULL;
+	sdo.read_callback = NULL;
+	sdo.abort_callback = NULL;
+	sdo.data = NULL;
+
+	return mch_sdo_enqueue(machine, &sdo);
+}
+
+
+/**
+ * Enqueue a write request SDO that is never coalesced, for objects
+ * that act on each value written (e.g. a command variable).
+ */
+int mch_sdo_queue_ordered_write(mch_sdo_t *machine, uint16_t index, uint8_t subindex, uint32_t value, uint8_t size)
+{
+	sdo_t sdo = sdo_t();
+	sdo.sdo_class = SDO_CLASS_DEFAULT;
+	sdo.is_write = true;
+	sdo.ordered = true;
+	sdo.index = index;
+	sdo.subindex = subindex;
+	sdo.value = value;
+	sdo.size = size;
+
+	sdo.write_callback = NULL;
+	sdo.read_callback = NULL;
+	sdo.abort_callback = NULL;
+	sdo.data = NULL;
+
+	return mch_sdo_enqueue(machine, &sdo);
 }
 
 
 /**
  * Enqueue a read request SDO and register callback.
  *
- * If the SDO is dropped or aborted, the abort_callback is invoked.
- * In case the read succeeds the read_callback is invoked.
+ * If the SDO is dropped, aborted or rejected, the abort_callback is
+ * invoked. In case the read succeeds the read_callback is invoked.
+ *
+ * Returns 0 on success, -1 if the queue is full.
  */
-void mch_sdo_queue_read_with_cb(mch_sdo_t *machine, uint16_t index, uint8_t subindex,
+int mch_sdo_queue_read_with_cb(mch_sdo_t *machine, uint16_t index, uint8_t subindex,
 	sdo_read_callback_t read_callback, sdo_abort_callback_t abort_callback, void *data)
 {
-	sdo_t *sdo = new sdo_t();
-	sdo->is_write = false;
-	sdo->index = index;
-	sdo->subindex = subindex;
-	sdo->value = 0;
-	sdo->size = 0;
+	sdo_t sdo = sdo_t();
+	sdo.sdo_class = SDO_CLASS_DEFAULT;
+	sdo.is_write = false;
+	sdo.ordered = false;
+	sdo.index = index;
+	sdo.subindex = subindex;
+	sdo.value = 0;
+	sdo.size = 0;
+
+	sdo.write_callback = NULL;
+	sdo.read_callback = read_callback;
+	sdo.abort_callback = abort_callback;
+	sdo.data = data;
+
+	return mch_sdo_enqueue(machine, &sdo);
+}
 
-	sdo->write_callback = NULL;
-	sdo->read_callback = read_callback;
-	sdo->abort_callback = abort_callback;
-	sdo->data = NULL;
 
-	machine->sdo_queue.push(sdo);
-	mch_sdo_handle_event(machine, EV_SDO_ITEM_AVAILABLE);
+/**
+ * Enqueue read request SDO.
+ */
+int mch_sdo_queue_read(mch_sdo_t *machine, uint16_t index, uint8_t subindex)
+{
+	return mch_sdo_queue_read_with_cb(machine, index, subindex, NULL, NULL, NULL);
 }
 
 
 /**
- * Enqueue read request SDO.
+ * Moves SDOs not yet sent with the given callback data into a class
+ * of higher priority, for background transfers that something now
+ * depends on. They keep their place in the queue, so newer SDOs of
+ * the class do not overtake them.
+ *
+ * Returns the number of SDOs promoted.
  */
-void mch_sdo_queue_read(mch_sdo_t *machine, uint16_t index, uint8_t subindex)
+int mch_sdo_promote(mch_sdo_t *machine, void *data, uint8_t sdo_class)
 {
-	mch_sdo_queue_read_with_cb(machine, index, subindex, NULL, NULL, NULL);
+	assert(machine && sdo_class < SDO_NUM_CLASSES);
+
+	int promoted = 0;
+
+	for(int i = 0; i < machine->sdo_count; i++) {
+		sdo_t *sdo = mch_sdo_slot(machine, i);
+
+		if(sdo->retired || sdo->sent || sdo->data != data || sdo->sdo_class <= sdo_class)
+			continue;
+
+		machine->sdo_class_queued[sdo->sdo_class]--;
+		machine->sdo_class_queued[sdo_class]++;
+		sdo->sdo_class = sdo_class;
+		promoted++;
+	}
+
+	if(promoted && mch_sdo_active_state(machine) == ST_SDO_SENDING)
+		mch_sdo_send_available(machine);
+
+	return promoted;
 }
 
+
+/**
+ * Holds back set-point triggers of the motion machine (mch_mp.cc), the
+ * control word written in the motion class and RPDO1, while the DS402
+ * machine (mch_ds.cc) takes the drive through its states. The control
+ * word of the DS402 machine is written in the safety class and would
+ * otherwise be overtaken, or followed, by a trigger that enables the
+ * drive again.
+ *
+ * Starting the hold drops the triggers not yet sent, their abort
+ * callback is invoked with code 0. Triggers queued while it lasts are
+ * rejected.
+ *
+ * Returns the number of SDOs dropped.
+ */
+int mch_sdo_set_control_hold(mch_sdo_t *machine, bool hold)
+{
+	assert(machine);
+
+	machine->control_hold = hold;
+
+	if(!hold)
+		return 0;
+
+	int dropped = 0;
+	bool found = true;
+
+	// Retiring may release slots at the head, start over after each
+	while(found) {
+		found = false;
+
+		for(int i = 0; i < machine->sdo_count; i++) {
+			sdo_t *sdo = mch_sdo_slot(machine, i);
+
+			if(sdo->retired || sdo->sent || !mch_sdo_is_trigger(sdo))
+				continue;
+
+			mch_sdo_retire_slot(machine, sdo);
+			dropped++;
+			found = true;
+			break;
+		}
+	}
+
+	if(dropped && mch_sdo_active_state(machine) == ST_SDO_SENDING)
+		mch_sdo_send_available(machine);
+
+	return dropped;
+}
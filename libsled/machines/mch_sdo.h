@@ -6,6 +6,82 @@
 // Define machine prefix
 #define PREFIX mch_sdo
 
+// Number of SDOs that may await a response at the same time,
+//  1 sends the next SDO only after the previous one was answered.
+#define SDO_DEFAULT_WINDOW 1
+#define SDO_MAX_WINDOW 8
+
+// Time (s) to wait for a response before retransmitting, and the
+//  number of retransmissions before the SDO is aborted.
+#define SDO_DEFAULT_TIMEOUT 0.02
+#define SDO_DEFAULT_RETRIES 3
+
+// Abort code reported when no response was received
+#define SDO_ABORT_TIMEOUT 0x05040000
+
+// Number of SDOs that may be queued or in flight. Further SDOs are
+//  rejected and their abort callback receives SDO_ABORT_QUEUE_FULL.
+#define SDO_QUEUE_CAPACITY 128
+#define SDO_ABORT_QUEUE_FULL 0x05040005
+
+// Number of object indices for which statistics are kept, and of
+//  duplicate responses to retransmitted SDOs that are remembered.
+#define SDO_MAX_INDICES 64
+#define SDO_MAX_DUPLICATES 16
+
+// Response latency histogram, bucket i counts latencies
+//  below 2^i * SDO_HISTOGRAM_BASE seconds, the last one all others.
+#define SDO_HISTOGRAM_BUCKETS 16
+#define SDO_HISTOGRAM_BASE 125e-6
+
+struct event_base;
+
+/**
+ * Statistics of SDOs to a single object index.
+ */
+struct mch_sdo_index_stats_t {
+	uint16_t index;
+	uint64_t responses;
+	uint64_t aborts;
+	uint64_t retransmits;
+	uint64_t timeouts;
+	double max_latency;
+	uint32_t histogram[SDO_HISTOGRAM_BUCKETS];
+};
+
+/**
+ * Occupation of the SDO queue.
+ */
+struct mch_sdo_queue_stats_t {
+	int capacity;
+	int depth;				// SDOs queued or in flight
+	int high_water_mark;	// Largest depth observed
+	uint64_t overflows;		// SDOs rejected because the queue was full
+	uint64_t coalesced;		// Writes merged into a queued write
+};
+
+/**
+ * Priority classes, in order of decreasing priority. SDOs of a class
+ * are only sent when no class of higher priority has SDOs waiting.
+ */
+#define SDO_CLASS_SAFETY		0	// DS402 state machine
+#define SDO_CLASS_MOTION		1	// Motion tasks and their triggers
+#define SDO_CLASS_CONFIGURATION	2	// PDO configuration and others
+#define SDO_CLASS_BULK			3	// Diagnostics and lights
+#define SDO_NUM_CLASSES			4
+
+// Class given by the object (mch_sdo.cc)
+#define SDO_CLASS_DEFAULT 0xFF
+
+/**
+ * Time SDOs of a class spent in the queue before being sent.
+ */
+struct mch_sdo_class_stats_t {
+	uint64_t sent;
+	double total_wait;
+	double max_wait;
+};
+
 typedef void(*sdo_abort_callback_t)(void *data, uint16_t index, uint8_t subindex, uint32_t code);
 typedef void(*sdo_write_callback_t)(void *data, uint16_t index, uint8_t subindex);
 typedef void(*sdo_read_callback_t)(void *data, uint16_t index, uint8_t subindex, uint32_t value);
@@ -13,16 +89,41 @@ typedef void(*sdo_read_callback_t)(void *data, uint16_t index, uint8_t subindex,
 #include "machine_header.h"
 #include "mch_sdo_def.h"
 
-void mch_sdo_queue_write(mch_sdo_t *machine, uint16_t index, uint8_t subindex, uint32_t value, uint8_t size);
-void mch_sdo_queue_read(mch_sdo_t *machine, uint16_t index, uint8_t subindex);
+void mch_sdo_release(mch_sdo_t *machine);
+int mch_sdo_set_window(mch_sdo_t *machine, int window);
+int mch_sdo_set_timeout(mch_sdo_t *machine, double timeout, int retries);
+void mch_sdo_set_coalescing(mch_sdo_t *machine, bool coalescing);
+
+int mch_sdo_get_stats(mch_sdo_t *machine, mch_sdo_index_stats_t *stats, int max);
+void mch_sdo_reset_stats(mch_sdo_t *machine);
+
+void mch_sdo_get_queue_stats(mch_sdo_t *machine, mch_sdo_queue_stats_t *stats);
+void mch_sdo_reset_queue_stats(mch_sdo_t *machine);
+
+void mch_sdo_get_class_stats(mch_sdo_t *machine, mch_sdo_class_stats_t *stats);
+void mch_sdo_reset_class_stats(mch_sdo_t *machine);
 
-void mch_sdo_queue_write_with_cb(mch_sdo_t *machine, 
+int mch_sdo_queue_write(mch_sdo_t *machine, uint16_t index, uint8_t subindex, uint32_t value, uint8_t size);
+int mch_sdo_queue_read(mch_sdo_t *machine, uint16_t index, uint8_t subindex);
+int mch_sdo_queue_write_with_class(mch_sdo_t *machine, uint16_t index, uint8_t subindex, uint32_t value, uint8_t size,
+	uint8_t sdo_class);
+int mch_sdo_queue_pdo(mch_sdo_t *machine, uint8_t function, uint32_t value, uint8_t size, uint8_t sdo_class);
+int mch_sdo_queue_ordered_write(mch_sdo_t *machine, uint16_t index, uint8_t subindex, uint32_t value, uint8_t size);
+
+int mch_sdo_queue_write_with_cb(mch_sdo_t *machine, 
 	uint16_t index, uint8_t subindex, uint32_t value, uint8_t size,
 	sdo_write_callback_t write_callback, sdo_abort_callback_t abort_callback, void *data);
 
-void mch_sdo_queue_read_with_cb(mch_sdo_t *machine, 
-  uint16_t index, uint8_t subindex, uint32_t value,
-  sdo_read_callback_t read_callback, sdo_abort_callback_t abort_callback, void *data);
+int mch_sdo_queue_write_with_class_cb(mch_sdo_t *machine,
+	uint16_t index, uint8_t subindex, uint32_t value, uint8_t size, uint8_t sdo_class,
+	sdo_write_callback_t write_callback, sdo_abort_callback_t abort_callback, void *data);
+
+int mch_sdo_queue_read_with_cb(mch_sdo_t *machine, 
+	uint16_t index, uint8_t subindex,
+	sdo_read_callback_t read_callback, sdo_abort_callback_t abort_callback, void *data);
+
+int mch_sdo_promote(mch_sdo_t *machine, void *data, uint8_t sdo_class);
+int mch_sdo_set_control_hold(mch_sdo_t *machine, bool hold);
 
 #endif
 
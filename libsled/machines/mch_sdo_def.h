@@ -2,6 +2,8 @@
 
 #define INITIAL_STATE ST_SDO_DISABLED
 
+// Internal events and responses are handled at once, not queued
+//  (mch_sdo_handle_internal_event)
 BEGIN_EVENTS
 	EVENT(EV_NET_SDO_DISABLED)		// From net machine (mch_net.cc)
 	EVENT(EV_NET_SDO_ENABLED)		// From net machine (mch_net.cc)
@@ -11,6 +13,7 @@ BEGIN_EVENTS
 	EVENT(EV_SDO_READ_RESPONSE)		// From CANOpen (interface.cc)
 	EVENT(EV_SDO_WRITE_RESPONSE)	// From CANOpen (interface.cc)
 	EVENT(EV_SDO_ABORT_RESPONSE)	// From CANOpen (interface.cc)
+	EVENT(EV_SDO_TIMEOUT)			// Internal event, SDO given up after retries
 END_EVENTS
 
 BEGIN_STATES
@@ -20,16 +23,93 @@ BEGIN_STATES
 	STATE(ST_SDO_SENDING)
 END_STATES
 
+BEGIN_TRANSITIONS
+	TRANSITION(ST_SDO_DISABLED, EV_NET_SDO_ENABLED, ST_SDO_WAITING)
+	TRANSITION(ST_SDO_ERROR, EV_NET_SDO_ENABLED, ST_SDO_WAITING)
+
+	TRANSITION(ST_SDO_WAITING, EV_NET_SDO_DISABLED, ST_SDO_DISABLED)
+	TRANSITION(ST_SDO_WAITING, EV_SDO_ITEM_AVAILABLE, ST_SDO_SENDING)
+
+	TRANSITION(ST_SDO_SENDING, EV_NET_SDO_DISABLED, ST_SDO_DISABLED)
+	TRANSITION(ST_SDO_SENDING, EV_SDO_READ_RESPONSE, ST_SDO_WAITING)
+	TRANSITION(ST_SDO_SENDING, EV_SDO_WRITE_RESPONSE, ST_SDO_WAITING)
+	TRANSITION(ST_SDO_SENDING, EV_SDO_TIMEOUT, ST_SDO_WAITING)
+	TRANSITION(ST_SDO_SENDING, EV_SDO_ABORT_RESPONSE, ST_SDO_ERROR)
+END_TRANSITIONS
+
+// SDOs time out individually (mch_sdo_on_timeout)
+BEGIN_TIMEOUTS
+END_TIMEOUTS
+
 BEGIN_CALLBACKS
 END_CALLBACKS
 
 BEGIN_FIELDS
 	FIELD(intf_t *, interface)
+	FIELD(event_base *, ev_base)
+
+	// Preallocated SDOs, those in use form a ring in order of submission
+	FIELD_DECL(sdo_t, sdo_slots[SDO_QUEUE_CAPACITY])
+	FIELD_DECL(int, sdo_head)
+	FIELD_DECL(int, sdo_count)
+
+	// SDOs not yet sent, sent but not yet retired, and not yet answered
+	FIELD_DECL(int, sdo_queued)
+	FIELD_DECL(int, sdo_sent)
+	FIELD_DECL(int, sdo_outstanding)
+
+	// SDOs not yet sent and queue wait per priority class
+	FIELD_DECL(int, sdo_class_queued[SDO_NUM_CLASSES])
+	FIELD_DECL(mch_sdo_class_stats_t, class_stats[SDO_NUM_CLASSES])
+
+	// Queue occupation
+	FIELD_DECL(int, sdo_high_water_mark)
+	FIELD_DECL(uint64_t, sdo_overflows)
+
+	// Set-point triggers are rejected while the drive changes state
+	FIELD_DECL(bool, control_hold)
+
+	// Replace queued writes by newer writes to the same object
+	FIELD_DECL(bool, coalescing)
+	FIELD_DECL(uint64_t, sdo_coalesced)
+
+	// Maximum number of SDOs awaiting a response
+	FIELD_DECL(int, window)
+	FIELD_DECL(uint32_t, next_sequence)
+
+	// Receives the SDO responses, subscribed when the first SDO is sent
+	FIELD_DECL(intf_sdo_client_t, sdo_client)
+	FIELD_DECL(bool, subscribed)
+
+	// Response deadline and retransmission
+	FIELD_DECL(event *, timeout_event)
+	FIELD_DECL(double, timeout)
+	FIELD_DECL(int, max_retries)
+	FIELD_DECL(sdo_duplicate_t, sdo_duplicates[SDO_MAX_DUPLICATES])
+	FIELD_DECL(int, num_duplicates)
 
-	FIELD_DECL(std::queue<sdo_t *>, sdo_queue)
-	FIELD_DECL(sdo_t *, sdo_active)
+	// Statistics per object index, ordered by index
+	FIELD_DECL(mch_sdo_index_stats_t, stats[SDO_MAX_INDICES])
+	FIELD_DECL(int, num_stats)
 
-	FIELD_INIT(sdo_active, NULL)
+	FIELD_INIT(sdo_head, 0)
+	FIELD_INIT(sdo_count, 0)
+	FIELD_INIT(sdo_queued, 0)
+	FIELD_INIT(sdo_sent, 0)
+	FIELD_INIT(sdo_high_water_mark, 0)
+	FIELD_INIT(sdo_overflows, 0)
+	FIELD_INIT(control_hold, false)
+	FIELD_INIT(coalescing, false)
+	FIELD_INIT(sdo_coalesced, 0)
+	FIELD_INIT(num_duplicates, 0)
+	FIELD_INIT(num_stats, 0)
+	FIELD_INIT(sdo_outstanding, 0)
+	FIELD_INIT(window, SDO_DEFAULT_WINDOW)
+	FIELD_INIT(next_sequence, 0)
+	FIELD_INIT(subscribed, false)
+	FIELD_INIT(timeout_event, NULL)
+	FIELD_INIT(timeout, SDO_DEFAULT_TIMEOUT)
+	FIELD_INIT(max_retries, SDO_DEFAULT_RETRIES)
 END_FIELDS
 
 GENERATE_DEFAULT_FUNCTIONS
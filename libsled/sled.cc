@@ -1,11 +1,13 @@
 #include "config.h"
 #include "sled_internal.h"
+#include "sled_time.h"
 
 #include <assert.h>
 #include <event2/event.h>
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <syslog.h>
 #include <time.h>
 
@@ -13,13 +15,16 @@
 /* Maximum amount of seconds between NMT messages */
 #define MAX_NMT_DELAY 2.0
 
+// Interval at which state transitions are written to the log (us), the
+//  trace holds MACHINE_TRACE_SIZE transitions in between
+#define TRACE_DUMP_INTERVAL 100000
 
-static double get_time()
-{
-	timespec ts;
-	clock_gettime(CLOCK_MONOTONIC, &ts);
-	return double(ts.tv_sec) + double(ts.tv_nsec) / 1000.0 / 1000.0 / 1000.0;
-}
+// Resolution of position reported by the drive (1 um)
+#define POSITION_RESOLUTION 1e-6
+
+// Uncertainty of the time at which the drive sampled a position, the
+//  sample is timestamped on reception (one drive cycle).
+#define SAMPLE_TIME_UNCERTAINTY 0.001
 
 
 /** ******************
@@ -49,6 +54,7 @@ static void intf_on_nmt(intf_t *intf, void *payload, uint8_t state)
 	sled_t *sled = (sled_t *) payload;
 
 	switch(state) {
+		case 0x00: mch_net_on_boot_up(sled->mch_net); break;
 		case 0x04: mch_net_handle_event(sled->mch_net, EV_NET_STOPPED); break;
 		case 0x05: mch_net_handle_event(sled->mch_net, EV_NET_OPERATIONAL); break;
 		case 0x7F: mch_net_handle_event(sled->mch_net, EV_NET_PREOPERATIONAL); break;
@@ -58,67 +64,136 @@ static void intf_on_nmt(intf_t *intf, void *payload, uint8_t state)
 }
 
 
+#define DS_EVENT(event) (mch_ds_handle_event(sled->mch_ds, event), events++)
+#define MP_EVENT(event) (mch_mp_handle_event(sled->mch_mp, event), events++)
+
+/**
+ * Emits the machine events of a status word and mode of operation.
+ *
+ * @return Number of events emitted.
+ */
+static int sled_decode_status(sled_t *sled, uint16_t status, uint8_t mode)
+{
+	int events = 0;
+
+	if((status & 0x4F) == 0x40) DS_EVENT(EV_DS_NOT_READY_TO_SWITCH_ON);
+	if((status & 0x6F) == 0x21) DS_EVENT(EV_DS_READY_TO_SWITCH_ON);
+	if((status & 0x6F) == 0x23) DS_EVENT(EV_DS_SWITCHED_ON);
+	if((status & 0x6F) == 0x27) DS_EVENT(EV_DS_OPERATION_ENABLED);
+	if((status & 0x4F) == 0x08) DS_EVENT(EV_DS_FAULT);
+	if((status & 0x4F) == 0x0F) DS_EVENT(EV_DS_FAULT_REACTION_ACTIVE);
+	if((status & 0x6F) == 0x07) DS_EVENT(EV_DS_QUICK_STOP_ACTIVE);
+
+	if((status & 0x10) == 0x10)
+		DS_EVENT(EV_DS_VOLTAGE_ENABLED);
+	else
+		DS_EVENT(EV_DS_VOLTAGE_DISABLED);
+
+	if((status & 0x400) == 0x400)
+		MP_EVENT(EV_MP_TARGET_REACHED);
+
+	// Profile position (PP) mode
+	if(mode == 0x01) {
+		MP_EVENT(EV_MP_MODE_PP);
+
+		if((status & 0x1000) == 0x1000)
+			MP_EVENT(EV_MP_SETPOINT_ACK);
+		else
+			MP_EVENT(EV_MP_SETPOINT_NACK);
+	}
+
+	// Homing mode
+	if(mode == 0x06) {
+		MP_EVENT(EV_MP_MODE_HOMING);
+
+		if((status & 0x1000) == 0x1000)
+			MP_EVENT(EV_MP_HOMED);
+		else
+			MP_EVENT(EV_MP_NOTHOMED);
+	}
+
+	// Interpolated positioning mode
+	if(mode == 0x07) {
+		MP_EVENT(EV_MP_MODE_IP);
+	}
+
+	return events;
+}
+
+#undef DS_EVENT
+#undef MP_EVENT
+
+
 /**
  * Handle TPDO.
+ *
+ * @param time  Time at which the TPDO was received by the CAN driver.
  */
-static void intf_on_tpdo(intf_t *intf, void *payload, int pdo, uint8_t *data)
+static void intf_on_tpdo(intf_t *intf, void *payload, int pdo, uint8_t *data, double time)
 {
 	sled_t *sled = (sled_t *) payload;
 
 	if(pdo == 1) {
 		uint16_t status = (data[1] << 8) | data[0];
 		uint8_t mode = data[2];
+		sled_status_t *last = &(sled->status);
 
-		if((status & 0x4F) == 0x40) mch_ds_handle_event(sled->mch_ds, EV_DS_NOT_READY_TO_SWITCH_ON);
-		if((status & 0x6F) == 0x21) mch_ds_handle_event(sled->mch_ds, EV_DS_READY_TO_SWITCH_ON);
-		if((status & 0x6F) == 0x23) mch_ds_handle_event(sled->mch_ds, EV_DS_SWITCHED_ON);
-		if((status & 0x6F) == 0x27) mch_ds_handle_event(sled->mch_ds, EV_DS_OPERATION_ENABLED);
-		if((status & 0x4F) == 0x08) mch_ds_handle_event(sled->mch_ds, EV_DS_FAULT);
-		if((status & 0x4F) == 0x0F) mch_ds_handle_event(sled->mch_ds, EV_DS_FAULT_REACTION_ACTIVE);
-		if((status & 0x6F) == 0x07) mch_ds_handle_event(sled->mch_ds, EV_DS_QUICK_STOP_ACTIVE);
+		sled->last_status = status;
 
-		if((status & 0x10) == 0x10)
-			mch_ds_handle_event(sled->mch_ds, EV_DS_VOLTAGE_ENABLED);
-		else
-			mch_ds_handle_event(sled->mch_ds, EV_DS_VOLTAGE_DISABLED);
-
-		if((status & 0x400) == 0x400)
-			mch_mp_handle_event(sled->mch_mp, EV_MP_TARGET_REACHED);
+		// Target reached bit cleared, executed motion task has started
+		if((status & 0x400) == 0)
+			sled->motion_pending = false;
 
-		// Profile position (PP) mode
-		if(mode == 0x01) {
-			mch_mp_handle_event(sled->mch_mp, EV_MP_MODE_PP);
+		last->frames++;
 
-			if((status & 0x1000) == 0x1000)
-				mch_mp_handle_event(sled->mch_mp, EV_MP_SETPOINT_ACK);
-			else
-				mch_mp_handle_event(sled->mch_mp, EV_MP_SETPOINT_NACK);
+		// Status is stable and nothing else moved the machines since,
+		//  the events would not change any state.
+		if(last->stable && status == last->status && mode == last->mode &&
+		   mch_ds_active_state(sled->mch_ds) == last->ds_state &&
+		   mch_mp_active_state(sled->mch_mp) == last->mp_state) {
+			last->suppressed++;
+			last->events_suppressed += last->events;
+			return;
 		}
 
-		// Homing mode
-		if(mode == 0x06) {
-			mch_mp_handle_event(sled->mch_mp, EV_MP_MODE_HOMING);
+		mch_ds_state_t ds_state = mch_ds_active_state(sled->mch_ds);
+		mch_mp_state_t mp_state = mch_mp_active_state(sled->mch_mp);
 
-			if((status & 0x1000) == 0x1000)
-				mch_mp_handle_event(sled->mch_mp, EV_MP_HOMED);
-			else
-				mch_mp_handle_event(sled->mch_mp, EV_MP_NOTHOMED);
-		}
+		// Events of a status word are handled in a single drain
+		machine_queue_begin(&(sled->events));
+		last->events = sled_decode_status(sled, status, mode);
+		machine_queue_end(&(sled->events));
 
-		// Interpolated positioning mode
-		if(mode == 0x07) {
-			mch_mp_handle_event(sled->mch_mp, EV_MP_MODE_IP);
-		}
+		last->status = status;
+		last->mode = mode;
+		last->ds_state = mch_ds_active_state(sled->mch_ds);
+		last->mp_state = mch_mp_active_state(sled->mch_mp);
+
+		// A machine that changed state may accept other events of the
+		//  same status, decode the next frame again.
+		last->stable = last->ds_state == ds_state && last->mp_state == mp_state;
 	}
 
 	if(pdo == 2) {
 		int32_t position = (data[3] << 24) | (data[2] << 16) | (data[1] << 8) | data[0];
 		int32_t velocity = (data[7] << 24) | (data[6] << 16) | (data[5] << 8) | data[4];
 
-		sled->last_time = get_time();
+		// Synchronous TPDO2 holds the position at the time of SYNC
+		if(sled->sync.armed_period > 0.0 && mch_net_get_tpdo2_sync(sled->mch_net))
+			time = sled->sync.last_time;
+
+		sled->last_time = time;
 		sled->last_position = position / 1000.0 / 1000.0;
 		sled->last_velocity = velocity / 1000.0 / 1000.0;
+		sled->position_valid = true;
+
+		sled_history_push(sled, sled->last_time, sled->last_position, sled->last_velocity);
+		sled_stream_on_feedback(sled, sled->last_position);
 	}
+
+	// Diagnostic channels
+	if(pdo == 3 || pdo == 4)
+		sled_pdo_decode(sled, pdo, data, time);
 }
 
 
@@ -152,25 +227,62 @@ static void nmt_watchdog(evutil_socket_t fd, short flags, void *param)
 CALLBACK_FUNCTION_EVENT(intf, on_opened, net, EV_NET_INTF_OPENED);
 CALLBACK_FUNCTION_EVENT(intf, on_closed, net, EV_NET_INTF_CLOSED);
 
-// Inform SDO machine that SDO transmission is (not) possible.
-CALLBACK_FUNCTION_EVENT(net, on_sdos_enabled, sdo, EV_NET_SDO_ENABLED);
+// Inform SDO machine that SDO transmission is (not) possible, and
+//  find out whether direct task access can be used.
+void mch_net_on_sdos_enabled(mch_net_t *mch_net, void *payload)
+{
+	sled_t *sled = (sled_t *) payload;
+	mch_sdo_handle_event(sled->mch_sdo, EV_NET_SDO_ENABLED);
+	sled_profile_probe_direct_tasks(sled);
+}
+
 CALLBACK_FUNCTION_EVENT(net, on_sdos_disabled, sdo, EV_NET_SDO_DISABLED);
 
-// Notify DS402 that NMT is (in)operational.
+// Notify DS402 that NMT is (in)operational, or that an operational
+//  drive was adopted as is.
 void mch_net_on_enter_operational(mch_net_t *mch_net, void *payload)
 {
 	sled_t *sled = (sled_t *) payload;
 	sled_profiles_reset(sled);
-	mch_ds_handle_event(sled->mch_ds, EV_DS_NET_OPERATIONAL);
+
+	// Position from before the drive (re)started
+	sled->position_valid = false;
+	mch_ds_handle_event(sled->mch_ds,
+		mch_net_is_attached(mch_net) ? EV_DS_NET_ATTACHED : EV_DS_NET_OPERATIONAL);
 }
 
 CALLBACK_FUNCTION_EVENT(net, on_leave_operational, ds, EV_DS_NET_INOPERATIONAL);
 
-// Inform MP machine that DS is (in)operational.
-CALLBACK_FUNCTION_EVENT(ds, on_operation_enabled, mp, EV_MP_DS_OPERATIONAL);
+// Inform MP machine that DS is (in)operational, the motion state of
+//  an adopted drive is taken over as well.
+void mch_ds_on_operation_enabled(mch_ds_t *mch_ds, void *payload)
+{
+	sled_t *sled = (sled_t *) payload;
+	mch_mp_handle_event(sled->mch_mp,
+		mch_ds_is_attached(mch_ds) ? EV_MP_DS_ATTACHED : EV_MP_DS_OPERATIONAL);
+}
+
 CALLBACK_FUNCTION_EVENT(ds, on_operation_disabled, mp, EV_MP_DS_INOPERATIONAL);
 
 
+/**
+ * Writes the transitions leading to a drive fault to the system log,
+ * once events of higher priority have been handled.
+ */
+void mch_ds_on_fault(mch_ds_t *mch_ds, void *payload)
+{
+	sled_t *sled = (sled_t *) payload;
+	event_active(sled->trace_dump, 0, 0);
+}
+
+
+static void on_trace_dump(evutil_socket_t fd, short flags, void *param)
+{
+	sled_t *sled = (sled_t *) param;
+	machine_trace_dump(&(sled->trace), &(sled->trace_cursor));
+}
+
+
 /**
  * Setup state machines
  */
@@ -178,11 +290,35 @@ static void setup_state_machines(sled_t *sled)
 {
 	// Setup state machines
 	sled->mch_intf = mch_intf_create(sled->interface);
-	sled->mch_sdo = mch_sdo_create(sled->interface);
+	sled->mch_sdo = mch_sdo_create(sled->interface, sled->ev_base);
 	sled->mch_net = mch_net_create(sled->interface, sled->mch_sdo);
+	mch_net_set_pdo_map(sled->mch_net, sled_pdo_map, sled_pdo_map_size);
 	sled->mch_ds = mch_ds_create(sled->interface, sled->mch_sdo);
 	sled->mch_mp = mch_mp_create(sled->interface, sled->mch_sdo);
 
+	// All machines post their events to a single queue
+	machine_queue_init(&(sled->events));
+	mch_intf_set_queue(sled->mch_intf, &(sled->events));
+	mch_net_set_queue(sled->mch_net, &(sled->events));
+	mch_sdo_set_queue(sled->mch_sdo, &(sled->events));
+	mch_ds_set_queue(sled->mch_ds, &(sled->events));
+	mch_mp_set_queue(sled->mch_mp, &(sled->events));
+
+	// Transitions are recorded, not logged as they happen
+	machine_trace_init(&(sled->trace));
+	sled->trace_cursor = 0;
+	mch_intf_set_trace(sled->mch_intf, &(sled->trace));
+	mch_net_set_trace(sled->mch_net, &(sled->trace));
+	mch_sdo_set_trace(sled->mch_sdo, &(sled->trace));
+	mch_ds_set_trace(sled->mch_ds, &(sled->trace));
+	mch_mp_set_trace(sled->mch_mp, &(sled->trace));
+
+	// States waiting for the drive send their command again if
+	//  it has no effect within the time declared in *_def.h
+	mch_net_set_timer(sled->mch_net, &(sled->timer));
+	mch_ds_set_timer(sled->mch_ds, &(sled->timer));
+	mch_mp_set_timer(sled->mch_mp, &(sled->timer));
+
 	// Register callback payload
 	mch_intf_set_callback_payload(sled->mch_intf, (void *) sled);
 	mch_net_set_callback_payload(sled->mch_net, (void *) sled);
@@ -198,6 +334,7 @@ static void setup_state_machines(sled_t *sled)
 	REGISTER_CALLBACK(net, leave_operational);
 	REGISTER_CALLBACK(ds, operation_enabled);
 	REGISTER_CALLBACK(ds, operation_disabled);
+	REGISTER_CALLBACK(ds, fault);
 }
 
 
@@ -207,12 +344,43 @@ static void setup_state_machines(sled_t *sled)
 
 
 /**
- * Setup sled structures.
+ * Setup sled structures using the default CAN device.
  */
 sled_t *sled_create(event_base *ev_base)
 {
-	sled_t *sled = (sled_t *) malloc(sizeof(sled_t));
+	return sled_create_with_device(ev_base, INTF_DEFAULT_DEVICE);
+}
+
+
+/**
+ * Setup sled structures.
+ *
+ * @param ev_base  LibEvent event_base.
+ * @param device  CAN device, either a PEAK device node (/dev/pcanpci0)
+ *                or a SocketCAN interface (can0, vcan0). The default
+ *                device is used when NULL.
+ */
+sled_t *sled_create_with_device(event_base *ev_base, const char *device)
+{
+	// Position history is cache-line aligned
+	sled_t *sled;
+	if(posix_memalign((void **) &sled, SLED_CACHE_LINE, sizeof(sled_t)) != 0)
+		return NULL;
+
+	// Fields not set below start out zero
+	memset(sled, 0, sizeof(sled_t));
+
 	sled->ev_base = ev_base;
+	sled->last_status = 0;
+	sled_history_init(sled);
+
+	memset(&(sled->status), 0, sizeof(sled_status_t));
+	memset(sled->channels, 0, sizeof(sled->channels));
+
+	sled->motion_pending = false;
+	sled->motion_start = sled->motion_time = 0.0;
+	sled->motion_target = NAN;
+	sled->motion_acceleration = SLED_MAX_ACCELERATION;
 
 	/* Make sure the watchdog times out */
 	sled->time_last_nmt_msg = get_time() - MAX_NMT_DELAY;
@@ -220,6 +388,11 @@ sled_t *sled_create(event_base *ev_base)
 	////////////////////////
 	// Initialise profiles
 
+	// Nothing loaded in slot 0, edit tasks through slot 0
+	sled->current_profile = -1;
+	sled->direct_tasks = false;
+	sled->direct_tasks_supported = -1;
+
 	// Reset sled profiles
 	for(int profile = 0; profile < MAX_PROFILES; profile++)
 		sled_profile_clear(sled, profile, false);
@@ -239,11 +412,25 @@ sled_t *sled_create(event_base *ev_base)
 	sled_profile_set_next(sled, sled->sinusoid_rthere, sled->sinusoid_back, 0.0, bln_after);
 	sled_profile_set_next(sled, sled->sinusoid_back, sled->sinusoid_there, 0.0, bln_after);
 
+	// No set-points are streamed until started
+	sled_stream_init(sled);
+
+	if(sled_sync_init(sled) == -1) {
+		free(sled);
+		return NULL;
+	}
+
+	if(machine_timer_init(&(sled->timer), ev_base) == -1) {
+		sled_sync_destroy(sled);
+		free(sled);
+		return NULL;
+	}
+
 	////////////////////////////
 	// Interface-specific part
 
 	// Create interface
-	sled->interface = intf_create(sled->ev_base);
+	sled->interface = intf_create(sled->ev_base, device);
 	intf_set_callback_payload(sled->interface, (void *) sled);
 
 	// Setup state machines
@@ -264,6 +451,16 @@ sled_t *sled_create(event_base *ev_base)
 	event_priority_set(sled->watchdog, 0);	/* Important */
 	event_add(sled->watchdog, &watchdog_timeout);
 
+	// Transitions are written to the log periodically and on a fault,
+	//  when nothing else is pending
+	timeval trace_dump_interval;
+	trace_dump_interval.tv_sec = 0;
+	trace_dump_interval.tv_usec = TRACE_DUMP_INTERVAL;
+
+	sled->trace_dump = event_new(ev_base, -1, EV_PERSIST, on_trace_dump, (void *) sled);
+	event_priority_set(sled->trace_dump, 1);
+	event_add(sled->trace_dump, &trace_dump_interval);
+
 	// Open interface
 	mch_intf_handle_event(sled->mch_intf, EV_INTF_OPEN);
 
@@ -280,21 +477,28 @@ void sled_destroy(sled_t **handle)
 {
 	sled_t *sled = *handle;
 
-	free(*handle);
-	*handle = NULL;
-}
+	// Closing disables the machines and drops queued SDOs, the drive
+	//  is left in its current state.
+	mch_intf_handle_event(sled->mch_intf, EV_INTF_CLOSE);
+	mch_sdo_release(sled->mch_sdo);
+	intf_destroy(&(sled->interface));
 
+	event_del(sled->watchdog);
+	event_free(sled->watchdog);
 
-/**
- * Set new setpoint.
- *
- * @param handle  Sled handle.
- * @param position  Position set-point in meters.
- */
-int sled_rt_new_setpoint(sled_t *handle, double position)
-{
-	// No can do
-	return -1;
+	sled_sync_destroy(sled);
+	event_del(sled->trace_dump);
+	event_free(sled->trace_dump);
+	machine_timer_destroy(&(sled->timer));
+
+	mch_intf_destroy(&(sled->mch_intf));
+	mch_net_destroy(&(sled->mch_net));
+	mch_sdo_destroy(&(sled->mch_sdo));
+	mch_ds_destroy(&(sled->mch_ds));
+	mch_mp_destroy(&(sled->mch_mp));
+
+	free(*handle);
+	*handle = NULL;
 }
 
 
@@ -309,7 +513,7 @@ int sled_rt_get_position_and_time(sled_t *handle, double &position, double &time
 {
 	assert(handle);
 
-	if(mch_net_active_state(handle->mch_net) != ST_NET_OPERATIONAL) {
+	if(mch_net_active_state(handle->mch_net) != ST_NET_OPERATIONAL || !handle->position_valid) {
     time = get_time();
     position = NAN;
 		return -1;
@@ -332,8 +536,8 @@ int sled_rt_get_position(sled_t *handle, double &position)
 {
 	assert(handle);
 
-	// Position is only valid if sled is operational
-	if(mch_net_active_state(handle->mch_net) != ST_NET_OPERATIONAL)
+	// Position is only valid if sled is operational and reported one
+	if(mch_net_active_state(handle->mch_net) != ST_NET_OPERATIONAL || !handle->position_valid)
 		return -1;
 
 	position = handle->last_position;
@@ -341,6 +545,64 @@ int sled_rt_get_position(sled_t *handle, double &position)
 }
 
 
+/**
+ * Predicts the position at an arbitrary time.
+ *
+ * Extrapolates the last position with the last velocity. The error
+ * bound assumes the acceleration of the active motion task, derived
+ * from its distance and duration, or SLED_MAX_ACCELERATION while
+ * streaming, and a drive cycle of uncertainty in the sample time.
+ * The prediction does not pass the target of the active motion task.
+ *
+ * @param handle  Sled handle.
+ * @param time  Time (CLOCK_MONOTONIC) of prediction.
+ * @param position  Predicted position (by-reference) in meters.
+ * @param error  Bound on the prediction error (by-reference) in meters.
+ *
+ * @return 0 on success, -1 if no position is available.
+ */
+int sled_rt_predict_position(sled_t *handle, double time, double &position, double &error)
+{
+	assert(handle);
+
+	if(mch_net_active_state(handle->mch_net) != ST_NET_OPERATIONAL || !handle->position_valid) {
+		position = error = NAN;
+		return -1;
+	}
+
+	double dt = time - handle->last_time;
+
+	// Motion task executed but not yet reported, or still moving
+	bool pending = handle->motion_pending && time < handle->motion_start + handle->motion_time;
+	bool moving = pending || (handle->last_status & 0x400) == 0;
+
+	double acceleration = 0.0;
+	if(handle->stream.active)
+		acceleration = SLED_MAX_ACCELERATION;
+	else if(moving)
+		acceleration = handle->motion_acceleration;
+
+	position = handle->last_position + handle->last_velocity * dt;
+	error = 0.5 * acceleration * dt * dt + POSITION_RESOLUTION;
+
+	if(moving || handle->stream.active)
+		error += fabs(handle->last_velocity) * SAMPLE_TIME_UNCERTAINTY +
+			acceleration * fabs(dt) * SAMPLE_TIME_UNCERTAINTY;
+
+	// Motion tasks do not overshoot their target
+	double target = handle->motion_target;
+
+	if(moving && !handle->stream.active && !isnan(target) && dt > 0.0) {
+		double from = handle->last_position;
+
+		if((target - from) * (position - from) > 0.0 && fabs(position - from) > fabs(target - from))
+			position = target;
+	}
+
+	return 0;
+}
+
+
 /**
  * Start sinusoidal motion.
  *
@@ -466,3 +728,295 @@ int sled_light_set_state(sled_t *handle, bool state)
 	return 0;
 }
 
+
+/**
+ * Selects warm attach: a drive that is already operational when
+ * libsled starts is adopted without resetting it, provided its PDO
+ * configuration matches. The DS402 state, mode of operation and
+ * homing are taken over as reported, such that a restart of the
+ * server does not re-enable or re-home the drive.
+ *
+ * Call directly after sled_create(), before the event loop runs.
+ *
+ * @param handle  libsled handle.
+ * @param warm_attach  Adopt an operational drive (default false).
+ *
+ * @return 0 on success, -1 on failure.
+ */
+int sled_set_warm_attach(sled_t *handle, bool warm_attach)
+{
+	assert(handle);
+	mch_net_set_warm_attach(handle->mch_net, warm_attach);
+	return 0;
+}
+
+
+/**
+ * Selects direct motion task access: profile fields are written to
+ * the subindex of their motion task instead of being edited in task
+ * 0 and copied, saving two SDOs per uploaded profile. The drive must
+ * address tasks 201..300 at subindices 0x02..0x65 of the motion task
+ * objects. This is probed once SDOs are enabled, tasks are copied
+ * until the drive has answered and if it does not support it.
+ *
+ * @param handle  libsled handle.
+ * @param direct_tasks  Write motion tasks directly (default false).
+ *
+ * @return 0 on success, -1 on failure.
+ */
+int sled_set_direct_tasks(sled_t *handle, bool direct_tasks)
+{
+	assert(handle);
+	handle->direct_tasks = direct_tasks;
+	return 0;
+}
+
+
+/**
+ * Writes state transitions of the libsled state machines recorded
+ * since the previous dump to the system log. Transitions are only
+ * recorded while handling events, call this outside real-time paths.
+ * libsled also dumps them at a low rate and on a drive fault.
+ *
+ * @param handle  libsled handle.
+ *
+ * @return Number of transitions written.
+ */
+int sled_trace_dump(sled_t *handle)
+{
+	assert(handle);
+	return machine_trace_dump(&(handle->trace), &(handle->trace_cursor));
+}
+
+
+
+/**
+ * Sets the maximum number of CAN frames handled before control
+ * is returned to the event loop.
+ *
+ * @param handle  libsled handle.
+ * @param budget  Number of frames per read event.
+ *
+ * @return 0 on success, -1 on failure.
+ */
+int sled_can_set_read_budget(sled_t *handle, int budget)
+{
+	assert(handle);
+
+	if(budget <= 0)
+		return -1;
+
+	intf_set_read_budget(handle->interface, budget);
+	return 0;
+}
+
+
+/**
+ * Returns CAN receive statistics.
+ *
+ * @param handle  libsled handle.
+ * @param stats  Structure that receives the statistics.
+ * @param reset  Reset statistics after reading.
+ *
+ * @return 0 on success, -1 on failure.
+ */
+int sled_can_get_statistics(sled_t *handle, sled_can_stats_t *stats, bool reset)
+{
+	assert(handle);
+
+	if(!stats)
+		return -1;
+
+	intf_rx_stats_t rx_stats;
+	intf_get_rx_stats(handle->interface, &rx_stats);
+
+	stats->wakeups = rx_stats.wakeups;
+	stats->empty_wakeups = rx_stats.empty_wakeups;
+	stats->frames = rx_stats.frames;
+	stats->budget_exhausted = rx_stats.budget_exhausted;
+	stats->overruns = rx_stats.overruns;
+	stats->max_frames_per_wakeup = rx_stats.max_frames_per_wakeup;
+	stats->max_queue_depth = rx_stats.max_queue_depth;
+
+	stats->status_frames = handle->status.frames;
+	stats->status_suppressed = handle->status.suppressed;
+	stats->events_suppressed = handle->status.events_suppressed;
+
+	machine_queue_stats_t event_stats;
+	machine_queue_get_stats(&(handle->events), &event_stats, reset);
+
+	stats->events = event_stats.events;
+	stats->event_drains = event_stats.drains;
+	stats->event_overflows = event_stats.overflows;
+	stats->max_pending_events = event_stats.high_water_mark;
+	stats->max_events_per_drain = event_stats.max_events_per_drain;
+	stats->event_time = event_stats.total_drain_time;
+	stats->max_drain_time = event_stats.max_drain_time;
+	stats->state_timeouts = handle->timer.expired;
+
+	if(reset) {
+		intf_reset_rx_stats(handle->interface);
+		handle->timer.expired = 0;
+		handle->status.frames = handle->status.suppressed = handle->status.events_suppressed = 0;
+	}
+
+	return 0;
+}
+
+
+/**
+ * Sets the number of SDO transfers that may be in progress at
+ * the same time. Transfers to the same object and those that
+ * depend on earlier transfers (e.g. copying and executing motion
+ * tasks) are still performed one at a time.
+ *
+ * @param handle  libsled handle.
+ * @param window  Number of SDOs awaiting a response (1 to disable pipelining).
+ *
+ * @return 0 on success, -1 on failure.
+ */
+int sled_sdo_set_window(sled_t *handle, int window)
+{
+	assert(handle);
+	return mch_sdo_set_window(handle->mch_sdo, window);
+}
+
+
+/**
+ * Sets how long to wait for an SDO response before the request
+ * is sent again, and how often it is sent again before the
+ * transfer is aborted.
+ *
+ * @param handle  libsled handle.
+ * @param timeout  Response timeout in seconds.
+ * @param retries  Number of retransmissions.
+ *
+ * @return 0 on success, -1 on failure.
+ */
+int sled_sdo_set_timeout(sled_t *handle, double timeout, int retries)
+{
+	assert(handle);
+	return mch_sdo_set_timeout(handle->mch_sdo, timeout, retries);
+}
+
+
+/**
+ * Enables coalescing of SDO writes. A write that was not yet sent is
+ * then replaced by a later write to the same object, unless either
+ * has callbacks or the object acts on every value written.
+ *
+ * @param handle  libsled handle.
+ * @param coalescing  Enable or disable coalescing.
+ *
+ * @return 0 on success, -1 on failure.
+ */
+int sled_sdo_set_coalescing(sled_t *handle, bool coalescing)
+{
+	assert(handle);
+
+	mch_sdo_set_coalescing(handle->mch_sdo, coalescing);
+	return 0;
+}
+
+
+/**
+ * Returns SDO transfer statistics per object index.
+ *
+ * @param handle  libsled handle.
+ * @param stats  Array that receives the statistics.
+ * @param max  Number of elements in the array.
+ * @param reset  Reset statistics after reading.
+ *
+ * @return Number of object indices written, -1 on failure.
+ */
+int sled_sdo_get_statistics(sled_t *handle, sled_sdo_stats_t *stats, int max, bool reset)
+{
+	assert(handle);
+
+	if(!stats || max < 0)
+		return -1;
+
+	mch_sdo_index_stats_t index_stats[SDO_MAX_INDICES];
+	int count = mch_sdo_get_stats(handle->mch_sdo, index_stats, max < SDO_MAX_INDICES ? max : SDO_MAX_INDICES);
+
+	for(int i = 0; i < count; i++) {
+		stats[i].index = index_stats[i].index;
+		stats[i].responses = index_stats[i].responses;
+		stats[i].aborts = index_stats[i].aborts;
+		stats[i].retransmits = index_stats[i].retransmits;
+		stats[i].timeouts = index_stats[i].timeouts;
+		stats[i].max_latency = index_stats[i].max_latency;
+
+		for(int j = 0; j < SLED_SDO_HISTOGRAM_BUCKETS && j < SDO_HISTOGRAM_BUCKETS; j++)
+			stats[i].histogram[j] = index_stats[i].histogram[j];
+	}
+
+	if(reset)
+		mch_sdo_reset_stats(handle->mch_sdo);
+
+	return count;
+}
+
+
+/**
+ * Returns occupation of the SDO queue.
+ *
+ * @param handle  libsled handle.
+ * @param stats  Receives the statistics.
+ * @param reset  Reset high-water mark and overflow counter after reading.
+ *
+ * @return 0 on success, -1 on failure.
+ */
+int sled_sdo_get_queue_statistics(sled_t *handle, sled_sdo_queue_stats_t *stats, bool reset)
+{
+	assert(handle);
+
+	if(!stats)
+		return -1;
+
+	mch_sdo_queue_stats_t queue_stats;
+	mch_sdo_get_queue_stats(handle->mch_sdo, &queue_stats);
+
+	stats->capacity = queue_stats.capacity;
+	stats->depth = queue_stats.depth;
+	stats->high_water_mark = queue_stats.high_water_mark;
+	stats->overflows = queue_stats.overflows;
+	stats->coalesced = queue_stats.coalesced;
+
+	if(reset)
+		mch_sdo_reset_queue_stats(handle->mch_sdo);
+
+	return 0;
+}
+
+
+/**
+ * Returns time SDOs waited in the queue per priority class.
+ *
+ * @param handle  libsled handle.
+ * @param stats  Array of SLED_SDO_NUM_CLASSES elements that receives the statistics.
+ * @param reset  Reset statistics after reading.
+ *
+ * @return 0 on success, -1 on failure.
+ */
+int sled_sdo_get_class_statistics(sled_t *handle, sled_sdo_class_stats_t *stats, bool reset)
+{
+	assert(handle);
+
+	if(!stats)
+		return -1;
+
+	mch_sdo_class_stats_t class_stats[SDO_NUM_CLASSES];
+	mch_sdo_get_class_stats(handle->mch_sdo, class_stats);
+
+	for(int i = 0; i < SLED_SDO_NUM_CLASSES && i < SDO_NUM_CLASSES; i++) {
+		stats[i].sent = class_stats[i].sent;
+		stats[i].mean_wait = class_stats[i].sent ? class_stats[i].total_wait / class_stats[i].sent : 0.0;
+		stats[i].max_wait = class_stats[i].max_wait;
+	}
+
+	if(reset)
+		mch_sdo_reset_class_stats(handle->mch_sdo);
+
+	return 0;
+}
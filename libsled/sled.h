@@ -1,19 +1,147 @@
 #ifndef __SLED_H__
 #define __SLED_H__
 
+#include <stdint.h>
+
 extern "C" {
 
 struct event_base;
 struct sled_t;
 
+/**
+ * CAN receive path statistics.
+ */
+struct sled_can_stats_t {
+	uint64_t wakeups;				// Read events handled
+	uint64_t empty_wakeups;			// Read events without any frame pending
+	uint64_t frames;				// Frames received
+	uint64_t budget_exhausted;		// Read events that hit the frame budget
+	uint64_t overruns;				// Receive overruns reported by driver
+	uint32_t max_frames_per_wakeup;
+	uint32_t max_queue_depth;		// Largest number of frames pending on wakeup
+	uint64_t status_frames;			// Status words received (TPDO1)
+	uint64_t status_suppressed;		// Status words equal to the previous one, not decoded
+	uint64_t events_suppressed;		// Machine events not emitted for these
+	uint64_t events;				// State machine events handled
+	uint64_t event_drains;			// Callbacks that handled events
+	uint64_t event_overflows;		// Events handled out of order, queue full
+	uint32_t max_pending_events;
+	uint32_t max_events_per_drain;
+	double event_time;				// Time spent handling events (s)
+	double max_drain_time;
+	uint64_t state_timeouts;		// States not left within their dwell time
+};
+
+/**
+ * SDO transfer statistics of a single object index.
+ *
+ * Bucket i of the histogram counts response times below
+ * 2^i * 125 us, the last bucket counts all slower responses.
+ */
+#define SLED_SDO_HISTOGRAM_BUCKETS 16
+
+struct sled_sdo_stats_t {
+	uint16_t index;
+	uint64_t responses;				// Responses received (including aborts)
+	uint64_t aborts;				// Transfers aborted by the drive
+	uint64_t retransmits;			// Requests sent again after a timeout
+	uint64_t timeouts;				// Transfers given up after all retransmissions
+	double max_latency;				// Slowest response in seconds
+	uint32_t histogram[SLED_SDO_HISTOGRAM_BUCKETS];
+};
+
+/**
+ * Occupation of the SDO queue, which has a fixed capacity.
+ */
+struct sled_sdo_queue_stats_t {
+	uint32_t capacity;
+	uint32_t depth;					// SDOs queued or awaiting a response
+	uint32_t high_water_mark;		// Largest depth since last reset
+	uint64_t overflows;				// SDOs rejected because the queue was full
+	uint64_t coalesced;				// Writes merged into a queued write to the same object
+};
+
+/**
+ * Time SDOs of a priority class waited in the queue before being sent.
+ * Classes in order of priority: DS402 state machine, motion tasks and
+ * their triggers, configuration, diagnostics and lights.
+ */
+#define SLED_SDO_NUM_CLASSES 4
+
+struct sled_sdo_class_stats_t {
+	uint64_t sent;					// SDOs sent (excluding retransmissions)
+	double mean_wait;				// Mean time in queue in seconds
+	double max_wait;				// Longest time in queue in seconds
+};
+
+/**
+ * Set-point streaming statistics.
+ *
+ * Latency is the time from queueing a set-point until it was sent,
+ * the tracking error compares the position reported by the drive
+ * with the last set-point sent.
+ */
+struct sled_stream_stats_t {
+	uint64_t cycles;				// SYNC messages sent
+	uint64_t setpoints;				// Set-points sent
+	uint64_t underruns;				// Cycles without a new set-point
+	uint64_t skipped;				// Overdue set-points dropped to catch up
+	uint64_t overflows;				// Set-points rejected because the buffer was full
+	double mean_latency, max_latency;
+	double rms_error, max_error;	// Tracking error in meters
+};
+
+/**
+ * SYNC producer statistics.
+ */
+struct sled_sync_stats_t {
+	double period;					// Current period in seconds, 0 if stopped
+	uint64_t cycles;				// SYNC messages sent
+	uint64_t missed;				// Timer expirations not handled in time
+};
+
+/**
+ * Diagnostic channels sent by the drive (TPDO3 and TPDO4).
+ */
+enum sled_channel_t {
+	SLED_CHANNEL_FOLLOWING_ERROR,	// Following error in meters (0x60F4)
+	SLED_CHANNEL_CURRENT,			// Actual current, fraction of rated (0x6078)
+	SLED_CHANNEL_DIGITAL_INPUTS,	// Digital inputs (0x60FD)
+	SLED_NUM_CHANNELS
+};
+
+/**
+ * Position sample as reported by the drive (TPDO2).
+ */
+struct sled_sample_t {
+	double time;					// Time of reception (CLOCK_MONOTONIC)
+	double position;				// Position in meters
+	double velocity;				// Velocity in meters per second
+	uint16_t status;				// Last status word (TPDO1)
+};
+
 // Opening and closing of connection to sled
 sled_t *sled_create(event_base *ev_base);
+sled_t *sled_create_with_device(event_base *ev_base, const char *device);
 void sled_destroy(sled_t **sled);
 
 // Set-points
 int sled_rt_new_setpoint(sled_t *handle, double position);
+int sled_rt_new_setpoint_at(sled_t *handle, double position, double time);
+int sled_rt_stream_start(sled_t *handle, double period);
+int sled_rt_stream_stop(sled_t *handle);
+int sled_rt_get_stream_statistics(sled_t *handle, sled_stream_stats_t *stats, bool reset);
 int sled_rt_get_position(sled_t *handle, double &position);
 int sled_rt_get_position_and_time(sled_t *handle, double &position, double &time);
+int sled_rt_predict_position(sled_t *handle, double time, double &position, double &error);
+int sled_rt_get_channel(sled_t *handle, sled_channel_t channel, double &value, double &time);
+const char *sled_channel_name(sled_channel_t channel);
+int sled_rt_get_samples(sled_t *handle, uint64_t *since, sled_sample_t *samples, int max);
+
+// SYNC producer
+int sled_sync_start(sled_t *handle, double period, bool sync_tpdo);
+int sled_sync_stop(sled_t *handle);
+int sled_sync_get_statistics(sled_t *handle, sled_sync_stats_t *stats, bool reset);
 
 // Sinusoids
 int sled_sinusoid_start(sled_t *sled, double amplitude, double period);
@@ -26,6 +154,25 @@ int sled_rsinusoid_stop(sled_t *sled);
 // Light
 int sled_light_set_state(sled_t *sled, bool state);
 
+// Start-up
+int sled_set_warm_attach(sled_t *sled, bool warm_attach);
+int sled_set_direct_tasks(sled_t *sled, bool direct_tasks);
+
+// State machine transitions
+int sled_trace_dump(sled_t *sled);
+
+// CAN bus statistics
+int sled_can_set_read_budget(sled_t *sled, int budget);
+int sled_can_get_statistics(sled_t *sled, sled_can_stats_t *stats, bool reset);
+
+// SDO transfers
+int sled_sdo_set_window(sled_t *sled, int window);
+int sled_sdo_set_timeout(sled_t *sled, double timeout, int retries);
+int sled_sdo_set_coalescing(sled_t *sled, bool coalescing);
+int sled_sdo_get_statistics(sled_t *sled, sled_sdo_stats_t *stats, int max, bool reset);
+int sled_sdo_get_queue_statistics(sled_t *sled, sled_sdo_queue_stats_t *stats, bool reset);
+int sled_sdo_get_class_statistics(sled_t *sled, sled_sdo_class_stats_t *stats, bool reset);
+
 }
 
 #endif
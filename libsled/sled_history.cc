@@ -0,0 +1,86 @@
+#include "sled_internal.h"
+
+#include <assert.h>
+#include <string.h>
+
+
+void sled_history_init(sled_t *sled)
+{
+	memset(&(sled->history), 0, sizeof(sled_history_t));
+}
+
+
+/**
+ * Append sample to history, overwriting the oldest one.
+ */
+void sled_history_push(sled_t *sled, double time, double position, double velocity)
+{
+	sled_history_t *history = &(sled->history);
+	uint64_t head = history->head;
+
+	// Publish the previous head before overwriting the slot of the
+	//  oldest sample, a reader that sees the new sample then also sees
+	//  that the oldest is gone (sled_rt_get_samples).
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	sled_sample_t *sample = &(history->samples[head % SLED_HISTORY_SIZE]);
+	sample->time = time;
+	sample->position = position;
+	sample->velocity = velocity;
+	sample->status = sled->last_status;
+
+	__atomic_store_n(&(history->head), head + 1, __ATOMIC_RELEASE);
+}
+
+
+/**
+ * Returns position samples received after a cursor, oldest first.
+ *
+ * The cursor counts samples and is advanced past the samples returned.
+ * Start with a cursor of zero to receive all samples still available.
+ * If the caller fell behind more than the history holds, the oldest
+ * samples are lost and the cursor skips ahead. May be called from any
+ * thread.
+ *
+ * @param handle  Sled handle.
+ * @param since  Cursor (by-reference).
+ * @param samples  Receives at most max samples.
+ * @param max  Size of samples.
+ *
+ * @return Number of samples returned.
+ */
+int sled_rt_get_samples(sled_t *handle, uint64_t *since, sled_sample_t *samples, int max)
+{
+	assert(handle && since);
+	sled_history_t *history = &(handle->history);
+
+	uint64_t head = __atomic_load_n(&(history->head), __ATOMIC_ACQUIRE);
+	uint64_t first = *since;
+
+	if(head > SLED_HISTORY_SIZE && first < head - SLED_HISTORY_SIZE)
+		first = head - SLED_HISTORY_SIZE;
+
+	if(first > head)
+		first = head;
+
+	int count = head - first < uint64_t(max) ? int(head - first) : max;
+
+	for(int i = 0; i < count; i++)
+		samples[i] = history->samples[(first + i) % SLED_HISTORY_SIZE];
+
+	// Drop samples that were (or are being) overwritten while copying
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	uint64_t valid = __atomic_load_n(&(history->head), __ATOMIC_RELAXED) + 1;
+	valid = valid > SLED_HISTORY_SIZE ? valid - SLED_HISTORY_SIZE : 0;
+
+	int lost = 0;
+	if(valid > first)
+		lost = valid - first < uint64_t(count) ? int(valid - first) : count;
+
+	if(lost > 0)
+		memmove(samples, samples + lost, (count - lost) * sizeof(sled_sample_t));
+
+	*since = first + count;
+
+	return count - lost;
+}
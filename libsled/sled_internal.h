@@ -13,9 +13,20 @@
 #include "machines/mch_sdo.h"
 #include "machines/mch_ds.h"
 #include "machines/mch_mp.h"
+#include "machines/machine_queue.h"
+#include "machines/machine_trace.h"
+#include "machines/machine_timer.h"
 
 #define MAX_PROFILES 99
 
+// Volatile motion tasks, each profile and each staged profile holds one.
+#define FIRST_MOTION_TASK 201
+#define LAST_MOTION_TASK 300
+
+// Bound on acceleration used for position prediction when the
+//  trajectory is not known, in m/s^2.
+#define SLED_MAX_ACCELERATION 10.0
+
 /**
  * Generates callback function for callback FNAME of the SNAME machine.
  * When executed it sends event EVENT to the DNAME machine.
@@ -51,6 +62,10 @@ struct sled_profile_t {
 
 	int profile;
 
+	// Motion task the next version is staged in, -1 if not staged. While
+	//  staged, the field states below refer to this task.
+	int staged;
+
 	int table;
 	position_type_t position_type;
 	double position, time;
@@ -73,6 +88,122 @@ struct sled_profile_t {
 };
 
 
+/**
+ * Set-point streaming in interpolated position mode.
+ *
+ * Set-points are passed from the caller to the event loop through a
+ * single-producer single-consumer ring: only the producer writes head,
+ * only the event loop writes tail.
+ */
+#define SLED_STREAM_BUFFER_SIZE 256		// Power of two
+#define SLED_STREAM_DEFAULT_PERIOD 0.004
+
+struct sled_setpoint_t {
+	double time;		// Time at which position should be reached
+	double position;
+	double queued;		// Time at which the set-point was queued
+};
+
+struct sled_stream_t {
+	sled_setpoint_t buffer[SLED_STREAM_BUFFER_SIZE];
+	uint32_t head, tail;
+
+	bool active;
+	double period;
+
+	// Last set-point sent, held when none is available
+	double setpoint;
+	bool started;
+
+	// Statistics, overflows is written by the producer
+	uint64_t cycles, setpoints, underruns, skipped, overflows;
+	double sum_latency, max_latency;
+	uint64_t feedback;
+	double sum_sq_error, max_error;
+};
+
+void sled_stream_init(sled_t *sled);
+void sled_stream_on_cycle(sled_t *sled);
+void sled_stream_on_feedback(sled_t *sled, double position);
+
+
+/**
+ * PDO configuration and decoding of diagnostic channels (sled_pdo.cc).
+ */
+struct sled_channel_value_t {
+	bool valid;
+	double value, time;
+};
+
+extern const mch_net_pdo_t sled_pdo_map[];
+extern const int sled_pdo_map_size;
+
+void sled_pdo_decode(sled_t *sled, int pdo, uint8_t *data, double time);
+
+
+/**
+ * Last status word decoded, status words are only decoded into machine
+ * events when they differ from the last one or a machine changed state
+ * in the meantime. Stable once decoding did not change any state.
+ */
+struct sled_status_t {
+	bool stable;
+	uint16_t status;
+	uint8_t mode;
+	mch_ds_state_t ds_state;
+	mch_mp_state_t mp_state;
+	int events;						// Events emitted by last decode
+
+	uint64_t frames, suppressed, events_suppressed;
+};
+
+
+/**
+ * History of position samples.
+ *
+ * Written by the event loop only, read without locks from any thread:
+ * samples are copied first and discarded if the writer wrapped around
+ * onto them in the meantime. Samples are half a cache line and the
+ * counter has a line of its own, so readers polling the counter do not
+ * share a line with the sample being written.
+ */
+#define SLED_HISTORY_SIZE 1024		// Power of two
+#define SLED_CACHE_LINE 64
+
+struct sled_history_t {
+	sled_sample_t samples[SLED_HISTORY_SIZE] __attribute__((aligned(SLED_CACHE_LINE)));
+
+	// Number of samples written
+	uint64_t head __attribute__((aligned(SLED_CACHE_LINE)));
+} __attribute__((aligned(SLED_CACHE_LINE)));
+
+void sled_history_init(sled_t *sled);
+void sled_history_push(sled_t *sled, double time, double position, double velocity);
+
+
+/**
+ * SYNC producer, driven by a timerfd on the event loop.
+ *
+ * Runs at the streaming period while set-points are streamed, else at
+ * the period given to sled_sync_start().
+ */
+struct sled_sync_t {
+	int fd;
+	event *ev;
+
+	bool enabled;			// Started by sled_sync_start()
+	double period;			// Period requested by sled_sync_start()
+	double armed_period;	// Period of the timer, 0 if stopped
+	double last_time;		// Time last SYNC was sent
+
+	uint64_t cycles, missed;
+};
+
+int sled_sync_init(sled_t *sled);
+int sled_sync_update(sled_t *sled);
+void sled_sync_destroy(sled_t *sled);
+
+
 /**
  * Sled instance variables.
  */
@@ -83,6 +214,11 @@ struct sled_t {
 	// Profile loaded in register 0.
 	int current_profile;
 
+	// Motion task objects address tasks directly (no copy to/from 0),
+	//  once the drive has shown to support it (1), -1 until probed.
+	bool direct_tasks;
+	int direct_tasks_supported;
+
 	// Lib event event base
 	event_base *ev_base;
 
@@ -96,12 +232,44 @@ struct sled_t {
 	mch_ds_t *mch_ds;
 	mch_mp_t *mch_mp;
 
-	// Last position and velocity
+	// Events of all state machines, handled run-to-completion
+	machine_queue_t events;
+
+	// State transitions of all machines, written to the system log by
+	//  a low priority event, up to trace_cursor
+	machine_trace_t trace;
+	uint64_t trace_cursor;
+	event *trace_dump;
+
+	// Dwell timeouts of the net, ds and mp machines
+	machine_timer_t timer;
+
+	// Last position and velocity, valid once TPDO2 was received since
+	//  the drive became operational
 	double last_time, last_position, last_velocity;
+	bool position_valid;
+	uint16_t last_status;
+	sled_status_t status;
+
+	// Position history
+	sled_history_t history;
+
+	// Diagnostic channels
+	sled_channel_value_t channels[SLED_NUM_CHANNELS];
+
+	// Motion task started last, for position prediction. Target is
+	//  NAN if not known in advance (relative or chained profiles).
+	bool motion_pending;			// Executed, not yet seen moving
+	double motion_start, motion_time;
+	double motion_target, motion_acceleration;
 
 	// Profiles for sinusoid
 	int sinusoid_there, sinusoid_rthere, sinusoid_back, sinusoid_rback;
 
+	// Set-point streaming
+	sled_stream_t stream;
+	sled_sync_t sync;
+
 	// Time of last NMT message (for watchdog).
 	double time_last_nmt_msg;
 
@@ -111,6 +279,7 @@ struct sled_t {
 
 
 void sled_profile_clear(sled_t *sled, int profile, bool in_use);
+void sled_profile_probe_direct_tasks(sled_t *sled);
 
 
 #endif
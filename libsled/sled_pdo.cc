@@ -0,0 +1,152 @@
+#include "config.h"
+#include "sled_internal.h"
+
+#include <assert.h>
+#include <math.h>
+
+
+/**
+ * PDO configuration of the drive.
+ *
+ * TPDO1 and TPDO2 feed the state machines and position (sled.cc),
+ * TPDO3 and TPDO4 carry diagnostic channels. Inhibit times are in
+ * 100 us, event timers in ms.
+ */
+const mch_net_pdo_t sled_pdo_map[] = {
+	// Status word and mode of operation, on change
+	{true, 1, 0xFF, 10, 10, 2, {
+		{0x60410010, -1},
+		{0x60610008, -1}}},
+
+	// Position and velocity, on change or on SYNC (mch_net_set_tpdo2_sync)
+	{true, 2, 0xFF, 10, 10, 2, {
+		{0x60640020, -1},
+		{0x606C0020, -1}}},
+
+	// Following error and current, on change
+	{true, 3, 0xFF, 50, 100, 2, {
+		{0x60F40020, SLED_CHANNEL_FOLLOWING_ERROR},
+		{0x60780010, SLED_CHANNEL_CURRENT}}},
+
+	// Digital inputs, on change
+	{true, 4, 0xFF, 10, 100, 1, {
+		{0x60FD0020, SLED_CHANNEL_DIGITAL_INPUTS}}},
+
+	// Interpolation set-point, applied on every SYNC
+	{false, 2, 0x01, 0, 0, 1, {
+		{0x60C10120, -1}}},
+
+	#ifdef RPDO_MOTION_TRIGGER
+	// Motion task and control word, the task is mapped first
+	//  such that it is set before the control word.
+	{false, 1, 0xFF, 0, 0, 2, {
+		{0x20800010, -1},
+		{0x60400010, -1}}},
+	#endif
+};
+
+const int sled_pdo_map_size = sizeof(sled_pdo_map) / sizeof(mch_net_pdo_t);
+
+
+/**
+ * Decoding of channels: whether the object is signed and the factor
+ * to convert to SI units (following error in m, current in fraction
+ * of rated current).
+ */
+struct sled_channel_desc_t {
+	const char *name;
+	bool is_signed;
+	double scale;
+};
+
+static const sled_channel_desc_t sled_channels[SLED_NUM_CHANNELS] = {
+	{"following-error", true, 1.0 / 1000.0 / 1000.0},
+	{"current", true, 1.0 / 1000.0},
+	{"digital-inputs", false, 1.0},
+};
+
+
+/**
+ * Decodes TPDO into the channels mapped onto it.
+ */
+void sled_pdo_decode(sled_t *sled, int pdo, uint8_t *data, double time)
+{
+	for(int i = 0; i < sled_pdo_map_size; i++) {
+		const mch_net_pdo_t *map = &(sled_pdo_map[i]);
+
+		if(!map->transmit || map->number != pdo)
+			continue;
+
+		int offset = 0;
+
+		for(int j = 0; j < map->count; j++) {
+			int bytes = (map->entries[j].object & 0xFF) / 8;
+			int channel = map->entries[j].channel;
+
+			if(offset + bytes > 8)
+				break;
+
+			uint32_t raw = 0;
+			for(int k = 0; k < bytes; k++)
+				raw |= uint32_t(data[offset + k]) << (8 * k);
+
+			offset += bytes;
+
+			if(channel < 0 || channel >= SLED_NUM_CHANNELS)
+				continue;
+
+			const sled_channel_desc_t *desc = &(sled_channels[channel]);
+			double value = raw;
+
+			// Sign extend
+			if(desc->is_signed && bytes < 4 && (raw & (1u << (8 * bytes - 1))))
+				value = double(int32_t(raw | (0xFFFFFFFFu << (8 * bytes))));
+			else if(desc->is_signed)
+				value = double(int32_t(raw));
+
+			sled->channels[channel].value = value * desc->scale;
+			sled->channels[channel].time = time;
+			sled->channels[channel].valid = true;
+		}
+	}
+}
+
+
+/**
+ * Returns name of channel.
+ */
+const char *sled_channel_name(sled_channel_t channel)
+{
+	if(channel < 0 || channel >= SLED_NUM_CHANNELS)
+		return "invalid";
+
+	return sled_channels[channel].name;
+}
+
+
+/**
+ * Returns last value of a diagnostic channel, sent by the drive in
+ * TPDO3 and TPDO4.
+ *
+ * @param handle  Sled handle.
+ * @param channel  Channel.
+ * @param value  Value (by-reference), in meters for following error
+ *               and fraction of rated current for current.
+ * @param time  Time the value was received (by-reference).
+ *
+ * @return 0 on success, -1 if no value was received yet.
+ */
+int sled_rt_get_channel(sled_t *handle, sled_channel_t channel, double &value, double &time)
+{
+	assert(handle);
+
+	if(channel < 0 || channel >= SLED_NUM_CHANNELS || !handle->channels[channel].valid) {
+		value = time = NAN;
+		return -1;
+	}
+
+	value = handle->channels[channel].value;
+	time = handle->channels[channel].time;
+
+	return 0;
+}
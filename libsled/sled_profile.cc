@@ -1,9 +1,12 @@
 #include "sled_internal.h"
+#include "sled_time.h"
 
 #include <syslog.h>
 #include <assert.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <math.h>
+#include <time.h>
 
 
 /**
@@ -81,32 +84,38 @@ static bool sled_profile_has_changes_pending(sled_profile_t *profile)
 
 
 /**
- * Set state of field identified by dictionary index.
+ * State of field identified by dictionary index.
  */
-static void sled_profile_set_field_state(sled_profile_t *profile, uint16_t index, field_state_t state)
+static field_state_t *sled_profile_field_state(sled_profile_t *profile, uint16_t index)
 {
 	assert(profile);
 
 	switch(index) {
-		case OB_O_P:   profile->_ob_o_p   = state; break;
-		case OB_O_V:   profile->_ob_o_v   = state; break;
-		case OB_O_C:   profile->_ob_o_c   = state; break;
-		case OB_O_ACC: profile->_ob_o_acc = state; break;
-		case OB_O_DEC: profile->_ob_o_dec = state; break;
-		case OB_O_TAB: profile->_ob_o_tab = state; break;
-		case OB_O_FN:  profile->_ob_o_fn  = state; break;
-		case OB_O_FT:  profile->_ob_o_ft  = state; break;
+		case OB_O_P:   return &(profile->_ob_o_p);
+		case OB_O_V:   return &(profile->_ob_o_v);
+		case OB_O_C:   return &(profile->_ob_o_c);
+		case OB_O_ACC: return &(profile->_ob_o_acc);
+		case OB_O_DEC: return &(profile->_ob_o_dec);
+		case OB_O_TAB: return &(profile->_ob_o_tab);
+		case OB_O_FN:  return &(profile->_ob_o_fn);
+		case OB_O_FT:  return &(profile->_ob_o_ft);
 	}
+
+	return NULL;
 }
 
 
 /**
- * Mark field as written.
+ * Mark field as written, unless it changed again (or was staged)
+ * while being written.
  */
 static void on_success_callback(void *data, uint16_t index, uint8_t subindex)
 {
 	sled_profile_t *profile = (sled_profile_t *) data;
-	sled_profile_set_field_state(profile, index, FIELD_WRITTEN);
+	field_state_t *state = sled_profile_field_state(profile, index);
+
+	if(state && *state == FIELD_WRITING)
+		*state = FIELD_WRITTEN;
 }
 
 
@@ -116,7 +125,10 @@ static void on_success_callback(void *data, uint16_t index, uint8_t subindex)
 static void on_failure_callback(void *data, uint16_t index, uint8_t subindex, uint32_t abort)
 {
 	sled_profile_t *profile = (sled_profile_t *) data;
-	sled_profile_set_field_state(profile, index, FIELD_INVALID);
+	field_state_t *state = sled_profile_field_state(profile, index);
+
+	if(state)
+		*state = FIELD_INVALID;
 
 	syslog(LOG_ERR, "%s() uploading of profile failed \
 			abort code %04x on index %04x:%02x",
@@ -129,34 +141,98 @@ static void on_failure_callback(void *data, uint16_t index, uint8_t subindex, ui
 #define WRITE_FIELD_IF_CHANGED(name, index, value) \
 	if(profile->_ ## name == FIELD_CHANGED) { \
 		profile->_ ## name = FIELD_WRITING; \
-		mch_sdo_queue_write_with_cb( \
-				sled->mch_sdo, index, 0x01, value, 0x04, \
+		mch_sdo_queue_write_with_class_cb( \
+				sled->mch_sdo, index, subindex, value, 0x04, sdo_class, \
 				on_success_callback, on_failure_callback, (void *) profile \
 				); \
 	}
 
 
+/**
+ * Whether fields are written to the motion task itself.
+ */
+static bool sled_profile_direct(sled_t *sled)
+{
+	return sled->direct_tasks && sled->direct_tasks_supported == 1;
+}
+
+
+/**
+ * The drive addresses the first motion task directly.
+ */
+static void on_probe_callback(void *data, uint16_t index, uint8_t subindex, uint32_t value)
+{
+	sled_t *sled = (sled_t *) data;
+	sled->direct_tasks_supported = 1;
+}
+
+
+/**
+ * The drive lacks the subindex of the first motion task, tasks are
+ * edited in task 0. A dropped probe (code 0) is sent again once SDOs
+ * are enabled.
+ */
+static void on_probe_failure_callback(void *data, uint16_t index, uint8_t subindex, uint32_t abort)
+{
+	sled_t *sled = (sled_t *) data;
+
+	if(abort == 0)
+		return;
+
+	syslog(LOG_NOTICE, "%s() direct motion task access not supported "
+		"(abort code %08x), copying tasks instead", __FUNCTION__, abort);
+
+	sled->direct_tasks_supported = 0;
+}
+
+
+/**
+ * Reads the first motion task at its own subindex once, if direct
+ * task access was selected. Profiles are uploaded through task 0
+ * until the read succeeds.
+ */
+void sled_profile_probe_direct_tasks(sled_t *sled)
+{
+	assert(sled);
+
+	if(!sled->direct_tasks || sled->direct_tasks_supported >= 0)
+		return;
+
+	mch_sdo_queue_read_with_cb(sled->mch_sdo, OB_O_P, OB_O_SUBINDEX(FIRST_MOTION_TASK),
+		on_probe_callback, on_probe_failure_callback, (void *) sled);
+}
+
+
 #define COPY_MOTION_TASK(from, to) \
 	mch_sdo_queue_write(sled->mch_sdo, OB_COPY_MOTION_TASK, 0x0, (from & 0xFFFF) | ((to & 0xFFFF) << 16), 0x04);
 
 
 /**
- * Writes all pending changes to the device.
+ * Writes pending changes of a profile to its motion task, or to the
+ * task it is staged in.
+ *
+ * With direct task access selected the fields are written to the
+ * task itself, otherwise the task is edited in slot 0 and copied back.
  */
-int sled_profile_write_pending_changes(sled_t *sled, int profile_id)
+static void sled_profile_upload(sled_t *sled, sled_profile_t *profile, uint8_t sdo_class)
 {
-	sled_profile_t *profile = &(sled->profiles[profile_id]);
-
 	assert(sled && profile);
 
-	// No changes pending, bail out
 	if(!sled_profile_has_changes_pending(profile))
-		return 0;
+		return;
 
-	// Load correct profile in slot 0
-	if(!profile->never_sent && sled->current_profile != profile->profile) {
-		COPY_MOTION_TASK(profile->profile, 0x00)
-		sled->current_profile = profile->profile;
+	int task = profile->staged >= 0 ? profile->staged : profile->profile;
+	bool direct = sled_profile_direct(sled);
+	uint8_t subindex = OB_O_SUBINDEX(direct ? task : 0);
+
+	if(direct) {
+		// Slot 0 no longer matches the task
+		if(sled->current_profile == task)
+			sled->current_profile = -1;
+	} else if(!profile->never_sent && sled->current_profile != task) {
+		// Load correct profile in slot 0
+		COPY_MOTION_TASK(task, 0x00)
+		sled->current_profile = task;
 	}
 
 	WRITE_FIELD_IF_CHANGED(ob_o_p,   OB_O_P,   int32_t(profile->position * 1000.0 * 1000.0));
@@ -176,8 +252,29 @@ int sled_profile_write_pending_changes(sled_t *sled, int profile_id)
 	WRITE_FIELD_IF_CHANGED(ob_o_ft,  OB_O_FT,  int32_t(profile->delay * 1000.0));
 
 	// Copy back to profile (this could be defered to a later time)
-	COPY_MOTION_TASK(0x00, profile->profile);
+	if(!direct) {
+		COPY_MOTION_TASK(0x00, task);
+		sled->current_profile = task;
+	}
+
 	profile->never_sent = false;
+}
+
+
+/**
+ * Writes all pending changes to the device.
+ */
+int sled_profile_write_pending_changes(sled_t *sled, int profile_id)
+{
+	sled_profile_t *profile = &(sled->profiles[profile_id]);
+
+	assert(sled && profile);
+
+	// No changes pending, bail out
+	if(!sled_profile_has_changes_pending(profile))
+		return 0;
+
+	sled_profile_upload(sled, profile, SDO_CLASS_DEFAULT);
 
 	// Write profiles that the current profile depends on...
 	if(profile->next_profile >= 0)
@@ -197,7 +294,8 @@ void sled_profile_clear(sled_t *sled, int profile, bool in_use)
 
 	sled_profile_t *p = &(sled->profiles[profile]);
 
-	p->profile = 201 + profile;
+	p->profile = FIRST_MOTION_TASK + profile;
+	p->staged = -1;
 	p->in_use = in_use;
 
 	p->table = 2;
@@ -228,6 +326,28 @@ int sled_profiles_reset(sled_t *sled)
 }
 
 
+/**
+ * Returns a motion task that no profile holds, or -1 if there is none.
+ * Tasks move between profiles as staged tasks are swapped in.
+ */
+static int sled_profile_free_task(sled_t *sled)
+{
+	for(int task = FIRST_MOTION_TASK; task <= LAST_MOTION_TASK; task++) {
+		bool held = false;
+
+		for(int i = 0; i < MAX_PROFILES && !held; i++) {
+			sled_profile_t *p = &(sled->profiles[i]);
+			held = p->in_use && (p->profile == task || p->staged == task);
+		}
+
+		if(!held)
+			return task;
+	}
+
+	return -1;
+}
+
+
 /**
  * Allocates a profile on the sled.
  *
@@ -237,7 +357,12 @@ int sled_profile_create(sled_t *sled)
 {
 	for(int i = 0; i < MAX_PROFILES; i++) {
 		if(!sled->profiles[i].in_use) {
+			int task = sled_profile_free_task(sled);
+			if(task == -1)
+				return -1;
+
 			sled_profile_clear(sled, i, true);
+			sled->profiles[i].profile = task;
 			sled->profiles[i].in_use = true;
 			sled->profiles[i].never_sent = true;
 			return i;
@@ -270,7 +395,7 @@ int sled_profile_create_pt(sled_t *sled, double position, double time)
 /**
  * Destroys a sled profile, freeing it for future use.
  *
- * Returns 0 on success, -1 on failure (invalid profile)
+ * Returns 0 on success, -1 on failure (invalid profile, SDO queue full)
  */
 int sled_profile_destroy(sled_t *sled, int profile)
 {
@@ -280,16 +405,83 @@ int sled_profile_destroy(sled_t *sled, int profile)
 	if(!sled->profiles[profile].in_use)
 		return -1;
 
+	// Writes still queued at low priority would land after those of the
+	// next owner of the task, raise them above any write queued later
+	mch_sdo_promote(sled->mch_sdo, (void *) &(sled->profiles[profile]), SDO_CLASS_MOTION);
+
 	sled->profiles[profile].in_use = false;
 
 	return 0;
 }
 
 
+/**
+ * Stages a profile to be executed next: its fields are written to a
+ * second motion task in the background, while the profile may still
+ * be executing from its current task. Changes made after staging go
+ * to the staged task as well. Execution swaps the tasks, such that
+ * only the trigger remains to be sent.
+ *
+ * With direct task access the fields are written at the lowest SDO
+ * priority. Without it they pass through task 0 like any other upload,
+ * and keep the priority of motion tasks.
+ *
+ * Returns 0 on success, -1 on failure (invalid profile, no free task)
+ */
+int sled_profile_stage(sled_t *sled, int profile)
+{
+	if(profile < 0 || profile >= MAX_PROFILES)
+		return -1;
+
+	sled_profile_t *p = &(sled->profiles[profile]);
+
+	if(!p->in_use)
+		return -1;
+
+	if(p->staged < 0) {
+		int task = sled_profile_free_task(sled);
+
+		if(task == -1) {
+			syslog(LOG_ERR, "%s(%d) no free motion task", __FUNCTION__, profile);
+			return -1;
+		}
+
+		// Contents of the task are unknown, write all fields
+		p->staged = task;
+		p->never_sent = true;
+		sled_profile_mark_as_unsaved(p);
+	}
+
+	sled_profile_upload(sled, p, sled_profile_direct(sled) ? SDO_CLASS_BULK : SDO_CLASS_DEFAULT);
+
+	return 0;
+}
+
+
+/**
+ * Makes the staged task of a profile its motion task. Staged writes
+ * still queued are promoted, such that the trigger follows them.
+ */
+static void sled_profile_swap(sled_t *sled, int profile)
+{
+	sled_profile_t *p = &(sled->profiles[profile]);
+
+	mch_sdo_promote(sled->mch_sdo, (void *) p, SDO_CLASS_MOTION);
+
+	p->profile = p->staged;
+	p->staged = -1;
+
+	// Profiles continuing with this one refer to its old task
+	for(int i = 0; i < MAX_PROFILES; i++)
+		if(sled->profiles[i].in_use && sled->profiles[i].next_profile == profile)
+			sled->profiles[i]._ob_o_fn = FIELD_CHANGED;
+}
+
+
 /**
  * Sets type of profile (sinusoid or minimum jerk)
  *
- * Returns 0 on success, -1 on failure (invalid profile)
+ * Returns 0 on success, -1 on failure (invalid profile, SDO queue full)
  */
 int sled_profile_set_table(sled_t *sled, int profile, int table)
 {
@@ -311,7 +503,7 @@ int sled_profile_set_table(sled_t *sled, int profile, int table)
 /**
  * Sets profile target and time.
  *
- * Returns 0 on success, -1 on failure (invalid profile)
+ * Returns 0 on success, -1 on failure (invalid profile, SDO queue full)
  */
 int sled_profile_set_target(sled_t *sled, int profile, position_type_t type, double position, double time)
 {
@@ -350,7 +542,7 @@ int sled_profile_set_target(sled_t *sled, int profile, position_type_t type, dou
 /**
  * Sets next profile and blending type.
  *
- * Returns 0 on success, -1 on failure (invalid profile)
+ * Returns 0 on success, -1 on failure (invalid profile, SDO queue full)
  */
 int sled_profile_set_next(sled_t *sled, int profile, int next_profile, double delay, blend_type_t blend_type)
 {
@@ -381,10 +573,48 @@ int sled_profile_set_next(sled_t *sled, int profile, int next_profile, double de
 }
 
 
+/**
+ * Remember trajectory of profile that is executed, used to predict
+ * the position. Motion tasks accelerate over the first half and
+ * decelerate over the second half of their time, the acceleration is
+ * at most 2 pi d / t^2 for sinusoidal ramps.
+ */
+static void sled_profile_set_motion(sled_t *sled, sled_profile_t *profile)
+{
+	double distance = profile->position;
+	double target = NAN;
+
+	switch(profile->position_type) {
+		case pos_absolute:
+			target = profile->position;
+			distance = profile->position - sled->last_position;
+			break;
+		case pos_relative_actual:
+			target = sled->last_position + profile->position;
+			break;
+		case pos_relative_target:
+			break;
+	}
+
+	sled->motion_pending = true;
+	sled->motion_start = get_time();
+	sled->motion_time = profile->time;
+
+	// Chained profiles continue after the target
+	if(profile->next_profile >= 0 || profile->time <= 0.0) {
+		sled->motion_target = NAN;
+		sled->motion_acceleration = SLED_MAX_ACCELERATION;
+	} else {
+		sled->motion_target = target;
+		sled->motion_acceleration = 2.0 * M_PI * fabs(distance) / (profile->time * profile->time);
+	}
+}
+
+
 /**
  * Execute specified profile.
  *
- * Returns 0 on success, -1 on failure (invalid profile)
+ * Returns 0 on success, -1 on failure (invalid profile, SDO queue full)
  * Success only indicates that the command has been received.
  *
  * Fixme: we might want to return some kind of handle such that
@@ -407,14 +637,27 @@ int sled_profile_execute(sled_t *sled, int profile)
 		return -1;
 	}
 
-	sled_profile_write_pending_changes(sled, profile);
+	// Swap in staged tasks along the chain, then write what changed
+	int id = profile;
+	for(int i = 0; i < MAX_PROFILES && id >= 0; i++, id = sled->profiles[id].next_profile)
+		if(sled->profiles[id].staged >= 0)
+			sled_profile_swap(sled, id);
 
-	// Set motion profile to be executed
-	mch_sdo_queue_write(sled->mch_sdo, OB_MOTION_TASK, 0x00, sled->profiles[profile].profile, 0x02);
-	mch_sdo_queue_write(sled->mch_sdo, OB_CONTROL_WORD, 0x00, 0x1F | 0x20, 0x02);
+	id = profile;
+	for(int i = 0; i < MAX_PROFILES && id >= 0; i++, id = sled->profiles[id].next_profile)
+		sled_profile_upload(sled, &(sled->profiles[id]), SDO_CLASS_DEFAULT);
+
+	// Set motion profile to be executed and raise new set-point
+	if(mch_mp_send_motion_task(sled->mch_mp, sled->profiles[profile].profile, 0x1F | 0x20) == -1) {
+		syslog(LOG_ERR, "%s(%d) unable to execute, SDO queue full or drive not enabled",
+				__FUNCTION__, profile);
+		return -1;
+	}
 
 	mch_mp_handle_event(sled->mch_mp, EV_MP_SETPOINT_SET);
 
+	sled_profile_set_motion(sled, &(sled->profiles[profile]));
+
 	return 0;
 }
 
@@ -24,6 +24,7 @@ int sled_profile_create(sled_t *sled);
 int sled_profile_create_pt(sled_t *sled, double position, double time);
 int sled_profile_execute(sled_t *sled, int profile);
 int sled_profile_destroy(sled_t *sled, int profile);
+int sled_profile_stage(sled_t *sled, int profile);
 
 int sled_profiles_reset(sled_t *sled);
 int sled_profile_write_pending_changes(sled_t *sled, int profile_id);
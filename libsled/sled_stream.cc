@@ -0,0 +1,280 @@
+#include "sled_internal.h"
+#include "sled_time.h"
+
+#include <assert.h>
+#include <math.h>
+#include <string.h>
+#include <syslog.h>
+#include <time.h>
+
+
+/**
+ * Takes the set-point to send this cycle from the buffer.
+ *
+ * The oldest set-point is sent once it has to be reached before the end
+ * of the next cycle. Set-points that are already overdue are skipped if
+ * a newer one is overdue as well, so a late stream catches up.
+ *
+ * @return True if a new set-point was taken.
+ */
+static bool sled_stream_take(sled_stream_t *stream, double now, sled_setpoint_t *setpoint)
+{
+	uint32_t tail = stream->tail;
+	uint32_t head = __atomic_load_n(&(stream->head), __ATOMIC_ACQUIRE);
+
+	if(tail == head || stream->buffer[tail % SLED_STREAM_BUFFER_SIZE].time > now + stream->period)
+		return false;
+
+	while(head - tail > 1 && stream->buffer[(tail + 1) % SLED_STREAM_BUFFER_SIZE].time <= now) {
+		stream->skipped++;
+		tail++;
+	}
+
+	*setpoint = stream->buffer[tail % SLED_STREAM_BUFFER_SIZE];
+	tail++;
+
+	__atomic_store_n(&(stream->tail), tail, __ATOMIC_RELEASE);
+
+	return true;
+}
+
+
+/**
+ * Sends the set-point for the next cycle (RPDO2), called by the SYNC
+ * producer just before SYNC is sent.
+ *
+ * The set-point is held until the drive follows set-points, that is
+ * while switching to interpolated position mode.
+ */
+void sled_stream_on_cycle(sled_t *sled)
+{
+	sled_stream_t *stream = &(sled->stream);
+	double now = get_time();
+
+	if(mch_mp_active_state(sled->mch_mp) == ST_MP_IP_STREAM) {
+		sled_setpoint_t setpoint;
+
+		if(sled_stream_take(stream, now, &setpoint)) {
+			double latency = now - setpoint.queued;
+
+			stream->setpoint = setpoint.position;
+			stream->setpoints++;
+			stream->sum_latency += latency;
+			if(latency > stream->max_latency)
+				stream->max_latency = latency;
+
+			stream->started = true;
+		} else if(stream->started) {
+			stream->underruns++;
+		}
+	}
+
+	int32_t value = int32_t(round(stream->setpoint * 1000.0 * 1000.0));
+
+	intf_send_rpdo(sled->interface, FC_RPDO2, uint32_t(value), 0x04);
+
+	stream->cycles++;
+}
+
+
+/**
+ * Compares position reported by the drive with the last set-point.
+ */
+void sled_stream_on_feedback(sled_t *sled, double position)
+{
+	sled_stream_t *stream = &(sled->stream);
+
+	if(!stream->active || !stream->started)
+		return;
+
+	if(mch_mp_active_state(sled->mch_mp) != ST_MP_IP_STREAM)
+		return;
+
+	double error = fabs(position - stream->setpoint);
+
+	stream->feedback++;
+	stream->sum_sq_error += error * error;
+	if(error > stream->max_error)
+		stream->max_error = error;
+}
+
+
+static void sled_stream_reset_stats(sled_stream_t *stream)
+{
+	stream->cycles = stream->setpoints = stream->underruns = stream->skipped = 0;
+	__atomic_store_n(&(stream->overflows), 0, __ATOMIC_RELAXED);
+
+	stream->sum_latency = stream->max_latency = 0.0;
+	stream->feedback = 0;
+	stream->sum_sq_error = stream->max_error = 0.0;
+}
+
+
+void sled_stream_init(sled_t *sled)
+{
+	sled_stream_t *stream = &(sled->stream);
+
+	stream->head = stream->tail = 0;
+	stream->active = false;
+	stream->period = SLED_STREAM_DEFAULT_PERIOD;
+	stream->setpoint = 0.0;
+	stream->started = false;
+
+	sled_stream_reset_stats(stream);
+}
+
+
+/**
+ * Queue position set-point for streaming, to be sent in the next cycle.
+ *
+ * @param handle  Sled handle.
+ * @param position  Position set-point in meters.
+ *
+ * @return 0 on success, -1 if not streaming or the buffer is full.
+ */
+int sled_rt_new_setpoint(sled_t *handle, double position)
+{
+	return sled_rt_new_setpoint_at(handle, position, get_time());
+}
+
+
+/**
+ * Queue position set-point for streaming. This function may be called
+ * from a thread other than the one running the event loop, as long as
+ * only a single thread queues set-points.
+ *
+ * @param handle  Sled handle.
+ * @param position  Position set-point in meters.
+ * @param time  Time (CLOCK_MONOTONIC) at which the position should be reached.
+ *
+ * @return 0 on success, -1 if not streaming or the buffer is full.
+ */
+int sled_rt_new_setpoint_at(sled_t *handle, double position, double time)
+{
+	assert(handle);
+	sled_stream_t *stream = &(handle->stream);
+
+	if(!__atomic_load_n(&(stream->active), __ATOMIC_ACQUIRE))
+		return -1;
+
+	uint32_t head = stream->head;
+	uint32_t tail = __atomic_load_n(&(stream->tail), __ATOMIC_ACQUIRE);
+
+	if(head - tail >= SLED_STREAM_BUFFER_SIZE) {
+		__atomic_fetch_add(&(stream->overflows), 1, __ATOMIC_RELAXED);
+		return -1;
+	}
+
+	sled_setpoint_t *setpoint = &(stream->buffer[head % SLED_STREAM_BUFFER_SIZE]);
+	setpoint->time = time;
+	setpoint->position = position;
+	setpoint->queued = get_time();
+
+	__atomic_store_n(&(stream->head), head + 1, __ATOMIC_RELEASE);
+
+	return 0;
+}
+
+
+/**
+ * Switch to interpolated position mode and start sending set-points.
+ *
+ * Every period a set-point (RPDO2) and SYNC are sent, starting at the
+ * current position. While streaming, the SYNC producer runs at the
+ * streaming period. Fails unless the sled is idle.
+ *
+ * @param handle  Sled handle.
+ * @param period  Cycle time in seconds (whole milliseconds).
+ */
+int sled_rt_stream_start(sled_t *handle, double period)
+{
+	assert(handle);
+	sled_stream_t *stream = &(handle->stream);
+
+	int period_ms = int(round(period * 1000.0));
+
+	if(period_ms < 1 || period_ms > 255)
+		return -1;
+
+	if(stream->active || mch_mp_active_state(handle->mch_mp) != ST_MP_PP_IDLE) {
+		syslog(LOG_ERR, "%s() unable to start streaming, motor not idle", __FUNCTION__);
+		return -1;
+	}
+
+	// Interpolation period (ms)
+	if(mch_sdo_queue_write_with_class(handle->mch_sdo, 0x60C2, 0x01, period_ms, 0x01, SDO_CLASS_MOTION) == -1 ||
+	   mch_sdo_queue_write_with_class(handle->mch_sdo, 0x60C2, 0x02, 0xFD, 0x01, SDO_CLASS_MOTION) == -1)
+		return -1;
+
+	stream->period = period_ms / 1000.0;
+	stream->setpoint = handle->last_position;
+	stream->started = false;
+	stream->head = stream->tail = 0;
+
+	__atomic_store_n(&(stream->active), true, __ATOMIC_RELEASE);
+
+	if(sled_sync_update(handle) == -1) {
+		__atomic_store_n(&(stream->active), false, __ATOMIC_RELEASE);
+		return -1;
+	}
+
+	mch_mp_handle_event(handle->mch_mp, EV_MP_STREAM_START);
+
+	return 0;
+}
+
+
+/**
+ * Stop streaming and return to profile position mode.
+ */
+int sled_rt_stream_stop(sled_t *handle)
+{
+	assert(handle);
+	sled_stream_t *stream = &(handle->stream);
+
+	if(!stream->active)
+		return -1;
+
+	__atomic_store_n(&(stream->active), false, __ATOMIC_RELEASE);
+	sled_sync_update(handle);
+
+	mch_mp_handle_event(handle->mch_mp, EV_MP_STREAM_STOP);
+
+	return 0;
+}
+
+
+/**
+ * Returns statistics of set-point streaming.
+ *
+ * @param handle  Sled handle.
+ * @param stats  Receives the statistics.
+ * @param reset  Reset statistics after reading.
+ *
+ * @return 0 on success, -1 on failure.
+ */
+int sled_rt_get_stream_statistics(sled_t *handle, sled_stream_stats_t *stats, bool reset)
+{
+	assert(handle);
+	sled_stream_t *stream = &(handle->stream);
+
+	if(!stats)
+		return -1;
+
+	stats->cycles = stream->cycles;
+	stats->setpoints = stream->setpoints;
+	stats->underruns = stream->underruns;
+	stats->skipped = stream->skipped;
+	stats->overflows = __atomic_load_n(&(stream->overflows), __ATOMIC_RELAXED);
+
+	stats->mean_latency = stream->setpoints ? stream->sum_latency / stream->setpoints : 0.0;
+	stats->max_latency = stream->max_latency;
+
+	stats->rms_error = stream->feedback ? sqrt(stream->sum_sq_error / stream->feedback) : 0.0;
+	stats->max_error = stream->max_error;
+
+	if(reset)
+		sled_stream_reset_stats(stream);
+
+	return 0;
+}
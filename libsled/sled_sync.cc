@@ -0,0 +1,186 @@
+#include "sled_internal.h"
+#include "sled_time.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <event2/event.h>
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+#include <syslog.h>
+#include <unistd.h>
+#include <sys/timerfd.h>
+
+
+/**
+ * Timer expired, send SYNC.
+ *
+ * Expirations that were not handled in time are counted as missed,
+ * only a single SYNC is sent for them.
+ */
+static void sled_sync_on_timer(evutil_socket_t fd, short flags, void *param)
+{
+	sled_t *sled = (sled_t *) param;
+	sled_sync_t *sync = &(sled->sync);
+	uint64_t expirations;
+
+	if(read(fd, &expirations, sizeof(expirations)) != sizeof(expirations))
+		return;
+
+	if(expirations > 1)
+		sync->missed += expirations - 1;
+
+	if(sled->stream.active)
+		sled_stream_on_cycle(sled);
+
+	sync->last_time = get_time();
+	intf_send_sync(sled->interface);
+	sync->cycles++;
+}
+
+
+int sled_sync_init(sled_t *sled)
+{
+	sled_sync_t *sync = &(sled->sync);
+
+	sync->enabled = false;
+	sync->period = sync->armed_period = 0.0;
+	sync->last_time = 0.0;
+	sync->cycles = sync->missed = 0;
+
+	sync->fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+
+	if(sync->fd == -1) {
+		syslog(LOG_ERR, "%s() timerfd_create failed (%s)", __FUNCTION__, strerror(errno));
+		return -1;
+	}
+
+	sync->ev = event_new(sled->ev_base, sync->fd, EV_READ | EV_PERSIST, sled_sync_on_timer, (void *) sled);
+	event_priority_set(sync->ev, 0);
+	event_add(sync->ev, NULL);
+
+	return 0;
+}
+
+
+/**
+ * (Re)arms the timer at the period required, or stops it.
+ */
+int sled_sync_update(sled_t *sled)
+{
+	sled_sync_t *sync = &(sled->sync);
+	double period = 0.0;
+
+	if(sled->stream.active)
+		period = sled->stream.period;
+	else if(sync->enabled)
+		period = sync->period;
+
+	if(period == sync->armed_period)
+		return 0;
+
+	long ns = long(round(period * 1000.0 * 1000.0 * 1000.0));
+
+	itimerspec spec;
+	spec.it_interval.tv_sec = ns / 1000000000L;
+	spec.it_interval.tv_nsec = ns % 1000000000L;
+	spec.it_value = spec.it_interval;
+
+	if(timerfd_settime(sync->fd, 0, &spec, NULL) == -1) {
+		syslog(LOG_ERR, "%s() timerfd_settime failed (%s)", __FUNCTION__, strerror(errno));
+		return -1;
+	}
+
+	sync->armed_period = period;
+
+	return 0;
+}
+
+
+void sled_sync_destroy(sled_t *sled)
+{
+	sled_sync_t *sync = &(sled->sync);
+
+	event_free(sync->ev);
+	close(sync->fd);
+}
+
+
+/**
+ * Start sending SYNC messages at a fixed period.
+ *
+ * With sync_tpdo, the drive sends position and velocity (TPDO2) on
+ * every SYNC instead of on change, such that samples are taken at
+ * evenly spaced times. While set-points are streamed, SYNC is sent at
+ * the streaming period instead.
+ *
+ * @param handle  Sled handle.
+ * @param period  SYNC period in seconds.
+ * @param sync_tpdo  Transmit TPDO2 on SYNC.
+ *
+ * @return 0 on success, -1 on failure.
+ */
+int sled_sync_start(sled_t *handle, double period, bool sync_tpdo)
+{
+	assert(handle);
+	sled_sync_t *sync = &(handle->sync);
+
+	if(period < 0.0005 || period > 1.0)
+		return -1;
+
+	sync->enabled = true;
+	sync->period = period;
+
+	if(sled_sync_update(handle) == -1) {
+		sync->enabled = false;
+		return -1;
+	}
+
+	return mch_net_set_tpdo2_sync(handle->mch_net, sync_tpdo);
+}
+
+
+/**
+ * Stop sending SYNC messages, TPDO2 is sent on change again.
+ */
+int sled_sync_stop(sled_t *handle)
+{
+	assert(handle);
+	sled_sync_t *sync = &(handle->sync);
+
+	if(!sync->enabled)
+		return -1;
+
+	sync->enabled = false;
+	sled_sync_update(handle);
+
+	return mch_net_set_tpdo2_sync(handle->mch_net, false);
+}
+
+
+/**
+ * Returns statistics of the SYNC producer.
+ *
+ * @param handle  Sled handle.
+ * @param stats  Receives the statistics.
+ * @param reset  Reset statistics after reading.
+ *
+ * @return 0 on success, -1 on failure.
+ */
+int sled_sync_get_statistics(sled_t *handle, sled_sync_stats_t *stats, bool reset)
+{
+	assert(handle);
+	sled_sync_t *sync = &(handle->sync);
+
+	if(!stats)
+		return -1;
+
+	stats->period = sync->armed_period;
+	stats->cycles = sync->cycles;
+	stats->missed = sync->missed;
+
+	if(reset)
+		sync->cycles = sync->missed = 0;
+
+	return 0;
+}
@@ -0,0 +1,16 @@
+#ifndef __SLED_TIME_H__
+#define __SLED_TIME_H__
+
+#include <time.h>
+
+/**
+ * Returns current time in seconds (CLOCK_MONOTONIC).
+ */
+static inline double get_time()
+{
+	timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return double(ts.tv_sec) + double(ts.tv_nsec) / 1000.0 / 1000.0 / 1000.0;
+}
+
+#endif
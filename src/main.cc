@@ -185,8 +185,22 @@ static void print_help()
 	" on " __DATE__ " " __TIME__ "\n");
 
 	printf("\n");
-	printf("  --no-daemon   Do not daemonize.\n");
-	printf("  --help        Print help text.\n");
+	printf("  --no-daemon     Do not daemonize.\n");
+	printf("  --device DEV    CAN device, PEAK node or SocketCAN interface\n");
+	printf("                  (default /dev/pcanpci0).\n");
+	printf("  --sdo-window N  Number of SDO transfers in progress at the\n");
+	printf("                  same time (default 1).\n");
+	printf("  --sdo-coalesce  Replace queued SDO writes by newer writes\n");
+	printf("                  to the same object.\n");
+	printf("  --sync-period MS  Send SYNC every MS milliseconds and stream\n");
+	printf("                  sample position on every SYNC.\n");
+	printf("  --warm-attach   Adopt a drive that is already operational\n");
+	printf("                  instead of resetting, enabling and homing it.\n");
+	printf("  --direct-tasks  Write motion tasks directly instead of copying\n");
+	printf("                  them through task 0.\n");
+	printf("  --stage-profiles  Upload profiles in the background when set,\n");
+	printf("                  such that executing them only triggers.\n");
+	printf("  --help          Print help text.\n");
 	printf("\n");
 }
 
@@ -194,6 +208,13 @@ static void print_help()
 int main(int argc, char **argv)
 {
 	int daemonize_flag = 1;
+	const char *device = NULL;
+	int sdo_window = 0;
+	int sdo_coalesce_flag = 0;
+	int warm_attach_flag = 0;
+	int direct_tasks_flag = 0;
+	int stage_profiles_flag = 0;
+	double sync_period = 0.0;
 	uid_t uid = get_uid_by_name("sled");
 
 	/* Parse command line arguments */
@@ -202,13 +223,20 @@ int main(int argc, char **argv)
 			{"no-daemon",	no_argument, &daemonize_flag, 0},
 			{"help",		no_argument, 0, 'h'},
 			{"user",		required_argument, 0, 'u'},
+			{"device",		required_argument, 0, 'd'},
+			{"sdo-window",	required_argument, 0, 'w'},
+			{"sdo-coalesce",	no_argument, &sdo_coalesce_flag, 1},
+			{"sync-period",	required_argument, 0, 's'},
+			{"warm-attach",	no_argument, &warm_attach_flag, 1},
+			{"direct-tasks",	no_argument, &direct_tasks_flag, 1},
+			{"stage-profiles",	no_argument, &stage_profiles_flag, 1},
 			{"\0", 0, 0, 0}
 		};
 
 	int option_index = 0;
 	int c = 0;
 
-	while((c = getopt_long(argc, argv, "hu:", long_options, &option_index)) != -1) {
+	while((c = getopt_long(argc, argv, "hu:d:w:s:", long_options, &option_index)) != -1) {
 		switch(c) {
 			case 'u':
 				uid = get_uid_by_name(optarg);
@@ -218,6 +246,18 @@ int main(int argc, char **argv)
 				}
 				break;
 
+			case 'd':
+				device = optarg;
+				break;
+
+			case 'w':
+				sdo_window = atoi(optarg);
+				break;
+
+			case 's':
+				sync_period = atof(optarg) / 1000.0;
+				break;
+
 			case 'h':
 				print_help();
 				exit(EXIT_SUCCESS);
@@ -280,11 +320,32 @@ int main(int argc, char **argv)
 	}
 
 	/* Setup context */
-	sled_server_ctx_t *context = setup_sled_server_context(ev_base);
+	sled_server_ctx_t *context = setup_sled_server_context(ev_base, device);
 
 	if(context == NULL)
 		return 1;
 
+	if(warm_attach_flag)
+		sled_set_warm_attach(context->sled, true);
+
+	if(direct_tasks_flag)
+		sled_set_direct_tasks(context->sled, true);
+
+	context->stage_profiles = stage_profiles_flag;
+
+	if(sdo_window && sled_sdo_set_window(context->sled, sdo_window) == -1) {
+		fprintf(stderr, "Invalid SDO window (%d).\n", sdo_window);
+		return 1;
+	}
+
+	if(sdo_coalesce_flag)
+		sled_sdo_set_coalescing(context->sled, true);
+
+	if(sync_period > 0.0 && sled_sync_start(context->sled, sync_period, true) == -1) {
+		fprintf(stderr, "Invalid SYNC period (%g ms).\n", sync_period * 1000.0);
+		return 1;
+	}
+
 	printf("Starting event loop.\n");
 
 	// Event loop
@@ -1,8 +1,11 @@
 #include "server.h"
 #include "parser.h"
 
+#include <libsled/sled_time.h>
+
 #include <math.h>
 #include <stdlib.h>
+#include <stdio.h>
 #include <arpa/inet.h>
 #include <time.h>
 #include <syslog.h>
@@ -12,6 +15,9 @@
 // Interval at which new samples are sent in us
 #define SAMPLE_INTERVAL 1000
 
+// Position samples fetched from libsled at once
+#define SAMPLE_BATCH 64
+
 // Interval after which samples are counted as invalid
 #define MAX_SAMPLE_INTERVAL 2000
 
@@ -21,19 +27,6 @@
 //test
 #define SAWTOOTH
 
-/**
- * Returns current time in seconds.
- *
- * @return Current time in seconds.
- */
-static double get_time()
-{
-	timespec ts;
-	clock_gettime(CLOCK_MONOTONIC, &ts);
-	return double(ts.tv_sec) + double(ts.tv_nsec) / 1000.0 / 1000.0 / 1000.0;
-}
-
-
 /**
  * Translate protocol profile IDs into sled profile IDs.
  *
@@ -104,8 +97,9 @@ static void rtc3d_command_handler(rtc3d_connection_t *rtc3d_conn, char *cmd)
 
 
 		case cmd_sendcurrentframe: {
-			double position;
-			if(sled_rt_get_position(ctx->sled, position) == -1)
+			// Position at the time of the request, not of the last TPDO
+			double position, error;
+			if(sled_rt_predict_position(ctx->sled, get_time(), position, error) == -1)
 				rtc3d_send_error(rtc3d_conn, (char *) "err-sendcurrentframe");
 			else
 				rtc3d_send_data(rtc3d_conn, -1, -1, position * 1000.0);
@@ -169,6 +163,10 @@ static void rtc3d_command_handler(rtc3d_connection_t *rtc3d_conn, char *cmd)
 				sled_profile_set_next(ctx->sled, profile_id, -1, 0, bln_none);
 			}
 
+			// A profile that was just set is likely executed next
+			if(ctx->stage_profiles)
+				sled_profile_stage(ctx->sled, profile_id);
+
 			rtc3d_send_command(rtc3d_conn, (char *) "ok-profile-set");
 
 			break;
@@ -253,7 +251,96 @@ static void rtc3d_command_handler(rtc3d_connection_t *rtc3d_conn, char *cmd)
 }
 
 
-static void update_timeout_stats(double time_actual)
+/**
+ * Writes CAN receive statistics for the last period to the system log.
+ */
+static void report_can_stats(sled_t *sled)
+{
+	sled_can_stats_t stats;
+
+	if(sled_can_get_statistics(sled, &stats, true) == -1)
+		return;
+
+	syslog(LOG_DEBUG, "%s() %llu frames in %llu wakeups (%llu empty); "
+		"max %u frames per wakeup; max queue depth %u; "
+		"budget exhausted %llu times; %llu overruns\n",
+		__FUNCTION__,
+		(unsigned long long) stats.frames,
+		(unsigned long long) stats.wakeups,
+		(unsigned long long) stats.empty_wakeups,
+		stats.max_frames_per_wakeup, stats.max_queue_depth,
+		(unsigned long long) stats.budget_exhausted,
+		(unsigned long long) stats.overruns);
+
+	syslog(LOG_DEBUG, "%s() %llu machine events in %llu drains; "
+		"max %u events per drain; max %u pending; %llu overflows; "
+		"%.3f ms total, max %.3f ms per drain\n",
+		__FUNCTION__,
+		(unsigned long long) stats.events,
+		(unsigned long long) stats.event_drains,
+		stats.max_events_per_drain, stats.max_pending_events,
+		(unsigned long long) stats.event_overflows,
+		stats.event_time * 1000.0, stats.max_drain_time * 1000.0);
+}
+
+
+/**
+ * Writes SDO statistics for the last period to the system log,
+ * one line per object index.
+ */
+static void report_sdo_stats(sled_t *sled)
+{
+	sled_sdo_stats_t stats[64];
+	int count = sled_sdo_get_statistics(sled, stats, 64, true);
+
+	for(int i = 0; i < count; i++) {
+		char histogram[SLED_SDO_HISTOGRAM_BUCKETS * 11 + 1];
+		int length = 0;
+
+		for(int j = 0; j < SLED_SDO_HISTOGRAM_BUCKETS; j++)
+			length += snprintf(histogram + length, sizeof(histogram) - length, " %u", stats[i].histogram[j]);
+
+		syslog(LOG_DEBUG, "%s() %04x: %llu responses; max %.2f ms; "
+			"%llu retransmits; %llu timeouts; %llu aborts; histogram%s\n",
+			__FUNCTION__, stats[i].index,
+			(unsigned long long) stats[i].responses,
+			stats[i].max_latency * 1e3,
+			(unsigned long long) stats[i].retransmits,
+			(unsigned long long) stats[i].timeouts,
+			(unsigned long long) stats[i].aborts,
+			histogram);
+	}
+
+	sled_sdo_queue_stats_t queue_stats;
+	sled_sdo_get_queue_statistics(sled, &queue_stats, true);
+
+	syslog(LOG_DEBUG, "%s() queue: %u of %u in use; high-water mark %u; %llu overflows; %llu coalesced\n",
+		__FUNCTION__, queue_stats.depth, queue_stats.capacity, queue_stats.high_water_mark,
+		(unsigned long long) queue_stats.overflows,
+		(unsigned long long) queue_stats.coalesced);
+
+	sled_sdo_class_stats_t class_stats[SLED_SDO_NUM_CLASSES];
+	sled_sdo_get_class_statistics(sled, class_stats, true);
+
+	for(int i = 0; i < SLED_SDO_NUM_CLASSES; i++)
+		syslog(LOG_DEBUG, "%s() class %d: %llu sent; queue wait mean %.2f ms, max %.2f ms\n",
+			__FUNCTION__, i, (unsigned long long) class_stats[i].sent,
+			class_stats[i].mean_wait * 1e3, class_stats[i].max_wait * 1e3);
+}
+
+
+static void report_channels(sled_t *sled)
+{
+	for(int i = 0; i < SLED_NUM_CHANNELS; i++) {
+		double value, time;
+
+		if(sled_rt_get_channel(sled, sled_channel_t(i), value, time) == 0)
+			syslog(LOG_DEBUG, "%s() %s: %g\n", __FUNCTION__, sled_channel_name(sled_channel_t(i)), value);
+	}
+}
+
+
+static void update_timeout_stats(sled_server_ctx_t *ctx, double time_actual)
 {
 	static double time_previous = time_actual;
 
@@ -281,12 +368,33 @@ static void update_timeout_stats(double time_actual)
 			(sum_delay/num_samples)*1e6,
 			(max_delay * 1e6));
 
+		report_can_stats(ctx->sled);
+		report_sdo_stats(ctx->sled);
+		report_channels(ctx->sled);
+
 		sum_delay = max_delay = 0;
 		num_samples = num_unacceptable = 0;
 	}
 }
 
 
+/**
+ * Sends a position sample to all stream clients.
+ */
+static void send_sample(sled_server_ctx_t *ctx, int frame, double time, double position, double tcurrent)
+{
+	for(std::list<rtc3d_connection_t *>::iterator it = (ctx->stream_clients).begin();
+		it != (ctx->stream_clients).end(); it++) {
+#ifdef SAWTOOTH
+		
+		rtc3d_send_data(*it, frame, (uint64_t) (time * 1e6), fmod(tcurrent, 10.0)*1000);
+#else
+		rtc3d_send_data(*it, frame, (uint64_t) (time * 1e6), position * 1000.0);
+#endif
+	}
+}
+
+
 static void on_timeout(evutil_socket_t sock, short events, void *arg)
 {
 	sled_server_ctx_t *ctx = (sled_server_ctx_t *) arg;
@@ -295,33 +403,34 @@ static void on_timeout(evutil_socket_t sock, short events, void *arg)
 		return;
 
 	double tcurrent = get_time();
-	update_timeout_stats(tcurrent);
+	update_timeout_stats(ctx, tcurrent);
 
-	// Get position
-	double position, time;
-	sled_rt_get_position_and_time(ctx->sled, position, time);
-
-	// Send position to all clients
+	// Send all samples received since the last time to all clients
 	static int frame = 0;
+	sled_sample_t samples[SAMPLE_BATCH];
+	int count, sent = 0;
 
-	for(std::list<rtc3d_connection_t *>::iterator it = (ctx->stream_clients).begin();
-		it != (ctx->stream_clients).end(); it++) {
-#ifdef SAWTOOTH
-		
-		rtc3d_send_data(*it, frame, (uint64_t) (time * 1e6), fmod(tcurrent, 10.0)*1000);
-#else
-		rtc3d_send_data(*it, frame, (uint64_t) (time * 1e6), position * 1000.0);
-#endif
+	while((count = sled_rt_get_samples(ctx->sled, &(ctx->sample_cursor), samples, SAMPLE_BATCH)) > 0) {
+		for(int i = 0; i < count; i++)
+			send_sample(ctx, frame++, samples[i].time, samples[i].position, tcurrent);
+
+		sent += count;
 	}
 
-	frame++;
+	// Clients expect a frame every interval, repeat the last sample
+	//  (NAN if there is none) when the drive reported nothing new.
+	if(sent == 0) {
+		double position, time;
+		sled_rt_get_position_and_time(ctx->sled, position, time);
+		send_sample(ctx, frame++, time, position, tcurrent);
+	}
 }
 
 
 /**
  * Create server context (to be passed to RTC3D server).
  */
-sled_server_ctx_t *setup_sled_server_context(event_base *ev_base)
+sled_server_ctx_t *setup_sled_server_context(event_base *ev_base, const char *device)
 {
 	sled_server_ctx_t *ctx;
 
@@ -337,7 +446,7 @@ sled_server_ctx_t *setup_sled_server_context(event_base *ev_base)
 		return NULL;
 	}
 
-	ctx->sled = sled_create(ev_base);
+	ctx->sled = sled_create_with_device(ev_base, device);
 
 	/* Setup server */
 	ctx->server = rtc3d_setup_server(ev_base, (void *) ctx, 3375);
@@ -30,13 +30,19 @@ struct sled_server_ctx_t {
 
 	std::list<rtc3d_connection_t *> stream_clients;
 
+	// Position samples up to this one were streamed
+	uint64_t sample_cursor;
+
 	// Maps protocol profile ids onto sled profile ids
 	std::map<int, int> profile_tlate;
+
+	// Upload profiles in the background as soon as they are set
+	bool stage_profiles;
 };
 
 struct event_base;
 
-sled_server_ctx_t *setup_sled_server_context(event_base *ev_base);
+sled_server_ctx_t *setup_sled_server_context(event_base *ev_base, const char *device);
 void teardown_sled_server_context(sled_server_ctx_t **ctx);
 
 #endif
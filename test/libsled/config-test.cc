@@ -0,0 +1,321 @@
+/**
+ * Exercises the PDO configuration upload of the network machine
+ * (mch_net.cc) over a socketpair, the test plays a drive that keeps
+ * the objects written to it: the configuration is read back first,
+ * and only objects that differ are written.
+ *
+ * Exits with status 0 if all tests pass.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/socket.h>
+#include <linux/can.h>
+
+#include <event2/event.h>
+
+#include "interface.h"
+#include "machines/mch_sdo.h"
+#include "machines/mch_net.h"
+
+
+#define CHECK(condition) \
+	if(!(condition)) { \
+		fprintf(stderr, "%s:%d: %s() check failed: %s\n", __FILE__, __LINE__, __FUNCTION__, #condition); \
+		return false; \
+	}
+
+#define TEST_MAX_OBJECTS 32
+
+
+/**
+ * Object in the dictionary of the drive.
+ */
+struct object_t {
+	uint16_t index;
+	uint8_t subindex;
+	uint32_t value;
+};
+
+struct test_t {
+	event_base *ev_base;
+	intf_t *intf;
+	mch_sdo_t *mch_sdo;
+	mch_net_t *mch_net;
+
+	// Drive end of the socketpair
+	int fd;
+
+	object_t objects[TEST_MAX_OBJECTS];
+	int num_objects;
+
+	// Requests answered by the drive since the last verification
+	int reads;
+	int writes;
+	object_t written[TEST_MAX_OBJECTS];
+};
+
+
+// One transmit and one receive PDO, as in sled_pdo.cc
+static const mch_net_pdo_t test_pdo_map[] = {
+	{true, 1, 0xFF, 0, 10, 2, {{0x60410010, -1}, {0x60610008, -1}}},
+	{false, 1, 0xFF, 0, 0, 1, {{0x60400010, -1}}},
+};
+
+
+static object_t *test_object(test_t *test, uint16_t index, uint8_t subindex)
+{
+	for(int i = 0; i < test->num_objects; i++)
+		if(test->objects[i].index == index && test->objects[i].subindex == subindex)
+			return &(test->objects[i]);
+
+	if(test->num_objects == TEST_MAX_OBJECTS)
+		return NULL;
+
+	object_t *object = &(test->objects[test->num_objects++]);
+	object->index = index;
+	object->subindex = subindex;
+	object->value = 0;
+
+	return object;
+}
+
+
+/**
+ * Answers SDO requests as the drive would until none are left, reads
+ * with the value last written.
+ */
+static void test_serve(test_t *test)
+{
+	can_frame request;
+
+	while(recv(test->fd, &request, sizeof(request), MSG_DONTWAIT) == sizeof(request)) {
+		// NMT commands
+		if((request.can_id & CAN_SFF_MASK) != COB_ID(FC_SDO_RX, INTF_NODE_ID))
+			continue;
+
+		uint16_t index = request.data[1] | (request.data[2] << 8);
+		uint8_t subindex = request.data[3];
+		object_t *object = test_object(test, index, subindex);
+
+		can_frame frame;
+		memset(&frame, 0, sizeof(frame));
+
+		frame.can_id = COB_ID(FC_SDO_TX, INTF_NODE_ID);
+		frame.can_dlc = 8;
+		memcpy(&(frame.data[1]), &(request.data[1]), 3);
+
+		if(request.data[0] == 0x40) {
+			frame.data[0] = 0x43;
+			frame.data[4] = object->value & 0xFF;
+			frame.data[5] = (object->value >> 8) & 0xFF;
+			frame.data[6] = (object->value >> 16) & 0xFF;
+			frame.data[7] = (object->value >> 24) & 0xFF;
+			test->reads++;
+		}
+		else {
+			frame.data[0] = 0x60;
+			object->value = request.data[4] | (request.data[5] << 8) |
+				(request.data[6] << 16) | (request.data[7] << 24);
+
+			if(test->writes < TEST_MAX_OBJECTS)
+				test->written[test->writes] = *object;
+			test->writes++;
+		}
+
+		if(send(test->fd, &frame, sizeof(frame), 0) != sizeof(frame))
+			perror("send()");
+
+		event_base_loop(test->ev_base, EVLOOP_NONBLOCK);
+	}
+}
+
+
+/**
+ * Takes the network machine through pre-operational, where the
+ * configuration is verified and uploaded, to operational.
+ */
+static bool test_configure(test_t *test)
+{
+	test->reads = 0;
+	test->writes = 0;
+
+	// Nothing is read back from a drive that just booted
+	mch_net_handle_event(test->mch_net, EV_NET_PREOPERATIONAL);
+	CHECK(mch_net_active_state(test->mch_net) == ST_NET_VERIFYCONFIG ||
+		mch_net_active_state(test->mch_net) == ST_NET_UPLOADCONFIG);
+
+	test_serve(test);
+	CHECK(mch_net_active_state(test->mch_net) == ST_NET_STARTREMOTENODE);
+
+	mch_net_handle_event(test->mch_net, EV_NET_OPERATIONAL);
+	CHECK(mch_net_active_state(test->mch_net) == ST_NET_OPERATIONAL);
+
+	int reads, writes;
+	mch_net_get_config_counts(test->mch_net, &reads, &writes);
+	CHECK(reads == test->reads && writes == test->writes);
+
+	return true;
+}
+
+
+/**
+ * The drive drops out of operational, e.g. after a reset of the
+ * communication, and is configured again.
+ */
+static bool test_reconfigure(test_t *test)
+{
+	mch_net_handle_event(test->mch_net, EV_NET_PREOPERATIONAL);
+	CHECK(mch_net_active_state(test->mch_net) == ST_NET_UNKNOWN);
+
+	return test_configure(test);
+}
+
+
+static void test_sdos_enabled(mch_net_t *mch_net, void *payload)
+{
+	test_t *test = (test_t *) payload;
+	mch_sdo_handle_event(test->mch_sdo, EV_NET_SDO_ENABLED);
+}
+
+
+static void test_sdos_disabled(mch_net_t *mch_net, void *payload)
+{
+	test_t *test = (test_t *) payload;
+	mch_sdo_handle_event(test->mch_sdo, EV_NET_SDO_DISABLED);
+}
+
+
+static bool test_setup(test_t *test)
+{
+	memset(test, 0, sizeof(test_t));
+
+	int sv[2];
+	if(socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sv) == -1) {
+		perror("socketpair()");
+		return false;
+	}
+
+	char device[32];
+	snprintf(device, sizeof(device), INTF_FD_DEVICE_PREFIX "%d", sv[0]);
+
+	test->ev_base = event_base_new();
+	test->fd = sv[1];
+	test->intf = intf_create(test->ev_base, device);
+
+	CHECK(intf_open(test->intf) == 0);
+
+	test->mch_sdo = mch_sdo_create(test->intf, test->ev_base);
+	test->mch_net = mch_net_create(test->intf, test->mch_sdo);
+
+	mch_net_set_pdo_map(test->mch_net, test_pdo_map, sizeof(test_pdo_map) / sizeof(test_pdo_map[0]));
+	mch_net_set_callback_payload(test->mch_net, (void *) test);
+	mch_net_set_sdos_enabled_handler(test->mch_net, test_sdos_enabled);
+	mch_net_set_sdos_disabled_handler(test->mch_net, test_sdos_disabled);
+
+	mch_net_handle_event(test->mch_net, EV_NET_INTF_OPENED);
+	CHECK(mch_net_active_state(test->mch_net) == ST_NET_OBSERVE);
+
+	// Configured once from the defaults of a drive that just booted
+	mch_net_on_boot_up(test->mch_net);
+	CHECK(test_configure(test));
+	CHECK(test->reads == 0 && test->writes > 0);
+
+	return true;
+}
+
+
+static void test_teardown(test_t *test)
+{
+	if(test->mch_net)
+		mch_net_destroy(&(test->mch_net));
+	if(test->mch_sdo) {
+		mch_sdo_release(test->mch_sdo);
+		mch_sdo_destroy(&(test->mch_sdo));
+	}
+	intf_destroy(&(test->intf));
+	event_base_free(test->ev_base);
+	close(test->fd);
+}
+
+
+/**
+ * A drive that kept its configuration is only read.
+ */
+static bool test_match(test_t *test)
+{
+	int uploaded = test->num_objects;
+
+	CHECK(test_reconfigure(test));
+	CHECK(test->reads == uploaded);
+	CHECK(test->writes == 0);
+
+	return true;
+}
+
+
+/**
+ * A communication parameter that differs is written on its own, a
+ * mapping that differs is disabled, written and enabled again.
+ */
+static bool test_mismatch(test_t *test)
+{
+	// Transmission type of TPDO1
+	test_object(test, 0x1800, 0x02)->value = 0x01;
+
+	// Entry of the RPDO1 mapping
+	test_object(test, 0x1600, 0x01)->value = 0x60400008;
+
+	CHECK(test_reconfigure(test));
+	CHECK(test->writes == 4);
+
+	CHECK(test->written[0].index == 0x1800 && test->written[0].subindex == 0x02);
+	CHECK(test->written[0].value == 0xFF);
+
+	CHECK(test->written[1].index == 0x1600 && test->written[1].subindex == 0x00);
+	CHECK(test->written[1].value == 0);
+	CHECK(test->written[2].index == 0x1600 && test->written[2].subindex == 0x01);
+	CHECK(test->written[2].value == 0x60400010);
+	CHECK(test->written[3].index == 0x1600 && test->written[3].subindex == 0x00);
+	CHECK(test->written[3].value == 1);
+
+	// Matches again from here on
+	CHECK(test_reconfigure(test));
+	CHECK(test->writes == 0);
+
+	return true;
+}
+
+
+struct test_case_t {
+	const char *name;
+	bool (*run)(test_t *test);
+};
+
+static const test_case_t test_cases[] = {
+	{"match", test_match},
+	{"mismatch", test_mismatch},
+};
+
+
+int main(int argc, char *argv[])
+{
+	int failed = 0;
+
+	for(size_t i = 0; i < sizeof(test_cases) / sizeof(test_cases[0]); i++) {
+		test_t test;
+
+		bool passed = test_setup(&test) && test_cases[i].run(&test);
+		test_teardown(&test);
+
+		printf("%-24s %s\n", test_cases[i].name, passed ? "ok" : "FAILED");
+
+		if(!passed)
+			failed++;
+	}
+
+	return failed ? 1 : 0;
+}
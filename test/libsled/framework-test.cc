@@ -0,0 +1,344 @@
+/**
+ * Exercises the state machine framework (machines/machine_body.h) with
+ * the machine declared in mch_test_def.h: transitions looked up in the
+ * compile-time table, states entered again by a transition to
+ * themselves, dwell timeouts armed again on every entry, and events of
+ * machines sharing a queue handled in order of posting. The build checks that a conflicting or unreachable table
+ * does not compile (CMakeLists.txt).
+ *
+ * Exits with status 0 if all tests pass.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <event2/event.h>
+
+#include "mch_test.h"
+
+#define MACHINE_FILE() "mch_test_def.h"
+#include "machines/machine_body.h"
+
+
+#define CHECK(condition) \
+	if(!(condition)) { \
+		fprintf(stderr, "%s:%d: %s() check failed: %s\n", __FILE__, __LINE__, __FUNCTION__, #condition); \
+		return false; \
+	}
+
+
+#define TEST_LOG_SIZE 32
+
+struct test_log_entry_t {
+	int id;
+	mch_test_state_t state;
+};
+
+struct test_t {
+	machine_queue_t queue;
+	mch_test_t *a;
+	mch_test_t *b;
+};
+
+// States entered, by all machines in order
+static test_log_entry_t test_log[TEST_LOG_SIZE];
+static int test_log_length;
+
+// States entered while another one was being entered
+static int test_nested;
+static int test_depth;
+
+
+/**
+ * Records the state entered. With a peer, entering the first state
+ * starts the peer and moves on to the next state.
+ */
+void mch_test_on_enter(mch_test_t *machine)
+{
+	if(test_depth > 0)
+		test_nested++;
+
+	test_depth++;
+	machine->entered++;
+
+	if(test_log_length < TEST_LOG_SIZE) {
+		test_log[test_log_length].id = machine->id;
+		test_log[test_log_length].state = mch_test_active_state(machine);
+		test_log_length++;
+	}
+
+	if(machine->peer && mch_test_active_state(machine) == ST_TEST_FIRST) {
+		mch_test_handle_event(machine->peer, EV_TEST_START);
+		mch_test_handle_event(machine, EV_TEST_NEXT);
+	}
+
+	test_depth--;
+}
+
+
+void mch_test_on_exit(mch_test_t *machine)
+{
+}
+
+
+/**
+ * Events follow the declared transitions, any other event leaves the
+ * state without entering it again.
+ */
+static bool test_transitions(test_t *test)
+{
+	mch_test_t *machine = test->a;
+
+	mch_test_handle_event(machine, EV_TEST_START);
+	CHECK(mch_test_active_state(machine) == ST_TEST_FIRST);
+	CHECK(machine->entered == 1);
+
+	// No transition declared
+	mch_test_handle_event(machine, EV_TEST_START);
+	CHECK(mch_test_active_state(machine) == ST_TEST_FIRST);
+	CHECK(machine->entered == 1);
+
+	mch_test_handle_event(machine, EV_TEST_NEXT);
+	CHECK(mch_test_active_state(machine) == ST_TEST_SECOND);
+
+	// From every state but the excluded one
+	mch_test_handle_event(machine, EV_TEST_STOP);
+	CHECK(mch_test_active_state(machine) == ST_TEST_IDLE);
+	CHECK(machine->entered == 3);
+
+	mch_test_handle_event(machine, EV_TEST_STOP);
+	CHECK(mch_test_active_state(machine) == ST_TEST_IDLE);
+	CHECK(machine->entered == 3);
+
+	return true;
+}
+
+
+/**
+ * A transition to the same state leaves and enters it again, and is
+ * counted until the state is left.
+ */
+static bool test_reentry(test_t *test)
+{
+	mch_test_t *machine = test->a;
+
+	mch_test_handle_event(machine, EV_TEST_START);
+	mch_test_handle_event(machine, EV_TEST_NEXT);
+	mch_test_handle_event(machine, EV_TEST_NEXT);
+	CHECK(mch_test_active_state(machine) == ST_TEST_WAITING);
+	CHECK(machine->reentries == 0);
+
+	mch_test_handle_event(machine, EV_TEST_TIMEOUT);
+	mch_test_handle_event(machine, EV_TEST_TIMEOUT);
+	CHECK(mch_test_active_state(machine) == ST_TEST_WAITING);
+	CHECK(machine->entered == 5);
+	CHECK(machine->reentries == 2);
+
+	mch_test_handle_event(machine, EV_TEST_STOP);
+	CHECK(machine->reentries == 0);
+
+	return true;
+}
+
+
+/**
+ * A dwell timeout that enters its state again is armed again, until
+ * the state is left.
+ */
+static bool test_dwell_timeout(test_t *test)
+{
+	mch_test_t *machine = test->a;
+
+	event_base *ev_base = event_base_new();
+	event_base_priority_init(ev_base, 2);
+
+	machine_timer_t timer;
+	CHECK(machine_timer_init(&timer, ev_base) == 0);
+	CHECK(mch_test_set_timer(machine, &timer) == 0);
+
+	mch_test_handle_event(machine, EV_TEST_START);
+	mch_test_handle_event(machine, EV_TEST_NEXT);
+	CHECK(!timer.slots[machine->timer_slot].armed);
+
+	mch_test_handle_event(machine, EV_TEST_NEXT);
+	CHECK(timer.slots[machine->timer_slot].armed);
+
+	for(int i = 1; i <= 3; i++) {
+		double deadline = timer.slots[machine->timer_slot].deadline;
+		event_base_loop(ev_base, EVLOOP_ONCE);
+
+		CHECK(timer.expired == (uint64_t) i);
+		CHECK(machine->reentries == i);
+		CHECK(mch_test_active_state(machine) == ST_TEST_WAITING);
+		CHECK(timer.slots[machine->timer_slot].armed);
+		CHECK(timer.slots[machine->timer_slot].deadline > deadline);
+	}
+
+	mch_test_handle_event(machine, EV_TEST_STOP);
+	CHECK(!timer.slots[machine->timer_slot].armed);
+	CHECK(timer.scheduled == 0.0);
+
+	// Nothing left to expire
+	CHECK(event_base_loop(ev_base, EVLOOP_NONBLOCK) == 1);
+	CHECK(timer.expired == 3);
+
+	machine_timer_destroy(&timer);
+	event_base_free(ev_base);
+
+	return true;
+}
+
+
+static bool test_log_is(int id, mch_test_state_t state, int index)
+{
+	return index < test_log_length &&
+		test_log[index].id == id && test_log[index].state == state;
+}
+
+
+/**
+ * Without a queue, events posted by a handler are handled before it
+ * returns, the machines enter states within each other.
+ */
+static bool test_nesting(test_t *test)
+{
+	test->a->peer = test->b;
+	test->b->peer = test->a;
+
+	mch_test_handle_event(test->a, EV_TEST_START);
+
+	CHECK(test_log_length == 4);
+	CHECK(test_log_is(1, ST_TEST_FIRST, 0));
+	CHECK(test_log_is(2, ST_TEST_FIRST, 1));
+	CHECK(test_log_is(2, ST_TEST_SECOND, 2));
+	CHECK(test_log_is(1, ST_TEST_SECOND, 3));
+	CHECK(test_nested == 3);
+
+	return true;
+}
+
+
+/**
+ * Events posted to a shared queue are handled in order of posting,
+ * each run to completion before the next one.
+ */
+static bool test_queue_order(test_t *test)
+{
+	test->a->peer = test->b;
+	test->b->peer = test->a;
+
+	mch_test_set_queue(test->a, &(test->queue));
+	mch_test_set_queue(test->b, &(test->queue));
+
+	mch_test_handle_event(test->a, EV_TEST_START);
+
+	// Posted by a: START to b, NEXT to a. Then by b: START to a, which
+	//  is no longer idle, and NEXT to b.
+	CHECK(test_log_length == 4);
+	CHECK(test_log_is(1, ST_TEST_FIRST, 0));
+	CHECK(test_log_is(2, ST_TEST_FIRST, 1));
+	CHECK(test_log_is(1, ST_TEST_SECOND, 2));
+	CHECK(test_log_is(2, ST_TEST_SECOND, 3));
+	CHECK(test_nested == 0);
+
+	machine_queue_stats_t stats;
+	machine_queue_get_stats(&(test->queue), &stats, false);
+
+	CHECK(stats.events == 5);
+	CHECK(stats.drains == 1);
+	CHECK(stats.high_water_mark == 3);
+	CHECK(stats.overflows == 0);
+
+	return true;
+}
+
+
+/**
+ * Events posted in a batch are only handled once it is closed.
+ */
+static bool test_queue_batch(test_t *test)
+{
+	mch_test_set_queue(test->a, &(test->queue));
+	mch_test_set_queue(test->b, &(test->queue));
+
+	machine_queue_begin(&(test->queue));
+
+	mch_test_handle_event(test->b, EV_TEST_START);
+	mch_test_handle_event(test->a, EV_TEST_START);
+	mch_test_handle_event(test->b, EV_TEST_NEXT);
+
+	CHECK(mch_test_active_state(test->a) == ST_TEST_IDLE);
+	CHECK(mch_test_active_state(test->b) == ST_TEST_IDLE);
+	CHECK(test_log_length == 0);
+
+	machine_queue_end(&(test->queue));
+
+	CHECK(test_log_length == 3);
+	CHECK(test_log_is(2, ST_TEST_FIRST, 0));
+	CHECK(test_log_is(1, ST_TEST_FIRST, 1));
+	CHECK(test_log_is(2, ST_TEST_SECOND, 2));
+
+	machine_queue_stats_t stats;
+	machine_queue_get_stats(&(test->queue), &stats, false);
+
+	CHECK(stats.drains == 1);
+	CHECK(stats.max_events_per_drain == 3);
+
+	return true;
+}
+
+
+static void test_setup(test_t *test)
+{
+	machine_queue_init(&(test->queue));
+	test->a = mch_test_create(1);
+	test->b = mch_test_create(2);
+
+	test_log_length = 0;
+	test_nested = 0;
+	test_depth = 0;
+}
+
+
+static void test_teardown(test_t *test)
+{
+	mch_test_destroy(&(test->a));
+	mch_test_destroy(&(test->b));
+}
+
+
+struct test_case_t {
+	const char *name;
+	bool (*run)(test_t *test);
+};
+
+static const test_case_t test_cases[] = {
+	{"transitions", test_transitions},
+	{"re-entry", test_reentry},
+	{"dwell timeout", test_dwell_timeout},
+	{"nesting", test_nesting},
+	{"queue order", test_queue_order},
+	{"queue batch", test_queue_batch},
+};
+
+
+int main(int argc, char *argv[])
+{
+	int failed = 0;
+
+	for(size_t i = 0; i < sizeof(test_cases) / sizeof(test_cases[0]); i++) {
+		test_t test;
+		test_setup(&test);
+
+		bool passed = test_cases[i].run(&test);
+		test_teardown(&test);
+
+		printf("%-24s %s\n", test_cases[i].name, passed ? "ok" : "FAILED");
+
+		if(!passed)
+			failed++;
+	}
+
+	return failed ? 1 : 0;
+}
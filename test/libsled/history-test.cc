@@ -0,0 +1,143 @@
+/**
+ * Exercises the position history (sled_history.cc): samples are
+ * returned in order across wraparound, and a reader that fell behind
+ * can tell how many samples it lost from the cursor.
+ *
+ * Exits with status 0 if all tests pass.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include <event2/event.h>
+#include <sled.h>
+#include <sled_internal.h>
+
+
+#define CHECK(condition) \
+	if(!(condition)) { \
+		fprintf(stderr, "%s:%d: %s() check failed: %s\n", __FILE__, __LINE__, __FUNCTION__, #condition); \
+		return false; \
+	}
+
+
+/**
+ * Pushes samples numbered from first, the time is the number.
+ */
+static void test_push(sled_t *sled, uint64_t first, int count)
+{
+	for(int i = 0; i < count; i++)
+		sled_history_push(sled, double(first + i), 0.0, 0.0);
+}
+
+
+/**
+ * Checks that count samples numbered from first were returned.
+ */
+static bool test_consecutive(const sled_sample_t *samples, int count, uint64_t first)
+{
+	for(int i = 0; i < count; i++)
+		CHECK(samples[i].time == double(first + i));
+
+	return true;
+}
+
+
+/**
+ * A reader keeping up receives every sample once, also while the
+ * writer wraps around.
+ */
+static bool test_wraparound(sled_t *sled)
+{
+	static sled_sample_t samples[SLED_HISTORY_SIZE];
+	uint64_t since = 0;
+	uint64_t written = 0;
+
+	for(int round = 0; round < 5; round++) {
+		test_push(sled, written, SLED_HISTORY_SIZE / 2 + 3);
+		written += SLED_HISTORY_SIZE / 2 + 3;
+
+		uint64_t first = since;
+		int count = sled_rt_get_samples(sled, &since, samples, SLED_HISTORY_SIZE);
+
+		CHECK(count == SLED_HISTORY_SIZE / 2 + 3);
+		CHECK(since == written);
+		CHECK(test_consecutive(samples, count, first));
+	}
+
+	// Nothing new
+	CHECK(sled_rt_get_samples(sled, &since, samples, SLED_HISTORY_SIZE) == 0);
+	CHECK(since == written);
+
+	return true;
+}
+
+
+/**
+ * A reader that fell behind skips the samples that were overwritten.
+ * The samples lost are the advance of the cursor minus those returned.
+ */
+static bool test_loss_accounting(sled_t *sled)
+{
+	static sled_sample_t samples[SLED_HISTORY_SIZE];
+	uint64_t since = 0;
+	uint64_t written = 3 * SLED_HISTORY_SIZE + 17;
+
+	test_push(sled, 0, written);
+
+	// Oldest slot is the next to be overwritten and not returned
+	uint64_t before = since;
+	int count = sled_rt_get_samples(sled, &since, samples, 16);
+	uint64_t lost = since - before - count;
+
+	CHECK(count == 15);
+	CHECK(lost == written - SLED_HISTORY_SIZE + 1);
+	CHECK(test_consecutive(samples, count, written - SLED_HISTORY_SIZE + 1));
+
+	// Continues where the last call stopped, no further loss
+	before = since;
+	count = sled_rt_get_samples(sled, &since, samples, SLED_HISTORY_SIZE);
+
+	CHECK(since - before == uint64_t(count));
+	CHECK(since == written);
+	CHECK(test_consecutive(samples, count, before));
+
+	// A cursor ahead of the writer is pulled back, nothing is returned
+	since = written + 10;
+	CHECK(sled_rt_get_samples(sled, &since, samples, SLED_HISTORY_SIZE) == 0);
+	CHECK(since == written);
+
+	return true;
+}
+
+
+struct test_case_t {
+	const char *name;
+	bool (*run)(sled_t *sled);
+};
+
+static const test_case_t test_cases[] = {
+	{"wraparound", test_wraparound},
+	{"loss accounting", test_loss_accounting},
+};
+
+
+int main(int argc, char *argv[])
+{
+	int failed = 0;
+
+	for(size_t i = 0; i < sizeof(test_cases) / sizeof(test_cases[0]); i++) {
+		sled_t *sled = new sled_t();
+		sled_history_init(sled);
+
+		bool passed = test_cases[i].run(sled);
+		delete sled;
+
+		printf("%-24s %s\n", test_cases[i].name, passed ? "ok" : "FAILED");
+
+		if(!passed)
+			failed++;
+	}
+
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,12 @@
+#ifndef __MCH_TEST_H__
+#define __MCH_TEST_H__
+
+#undef PREFIX
+
+// Define machine prefix
+#define PREFIX mch_test
+
+#include "machines/machine_header.h"
+#include "mch_test_def.h"
+
+#endif
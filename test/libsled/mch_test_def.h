@@ -0,0 +1,60 @@
+#include "machines/machine_empty.h"
+
+// Machine exercised by framework-test.cc. TEST_CONFLICT and
+//  TEST_UNREACHABLE each add a defect the build has to reject.
+
+#define INITIAL_STATE ST_TEST_IDLE
+
+BEGIN_EVENTS
+	EVENT(EV_TEST_START)
+	EVENT(EV_TEST_NEXT)
+	EVENT(EV_TEST_STOP)
+	EVENT(EV_TEST_TIMEOUT)			// Internal, state not left in time
+END_EVENTS
+
+BEGIN_STATES
+	STATE(ST_TEST_IDLE)
+	STATE(ST_TEST_FIRST)
+	STATE(ST_TEST_SECOND)
+	STATE(ST_TEST_WAITING)
+#ifdef TEST_UNREACHABLE
+	STATE(ST_TEST_UNREACHABLE)
+#endif
+END_STATES
+
+BEGIN_TRANSITIONS
+	TRANSITION(ST_TEST_IDLE, EV_TEST_START, ST_TEST_FIRST)
+	TRANSITION(ST_TEST_FIRST, EV_TEST_NEXT, ST_TEST_SECOND)
+	TRANSITION(ST_TEST_SECOND, EV_TEST_NEXT, ST_TEST_WAITING)
+
+	TRANSITION_ANY_BUT(ST_TEST_IDLE, EV_TEST_STOP, ST_TEST_IDLE)
+
+	// Entered again, the timeout is armed again
+	TRANSITION(ST_TEST_WAITING, EV_TEST_TIMEOUT, ST_TEST_WAITING)
+
+#ifdef TEST_CONFLICT
+	TRANSITION(ST_TEST_SECOND, EV_TEST_STOP, ST_TEST_FIRST)
+#endif
+END_TRANSITIONS
+
+// Only armed once a timer is set
+BEGIN_TIMEOUTS
+	STATE_TIMEOUT(ST_TEST_WAITING, 0.02, EV_TEST_TIMEOUT)
+END_TIMEOUTS
+
+BEGIN_CALLBACKS
+END_CALLBACKS
+
+BEGIN_FIELDS
+	FIELD(int, id)
+
+	// Times a state was entered
+	FIELD_DECL(int, entered)
+	FIELD_INIT(entered, 0)
+
+	// Started when this machine is started
+	FIELD_DECL(mch_test_t *, peer)
+	FIELD_INIT(peer, NULL)
+END_FIELDS
+
+GENERATE_DEFAULT_FUNCTIONS
@@ -0,0 +1,614 @@
+/**
+ * Exercises the SDO scheduler over a socketpair, the test plays the
+ * drive on the other end: wraparound of the ring of slots, strict
+ * priority of classes, barriers, holding back set-point triggers while
+ * the DS402 machine changes the drive state, promotion of staged
+ * writes ahead of a trigger, and holding back SDOs while a duplicate
+ * response may still arrive.
+ *
+ * Exits with status 0 if all tests pass.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/socket.h>
+#include <linux/can.h>
+
+#include <event2/event.h>
+
+#include "interface.h"
+#include "machines/mch_sdo.h"
+#include "machines/mch_ds.h"
+#include "machines/machine_queue.h"
+
+
+#define CHECK(condition) \
+	if(!(condition)) { \
+		fprintf(stderr, "%s:%d: %s() check failed: %s\n", __FILE__, __LINE__, __FUNCTION__, #condition); \
+		return false; \
+	}
+
+#define OB_TEST 0x2010
+#define OB_TEST_OTHER 0x2011
+
+// Response timeout, the event loop runs a bit longer to pass a single
+//  deadline but none after it
+#define TEST_TIMEOUT 0.05
+#define TEST_PAST_DEADLINE (1.2 * TEST_TIMEOUT)
+
+
+struct test_t {
+	event_base *ev_base;
+	intf_t *intf;
+	mch_sdo_t *mch_sdo;
+	mch_ds_t *mch_ds;
+
+	// Drive end of the socketpair
+	int fd;
+
+	// Abort callbacks received and the code of the last one
+	int aborts;
+	uint32_t abort_code;
+};
+
+
+/**
+ * Request received by the drive.
+ */
+struct request_t {
+	uint16_t cob_id;
+	uint8_t command;
+	uint16_t index;
+	uint8_t subindex;
+	uint32_t value;
+};
+
+
+static void test_abort_callback(void *data, uint16_t index, uint8_t subindex, uint32_t code)
+{
+	test_t *test = (test_t *) data;
+
+	test->aborts++;
+	test->abort_code = code;
+}
+
+
+/**
+ * Handles pending events without waiting.
+ */
+static void test_pump(test_t *test)
+{
+	event_base_loop(test->ev_base, EVLOOP_NONBLOCK);
+}
+
+
+/**
+ * Runs the event loop for a while, e.g. to let SDOs time out.
+ */
+static void test_run(test_t *test, double seconds)
+{
+	timeval tv;
+	tv.tv_sec = time_t(seconds);
+	tv.tv_usec = suseconds_t((seconds - tv.tv_sec) * 1000000.0);
+
+	event_base_loopexit(test->ev_base, &tv);
+	event_base_dispatch(test->ev_base);
+}
+
+
+/**
+ * Returns the next frame sent to the drive, false if there is none.
+ */
+static bool test_receive(test_t *test, request_t *request)
+{
+	can_frame frame;
+
+	if(recv(test->fd, &frame, sizeof(frame), MSG_DONTWAIT) != sizeof(frame))
+		return false;
+
+	request->cob_id = frame.can_id & CAN_SFF_MASK;
+	request->command = frame.data[0];
+	request->index = frame.data[1] | (frame.data[2] << 8);
+	request->subindex = frame.data[3];
+	request->value = frame.data[4] | (frame.data[5] << 8) | (frame.data[6] << 16) | (frame.data[7] << 24);
+
+	// RPDOs carry data only
+	if(request->cob_id != COB_ID(FC_SDO_RX, INTF_NODE_ID)) {
+		request->index = 0;
+		request->value = frame.data[0] | (frame.data[1] << 8);
+	}
+
+	return true;
+}
+
+
+/**
+ * Answers an SDO request as the drive would, and lets libsled handle it.
+ */
+static void test_respond(test_t *test, const request_t *request, uint32_t value)
+{
+	can_frame frame;
+	memset(&frame, 0, sizeof(frame));
+
+	frame.can_id = COB_ID(FC_SDO_TX, INTF_NODE_ID);
+	frame.can_dlc = 8;
+	frame.data[0] = request->command == 0x40 ? 0x43 : 0x60;
+	frame.data[1] = request->index & 0xFF;
+	frame.data[2] = request->index >> 8;
+	frame.data[3] = request->subindex;
+
+	if(request->command == 0x40) {
+		frame.data[4] = value & 0xFF;
+		frame.data[5] = (value >> 8) & 0xFF;
+		frame.data[6] = (value >> 16) & 0xFF;
+		frame.data[7] = (value >> 24) & 0xFF;
+	}
+
+	if(send(test->fd, &frame, sizeof(frame), 0) != sizeof(frame))
+		perror("send()");
+
+	test_pump(test);
+}
+
+
+static bool test_setup(test_t *test, int window)
+{
+	memset(test, 0, sizeof(test_t));
+
+	int sv[2];
+	if(socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sv) == -1) {
+		perror("socketpair()");
+		return false;
+	}
+
+	char device[32];
+	snprintf(device, sizeof(device), INTF_FD_DEVICE_PREFIX "%d", sv[0]);
+
+	test->ev_base = event_base_new();
+	test->fd = sv[1];
+	test->intf = intf_create(test->ev_base, device);
+
+	CHECK(intf_open(test->intf) == 0);
+
+	test->mch_sdo = mch_sdo_create(test->intf, test->ev_base);
+	test->mch_ds = mch_ds_create(test->intf, test->mch_sdo);
+
+	// Only tests of retransmission should see any
+	CHECK(mch_sdo_set_timeout(test->mch_sdo, 1.0, SDO_DEFAULT_RETRIES) == 0);
+	CHECK(mch_sdo_set_window(test->mch_sdo, window) == 0);
+	mch_sdo_handle_event(test->mch_sdo, EV_NET_SDO_ENABLED);
+
+	return true;
+}
+
+
+static void test_teardown(test_t *test)
+{
+	mch_ds_destroy(&(test->mch_ds));
+	mch_sdo_release(test->mch_sdo);
+	mch_sdo_destroy(&(test->mch_sdo));
+	intf_destroy(&(test->intf));
+	event_base_free(test->ev_base);
+	close(test->fd);
+}
+
+
+/**
+ * Fills the ring after the head moved, such that it wraps around, and
+ * checks that SDOs are sent in order and the overflow is rejected.
+ */
+static bool test_ring_wraparound(test_t *test)
+{
+	request_t request, other;
+
+	// Move the head halfway through the slots
+	for(int i = 0; i < SDO_QUEUE_CAPACITY / 2; i++) {
+		CHECK(mch_sdo_queue_write(test->mch_sdo, OB_TEST, 0x01, i, 0x04) == 0);
+		CHECK(test_receive(test, &request));
+		test_respond(test, &request, 0);
+	}
+
+	for(int i = 0; i < SDO_QUEUE_CAPACITY; i++)
+		CHECK(mch_sdo_queue_write(test->mch_sdo, OB_TEST, 0x01, 1000 + i, 0x04) == 0);
+
+	CHECK(mch_sdo_queue_write_with_cb(test->mch_sdo, OB_TEST, 0x01, 0, 0x04,
+		NULL, test_abort_callback, test) == -1);
+	CHECK(test->aborts == 1 && test->abort_code == SDO_ABORT_QUEUE_FULL);
+
+	mch_sdo_queue_stats_t stats;
+	mch_sdo_get_queue_stats(test->mch_sdo, &stats);
+	CHECK(stats.depth == SDO_QUEUE_CAPACITY);
+	CHECK(stats.high_water_mark == SDO_QUEUE_CAPACITY);
+	CHECK(stats.overflows == 1);
+
+	for(int i = 0; i < SDO_QUEUE_CAPACITY; i++) {
+		CHECK(test_receive(test, &request));
+		CHECK(request.index == OB_TEST && request.value == uint32_t(1000 + i));
+		CHECK(!test_receive(test, &other));
+		test_respond(test, &request, 0);
+	}
+
+	mch_sdo_get_queue_stats(test->mch_sdo, &stats);
+	CHECK(stats.depth == 0);
+	CHECK(mch_sdo_active_state(test->mch_sdo) == ST_SDO_WAITING);
+
+	return true;
+}
+
+
+/**
+ * SDOs queued while another one is in flight leave in order of class,
+ * regardless of the order they were queued in.
+ */
+static bool test_class_priority(test_t *test)
+{
+	request_t request, pending;
+
+	CHECK(mch_sdo_queue_write(test->mch_sdo, OB_TEST, 0x01, 0, 0x04) == 0);
+	CHECK(test_receive(test, &pending));
+
+	CHECK(mch_sdo_queue_write(test->mch_sdo, OB_O_O1, OB_O_SUBINDEX(0), 1, 0x04) == 0);
+	CHECK(mch_sdo_queue_write(test->mch_sdo, OB_TEST_OTHER, 0x01, 2, 0x04) == 0);
+	CHECK(mch_sdo_queue_write(test->mch_sdo, OB_O_P, OB_O_SUBINDEX(0), 3, 0x04) == 0);
+	CHECK(mch_sdo_queue_read(test->mch_sdo, 0x3518, 0x00) == 0);
+	CHECK(!test_receive(test, &request));
+
+	const uint16_t expected[] = {0x3518, OB_O_P, OB_TEST_OTHER, OB_O_O1};
+
+	test_respond(test, &pending, 0);
+
+	for(int i = 0; i < 4; i++) {
+		CHECK(test_receive(test, &request));
+		CHECK(request.index == expected[i]);
+		test_respond(test, &request, 0);
+	}
+
+	CHECK(!test_receive(test, &request));
+
+	return true;
+}
+
+
+/**
+ * A barrier waits for the SDOs queued before it to be answered, and
+ * nothing is sent while it is in flight.
+ */
+static bool test_barrier(test_t *test)
+{
+	request_t p, v, copy, acc, request;
+
+	CHECK(mch_sdo_queue_write(test->mch_sdo, OB_O_P, OB_O_SUBINDEX(0), 1, 0x04) == 0);
+	CHECK(mch_sdo_queue_write(test->mch_sdo, OB_O_V, OB_O_SUBINDEX(0), 2, 0x04) == 0);
+	CHECK(mch_sdo_queue_write(test->mch_sdo, OB_COPY_MOTION_TASK, 0x00, 0x00010000, 0x04) == 0);
+	CHECK(mch_sdo_queue_write(test->mch_sdo, OB_O_ACC, OB_O_SUBINDEX(0), 3, 0x04) == 0);
+
+	// Both fields are in flight, the copy and the field after it wait
+	CHECK(test_receive(test, &p) && p.index == OB_O_P);
+	CHECK(test_receive(test, &v) && v.index == OB_O_V);
+	CHECK(!test_receive(test, &request));
+
+	test_respond(test, &v, 0);
+	CHECK(!test_receive(test, &request));
+
+	test_respond(test, &p, 0);
+	CHECK(test_receive(test, &copy) && copy.index == OB_COPY_MOTION_TASK);
+	CHECK(!test_receive(test, &request));
+
+	test_respond(test, &copy, 0);
+	CHECK(test_receive(test, &acc) && acc.index == OB_O_ACC);
+	test_respond(test, &acc, 0);
+
+	return true;
+}
+
+
+/**
+ * Answers the control word the DS402 machine (mch_ds.cc) wrote on
+ * entering its current state.
+ */
+static bool test_control_word(test_t *test, uint16_t control_word)
+{
+	request_t request;
+
+	CHECK(test_receive(test, &request));
+	CHECK(request.index == OB_CONTROL_WORD && request.value == control_word);
+	test_respond(test, &request, 0);
+
+	return true;
+}
+
+
+/**
+ * Takes the DS402 machine to operation enabled, as the status
+ * words of a drive with voltage enabled would.
+ */
+static bool test_enable_operation(test_t *test)
+{
+	mch_ds_handle_event(test->mch_ds, EV_DS_NET_OPERATIONAL);
+	CHECK(test_control_word(test, 0x06));
+	mch_ds_handle_event(test->mch_ds, EV_DS_READY_TO_SWITCH_ON);
+	mch_ds_handle_event(test->mch_ds, EV_DS_VOLTAGE_ENABLED);
+	CHECK(test_control_word(test, 0x07));
+	mch_ds_handle_event(test->mch_ds, EV_DS_SWITCHED_ON);
+	mch_ds_handle_event(test->mch_ds, EV_DS_VOLTAGE_ENABLED);
+	CHECK(test_control_word(test, 0x0F));
+	mch_ds_handle_event(test->mch_ds, EV_DS_OPERATION_ENABLED);
+
+	CHECK(mch_ds_active_state(test->mch_ds) == ST_DS_OPERATION_ENABLED);
+
+	return true;
+}
+
+
+/**
+ * Set-point triggers of the motion machine (mch_mp.cc) that are still
+ * queued when the DS402 machine disables operation are dropped, else
+ * they would be sent after its control word and enable the drive again.
+ */
+static bool test_control_word_drop(test_t *test)
+{
+	request_t request, pending;
+
+	CHECK(test_enable_operation(test));
+
+	CHECK(mch_sdo_queue_write(test->mch_sdo, OB_TEST, 0x01, 0, 0x04) == 0);
+	CHECK(test_receive(test, &pending));
+
+	// Set-point trigger by RPDO and by SDO, as queued by mch_mp.cc
+	CHECK(mch_sdo_queue_pdo(test->mch_sdo, FC_RPDO1, 0x003F, 0x02, SDO_CLASS_MOTION) == 0);
+	CHECK(mch_sdo_queue_write_with_class_cb(test->mch_sdo, OB_CONTROL_WORD, 0x00, 0x003F, 0x02,
+		SDO_CLASS_MOTION, NULL, test_abort_callback, test) == 0);
+
+	mch_ds_handle_event(test->mch_ds, EV_DS_VOLTAGE_DISABLED);
+	CHECK(test->aborts == 1 && test->abort_code == 0);
+
+	test_respond(test, &pending, 0);
+	CHECK(test_control_word(test, 0x07));
+	CHECK(!test_receive(test, &request));
+
+	return true;
+}
+
+
+/**
+ * Set-point triggers queued after the DS402 machine wrote its control
+ * word, e.g. by the motion machine leaving a state in reaction to it,
+ * are rejected until operation is enabled again.
+ */
+static bool test_control_word_hold(test_t *test)
+{
+	request_t request, pending;
+
+	CHECK(test_enable_operation(test));
+
+	CHECK(mch_sdo_queue_write(test->mch_sdo, OB_TEST, 0x01, 0, 0x04) == 0);
+	CHECK(test_receive(test, &pending));
+
+	mch_ds_handle_event(test->mch_ds, EV_DS_VOLTAGE_DISABLED);
+
+	CHECK(mch_sdo_queue_write_with_class_cb(test->mch_sdo, OB_CONTROL_WORD, 0x00, 0x002F, 0x02,
+		SDO_CLASS_MOTION, NULL, test_abort_callback, test) == -1);
+	CHECK(test->aborts == 1 && test->abort_code == 0);
+	CHECK(mch_sdo_queue_pdo(test->mch_sdo, FC_RPDO1, 0x003F, 0x02, SDO_CLASS_MOTION) == -1);
+
+	test_respond(test, &pending, 0);
+	CHECK(test_control_word(test, 0x07));
+	CHECK(!test_receive(test, &request));
+
+	// Accepted once operation is enabled again
+	mch_ds_handle_event(test->mch_ds, EV_DS_SWITCHED_ON);
+	mch_ds_handle_event(test->mch_ds, EV_DS_VOLTAGE_ENABLED);
+	CHECK(test_control_word(test, 0x0F));
+	mch_ds_handle_event(test->mch_ds, EV_DS_OPERATION_ENABLED);
+
+	CHECK(mch_sdo_queue_write_with_class(test->mch_sdo, OB_CONTROL_WORD, 0x00, 0x002F, 0x02,
+		SDO_CLASS_MOTION) == 0);
+	CHECK(test_control_word(test, 0x002F));
+
+	return true;
+}
+
+
+/**
+ * Fields of a staged profile are written at the lowest priority, and
+ * promoted on execution such that they are written before its trigger
+ * (sled_profile.cc). Promoted writes keep their place in the queue.
+ */
+static bool test_staged_promotion(test_t *test)
+{
+	request_t request, pending;
+	int staged, other;
+
+	CHECK(mch_sdo_queue_write(test->mch_sdo, OB_TEST, 0x01, 0, 0x04) == 0);
+	CHECK(test_receive(test, &pending));
+
+	// Background writes of the staged profile and of another one
+	CHECK(mch_sdo_queue_write_with_class_cb(test->mch_sdo, OB_O_P, OB_O_SUBINDEX(201), 1, 0x04,
+		SDO_CLASS_BULK, NULL, NULL, &staged) == 0);
+	CHECK(mch_sdo_queue_write_with_class_cb(test->mch_sdo, OB_O_ACC, OB_O_SUBINDEX(202), 2, 0x04,
+		SDO_CLASS_BULK, NULL, NULL, &other) == 0);
+	CHECK(mch_sdo_queue_write_with_class_cb(test->mch_sdo, OB_O_V, OB_O_SUBINDEX(201), 3, 0x04,
+		SDO_CLASS_BULK, NULL, NULL, &staged) == 0);
+	CHECK(mch_sdo_queue_write_with_class(test->mch_sdo, OB_TEST_OTHER, 0x01, 4, 0x04,
+		SDO_CLASS_CONFIGURATION) == 0);
+
+	// Queued after the staged fields, before execution
+	CHECK(mch_sdo_queue_write_with_class(test->mch_sdo, OB_O_O1, OB_O_SUBINDEX(0), 5, 0x04,
+		SDO_CLASS_MOTION) == 0);
+
+	CHECK(mch_sdo_promote(test->mch_sdo, &staged, SDO_CLASS_MOTION) == 2);
+	CHECK(mch_sdo_queue_write_with_class(test->mch_sdo, OB_CONTROL_WORD, 0x00, 0x003F, 0x02,
+		SDO_CLASS_MOTION) == 0);
+	CHECK(!test_receive(test, &request));
+
+	const uint16_t expected[] = {OB_O_P, OB_O_V, OB_O_O1, OB_CONTROL_WORD, OB_TEST_OTHER, OB_O_ACC};
+
+	test_respond(test, &pending, 0);
+
+	for(size_t i = 0; i < sizeof(expected) / sizeof(expected[0]); i++) {
+		CHECK(test_receive(test, &request));
+		CHECK(request.index == expected[i]);
+		test_respond(test, &request, 0);
+	}
+
+	CHECK(!test_receive(test, &request));
+
+	// Already sent, or already in a higher class
+	CHECK(mch_sdo_promote(test->mch_sdo, &staged, SDO_CLASS_MOTION) == 0);
+
+	return true;
+}
+
+
+/**
+ * Queues a motion task field, as another machine reacting to an event
+ * in the same drain would.
+ */
+static void test_queue_field(void *machine, int event)
+{
+	test_t *test = (test_t *) machine;
+	mch_sdo_queue_write(test->mch_sdo, OB_O_P, OB_O_SUBINDEX(0), 1, 0x04);
+}
+
+
+/**
+ * The machine changes its own state at once while a queue is drained,
+ * an RPDO sent and answered by itself does not leave it waiting with
+ * a write in flight. An abort of that write then stops the queue.
+ */
+static bool test_drain_abort(test_t *test)
+{
+	machine_queue_t queue;
+	request_t pdo, field, request;
+
+	machine_queue_init(&queue);
+	mch_sdo_set_queue(test->mch_sdo, &queue);
+
+	machine_queue_begin(&queue);
+	CHECK(mch_sdo_queue_pdo(test->mch_sdo, FC_RPDO2, 0x0001, 0x02, SDO_CLASS_MOTION) == 0);
+	machine_queue_post(&queue, test_queue_field, test, 0);
+	machine_queue_end(&queue);
+
+	CHECK(test_receive(test, &pdo) && pdo.cob_id == COB_ID(FC_RPDO2, INTF_NODE_ID));
+	CHECK(test_receive(test, &field) && field.index == OB_O_P);
+	CHECK(mch_sdo_active_state(test->mch_sdo) == ST_SDO_SENDING);
+
+	// Abort the field, the copy depending on it is never sent
+	can_frame frame;
+	memset(&frame, 0, sizeof(frame));
+	frame.can_id = COB_ID(FC_SDO_TX, INTF_NODE_ID);
+	frame.can_dlc = 8;
+	frame.data[0] = 0x80;
+	frame.data[1] = field.index & 0xFF;
+	frame.data[2] = field.index >> 8;
+	frame.data[3] = field.subindex;
+	frame.data[7] = 0x06;
+	CHECK(send(test->fd, &frame, sizeof(frame), 0) == sizeof(frame));
+	test_pump(test);
+
+	CHECK(mch_sdo_active_state(test->mch_sdo) == ST_SDO_ERROR);
+
+	CHECK(mch_sdo_queue_write(test->mch_sdo, OB_COPY_MOTION_TASK, 0x00, 0x00010000, 0x04) == 0);
+	CHECK(!test_receive(test, &request));
+
+	mch_sdo_set_queue(test->mch_sdo, NULL);
+
+	return true;
+}
+
+
+/**
+ * After a retransmitted SDO was answered, the next SDO to the object is
+ * held back until the second response arrived or could no longer.
+ */
+static bool test_duplicate_expiry(test_t *test)
+{
+	request_t first, retransmit, request;
+
+	CHECK(mch_sdo_set_timeout(test->mch_sdo, TEST_TIMEOUT, 1) == 0);
+
+	// Answer only the retransmission, the first response may still come
+	CHECK(mch_sdo_queue_write(test->mch_sdo, OB_TEST, 0x01, 1, 0x04) == 0);
+	CHECK(test_receive(test, &first));
+
+	test_run(test, TEST_PAST_DEADLINE);
+	CHECK(test_receive(test, &retransmit) && retransmit.value == 1);
+	test_respond(test, &retransmit, 0);
+
+	CHECK(mch_sdo_queue_write(test->mch_sdo, OB_TEST, 0x01, 2, 0x04) == 0);
+	CHECK(!test_receive(test, &request));
+
+	// Another object is not affected
+	CHECK(mch_sdo_queue_write(test->mch_sdo, OB_TEST_OTHER, 0x01, 3, 0x04) == 0);
+	CHECK(test_receive(test, &request) && request.index == OB_TEST_OTHER);
+	test_respond(test, &request, 0);
+
+	// Sent once the duplicate expired
+	test_run(test, TEST_PAST_DEADLINE);
+	CHECK(test_receive(test, &request) && request.index == OB_TEST && request.value == 2);
+	test_respond(test, &request, 0);
+
+	// Same again, but the duplicate arrives and is discarded
+	CHECK(mch_sdo_queue_write(test->mch_sdo, OB_TEST, 0x01, 4, 0x04) == 0);
+	CHECK(test_receive(test, &first));
+
+	test_run(test, TEST_PAST_DEADLINE);
+	CHECK(test_receive(test, &retransmit));
+	test_respond(test, &retransmit, 0);
+
+	CHECK(mch_sdo_queue_write(test->mch_sdo, OB_TEST, 0x01, 5, 0x04) == 0);
+	CHECK(!test_receive(test, &request));
+
+	test_respond(test, &first, 0);
+	CHECK(test_receive(test, &request) && request.index == OB_TEST && request.value == 5);
+	test_respond(test, &request, 0);
+
+	mch_sdo_index_stats_t stats[SDO_MAX_INDICES];
+	int count = mch_sdo_get_stats(test->mch_sdo, stats, SDO_MAX_INDICES);
+
+	CHECK(count >= 1 && stats[0].index == OB_TEST);
+	CHECK(stats[0].retransmits == 2 && stats[0].timeouts == 0);
+
+	return true;
+}
+
+
+struct test_case_t {
+	const char *name;
+	bool (*run)(test_t *test);
+	int window;
+};
+
+static const test_case_t test_cases[] = {
+	{"ring wraparound", test_ring_wraparound, 1},
+	{"class priority", test_class_priority, 1},
+	{"barrier", test_barrier, 4},
+	{"control word drop", test_control_word_drop, 1},
+	{"control word hold", test_control_word_hold, 1},
+	{"staged promotion", test_staged_promotion, 1},
+	{"duplicate expiry", test_duplicate_expiry, 1},
+	{"abort during drain", test_drain_abort, 1},
+};
+
+
+int main(int argc, char *argv[])
+{
+	int failed = 0;
+
+	for(size_t i = 0; i < sizeof(test_cases) / sizeof(test_cases[0]); i++) {
+		test_t test;
+
+		bool passed = test_setup(&test, test_cases[i].window) && test_cases[i].run(&test);
+		test_teardown(&test);
+
+		printf("%-24s %s\n", test_cases[i].name, passed ? "ok" : "FAILED");
+
+		if(!passed)
+			failed++;
+	}
+
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,219 @@
+/**
+ * Exercises decoding of status words (TPDO1) into machine events, the
+ * test plays the drive on the other end of a socketpair: repeated
+ * status words are suppressed once they no longer change any state,
+ * and a changed bit is decoded into its event.
+ *
+ * Exits with status 0 if all tests pass.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/socket.h>
+#include <linux/can.h>
+
+#include <event2/event.h>
+#include <sled.h>
+#include <sled_internal.h>
+
+
+#define CHECK(condition) \
+	if(!(condition)) { \
+		fprintf(stderr, "%s:%d: %s() check failed: %s\n", __FILE__, __LINE__, __FUNCTION__, #condition); \
+		return false; \
+	}
+
+// Switch on disabled, with and without voltage enabled (bit 4)
+#define STATUS_SWITCH_ON_DISABLED 0x0240
+#define STATUS_VOLTAGE_ENABLED 0x0010
+
+
+struct test_t {
+	event_base *ev_base;
+	sled_t *sled;
+
+	// Drive end of the socketpair
+	int fd;
+};
+
+
+/**
+ * Sends a status word and mode of operation as the drive would, and
+ * lets libsled handle it.
+ */
+static void test_status(test_t *test, uint16_t status, uint8_t mode)
+{
+	can_frame frame;
+	memset(&frame, 0, sizeof(frame));
+
+	frame.can_id = COB_ID(FC_TPDO1, INTF_NODE_ID);
+	frame.can_dlc = 3;
+	frame.data[0] = status & 0xFF;
+	frame.data[1] = status >> 8;
+	frame.data[2] = mode;
+
+	if(send(test->fd, &frame, sizeof(frame), 0) != sizeof(frame))
+		perror("send()");
+
+	event_base_loop(test->ev_base, EVLOOP_NONBLOCK);
+}
+
+
+static sled_can_stats_t test_stats(test_t *test)
+{
+	sled_can_stats_t stats;
+	sled_can_get_statistics(test->sled, &stats, false);
+	return stats;
+}
+
+
+static bool test_setup(test_t *test)
+{
+	memset(test, 0, sizeof(test_t));
+
+	int sv[2];
+	if(socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sv) == -1) {
+		perror("socketpair()");
+		return false;
+	}
+
+	char device[32];
+	snprintf(device, sizeof(device), INTF_FD_DEVICE_PREFIX "%d", sv[0]);
+
+	test->ev_base = event_base_new();
+	event_base_priority_init(test->ev_base, 2);
+
+	test->fd = sv[1];
+	test->sled = sled_create_with_device(test->ev_base, device);
+
+	CHECK(test->sled);
+
+	// As if the drive became operational, status words now move the
+	//  DS402 machine.
+	mch_ds_handle_event(test->sled->mch_ds, EV_DS_NET_OPERATIONAL);
+	CHECK(mch_ds_active_state(test->sled->mch_ds) == ST_DS_UNKNOWN);
+
+	return true;
+}
+
+
+static void test_teardown(test_t *test)
+{
+	if(test->sled)
+		sled_destroy(&(test->sled));
+
+	event_base_free(test->ev_base);
+	close(test->fd);
+}
+
+
+/**
+ * A status word is decoded until the machines no longer change state,
+ * repetitions after that are counted but not decoded.
+ */
+static bool test_duplicates(test_t *test)
+{
+	sled_t *sled = test->sled;
+
+	// Not ready to switch on and voltage disabled
+	test_status(test, STATUS_SWITCH_ON_DISABLED, 0x00);
+	CHECK(mch_ds_active_state(sled->mch_ds) == ST_DS_SWITCH_ON_DISABLED);
+	CHECK(test_stats(test).status_suppressed == 0);
+
+	// State changed, the same status word is decoded once more
+	sled_can_stats_t before = test_stats(test);
+	test_status(test, STATUS_SWITCH_ON_DISABLED, 0x00);
+
+	CHECK(test_stats(test).status_suppressed == 0);
+	CHECK(test_stats(test).events > before.events);
+
+	// Stable from here on
+	before = test_stats(test);
+
+	for(int i = 0; i < 5; i++)
+		test_status(test, STATUS_SWITCH_ON_DISABLED, 0x00);
+
+	sled_can_stats_t after = test_stats(test);
+
+	CHECK(after.status_frames == before.status_frames + 5);
+	CHECK(after.status_suppressed == 5);
+	CHECK(after.events_suppressed == 5 * 2);
+	CHECK(after.events == before.events);
+	CHECK(mch_ds_active_state(sled->mch_ds) == ST_DS_SWITCH_ON_DISABLED);
+
+	return true;
+}
+
+
+/**
+ * A single bit changed in a stable status word emits its event, and
+ * so does a machine that moved since the last decode.
+ */
+static bool test_changed_bits(test_t *test)
+{
+	sled_t *sled = test->sled;
+
+	test_status(test, STATUS_SWITCH_ON_DISABLED, 0x00);
+	test_status(test, STATUS_SWITCH_ON_DISABLED, 0x00);
+	test_status(test, STATUS_SWITCH_ON_DISABLED, 0x00);
+	CHECK(test_stats(test).status_suppressed == 1);
+
+	// Voltage enabled, the drive is prepared for switching on
+	test_status(test, STATUS_SWITCH_ON_DISABLED | STATUS_VOLTAGE_ENABLED, 0x00);
+	CHECK(test_stats(test).status_suppressed == 1);
+	CHECK(mch_ds_active_state(sled->mch_ds) == ST_DS_PREPARE_SWITCH_ON);
+
+	// Machine moved by something else, the unchanged word is decoded
+	mch_ds_handle_event(sled->mch_ds, EV_DS_NET_INOPERATIONAL);
+	mch_ds_handle_event(sled->mch_ds, EV_DS_NET_OPERATIONAL);
+	CHECK(mch_ds_active_state(sled->mch_ds) == ST_DS_UNKNOWN);
+
+	// Through switch on disabled in the same drain
+	test_status(test, STATUS_SWITCH_ON_DISABLED | STATUS_VOLTAGE_ENABLED, 0x00);
+	CHECK(test_stats(test).status_suppressed == 1);
+	CHECK(mch_ds_active_state(sled->mch_ds) == ST_DS_PREPARE_SWITCH_ON);
+
+	// A mode of operation is part of the word as well
+	test_status(test, STATUS_SWITCH_ON_DISABLED | STATUS_VOLTAGE_ENABLED, 0x00);
+	test_status(test, STATUS_SWITCH_ON_DISABLED | STATUS_VOLTAGE_ENABLED, 0x00);
+	uint64_t suppressed = test_stats(test).status_suppressed;
+
+	test_status(test, STATUS_SWITCH_ON_DISABLED | STATUS_VOLTAGE_ENABLED, 0x01);
+	CHECK(test_stats(test).status_suppressed == suppressed);
+
+	return true;
+}
+
+
+struct test_case_t {
+	const char *name;
+	bool (*run)(test_t *test);
+};
+
+static const test_case_t test_cases[] = {
+	{"duplicates", test_duplicates},
+	{"changed bits", test_changed_bits},
+};
+
+
+int main(int argc, char *argv[])
+{
+	int failed = 0;
+
+	for(size_t i = 0; i < sizeof(test_cases) / sizeof(test_cases[0]); i++) {
+		test_t test;
+
+		bool passed = test_setup(&test) && test_cases[i].run(&test);
+		test_teardown(&test);
+
+		printf("%-24s %s\n", test_cases[i].name, passed ? "ok" : "FAILED");
+
+		if(!passed)
+			failed++;
+	}
+
+	return failed ? 1 : 0;
+}
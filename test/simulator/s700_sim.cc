@@ -0,0 +1,1325 @@
+
+#include "s700_sim.h"
+
+#include <event2/event.h>
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <math.h>
+#include <time.h>
+
+#include <sys/socket.h>
+
+#include <linux/can.h>
+
+#define SIM_MAX_OBJECTS 192
+#define SIM_NUM_TASKS 301
+
+// SDO abort codes
+#define SDO_ABORT_COMMAND        0x05040001	// Command specifier not valid
+#define SDO_ABORT_READ_WO        0x06010001	// Attempt to read a write only object
+#define SDO_ABORT_WRITE_RO       0x06010002	// Attempt to write a read only object
+#define SDO_ABORT_NO_OBJECT      0x06020000	// Object does not exist
+#define SDO_ABORT_NO_MAP         0x06040041	// Object cannot be mapped to the PDO
+#define SDO_ABORT_MAP_LENGTH     0x06040042	// Mapped objects exceed PDO length
+#define SDO_ABORT_LENGTH         0x06070010	// Data type length does not match
+#define SDO_ABORT_NO_SUBINDEX    0x06090011	// Sub-index does not exist
+#define SDO_ABORT_VALUE_RANGE    0x06090030	// Value range exceeded
+#define SDO_ABORT_DEVICE_STATE   0x08000022	// Not possible in present device state
+
+// NMT states as reported in heartbeat
+#define NMT_BOOTUP          0x00
+#define NMT_STOPPED         0x04
+#define NMT_OPERATIONAL     0x05
+#define NMT_PREOPERATIONAL  0x7F
+
+// Modes of operation
+#define MODE_PP      0x01
+#define MODE_HOMING  0x06
+#define MODE_IP      0x07
+
+enum sim_access_t {
+	ACCESS_RO = 0x01,
+	ACCESS_WO = 0x02,
+	ACCESS_RW = 0x03
+};
+
+
+/**
+ * Object dictionary entry.
+ */
+struct sim_object_t {
+	uint16_t index;
+	uint8_t subindex;
+	uint8_t size;
+	uint8_t access;
+	uint32_t value;
+};
+
+
+/**
+ * Motion task as stored in the drive.
+ */
+struct sim_task_t {
+	int32_t p, v, c, acc, dec, tab, fn, ft;
+};
+
+
+/**
+ * DS402 power state machine.
+ */
+enum sim_ds_state_t {
+	DS_SWITCH_ON_DISABLED,
+	DS_READY_TO_SWITCH_ON,
+	DS_SWITCHED_ON,
+	DS_OPERATION_ENABLED,
+	DS_QUICK_STOP_ACTIVE,
+	DS_FAULT
+};
+
+
+/**
+ * Motion currently executed by the drive (positions in um).
+ */
+struct sim_motion_t {
+	bool active;
+	int task;
+	int table;
+	double start_time, duration;
+	double from, to;
+
+	// Next motion task is started at next_time
+	bool chained;
+	int next_task;
+	double next_time;
+};
+
+
+/**
+ * Transmit and receive state of a single PDO.
+ */
+struct sim_pdo_t {
+	uint8_t data[8];
+	uint8_t len;
+	bool valid;
+	double time;
+};
+
+
+struct sim_t {
+	event_base *ev_base;
+	int fd;
+
+	sim_options_t options;
+
+	event *read_event;
+	event *tick_event;
+
+	uint8_t nmt_state;
+	double last_heartbeat;
+
+	sim_object_t od[SIM_MAX_OBJECTS];
+	int od_size;
+
+	sim_task_t tasks[SIM_NUM_TASKS];
+
+	sim_ds_state_t ds_state;
+	uint16_t control_word;
+	bool setpoint_ack;
+
+	bool homed;
+	bool homing;
+	double homing_end;
+
+	bool ip_active;
+	double last_sync;
+
+	double position, velocity;
+	double last_tick;
+
+	sim_motion_t motion;
+	double motion_start_time;
+
+	sim_pdo_t tpdo[SIM_NUM_PDOS];
+	sim_pdo_t rpdo[SIM_NUM_PDOS];
+
+	sim_stats_t stats;
+	unsigned int seed;
+};
+
+
+static void sim_on_read(evutil_socket_t fd, short flags, void *param);
+static void sim_on_tick(evutil_socket_t fd, short flags, void *param);
+static void sim_on_sdo_delay(evutil_socket_t fd, short flags, void *param);
+
+
+/**
+ * Returns current time in seconds (CLOCK_MONOTONIC).
+ */
+double sim_get_time()
+{
+	timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return double(ts.tv_sec) + double(ts.tv_nsec) / 1000.0 / 1000.0 / 1000.0;
+}
+
+
+/**
+ * Fills options with the behaviour of a freshly powered drive.
+ */
+void sim_default_options(sim_options_t *options)
+{
+	assert(options);
+
+	options->node_id = 1;
+	options->heartbeat_ms = 100;
+	options->tick_us = 1000;
+	options->sdo_delay_us = 500;
+	options->sdo_drop_rate = 0.0;
+	options->rx_drop_rate = 0.0;
+
+	for(int i = 0; i < SIM_NUM_PDOS; i++)
+		options->tpdo_period_ms[i] = 0;
+
+	options->homed = false;
+	options->homing_time = 0.5;
+	options->direct_tasks = false;
+}
+
+
+/*
+ * Object dictionary
+ */
+
+static void sim_od_add(sim_t *sim, uint16_t index, uint8_t subindex, uint8_t size, uint8_t access, uint32_t value)
+{
+	assert(sim->od_size < SIM_MAX_OBJECTS);
+
+	sim_object_t *object = &(sim->od[sim->od_size++]);
+	object->index = index;
+	object->subindex = subindex;
+	object->size = size;
+	object->access = access;
+	object->value = value;
+}
+
+
+static sim_object_t *sim_od_find(sim_t *sim, uint16_t index, uint8_t subindex)
+{
+	for(int i = 0; i < sim->od_size; i++)
+		if(sim->od[i].index == index && sim->od[i].subindex == subindex)
+			return &(sim->od[i]);
+
+	return NULL;
+}
+
+
+static bool sim_od_index_exists(sim_t *sim, uint16_t index)
+{
+	for(int i = 0; i < sim->od_size; i++)
+		if(sim->od[i].index == index)
+			return true;
+
+	return false;
+}
+
+
+static uint32_t sim_od_get(sim_t *sim, uint16_t index, uint8_t subindex)
+{
+	sim_object_t *object = sim_od_find(sim, index, subindex);
+	assert(object);
+	return object->value;
+}
+
+
+static void sim_od_set(sim_t *sim, uint16_t index, uint8_t subindex, uint32_t value)
+{
+	sim_object_t *object = sim_od_find(sim, index, subindex);
+	assert(object);
+	object->value = value;
+}
+
+
+static void sim_od_setup(sim_t *sim)
+{
+	int node = sim->options.node_id;
+
+	sim_od_add(sim, 0x1000, 0x00, 4, ACCESS_RO, 0x00020192);	// Device type (DS402 servo)
+	sim_od_add(sim, 0x1017, 0x00, 2, ACCESS_RW, sim->options.heartbeat_ms);
+	sim_od_add(sim, 0x1018, 0x01, 4, ACCESS_RO, 0x0000006A);	// Vendor id
+
+	for(int n = 0; n < SIM_NUM_PDOS; n++) {
+		sim_od_add(sim, 0x1400 + n, 0x01, 4, ACCESS_RW, 0x200 + 0x100 * n + node);
+		sim_od_add(sim, 0x1400 + n, 0x02, 1, ACCESS_RW, 0xFF);
+
+		sim_od_add(sim, 0x1600 + n, 0x00, 1, ACCESS_RW, 0);
+		for(int i = 1; i <= 8; i++)
+			sim_od_add(sim, 0x1600 + n, i, 4, ACCESS_RW, 0);
+
+		sim_od_add(sim, 0x1800 + n, 0x01, 4, ACCESS_RW, 0x180 + 0x100 * n + node);
+		sim_od_add(sim, 0x1800 + n, 0x02, 1, ACCESS_RW, 0xFF);
+		sim_od_add(sim, 0x1800 + n, 0x03, 2, ACCESS_RW, 0);
+		sim_od_add(sim, 0x1800 + n, 0x05, 2, ACCESS_RW, 0);
+
+		sim_od_add(sim, 0x1A00 + n, 0x00, 1, ACCESS_RW, 0);
+		for(int i = 1; i <= 8; i++)
+			sim_od_add(sim, 0x1A00 + n, i, 4, ACCESS_RW, 0);
+	}
+
+	for(int i = 1; i <= 8; i++) {
+		sim_od_add(sim, 0x2030, i, 4, ACCESS_WO, 0);	// DP-RAM variables
+		sim_od_add(sim, 0x2090, i, 4, ACCESS_RO, 0);
+	}
+
+	sim_od_add(sim, 0x2080, 0x00, 2, ACCESS_RW, 0);	// Motion task
+	sim_od_add(sim, 0x2081, 0x00, 2, ACCESS_RO, 0);	// Active motion task
+	sim_od_add(sim, 0x2082, 0x00, 4, ACCESS_WO, 0);	// Copy motion task
+	sim_od_add(sim, 0x3518, 0x01, 4, ACCESS_RO, 0);	// Error status
+	sim_od_add(sim, 0x35AE, 0x01, 4, ACCESS_RW, 0);	// Digital output 1
+	sim_od_add(sim, 0x35B1, 0x01, 4, ACCESS_RW, 0);	// Digital output 2
+
+	sim_od_add(sim, 0x6040, 0x00, 2, ACCESS_RW, 0);	// Control word
+	sim_od_add(sim, 0x6041, 0x00, 2, ACCESS_RO, 0);	// Status word
+	sim_od_add(sim, 0x6060, 0x00, 1, ACCESS_RW, 0);	// Mode of operation
+	sim_od_add(sim, 0x6061, 0x00, 1, ACCESS_RO, 0);	// Mode of operation display
+	sim_od_add(sim, 0x6064, 0x00, 4, ACCESS_RO, 0);	// Position actual value
+	sim_od_add(sim, 0x606C, 0x00, 4, ACCESS_RO, 0);	// Velocity actual value
+	sim_od_add(sim, 0x6078, 0x00, 2, ACCESS_RO, 0);	// Current actual value
+	sim_od_add(sim, 0x60C1, 0x01, 4, ACCESS_RW, 0);	// Interpolation data
+	sim_od_add(sim, 0x60C2, 0x01, 1, ACCESS_RW, 1);	// Interpolation period
+	sim_od_add(sim, 0x60C2, 0x02, 1, ACCESS_RW, 0xFD);
+	sim_od_add(sim, 0x60F4, 0x00, 4, ACCESS_RO, 0);	// Following error
+	sim_od_add(sim, 0x60FD, 0x00, 4, ACCESS_RO, 0);	// Digital inputs
+}
+
+
+/**
+ * Returns motion task field stored at index, or NULL if the index
+ * is not one of the OB_O_* objects. Subindex 0x01 refers to task 0,
+ * with direct tasks 0x02..0x65 refer to tasks 201..300.
+ *
+ * Sets abort when the index exists but the subindex does not.
+ */
+static int32_t *sim_task_field(sim_t *sim, uint16_t index, uint8_t subindex, uint32_t *abort)
+{
+	int number = -1;
+
+	if(subindex == 0x01)
+		number = 0;
+	else if(sim->options.direct_tasks && subindex >= 0x02 && subindex <= 0x65)
+		number = subindex + 199;
+
+	sim_task_t *task = &(sim->tasks[number < 0 ? 0 : number]);
+	*abort = number < 0 ? SDO_ABORT_NO_SUBINDEX : 0;
+
+	switch(index) {
+		case 0x35BE: return &(task->p);
+		case 0x35BF: return &(task->v);
+		case 0x35B9: return &(task->c);
+		case 0x35B7: return &(task->acc);
+		case 0x35BA: return &(task->dec);
+		case 0x35B8: return &(task->tab);
+		case 0x35BC: return &(task->fn);
+		case 0x35BD: return &(task->ft);
+	}
+
+	return NULL;
+}
+
+
+/*
+ * Frame I/O
+ */
+
+static void sim_send(sim_t *sim, uint16_t id, const uint8_t *data, uint8_t len)
+{
+	can_frame frame;
+	memset(&frame, 0, sizeof(frame));
+
+	frame.can_id = id;
+	frame.can_dlc = len;
+	memcpy(frame.data, data, len);
+
+	if(write(sim->fd, &frame, sizeof(frame)) != sizeof(frame)) {
+		fprintf(stderr, "Simulator could not send frame: %s\n", strerror(errno));
+		return;
+	}
+
+	sim->stats.frames_sent++;
+}
+
+
+static void sim_send_emergency(sim_t *sim, uint16_t error_code)
+{
+	uint8_t data[8] = {uint8_t(error_code & 0xFF), uint8_t(error_code >> 8), 0x01, 0, 0, 0, 0, 0};
+	sim_send(sim, 0x080 + sim->options.node_id, data, 8);
+}
+
+
+static void sim_send_heartbeat(sim_t *sim)
+{
+	uint8_t state = sim->nmt_state;
+	sim_send(sim, 0x700 + sim->options.node_id, &state, 1);
+	sim->last_heartbeat = sim_get_time();
+}
+
+
+/*
+ * Drive behaviour
+ */
+
+/**
+ * Normalized motion profile, s(0) = 0 and s(1) = 1.
+ */
+static double sim_profile_shape(int table, double tau)
+{
+	const double pi2 = M_PI * M_PI;
+
+	switch(table) {
+		case 0:	// Sinusoid
+			return (1.0 - cos(M_PI * tau)) / 2.0;
+
+		case 1:	// Sinusoid with finite jerk at start
+			return (40.0 - pi2) / 4.0 * pow(tau, 3) + (pi2 - 30.0) / 2.0 * pow(tau, 4) +
+				(24.0 - pi2) / 4.0 * pow(tau, 5);
+
+		case 3:	// Sinusoid with finite jerk at end
+			return 1.0 - sim_profile_shape(1, 1.0 - tau);
+
+		default:	// Minimum jerk
+			return 10.0 * pow(tau, 3) - 15.0 * pow(tau, 4) + 6.0 * pow(tau, 5);
+	}
+}
+
+
+static void sim_start_task(sim_t *sim, int number, double now)
+{
+	if(number < 0 || number >= SIM_NUM_TASKS) {
+		sim_send_emergency(sim, 0x8681);	// Invalid motion task number
+		return;
+	}
+
+	sim_task_t *task = &(sim->tasks[number]);
+	sim_motion_t *motion = &(sim->motion);
+
+	double from = sim->position;
+	double to = task->p;
+
+	if(task->c & 0x01) {
+		if(task->c & 0x04)
+			to += sim->position;
+		else
+			to += motion->active ? motion->to : sim->position;
+	}
+
+	motion->active = true;
+	motion->task = number;
+	motion->table = (task->c & 0x200) ? task->tab : 2;
+	motion->start_time = now;
+	motion->duration = (task->acc + task->dec + 1) / 1000.0;
+	motion->from = from;
+	motion->to = to;
+
+	motion->chained = (task->c & 0x08) != 0;
+	motion->next_task = task->fn;
+	motion->next_time = 0.0;
+
+	sim->motion_start_time = now;
+	sim->stats.motion_tasks_started++;
+
+	sim_od_set(sim, 0x2081, 0x00, number);
+}
+
+
+static void sim_stop_motion(sim_t *sim)
+{
+	sim->motion.active = false;
+	sim->motion.chained = false;
+	sim->homing = false;
+	sim->ip_active = false;
+}
+
+
+static void sim_enter_fault(sim_t *sim, uint16_t error_code)
+{
+	sim_stop_motion(sim);
+	sim->ds_state = DS_FAULT;
+	sim_od_set(sim, 0x3518, 0x01, error_code);
+	sim_send_emergency(sim, error_code);
+}
+
+
+static void sim_clear_fault(sim_t *sim)
+{
+	if(sim->ds_state != DS_FAULT)
+		return;
+
+	sim->ds_state = DS_SWITCH_ON_DISABLED;
+	sim_send_emergency(sim, 0x0000);
+}
+
+
+/**
+ * Applies a new control word (DS402 device control).
+ */
+static void sim_set_control_word(sim_t *sim, uint16_t control_word, double now)
+{
+	uint16_t previous = sim->control_word;
+	sim->control_word = control_word;
+
+	// Fault reset on rising edge of bit 7
+	if((control_word & 0x80) && !(previous & 0x80)) {
+		sim_clear_fault(sim);
+		return;
+	}
+
+	if(sim->ds_state != DS_FAULT) {
+		if((control_word & 0x82) == 0x00) {
+			// Disable voltage
+			sim_stop_motion(sim);
+			sim->ds_state = DS_SWITCH_ON_DISABLED;
+		} else if((control_word & 0x86) == 0x02) {
+			// Quick stop
+			sim_stop_motion(sim);
+			sim->ds_state = (sim->ds_state == DS_OPERATION_ENABLED) ?
+				DS_QUICK_STOP_ACTIVE : DS_SWITCH_ON_DISABLED;
+		} else if((control_word & 0x87) == 0x06) {
+			// Shutdown
+			sim_stop_motion(sim);
+			sim->ds_state = DS_READY_TO_SWITCH_ON;
+		} else if((control_word & 0x8F) == 0x07) {
+			// Switch on or disable operation
+			if(sim->ds_state == DS_READY_TO_SWITCH_ON || sim->ds_state == DS_OPERATION_ENABLED) {
+				sim_stop_motion(sim);
+				sim->ds_state = DS_SWITCHED_ON;
+			}
+		} else if((control_word & 0x8F) == 0x0F) {
+			// Enable operation
+			if(sim->ds_state == DS_SWITCHED_ON || sim->ds_state == DS_QUICK_STOP_ACTIVE) {
+				sim->ds_state = DS_OPERATION_ENABLED;
+				sim->stats.operation_enabled++;
+			}
+		}
+	}
+
+	if(sim->ds_state != DS_OPERATION_ENABLED)
+		return;
+
+	bool rising = (control_word & 0x10) && !(previous & 0x10);
+	uint8_t mode = sim_od_get(sim, 0x6061, 0x00);
+
+	switch(mode) {
+		case MODE_PP:
+			if(rising && (!sim->motion.active || (control_word & 0x20))) {
+				sim_start_task(sim, sim_od_get(sim, 0x2080, 0x00), now);
+				sim->setpoint_ack = true;
+			}
+
+			if(!(control_word & 0x10))
+				sim->setpoint_ack = false;
+			break;
+
+		case MODE_HOMING:
+			if(rising && !sim->homing) {
+				sim->homing = true;
+				sim->homing_end = now + (sim->homed ? 0.0 : sim->options.homing_time);
+
+				sim->motion.active = true;
+				sim->motion.task = -1;
+				sim->motion.table = 2;
+				sim->motion.start_time = now;
+				sim->motion.duration = sim->homing_end - now;
+				sim->motion.from = sim->position;
+				sim->motion.to = 0.0;
+				sim->motion.chained = false;
+			}
+			break;
+
+		case MODE_IP:
+			sim->ip_active = (control_word & 0x10) != 0;
+			break;
+	}
+}
+
+
+static uint16_t sim_get_status_word(sim_t *sim)
+{
+	uint16_t status = 0x10;	// Voltage enabled
+
+	switch(sim->ds_state) {
+		case DS_SWITCH_ON_DISABLED: status |= 0x40; break;
+		case DS_READY_TO_SWITCH_ON: status |= 0x21; break;
+		case DS_SWITCHED_ON:        status |= 0x23; break;
+		case DS_OPERATION_ENABLED:  status |= 0x27; break;
+		case DS_QUICK_STOP_ACTIVE:  status |= 0x07; break;
+		case DS_FAULT:              status |= 0x08; break;
+	}
+
+	switch(sim_od_get(sim, 0x6061, 0x00)) {
+		case MODE_PP:
+			if(!sim->motion.active && !sim->motion.chained) status |= 0x400;
+			if(sim->setpoint_ack) status |= 0x1000;
+			break;
+
+		case MODE_HOMING:
+			if(!sim->homing) status |= 0x400;
+			if(sim->homed && !sim->homing) status |= 0x1000;
+			break;
+
+		case MODE_IP:
+			if(sim->ip_active) status |= 0x1000;
+			break;
+	}
+
+	return status;
+}
+
+
+/**
+ * Advances motion to the current time.
+ */
+static void sim_update_motion(sim_t *sim, double now)
+{
+	sim_motion_t *motion = &(sim->motion);
+	double previous = sim->position;
+
+	if(motion->active) {
+		double tau = motion->duration > 0.0 ? (now - motion->start_time) / motion->duration : 1.0;
+
+		if(tau >= 1.0) {
+			sim->position = motion->to;
+			motion->active = false;
+
+			if(sim->homing) {
+				sim->homing = false;
+				sim->homed = true;
+			}
+
+			if(motion->chained)
+				motion->next_time = now + sim->tasks[motion->task].ft / 1000.0;
+		} else {
+			sim->position = motion->from + (motion->to - motion->from) * sim_profile_shape(motion->table, tau);
+		}
+	} else if(motion->chained && now >= motion->next_time) {
+		sim_start_task(sim, motion->next_task, now);
+	}
+
+	double dt = now - sim->last_tick;
+
+	if(dt > 0.0 && !sim->ip_active)
+		sim->velocity = (sim->position - previous) / dt;
+
+	sim->last_tick = now;
+}
+
+
+/*
+ * PDOs
+ */
+
+/**
+ * Packs the objects mapped in TPDO n.
+ *
+ * @return Length of PDO in bytes.
+ */
+static uint8_t sim_pack_tpdo(sim_t *sim, int n, uint8_t *data)
+{
+	int count = sim_od_get(sim, 0x1A00 + n, 0x00);
+	int offset = 0;
+
+	memset(data, 0, 8);
+
+	for(int i = 1; i <= count; i++) {
+		uint32_t entry = sim_od_get(sim, 0x1A00 + n, i);
+		uint32_t value = sim_od_get(sim, entry >> 16, (entry >> 8) & 0xFF);
+		int bytes = (entry & 0xFF) / 8;
+
+		for(int j = 0; j < bytes && offset < 8; j++)
+			data[offset++] = (value >> (8 * j)) & 0xFF;
+	}
+
+	return offset;
+}
+
+
+static void sim_send_tpdo(sim_t *sim, int n, double now)
+{
+	sim_pdo_t *pdo = &(sim->tpdo[n]);
+	uint32_t cob_id = sim_od_get(sim, 0x1800 + n, 0x01);
+
+	if(cob_id & 0x80000000)
+		return;
+
+	sim_send(sim, cob_id & 0x7FF, pdo->data, pdo->len);
+
+	pdo->valid = true;
+	pdo->time = now;
+	sim->stats.tpdos_sent++;
+}
+
+
+/**
+ * Transmits event driven TPDOs that changed or whose event timer expired.
+ */
+static void sim_update_tpdos(sim_t *sim, double now)
+{
+	for(int n = 0; n < SIM_NUM_PDOS; n++) {
+		uint8_t data[8];
+		uint8_t len = sim_pack_tpdo(sim, n, data);
+
+		if(len == 0)
+			continue;
+
+		sim_pdo_t *pdo = &(sim->tpdo[n]);
+		bool changed = !pdo->valid || len != pdo->len || memcmp(data, pdo->data, len) != 0;
+		double elapsed = now - pdo->time;
+
+		memcpy(pdo->data, data, len);
+		pdo->len = len;
+
+		int period = sim->options.tpdo_period_ms[n];
+
+		if(period > 0) {
+			if(!pdo->valid || elapsed >= period / 1000.0)
+				sim_send_tpdo(sim, n, now);
+			continue;
+		}
+
+		uint8_t type = sim_od_get(sim, 0x1800 + n, 0x02);
+
+		// Synchronous PDOs are sent from sim_on_sync()
+		if(type != 0xFE && type != 0xFF)
+			continue;
+
+		double inhibit = sim_od_get(sim, 0x1800 + n, 0x03) / 10000.0;
+		double timer = sim_od_get(sim, 0x1800 + n, 0x05) / 1000.0;
+
+		if(changed && elapsed >= inhibit) {
+			sim_send_tpdo(sim, n, now);
+		} else if(timer > 0.0 && elapsed >= timer) {
+			sim_send_tpdo(sim, n, now);
+		} else if(changed) {
+			// Send on a later tick, once the inhibit time has passed
+			pdo->valid = false;
+		}
+	}
+}
+
+
+static uint32_t sim_write_object(sim_t *sim, uint16_t index, uint8_t subindex, uint32_t value, int size, double now);
+
+
+/**
+ * Writes data of RPDO n to the mapped objects.
+ */
+static void sim_apply_rpdo(sim_t *sim, int n, double now)
+{
+	sim_pdo_t *pdo = &(sim->rpdo[n]);
+	int count = sim_od_get(sim, 0x1600 + n, 0x00);
+	int offset = 0;
+
+	for(int i = 1; i <= count; i++) {
+		uint32_t entry = sim_od_get(sim, 0x1600 + n, i);
+		int bytes = (entry & 0xFF) / 8;
+		uint32_t value = 0;
+
+		for(int j = 0; j < bytes && offset < pdo->len; j++)
+			value |= uint32_t(pdo->data[offset++]) << (8 * j);
+
+		sim_write_object(sim, entry >> 16, (entry >> 8) & 0xFF, value, bytes, now);
+	}
+
+	pdo->valid = false;
+}
+
+
+static void sim_on_rpdo(sim_t *sim, int n, const can_frame *frame, double now)
+{
+	sim_pdo_t *pdo = &(sim->rpdo[n]);
+
+	memcpy(pdo->data, frame->data, 8);
+	pdo->len = frame->can_dlc;
+	pdo->valid = true;
+	pdo->time = now;
+
+	sim->stats.rpdos_received++;
+
+	// Synchronous RPDOs take effect on the next SYNC
+	uint8_t type = sim_od_get(sim, 0x1400 + n, 0x02);
+	if(type == 0xFE || type == 0xFF)
+		sim_apply_rpdo(sim, n, now);
+}
+
+
+/**
+ * Copies status word, position and velocity to the object dictionary.
+ */
+static void sim_update_actual_values(sim_t *sim)
+{
+	sim_od_set(sim, 0x6041, 0x00, sim_get_status_word(sim));
+	sim_od_set(sim, 0x6064, 0x00, uint32_t(int32_t(lround(sim->position))));
+	sim_od_set(sim, 0x606C, 0x00, uint32_t(int32_t(lround(sim->velocity))));
+
+	// Position loop lags about two milliseconds behind
+	sim_od_set(sim, 0x60F4, 0x00, uint32_t(int32_t(lround(sim->velocity * 0.002))));
+}
+
+
+static void sim_on_sync(sim_t *sim, double now)
+{
+	sim->stats.syncs_received++;
+
+	for(int n = 0; n < SIM_NUM_PDOS; n++)
+		if(sim->rpdo[n].valid)
+			sim_apply_rpdo(sim, n, now);
+
+	// Interpolated position mode follows the set-point received
+	if(sim->ip_active) {
+		double target = int32_t(sim_od_get(sim, 0x60C1, 0x01));
+		double dt = now - sim->last_sync;
+
+		if(sim->last_sync > 0.0 && dt > 0.0)
+			sim->velocity = (target - sim->position) / dt;
+
+		sim->position = target;
+	}
+
+	sim->last_sync = now;
+
+	// Synchronous TPDOs are sampled at SYNC, not at the last cycle
+	if(!sim->ip_active) {
+		sim_update_motion(sim, now);
+		sim_update_actual_values(sim);
+	}
+
+	for(int n = 0; n < SIM_NUM_PDOS; n++) {
+		uint8_t type = sim_od_get(sim, 0x1800 + n, 0x02);
+
+		if(type == 0 || type > 240 || sim->options.tpdo_period_ms[n] > 0)
+			continue;
+
+		if((sim->stats.syncs_received % type) != 0)
+			continue;
+
+		sim_pdo_t *pdo = &(sim->tpdo[n]);
+		pdo->len = sim_pack_tpdo(sim, n, pdo->data);
+
+		if(pdo->len > 0)
+			sim_send_tpdo(sim, n, now);
+	}
+}
+
+
+/*
+ * SDO server
+ */
+
+/**
+ * Validates a PDO mapping of count entries.
+ *
+ * @return Abort code, 0 if mapping is valid.
+ */
+static uint32_t sim_check_mapping(sim_t *sim, uint16_t mapping, int count, bool transmit)
+{
+	int bits = 0;
+
+	if(count > 8)
+		return SDO_ABORT_VALUE_RANGE;
+
+	for(int i = 1; i <= count; i++) {
+		uint32_t entry = sim_od_get(sim, mapping, i);
+		sim_object_t *object = sim_od_find(sim, entry >> 16, (entry >> 8) & 0xFF);
+
+		if(!object || (entry & 0x07) || (entry & 0xFF) > object->size * 8)
+			return SDO_ABORT_NO_MAP;
+
+		if(transmit && !(object->access & ACCESS_RO))
+			return SDO_ABORT_NO_MAP;
+		if(!transmit && !(object->access & ACCESS_WO))
+			return SDO_ABORT_NO_MAP;
+
+		bits += entry & 0xFF;
+	}
+
+	if(bits > 64)
+		return SDO_ABORT_MAP_LENGTH;
+
+	return 0;
+}
+
+
+/**
+ * Reads an object.
+ *
+ * @return Abort code, 0 on success.
+ */
+static uint32_t sim_read_object(sim_t *sim, uint16_t index, uint8_t subindex, uint32_t *value, int *size)
+{
+	uint32_t abort;
+	int32_t *field = sim_task_field(sim, index, subindex, &abort);
+
+	if(field) {
+		if(abort)
+			return abort;
+
+		*value = *field;
+		*size = 4;
+		return 0;
+	}
+
+	sim_object_t *object = sim_od_find(sim, index, subindex);
+
+	if(!object)
+		return sim_od_index_exists(sim, index) ? SDO_ABORT_NO_SUBINDEX : SDO_ABORT_NO_OBJECT;
+
+	if(!(object->access & ACCESS_RO))
+		return SDO_ABORT_READ_WO;
+
+	// Reading the error status acknowledges the fault
+	if(index == 0x3518)
+		sim_clear_fault(sim);
+
+	*value = object->value;
+	*size = object->size;
+	return 0;
+}
+
+
+/**
+ * Writes an object, size is 0 if not specified by the client.
+ *
+ * @return Abort code, 0 on success.
+ */
+static uint32_t sim_write_object(sim_t *sim, uint16_t index, uint8_t subindex, uint32_t value, int size, double now)
+{
+	uint32_t abort;
+	int32_t *field = sim_task_field(sim, index, subindex, &abort);
+
+	if(field) {
+		if(abort)
+			return abort;
+		if(size != 0 && size != 4)
+			return SDO_ABORT_LENGTH;
+
+		*field = value;
+		return 0;
+	}
+
+	sim_object_t *object = sim_od_find(sim, index, subindex);
+
+	if(!object)
+		return sim_od_index_exists(sim, index) ? SDO_ABORT_NO_SUBINDEX : SDO_ABORT_NO_OBJECT;
+
+	if(!(object->access & ACCESS_WO))
+		return SDO_ABORT_WRITE_RO;
+
+	if(size != 0 && size != object->size)
+		return SDO_ABORT_LENGTH;
+
+	// PDO mappings can only be changed while the PDO is disabled
+	bool rpdo_mapping = (index & 0xFFF0) == 0x1600 && (index & 0x0F) < SIM_NUM_PDOS;
+	bool tpdo_mapping = (index & 0xFFF0) == 0x1A00 && (index & 0x0F) < SIM_NUM_PDOS;
+
+	if(rpdo_mapping || tpdo_mapping) {
+		if(sim->nmt_state == NMT_OPERATIONAL)
+			return SDO_ABORT_DEVICE_STATE;
+
+		if(subindex == 0x00) {
+			abort = sim_check_mapping(sim, index, value, tpdo_mapping);
+			if(abort)
+				return abort;
+		} else if(sim_od_get(sim, index, 0x00) != 0) {
+			return SDO_ABORT_DEVICE_STATE;
+		}
+	}
+
+	switch(index) {
+		case 0x2082: {
+			uint16_t from = value & 0xFFFF;
+			uint16_t to = value >> 16;
+
+			if(from >= SIM_NUM_TASKS || to >= SIM_NUM_TASKS)
+				return SDO_ABORT_VALUE_RANGE;
+
+			sim->tasks[to] = sim->tasks[from];
+			break;
+		}
+
+		case 0x2080:
+			if(value >= SIM_NUM_TASKS)
+				return SDO_ABORT_VALUE_RANGE;
+			break;
+
+		case 0x6060:
+			if(value != MODE_PP && value != MODE_HOMING && value != MODE_IP)
+				return SDO_ABORT_VALUE_RANGE;
+
+			sim_od_set(sim, 0x6061, 0x00, value);
+			break;
+	}
+
+	object->value = value;
+
+	if(index == 0x6040)
+		sim_set_control_word(sim, value, now);
+
+	return 0;
+}
+
+
+/**
+ * Delayed SDO response.
+ */
+struct sim_sdo_response_t {
+	sim_t *sim;
+	can_frame frame;
+};
+
+
+static void sim_on_sdo_delay(evutil_socket_t fd, short flags, void *param)
+{
+	sim_sdo_response_t *response = (sim_sdo_response_t *) param;
+	sim_t *sim = response->sim;
+
+	sim_send(sim, response->frame.can_id, response->frame.data, 8);
+	delete response;
+}
+
+
+static void sim_on_sdo_request(sim_t *sim, const can_frame *frame, double now)
+{
+	const uint8_t *data = frame->data;
+
+	uint8_t command = data[0];
+	uint16_t index = data[1] | (data[2] << 8);
+	uint8_t subindex = data[3];
+	uint32_t value = data[4] | (data[5] << 8) | (data[6] << 16) | (uint32_t(data[7]) << 24);
+
+	uint32_t abort = 0;
+	uint8_t response[8] = {0, data[1], data[2], data[3], 0, 0, 0, 0};
+
+	// Abort requests from the client are not answered
+	if(command == 0x80)
+		return;
+
+	sim->stats.sdo_requests++;
+
+	if(command == 0x40) {
+		// Upload (read)
+		int size = 4;
+		abort = sim_read_object(sim, index, subindex, &value, &size);
+
+		response[0] = 0x43 | ((4 - size) << 2);
+		for(int i = 0; i < 4; i++)
+			response[4 + i] = (value >> (8 * i)) & 0xFF;
+	} else if((command & 0xE2) == 0x22) {
+		// Expedited download (write)
+		int size = (command & 0x01) ? 4 - ((command >> 2) & 0x03) : 0;
+
+		if(size)
+			value &= (size == 4) ? 0xFFFFFFFF : ((1u << (8 * size)) - 1);
+
+		abort = sim_write_object(sim, index, subindex, value, size, now);
+		response[0] = 0x60;
+	} else {
+		// Segmented and block transfers are not supported
+		abort = SDO_ABORT_COMMAND;
+	}
+
+	if(abort) {
+		response[0] = 0x80;
+		for(int i = 0; i < 4; i++)
+			response[4 + i] = (abort >> (8 * i)) & 0xFF;
+		sim->stats.sdo_aborts++;
+	}
+
+	if(sim->options.sdo_drop_rate > 0.0 && rand_r(&sim->seed) < sim->options.sdo_drop_rate * RAND_MAX) {
+		sim->stats.sdo_dropped++;
+		return;
+	}
+
+	uint16_t id = 0x580 + sim->options.node_id;
+
+	if(sim->options.sdo_delay_us <= 0) {
+		sim_send(sim, id, response, 8);
+		return;
+	}
+
+	sim_sdo_response_t *delayed = new sim_sdo_response_t();
+	delayed->sim = sim;
+	memset(&(delayed->frame), 0, sizeof(delayed->frame));
+	delayed->frame.can_id = id;
+	memcpy(delayed->frame.data, response, 8);
+
+	timeval delay;
+	delay.tv_sec = sim->options.sdo_delay_us / 1000000;
+	delay.tv_usec = sim->options.sdo_delay_us % 1000000;
+
+	event_base_once(sim->ev_base, -1, EV_TIMEOUT, sim_on_sdo_delay, delayed, &delay);
+}
+
+
+/*
+ * Network management
+ */
+
+static void sim_reset_communication(sim_t *sim)
+{
+	sim->nmt_state = NMT_BOOTUP;
+	sim_send_heartbeat(sim);
+	sim->nmt_state = NMT_PREOPERATIONAL;
+
+	for(int n = 0; n < SIM_NUM_PDOS; n++) {
+		sim->tpdo[n].valid = false;
+		sim->rpdo[n].valid = false;
+	}
+}
+
+
+static void sim_on_nmt(sim_t *sim, const can_frame *frame)
+{
+	if(frame->can_dlc < 2)
+		return;
+
+	if(frame->data[1] != 0 && frame->data[1] != sim->options.node_id)
+		return;
+
+	sim->stats.nmt_commands++;
+
+	switch(frame->data[0]) {
+		case 0x01: sim->nmt_state = NMT_OPERATIONAL; break;
+		case 0x02: sim->nmt_state = NMT_STOPPED; break;
+		case 0x80: sim->nmt_state = NMT_PREOPERATIONAL; break;
+		case 0x81:
+		case 0x82: sim_reset_communication(sim); break;
+	}
+
+	for(int n = 0; n < SIM_NUM_PDOS; n++)
+		sim->tpdo[n].valid = false;
+}
+
+
+static void sim_on_frame(sim_t *sim, const can_frame *frame, double now)
+{
+	uint16_t id = frame->can_id & CAN_SFF_MASK;
+	int node = sim->options.node_id;
+
+	sim->stats.frames_received++;
+
+	// NMT commands and RPDOs (0x200 - 0x57F) are not acknowledged
+	bool command = id == 0x000 || (id >= 0x200 && id < 0x580);
+	if(command && sim->options.rx_drop_rate > 0.0 && rand_r(&sim->seed) < sim->options.rx_drop_rate * RAND_MAX) {
+		sim->stats.rx_dropped++;
+		return;
+	}
+
+	if(id == 0x000) {
+		sim_on_nmt(sim, frame);
+		return;
+	}
+
+	if(id == 0x080) {
+		if(sim->nmt_state == NMT_OPERATIONAL)
+			sim_on_sync(sim, now);
+		return;
+	}
+
+	if(sim->nmt_state == NMT_STOPPED)
+		return;
+
+	if(id == 0x600 + node) {
+		sim_on_sdo_request(sim, frame, now);
+		return;
+	}
+
+	if(sim->nmt_state != NMT_OPERATIONAL)
+		return;
+
+	for(int n = 0; n < SIM_NUM_PDOS; n++) {
+		uint32_t cob_id = sim_od_get(sim, 0x1400 + n, 0x01);
+
+		if(!(cob_id & 0x80000000) && (cob_id & 0x7FF) == id) {
+			sim_on_rpdo(sim, n, frame, now);
+			return;
+		}
+	}
+}
+
+
+static void sim_on_read(evutil_socket_t fd, short flags, void *param)
+{
+	sim_t *sim = (sim_t *) param;
+	double now = sim_get_time();
+
+	while(true) {
+		can_frame frame;
+		ssize_t received = recv(sim->fd, &frame, sizeof(frame), MSG_DONTWAIT);
+
+		if(received == -1 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+			break;
+
+		if(received <= 0) {
+			// Peer has gone away
+			event_del(sim->read_event);
+			break;
+		}
+
+		if(received < ssize_t(sizeof(frame)) || (frame.can_id & (CAN_ERR_FLAG | CAN_RTR_FLAG)))
+			continue;
+
+		sim_on_frame(sim, &frame, now);
+	}
+
+	// Respond to control word changes without waiting for the next tick
+	sim_on_tick(-1, 0, sim);
+}
+
+
+/**
+ * Drive cycle.
+ */
+static void sim_on_tick(evutil_socket_t fd, short flags, void *param)
+{
+	sim_t *sim = (sim_t *) param;
+	double now = sim_get_time();
+
+	sim_update_motion(sim, now);
+	sim_update_actual_values(sim);
+
+	if(sim->nmt_state == NMT_OPERATIONAL)
+		sim_update_tpdos(sim, now);
+
+	uint16_t heartbeat = sim_od_get(sim, 0x1017, 0x00);
+
+	if(heartbeat > 0 && now - sim->last_heartbeat >= heartbeat / 1000.0)
+		sim_send_heartbeat(sim);
+}
+
+
+/**
+ * Creates a simulated drive that communicates over fd.
+ *
+ * The simulator takes ownership of fd and boots into the
+ * pre-operational state.
+ */
+sim_t *sim_create(event_base *ev_base, int fd, const sim_options_t *options)
+{
+	assert(ev_base && fd >= 0);
+
+	sim_t *sim = new sim_t();
+	memset(sim, 0, sizeof(sim_t));
+
+	sim->ev_base = ev_base;
+	sim->fd = fd;
+
+	if(options)
+		sim->options = *options;
+	else
+		sim_default_options(&(sim->options));
+
+	sim_od_setup(sim);
+
+	sim->ds_state = DS_SWITCH_ON_DISABLED;
+	sim->homed = sim->options.homed;
+	sim->last_tick = sim_get_time();
+	sim->seed = 1;
+
+	sim->read_event = event_new(ev_base, fd, EV_READ | EV_PERSIST, sim_on_read, sim);
+	event_add(sim->read_event, NULL);
+
+	timeval tick;
+	tick.tv_sec = sim->options.tick_us / 1000000;
+	tick.tv_usec = sim->options.tick_us % 1000000;
+
+	sim->tick_event = event_new(ev_base, -1, EV_PERSIST, sim_on_tick, sim);
+	event_add(sim->tick_event, &tick);
+
+	sim_reset_communication(sim);
+
+	return sim;
+}
+
+
+void sim_destroy(sim_t **handle)
+{
+	sim_t *sim = *handle;
+
+	event_free(sim->read_event);
+	event_free(sim->tick_event);
+	close(sim->fd);
+
+	delete sim;
+	*handle = NULL;
+}
+
+
+/**
+ * Puts the drive in the fault state and sends an emergency message.
+ */
+void sim_inject_fault(sim_t *sim, uint16_t error_code)
+{
+	assert(sim);
+	sim_enter_fault(sim, error_code);
+}
+
+
+/**
+ * Returns actual position in meters.
+ */
+double sim_get_position(sim_t *sim)
+{
+	assert(sim);
+	return sim->position / 1000.0 / 1000.0;
+}
+
+
+/**
+ * Returns position of the active motion task at a time (sim_get_time())
+ * between drive cycles, without advancing the simulation.
+ */
+double sim_get_position_at(sim_t *sim, double time)
+{
+	assert(sim);
+	sim_motion_t *motion = &(sim->motion);
+
+	if(!motion->active || motion->duration <= 0.0)
+		return sim_get_position(sim);
+
+	double tau = (time - motion->start_time) / motion->duration;
+
+	if(tau >= 1.0)
+		return motion->to / 1000.0 / 1000.0;
+
+	if(tau <= 0.0)
+		return motion->from / 1000.0 / 1000.0;
+
+	return (motion->from + (motion->to - motion->from) * sim_profile_shape(motion->table, tau)) / 1000.0 / 1000.0;
+}
+
+
+/**
+ * Returns time (sim_get_time()) at which the last motion task was started.
+ */
+double sim_get_motion_start_time(sim_t *sim)
+{
+	assert(sim);
+	return sim->motion_start_time;
+}
+
+
+bool sim_is_moving(sim_t *sim)
+{
+	assert(sim);
+	return sim->motion.active || sim->motion.chained;
+}
+
+
+void sim_get_stats(sim_t *sim, sim_stats_t *stats)
+{
+	assert(sim && stats);
+	*stats = sim->stats;
+}
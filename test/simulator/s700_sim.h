@@ -0,0 +1,94 @@
+#ifndef __S700_SIM_H__
+#define __S700_SIM_H__
+
+#include <stdint.h>
+
+/**
+ * Simulated Kollmorgen S700 drive.
+ *
+ * Implements the subset of the drive that libsled uses: NMT and
+ * heartbeat, expedited SDO transfers on the object dictionary,
+ * configurable TPDO/RPDO mappings, the DS402 power state machine,
+ * homing, profile position mode with motion tasks and interpolated
+ * position mode. Frames are exchanged as SocketCAN frames over a
+ * file descriptor, either a CAN_RAW socket or one end of a
+ * SOCK_SEQPACKET socketpair.
+ */
+
+struct event_base;
+struct sim_t;
+
+#define SIM_NUM_PDOS 4
+
+/**
+ * Simulator options, see sim_default_options() for defaults.
+ */
+struct sim_options_t {
+	int node_id;
+
+	// Interval between heartbeat messages in ms
+	int heartbeat_ms;
+
+	// Drive cycle time in us
+	int tick_us;
+
+	// Delay between SDO request and response in us
+	int sdo_delay_us;
+
+	// Fraction of SDO responses that are never sent
+	double sdo_drop_rate;
+
+	// Fraction of NMT commands and RPDOs that are lost on the bus
+	double rx_drop_rate;
+
+	// Transmit TPDOs at a fixed period (ms) instead of their
+	//  configured transmission type, 0 to disable.
+	int tpdo_period_ms[SIM_NUM_PDOS];
+
+	// Drive has been homed before and homing completes immediately
+	bool homed;
+
+	// Duration of the homing sequence in seconds
+	double homing_time;
+
+	// Motion task objects also address tasks 201..300 at subindices
+	//  0x02..0x65, otherwise only task 0 at subindex 0x01 exists.
+	bool direct_tasks;
+};
+
+
+/**
+ * Simulator counters.
+ */
+struct sim_stats_t {
+	uint64_t frames_received;
+	uint64_t frames_sent;
+	uint64_t sdo_requests;
+	uint64_t sdo_aborts;
+	uint64_t sdo_dropped;
+	uint64_t rx_dropped;
+	uint64_t tpdos_sent;
+	uint64_t rpdos_received;
+	uint64_t syncs_received;
+	uint64_t motion_tasks_started;
+	uint64_t nmt_commands;
+	uint64_t operation_enabled;		// Transitions to operation enabled
+};
+
+
+void sim_default_options(sim_options_t *options);
+
+sim_t *sim_create(event_base *ev_base, int fd, const sim_options_t *options);
+void sim_destroy(sim_t **sim);
+
+void sim_inject_fault(sim_t *sim, uint16_t error_code);
+
+double sim_get_position(sim_t *sim);
+double sim_get_position_at(sim_t *sim, double time);
+double sim_get_motion_start_time(sim_t *sim);
+bool sim_is_moving(sim_t *sim);
+void sim_get_stats(sim_t *sim, sim_stats_t *stats);
+
+double sim_get_time();
+
+#endif
@@ -0,0 +1,580 @@
+/**
+ * Runs libsled against the simulated drive over a socketpair and
+ * reports start-up time, profile execution latency, the rate at
+ * which position updates are received and the time to recover from
+ * a watchdog trip. Optionally libsled is restarted against the
+ * running drive, with and without warm attach.
+ */
+
+#include <signal.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <math.h>
+
+#include <sys/socket.h>
+
+#include <event2/event.h>
+#include <sled.h>
+#include <sled_profile.h>
+#include <sled_internal.h>
+
+#include "s700_sim.h"
+
+#define BENCH_TIMEOUT 60.0
+
+#define BENCH_IP_PERIOD 0.004
+#define BENCH_IP_DURATION 2.0
+#define BENCH_IP_LEAD 0.02		// Set-points are queued this far ahead
+
+
+enum bench_phase_t {
+	PHASE_STARTUP,
+	PHASE_EXECUTE,
+	PHASE_WAIT_START,
+	PHASE_WAIT_DONE,
+	PHASE_STREAM,
+	PHASE_IP_START,
+	PHASE_IP_STREAM,
+	PHASE_RECOVER,
+	PHASE_RESTART,
+	PHASE_DONE
+};
+
+
+struct bench_t {
+	event_base *ev_base;
+	sled_t *sled;
+	sim_t *sim;
+
+	// libsled end of the socketpair, each instance gets a duplicate
+	int fd;
+	int sdo_window;
+	bool sdo_coalesce;
+	bool direct_tasks;
+	bool stage;
+	double sync_period;
+
+	bench_phase_t phase;
+	double start_time, phase_time;
+
+	int trials, trial;
+	int profile;
+
+	double startup, recovery, restart;
+	double *latency;
+
+	// PDO configuration objects read and written on start-up
+	int config_reads, config_writes;
+
+	sled_can_stats_t stream_stats;
+	double stream_rate;
+
+	// State timeouts before statistics were reset for streaming
+	uint64_t state_timeouts;
+
+	uint64_t sample_cursor, samples;
+	double sample_rate;
+
+	// Prediction of position during motion, compared to last sample
+	uint64_t predictions, within_bound;
+	double sum_sq_predicted, sum_sq_last;
+
+	double max_following_error;
+
+	double ip_origin, ip_next;
+	sled_stream_stats_t ip_stats;
+
+	bool failed;
+};
+
+
+static int compare_double(const void *a, const void *b)
+{
+	double x = *(const double *) a, y = *(const double *) b;
+	return (x > y) - (x < y);
+}
+
+
+static void bench_on_timer(evutil_socket_t fd, short flags, void *param)
+{
+	bench_t *bench = (bench_t *) param;
+	double now = sim_get_time();
+
+	if(now - bench->start_time > BENCH_TIMEOUT) {
+		fprintf(stderr, "Benchmark timed out (phase %d, trial %d)\n", bench->phase, bench->trial);
+		bench->failed = true;
+		event_base_loopbreak(bench->ev_base);
+		return;
+	}
+
+	bool idle = mch_mp_active_state(bench->sled->mch_mp) == ST_MP_PP_IDLE;
+
+	switch(bench->phase) {
+		case PHASE_STARTUP:
+			if(idle) {
+				bench->startup = now - bench->start_time;
+				mch_net_get_config_counts(bench->sled->mch_net, &(bench->config_reads), &(bench->config_writes));
+				bench->phase = PHASE_EXECUTE;
+			}
+			break;
+
+		case PHASE_EXECUTE: {
+			// Unchanged if the trial was staged
+			double target = (bench->trial % 2) ? 0.0 : 0.1;
+			sled_profile_set_target(bench->sled, bench->profile, pos_absolute, target, 0.2);
+
+			bench->phase_time = sim_get_time();
+
+			if(sled_profile_execute(bench->sled, bench->profile) == -1) {
+				bench->failed = true;
+				event_base_loopbreak(bench->ev_base);
+				return;
+			}
+
+			bench->phase = PHASE_WAIT_START;
+			break;
+		}
+
+		case PHASE_WAIT_START:
+			if(sim_get_motion_start_time(bench->sim) >= bench->phase_time) {
+				bench->latency[bench->trial] = sim_get_motion_start_time(bench->sim) - bench->phase_time;
+				bench->phase = PHASE_WAIT_DONE;
+
+				// Upload the next trial during this one
+				if(bench->stage && bench->trial + 1 < bench->trials) {
+					double target = ((bench->trial + 1) % 2) ? 0.0 : 0.1;
+					sled_profile_set_target(bench->sled, bench->profile, pos_absolute, target, 0.2);
+					sled_profile_stage(bench->sled, bench->profile);
+				}
+			}
+			break;
+
+		case PHASE_WAIT_DONE:
+			if(idle && !sim_is_moving(bench->sim)) {
+				double position;
+				sled_rt_get_position(bench->sled, position);
+
+				// Last position update may still be in flight
+				if(fabs(position - sim_get_position(bench->sim)) > 1e-6)
+					break;
+
+				if(++bench->trial < bench->trials) {
+					bench->phase = PHASE_EXECUTE;
+				} else {
+					sled_can_get_statistics(bench->sled, &(bench->stream_stats), true);
+					bench->state_timeouts = bench->stream_stats.state_timeouts;
+					sled_profile_set_target(bench->sled, bench->profile, pos_absolute, 0.1, 1.0);
+
+					if(sled_profile_execute(bench->sled, bench->profile) == -1) {
+						bench->failed = true;
+						event_base_loopbreak(bench->ev_base);
+						return;
+					}
+
+					// Skip samples of the previous trials
+					sled_sample_t samples[64];
+					while(sled_rt_get_samples(bench->sled, &(bench->sample_cursor), samples, 64) > 0);
+
+					bench->phase_time = now;
+					bench->phase = PHASE_STREAM;
+				}
+			}
+			break;
+
+		case PHASE_STREAM:
+			if(bench->stream_rate == 0.0) {
+				sled_sample_t samples[64];
+				int count;
+
+				while((count = sled_rt_get_samples(bench->sled, &(bench->sample_cursor), samples, 64)) > 0)
+					bench->samples += count;
+
+				double actual = sim_get_position_at(bench->sim, now);
+
+				double following_error, time;
+				if(sled_rt_get_channel(bench->sled, SLED_CHANNEL_FOLLOWING_ERROR, following_error, time) == 0 &&
+				   fabs(following_error) > bench->max_following_error)
+					bench->max_following_error = fabs(following_error);
+				double predicted, error, last;
+
+				sled_rt_get_position(bench->sled, last);
+
+				if(sled_rt_predict_position(bench->sled, now, predicted, error) == 0) {
+					bench->predictions++;
+					bench->sum_sq_predicted += (predicted - actual) * (predicted - actual);
+					bench->sum_sq_last += (last - actual) * (last - actual);
+					if(fabs(predicted - actual) <= error)
+						bench->within_bound++;
+				}
+			}
+
+			if(bench->stream_rate == 0.0 && now - bench->phase_time >= 1.0) {
+				sled_can_get_statistics(bench->sled, &(bench->stream_stats), false);
+				bench->stream_rate = bench->stream_stats.frames / (now - bench->phase_time);
+				bench->sample_rate = bench->samples / (now - bench->phase_time);
+			}
+
+			if(idle && !sim_is_moving(bench->sim) && bench->stream_rate > 0.0) {
+				if(sled_rt_stream_start(bench->sled, BENCH_IP_PERIOD) == -1) {
+					bench->failed = true;
+					event_base_loopbreak(bench->ev_base);
+					return;
+				}
+
+				bench->phase = PHASE_IP_START;
+			}
+			break;
+
+		case PHASE_IP_START:
+			if(mch_mp_active_state(bench->sled->mch_mp) == ST_MP_IP_STREAM) {
+				sled_rt_get_position(bench->sled, bench->ip_origin);
+				sled_rt_get_stream_statistics(bench->sled, &(bench->ip_stats), true);
+
+				bench->phase_time = now;
+				bench->ip_next = now;
+				bench->phase = PHASE_IP_STREAM;
+			}
+			break;
+
+		case PHASE_IP_STREAM:
+			// Sinusoid of 5 cm at 1 Hz around the current position
+			while(bench->ip_next < now + BENCH_IP_LEAD) {
+				double t = bench->ip_next - bench->phase_time;
+				double position = bench->ip_origin + 0.05 * sin(2.0 * M_PI * t);
+
+				if(sled_rt_new_setpoint_at(bench->sled, position, bench->ip_next) == -1)
+					break;
+
+				bench->ip_next += BENCH_IP_PERIOD;
+			}
+
+			if(now - bench->phase_time >= BENCH_IP_DURATION) {
+				sled_rt_get_stream_statistics(bench->sled, &(bench->ip_stats), false);
+				sled_rt_stream_stop(bench->sled);
+
+				// Trip the watchdog, the drive keeps its configuration
+				mch_net_handle_event(bench->sled->mch_net, EV_NET_WATCHDOG_FAILED);
+
+				bench->phase_time = now;
+				bench->phase = PHASE_RECOVER;
+			}
+			break;
+
+		case PHASE_RECOVER:
+			if(idle) {
+				bench->recovery = now - bench->phase_time;
+
+				bench->phase = PHASE_DONE;
+				event_base_loopbreak(bench->ev_base);
+			}
+			break;
+
+		case PHASE_RESTART:
+			if(idle) {
+				bench->restart = now - bench->phase_time;
+
+				bench->phase = PHASE_DONE;
+				event_base_loopbreak(bench->ev_base);
+			}
+			break;
+
+		case PHASE_DONE:
+			break;
+	}
+}
+
+
+/**
+ * Creates a libsled instance on the simulated bus with the options
+ * given on the command line.
+ */
+static sled_t *bench_create_sled(bench_t *bench, bool warm_attach)
+{
+	char device[32];
+	snprintf(device, sizeof(device), "%s%d", INTF_FD_DEVICE_PREFIX, dup(bench->fd));
+
+	sled_t *sled = sled_create_with_device(bench->ev_base, device);
+	if(!sled)
+		return NULL;
+
+	sled_set_warm_attach(sled, warm_attach);
+	sled_set_direct_tasks(sled, bench->direct_tasks);
+
+	if(sled_sdo_set_window(sled, bench->sdo_window) == -1) {
+		fprintf(stderr, "Invalid SDO window (%d)\n", bench->sdo_window);
+		sled_destroy(&sled);
+		return NULL;
+	}
+
+	sled_sdo_set_coalescing(sled, bench->sdo_coalesce);
+
+	if(bench->sync_period > 0.0 && sled_sync_start(sled, bench->sync_period, true) == -1) {
+		fprintf(stderr, "Invalid SYNC period (%g ms)\n", bench->sync_period * 1000.0);
+		sled_destroy(&sled);
+		return NULL;
+	}
+
+	return sled;
+}
+
+
+/**
+ * Replaces the libsled instance, as a restart of the server would,
+ * and returns the time until the new one is in profile position mode.
+ */
+static double bench_restart(bench_t *bench, bool warm_attach)
+{
+	sled_destroy(&(bench->sled));
+
+	bench->sled = bench_create_sled(bench, warm_attach);
+	if(!bench->sled) {
+		bench->failed = true;
+		return NAN;
+	}
+
+	bench->start_time = bench->phase_time = sim_get_time();
+	bench->phase = PHASE_RESTART;
+
+	event_base_dispatch(bench->ev_base);
+
+	return bench->failed ? NAN : bench->restart;
+}
+
+
+static void print_help()
+{
+	printf("Usage: sled-bench [OPTION]...\n");
+	printf("Benchmark libsled against a simulated drive.\n\n");
+	printf("  --trials N         number of profiles to execute (default 20)\n");
+	printf("  --sdo-delay US     SDO response delay of the drive (default 500)\n");
+	printf("  --sdo-drop RATE    fraction of SDO responses to drop (default 0)\n");
+	printf("  --rx-drop RATE     fraction of NMT commands and RPDOs to drop (default 0)\n");
+	printf("  --tpdo-period MS   send TPDOs at a fixed period\n");
+	printf("  --sdo-window N     SDO transfers in progress at the same time\n");
+	printf("  --sdo-coalesce     replace queued SDO writes by newer ones\n");
+	printf("  --sync-period MS   send SYNC and sample position on every SYNC\n");
+	printf("  --restart          restart libsled, cold and with warm attach\n");
+	printf("  --direct-tasks     write motion tasks directly instead of through task 0\n");
+	printf("  --stage            upload the next trial while the current one moves\n");
+	printf("  --help             display this help and exit\n");
+}
+
+
+int main(int argc, char *argv[])
+{
+	signal(SIGPIPE, SIG_IGN);
+
+	sim_options_t options;
+	sim_default_options(&options);
+
+	int trials = 20;
+	int sdo_window = 1;
+	bool sdo_coalesce = false;
+	double sync_period = 0.0;
+	bool restart = false;
+	bool stage = false;
+
+	while(true) {
+		static struct option long_options[] = {
+			{"trials",      required_argument, 0, 'n'},
+			{"sdo-delay",   required_argument, 0, 's'},
+			{"sdo-drop",    required_argument, 0, 'r'},
+			{"rx-drop",     required_argument, 0, 'x'},
+			{"tpdo-period", required_argument, 0, 't'},
+			{"sdo-window",  required_argument, 0, 'w'},
+			{"sdo-coalesce", no_argument,      0, 'c'},
+			{"sync-period", required_argument, 0, 'y'},
+			{"restart",     no_argument,       0, 'R'},
+			{"direct-tasks", no_argument,      0, 'd'},
+			{"stage",       no_argument,       0, 'S'},
+			{"help",        no_argument,       0, 'h'},
+			{0, 0, 0, 0}
+		};
+
+		int option_index = 0;
+		int c = getopt_long(argc, argv, "n:s:r:x:t:w:cy:RdSh", long_options, &option_index);
+
+		if(c == -1)
+			break;
+
+		switch(c) {
+			case 'n': trials = atoi(optarg); break;
+			case 's': options.sdo_delay_us = atoi(optarg); break;
+			case 'r': options.sdo_drop_rate = atof(optarg); break;
+			case 'x': options.rx_drop_rate = atof(optarg); break;
+			case 't':
+				for(int i = 0; i < SIM_NUM_PDOS; i++)
+					options.tpdo_period_ms[i] = atoi(optarg);
+				break;
+			case 'w': sdo_window = atoi(optarg); break;
+			case 'c': sdo_coalesce = true; break;
+			case 'y': sync_period = atof(optarg) / 1000.0; break;
+			case 'R': restart = true; break;
+			case 'd': options.direct_tasks = true; break;
+			case 'S': stage = true; break;
+			case 'h': print_help(); return 0;
+			default: print_help(); return 1;
+		}
+	}
+
+	if(trials < 1) {
+		fprintf(stderr, "Number of trials should be positive\n");
+		return 1;
+	}
+
+	int sv[2];
+	if(socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sv) == -1) {
+		perror("socketpair()");
+		return 1;
+	}
+
+	event_base *ev_base = event_base_new();
+	event_base_priority_init(ev_base, 2);
+
+	bench_t bench;
+	memset(&bench, 0, sizeof(bench));
+
+	bench.ev_base = ev_base;
+	bench.fd = sv[0];
+	bench.sdo_window = sdo_window;
+	bench.sdo_coalesce = sdo_coalesce;
+	bench.stage = stage;
+	bench.direct_tasks = options.direct_tasks;
+	bench.sync_period = sync_period;
+	bench.trials = trials;
+	bench.latency = new double[trials];
+	bench.start_time = sim_get_time();
+
+	bench.sim = sim_create(ev_base, sv[1], &options);
+	bench.sled = bench_create_sled(&bench, false);
+
+	if(!bench.sled)
+		return 1;
+
+	bench.profile = sled_profile_create(bench.sled);
+
+	timeval interval = {0, 1000};
+	event *timer = event_new(ev_base, -1, EV_PERSIST, bench_on_timer, &bench);
+	event_add(timer, &interval);
+
+	event_base_dispatch(ev_base);
+
+	if(!bench.failed) {
+		qsort(bench.latency, trials, sizeof(double), compare_double);
+
+		double mean = 0.0;
+		for(int i = 0; i < trials; i++)
+			mean += bench.latency[i];
+		mean /= trials;
+
+		sim_stats_t stats;
+		sim_get_stats(bench.sim, &stats);
+
+		sled_sdo_stats_t sdo_stats[64];
+		int count = sled_sdo_get_statistics(bench.sled, sdo_stats, 64, false);
+
+		sled_sdo_queue_stats_t queue_stats;
+		sled_sdo_get_queue_statistics(bench.sled, &queue_stats, false);
+
+		sled_sdo_class_stats_t class_stats[SLED_SDO_NUM_CLASSES];
+		sled_sdo_get_class_statistics(bench.sled, class_stats, false);
+
+		unsigned long long retransmits = 0, timeouts = 0;
+		double max_latency = 0.0;
+
+		for(int i = 0; i < count; i++) {
+			retransmits += sdo_stats[i].retransmits;
+			timeouts += sdo_stats[i].timeouts;
+			if(sdo_stats[i].max_latency > max_latency)
+				max_latency = sdo_stats[i].max_latency;
+		}
+
+		int config_reads, config_writes;
+		mch_net_get_config_counts(bench.sled->mch_net, &config_reads, &config_writes);
+
+		printf("Start-up to profile position mode: %8.1f ms\n", bench.startup * 1000.0);
+		printf("PDO objects read / written:        %8d / %d\n", bench.config_reads, bench.config_writes);
+		printf("Watchdog trip to profile position: %8.1f ms\n", bench.recovery * 1000.0);
+		printf("PDO objects read / written:        %8d / %d\n", config_reads, config_writes);
+		printf("Profile execute latency (mean):    %8.2f ms\n", mean * 1000.0);
+		printf("Profile execute latency (median):  %8.2f ms\n", bench.latency[trials / 2] * 1000.0);
+		printf("Profile execute latency (max):     %8.2f ms\n", bench.latency[trials - 1] * 1000.0);
+		printf("Frames received during motion:     %8.1f /s\n", bench.stream_rate);
+		printf("Position samples during motion:    %8.1f /s\n", bench.sample_rate);
+		if(bench.predictions) {
+			printf("Position error, last sample (rms): %8.3f mm\n", sqrt(bench.sum_sq_last / bench.predictions) * 1000.0);
+			printf("Position error, predicted (rms):   %8.3f mm\n", sqrt(bench.sum_sq_predicted / bench.predictions) * 1000.0);
+			printf("Predictions within error bound:    %8.1f %%\n", 100.0 * bench.within_bound / bench.predictions);
+		}
+		printf("Following error during motion:     %8.3f mm (TPDO3)\n", bench.max_following_error * 1000.0);
+
+		sled_can_stats_t can_stats;
+		sled_can_get_statistics(bench.sled, &can_stats, false);
+
+		printf("Status words decoded / received:   %8llu / %llu\n",
+			(unsigned long long) (can_stats.status_frames - can_stats.status_suppressed),
+			(unsigned long long) can_stats.status_frames);
+		printf("Status events suppressed:          %8llu\n", (unsigned long long) can_stats.events_suppressed);
+		printf("Machine events / drains:           %8llu / %llu\n",
+			(unsigned long long) can_stats.events, (unsigned long long) can_stats.event_drains);
+		printf("Machine events per drain (max):    %8u\n", can_stats.max_events_per_drain);
+		printf("Machine event time (mean/max):     %8.2f / %.2f us\n",
+			can_stats.event_drains ? can_stats.event_time / can_stats.event_drains * 1e6 : 0.0,
+			can_stats.max_drain_time * 1e6);
+		printf("SDO requests served:               %8llu\n", (unsigned long long) stats.sdo_requests);
+		printf("SDO aborts:                        %8llu\n", (unsigned long long) stats.sdo_aborts);
+		printf("SDO responses dropped by drive:    %8llu\n", (unsigned long long) stats.sdo_dropped);
+		printf("NMT commands and RPDOs dropped:    %8llu\n", (unsigned long long) stats.rx_dropped);
+		printf("State timeouts:                    %8llu\n", (unsigned long long) (bench.state_timeouts + can_stats.state_timeouts));
+		printf("SDO retransmits:                   %8llu\n", retransmits);
+		printf("SDO timeouts:                      %8llu\n", timeouts);
+		printf("SDO max response time:             %8.2f ms\n", max_latency * 1000.0);
+		printf("SDO queue high-water mark:         %8u\n", queue_stats.high_water_mark);
+		printf("SDO queue overflows:               %8llu\n", (unsigned long long) queue_stats.overflows);
+		printf("SDO writes coalesced:              %8llu\n", (unsigned long long) queue_stats.coalesced);
+		for(int i = 0; i < SLED_SDO_NUM_CLASSES; i++)
+			printf("SDO class %d queue wait (mean/max): %7.2f / %.2f ms\n", i,
+				class_stats[i].mean_wait * 1000.0, class_stats[i].max_wait * 1000.0);
+		printf("Motion tasks started:              %8llu\n", (unsigned long long) stats.motion_tasks_started);
+		sled_sync_stats_t sync_stats;
+		sled_sync_get_statistics(bench.sled, &sync_stats, false);
+
+		printf("SYNC sent / missed:                %8llu / %llu\n",
+			(unsigned long long) sync_stats.cycles, (unsigned long long) sync_stats.missed);
+		printf("IP stream set-points / cycles:     %8llu / %llu\n",
+			(unsigned long long) bench.ip_stats.setpoints, (unsigned long long) bench.ip_stats.cycles);
+		printf("IP stream underruns / skipped:     %8llu / %llu\n",
+			(unsigned long long) bench.ip_stats.underruns, (unsigned long long) bench.ip_stats.skipped);
+		printf("IP stream latency (mean/max):      %8.2f / %.2f ms\n",
+			bench.ip_stats.mean_latency * 1000.0, bench.ip_stats.max_latency * 1000.0);
+		printf("IP stream tracking error (rms/max):%8.3f / %.3f mm\n",
+			bench.ip_stats.rms_error * 1000.0, bench.ip_stats.max_error * 1000.0);
+	}
+
+	if(!bench.failed && restart) {
+		for(int warm = 0; warm < 2 && !bench.failed; warm++) {
+			sim_stats_t before, after;
+			sim_get_stats(bench.sim, &before);
+
+			double time = bench_restart(&bench, warm);
+
+			sim_get_stats(bench.sim, &after);
+
+			if(bench.failed)
+				break;
+
+			printf("Restart to profile position (%s): %6.1f ms, %llu NMT commands, %llu enables\n",
+				warm ? "warm" : "cold", time * 1000.0,
+				(unsigned long long) (after.nmt_commands - before.nmt_commands),
+				(unsigned long long) (after.operation_enabled - before.operation_enabled));
+		}
+	}
+
+	event_free(timer);
+	delete[] bench.latency;
+
+	return bench.failed ? 1 : 0;
+}
@@ -0,0 +1,138 @@
+/**
+ * Simulated drive on a SocketCAN interface, e.g.:
+ *
+ *   sudo ip link add dev vcan0 type vcan
+ *   sudo ip link set up vcan0
+ *   sled-sim vcan0 &
+ *   sled-server --no-daemon --device vcan0
+ */
+
+#include <signal.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <getopt.h>
+
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <net/if.h>
+
+#include <linux/can.h>
+#include <linux/can/raw.h>
+
+#include <event2/event.h>
+
+#include "s700_sim.h"
+
+
+static int open_can_socket(const char *device)
+{
+	int fd = socket(PF_CAN, SOCK_RAW, CAN_RAW);
+
+	if(fd == -1) {
+		fprintf(stderr, "Could not create CAN socket: %s\n", strerror(errno));
+		return -1;
+	}
+
+	ifreq ifr;
+	memset(&ifr, 0, sizeof(ifr));
+	strncpy(ifr.ifr_name, device, IFNAMSIZ - 1);
+
+	if(ioctl(fd, SIOCGIFINDEX, &ifr) == -1) {
+		fprintf(stderr, "Error locating CAN interface (%s)\n", device);
+		close(fd);
+		return -1;
+	}
+
+	sockaddr_can addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.can_family = AF_CAN;
+	addr.can_ifindex = ifr.ifr_ifindex;
+
+	if(bind(fd, (sockaddr *) &addr, sizeof(addr)) == -1) {
+		fprintf(stderr, "Binding of CAN socket failed (%s): %s\n", device, strerror(errno));
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+
+static void print_help()
+{
+	printf("Usage: sled-sim [OPTION]... INTERFACE\n");
+	printf("Simulate a Kollmorgen S700 drive on a SocketCAN interface.\n\n");
+	printf("  --node ID          CANopen node id (default 1)\n");
+	printf("  --sdo-delay US     SDO response delay (default 500)\n");
+	printf("  --sdo-drop RATE    fraction of SDO responses to drop (default 0)\n");
+	printf("  --tpdo-period MS   send TPDOs at a fixed period\n");
+	printf("  --homed            drive has already been homed\n");
+	printf("  --help             display this help and exit\n");
+}
+
+
+int main(int argc, char *argv[])
+{
+	sim_options_t options;
+	sim_default_options(&options);
+
+	while(true) {
+		static struct option long_options[] = {
+			{"node",        required_argument, 0, 'n'},
+			{"sdo-delay",   required_argument, 0, 's'},
+			{"sdo-drop",    required_argument, 0, 'r'},
+			{"tpdo-period", required_argument, 0, 't'},
+			{"homed",       no_argument,       0, 'H'},
+			{"help",        no_argument,       0, 'h'},
+			{0, 0, 0, 0}
+		};
+
+		int option_index = 0;
+		int c = getopt_long(argc, argv, "n:s:r:t:Hh", long_options, &option_index);
+
+		if(c == -1)
+			break;
+
+		switch(c) {
+			case 'n': options.node_id = atoi(optarg); break;
+			case 's': options.sdo_delay_us = atoi(optarg); break;
+			case 'r': options.sdo_drop_rate = atof(optarg); break;
+			case 't':
+				for(int i = 0; i < SIM_NUM_PDOS; i++)
+					options.tpdo_period_ms[i] = atoi(optarg);
+				break;
+			case 'H': options.homed = true; break;
+			case 'h': print_help(); return 0;
+			default: print_help(); return 1;
+		}
+	}
+
+	if(optind != argc - 1) {
+		print_help();
+		return 1;
+	}
+
+	int fd = open_can_socket(argv[optind]);
+
+	if(fd == -1)
+		return 1;
+
+	event_base *ev_base = event_base_new();
+
+	if(!ev_base) {
+		fprintf(stderr, "Unable to initialize event base\n");
+		return 1;
+	}
+
+	sim_t *sim = sim_create(ev_base, fd, &options);
+
+	event_base_dispatch(ev_base);
+
+	sim_destroy(&sim);
+	event_base_free(ev_base);
+
+	return 0;
+}